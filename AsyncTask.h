@@ -0,0 +1,300 @@
+#ifndef ASYNC_TASK_H
+#define ASYNC_TASK_H
+#include "WorkStealingExecutor.h"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+using namespace std;
+
+// Coroutine tasks for queries that can run long (friend suggestions, history exports, bulk group changes).
+// A task does a bounded quantum of work, then yields its worker so short requests queued behind it run first;
+// at each yield it also stops if it was cancelled or ran past its deadline.
+
+enum class TaskStatus
+{
+    Completed,
+    Cancelled,
+    DeadlineExceeded
+};
+
+// Thrown out of a task, and out of every task awaiting it, when it stops early
+class TaskStopped : public exception
+{
+public:
+    TaskStatus status;
+
+    explicit TaskStopped(TaskStatus status) : status(status) {}
+
+    const char *what() const noexcept override
+    {
+        return status == TaskStatus::Cancelled ? "cancelled" : "deadline exceeded";
+    }
+};
+
+// Limits of one query, shared by the tasks it awaits. Must outlive them.
+class QueryContext
+{
+public:
+    WorkStealingExecutor *executor = nullptr; // Where to requeue after each quantum; nullptr runs to the end in one go
+    const atomic<bool> *cancelled = nullptr;  // Set by the owner to stop the query at its next yield
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    size_t quantum = 256; // Work units (users visited, messages written, ...) between yields
+    size_t spent = 0;
+
+    // Counts `units` of work; true when a quantum is used up and the task should `co_await yield()`
+    bool due(size_t units = 1)
+    {
+        spent += units;
+        if (spent < quantum)
+        {
+            return false;
+        }
+        spent = 0;
+        return true;
+    }
+
+    // Throws TaskStopped if the query was cancelled or is past its deadline
+    void check() const
+    {
+        if (cancelled && cancelled->load(memory_order_relaxed))
+        {
+            throw TaskStopped(TaskStatus::Cancelled);
+        }
+        if (deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= deadline)
+        {
+            throw TaskStopped(TaskStatus::DeadlineExceeded);
+        }
+    }
+
+    struct YieldAwaiter
+    {
+        QueryContext &context;
+
+        bool await_ready() const
+        {
+            return !context.executor || !context.executor->onWorker();
+        }
+
+        void await_suspend(coroutine_handle<> task) const
+        {
+            context.executor->yield(task);
+        }
+
+        void await_resume() const
+        {
+            context.check();
+        }
+    };
+
+    // Gives up the worker until everything queued before this task has had a turn, then checks the limits
+    YieldAwaiter yield()
+    {
+        return YieldAwaiter{*this};
+    }
+};
+
+template <typename T>
+class Task;
+
+class TaskPromiseBase
+{
+public:
+    coroutine_handle<> continuation; // The task awaiting this one, resumed when it finishes
+    exception_ptr error;
+
+    suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> task) noexcept
+        {
+            coroutine_handle<> next = task.promise().continuation;
+            return next ? next : noop_coroutine(); // Symmetric transfer: no stack growth through chains of awaits
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        error = current_exception();
+    }
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+    optional<T> value;
+
+    Task<T> get_return_object();
+
+    void return_value(T result)
+    {
+        value = move(result);
+    }
+
+    T take()
+    {
+        if (error)
+        {
+            rethrow_exception(error);
+        }
+        return move(*value);
+    }
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void take()
+    {
+        if (error)
+        {
+            rethrow_exception(error);
+        }
+    }
+};
+
+// Lazily started coroutine returning T. Another task runs it with `co_await`; runInline and spawnTask
+// start one from ordinary code. Reference parameters must outlive the task.
+template <typename T>
+class Task
+{
+public:
+    typedef TaskPromise<T> promise_type;
+
+private:
+    coroutine_handle<promise_type> handle;
+
+public:
+    explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {}
+    Task(Task &&other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    struct Awaiter
+    {
+        coroutine_handle<promise_type> handle;
+
+        bool await_ready() const
+        {
+            return false;
+        }
+
+        coroutine_handle<> await_suspend(coroutine_handle<> awaiting)
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume()
+        {
+            return handle.promise().take();
+        }
+    };
+
+    Awaiter operator co_await() &&
+    {
+        return Awaiter{handle};
+    }
+
+    // Runs the task to completion on the calling thread; its QueryContext must have no executor
+    T runInline()
+    {
+        handle.resume();
+        return handle.promise().take();
+    }
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Root of a spawned task: frees itself when done
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object()
+        {
+            return DetachedTask{coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            terminate(); // A spawned task must handle its own errors; there is nobody left to report them to
+        }
+    };
+
+    coroutine_handle<promise_type> handle;
+};
+
+inline DetachedTask detachTask(Task<void> task)
+{
+    try
+    {
+        co_await move(task);
+    }
+    catch (const TaskStopped &)
+    {
+    }
+}
+
+// Starts `task` on `executor` without waiting for it. A task stopped by its QueryContext simply ends.
+inline void spawnTask(WorkStealingExecutor &executor, Task<void> task, TaskPriority priority = TaskPriority::Interactive)
+{
+    executor.schedule(detachTask(move(task)).handle, priority);
+}
+
+#endif // ASYNC_TASK_H
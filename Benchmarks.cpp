@@ -0,0 +1,294 @@
+// Microbenchmarks for the hot paths of every subsystem, run at several data sizes.
+// Output is one row per (benchmark, size), as CSV or JSON, so runs can be diffed or compared
+// against a saved baseline; with --baseline the exit code is 2 if anything got slower than allowed.
+//
+// Build: make benchmarks
+// Usage: ./benchmarks [--sizes=1000,10000,100000] [--min-time=SECONDS] [--filter=NAME]
+//                     [--format=csv|json] [--baseline=FILE.csv] [--tolerance=FRACTION]
+#include "SocialMediaPlatform.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+struct BenchmarkOptions
+{
+    vector<size_t> sizes = {1000, 10000, 100000};
+    double minSeconds = 0.2; // Each benchmark repeats until it has run at least this long
+    string filter;
+    string format = "csv";
+    string baseline;
+    double tolerance = 0.15; // Allowed slowdown against the baseline before it counts as a regression
+};
+
+struct BenchmarkResult
+{
+    string name;
+    size_t size;
+    uint64_t iterations;
+    double nsPerOp;
+};
+
+// A populated platform: `size` users with about 10 friends each, a few posts per user,
+// one long conversation and one big group, so lookups and scans see realistic structures
+class Fixture
+{
+public:
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    vector<User *> users;
+    vector<string> usernames;
+    vector<string> posts;
+    string groupName = "benchmark group";
+    size_t size;
+
+    explicit Fixture(size_t size) : size(size)
+    {
+        QuietConsole quiet;
+        uint64_t state = 12345;
+        auto random = [&](size_t bound)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<size_t>((state >> 33) % bound);
+        };
+        for (size_t i = 0; i < size; i++)
+        {
+            usernames.push_back("student" + to_string(i));
+            users.push_back(userManagement.registerUser(usernames.back(), "pass" + to_string(i), usernames.back() + "@campus.edu", "benchmark user", i % 3 != 0));
+        }
+        for (size_t i = 1; i < size; i++)
+        {
+            for (int link = 0; link < 5; link++)
+            {
+                friendSystem.addFriend(users[i], users[random(i)]);
+            }
+        }
+        for (size_t i = 0; i < size; i++)
+        {
+            for (int p = 0; p < 3; p++)
+            {
+                posts.push_back("Post " + to_string(posts.size()) + " about the upcoming exam");
+                postManagement.createPost(users[i], posts.back());
+            }
+        }
+        // One conversation as long as the data size, for history scans
+        for (size_t i = 0; i < size; i++)
+        {
+            messagingSystem.sendMessage(users[i % 2], users[1 - i % 2], "message " + to_string(i) + " about the project deadline");
+        }
+        messagingSystem.createGroup(groupName);
+        for (size_t i = 0; i < min<size_t>(size, 5000); i++)
+        {
+            messagingSystem.addUserToGroup(groupName, users[i]);
+        }
+    }
+};
+
+class BenchmarkRunner
+{
+private:
+    const BenchmarkOptions &options;
+    vector<BenchmarkResult> results;
+
+public:
+    explicit BenchmarkRunner(const BenchmarkOptions &options) : options(options) {}
+
+    // Calls op(i) with i = 0, 1, 2, ... in doubling batches until the run is long enough
+    void run(const string &name, size_t size, const function<void(uint64_t)> &op)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == string::npos)
+        {
+            return;
+        }
+        QuietConsole quiet; // Several hot paths print; measure them without a terminal in the way
+        uint64_t iterations = 0;
+        uint64_t batch = 1;
+        chrono::duration<double> elapsed(0);
+        while (elapsed.count() < options.minSeconds)
+        {
+            auto start = chrono::steady_clock::now();
+            for (uint64_t i = 0; i < batch; i++)
+            {
+                op(iterations + i);
+            }
+            elapsed += chrono::steady_clock::now() - start;
+            iterations += batch;
+            batch *= 2;
+        }
+        results.push_back({name, size, iterations, elapsed.count() * 1e9 / iterations});
+    }
+
+    const vector<BenchmarkResult> &getResults() const
+    {
+        return results;
+    }
+};
+
+void runSuite(BenchmarkRunner &runner, size_t size)
+{
+    Fixture fixture(size);
+    vector<User *> &users = fixture.users;
+    UserManagement &userManagement = fixture.userManagement;
+    PostManagement &postManagement = fixture.postManagement;
+    FriendSystem &friendSystem = fixture.friendSystem;
+    MessagingSystem &messagingSystem = fixture.messagingSystem;
+    volatile uintptr_t sink = 0; // Keeps results of pure lookups alive
+
+    // Read-only paths first, so they all see the same data
+    runner.run("logIn", size, [&](uint64_t i)
+               {
+        size_t id = (i * 7919) % size;
+        sink = sink + reinterpret_cast<uintptr_t>(userManagement.logIn(fixture.usernames[id], "pass" + to_string(id))); });
+    runner.run("findUserByUsername", size, [&](uint64_t i)
+               { sink = sink + reinterpret_cast<uintptr_t>(userManagement.findUserByUsername(fixture.usernames[(i * 7919) % size])); });
+    runner.run("mutualFriendsCount", size, [&](uint64_t i)
+               { friendSystem.mutualFriendsCount(users[(i * 7919) % size], users[(i * 104729 + 1) % size]); });
+    runner.run("suggestFriendsBFS", size, [&](uint64_t i)
+               { friendSystem.suggestFriendsBFS(users[(i * 7919) % size]); });
+    // A friends feed: the friend list, then every friend's posts
+    runner.run("friendFeed", size, [&](uint64_t i)
+               {
+        for (User *friendUser : friendSystem.getFriends(users[(i * 7919) % size]))
+        {
+            sink = sink + postManagement.getUserPosts(friendUser).size();
+        } });
+    // Newest to oldest through the whole long conversation, one page per op
+    size_t cursor = HISTORY_LATEST;
+    runner.run("historyPage", size, [&](uint64_t)
+               {
+        HistoryPage page = messagingSystem.getChatHistoryPage(users[0], users[1], cursor);
+        cursor = page.hasMore ? page.cursor : HISTORY_LATEST;
+        sink = sink + page.messages.size(); });
+    runner.run("historySeek", size, [&](uint64_t i)
+               { sink = sink + messagingSystem.seekChatHistory(users[0], users[1], static_cast<int64_t>(i)); });
+    runner.run("searchChat", size, [&](uint64_t)
+               { sink = sink + messagingSystem.searchChat(users[0], users[1], "project deadline").hits.size(); });
+
+    // Mutating paths
+    runner.run("createPost", size, [&](uint64_t i)
+               { postManagement.createPost(users[i % size], "Benchmark post " + to_string(i)); });
+    runner.run("addComment", size, [&](uint64_t i)
+               { postManagement.addComment(users[i % size], fixture.posts[(i * 7919) % fixture.posts.size()], "Benchmark comment"); });
+    runner.run("addFriend", size, [&](uint64_t i)
+               { friendSystem.addFriend(users[(i * 7919) % size], users[(i * 104729 + 1) % size]); });
+    runner.run("sendMessage", size, [&](uint64_t i)
+               { messagingSystem.sendMessage(users[(i * 7919) % size], users[(i * 104729 + 1) % size], "benchmark message"); });
+    runner.run("sendMessageToGroup", size, [&](uint64_t i)
+               { messagingSystem.sendMessageToGroup(users[i % min<size_t>(size, 5000)], fixture.groupName, "benchmark group message"); });
+}
+
+// Baseline rows from an earlier CSV run, keyed by name and size
+map<pair<string, size_t>, double> readBaseline(const string &path)
+{
+    map<pair<string, size_t>, double> baseline;
+    ifstream file(path);
+    string line;
+    getline(file, line); // Header
+    while (getline(file, line))
+    {
+        stringstream row(line);
+        string name, size, iterations, nsPerOp;
+        if (getline(row, name, ',') && getline(row, size, ',') && getline(row, iterations, ',') && getline(row, nsPerOp, ','))
+        {
+            baseline[{name, strtoull(size.c_str(), nullptr, 10)}] = atof(nsPerOp.c_str());
+        }
+    }
+    return baseline;
+}
+
+void printResults(const vector<BenchmarkResult> &results, const string &format)
+{
+    if (format == "json")
+    {
+        cout << "[" << endl;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BenchmarkResult &result = results[i];
+            cout << "  {\"benchmark\": \"" << result.name << "\", \"size\": " << result.size << ", \"iterations\": " << result.iterations
+                 << ", \"ns_per_op\": " << result.nsPerOp << ", \"ops_per_sec\": " << 1e9 / result.nsPerOp << "}"
+                 << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        cout << "]" << endl;
+        return;
+    }
+    cout << "benchmark,size,iterations,ns_per_op,ops_per_sec" << endl;
+    for (const BenchmarkResult &result : results)
+    {
+        cout << result.name << "," << result.size << "," << result.iterations << "," << result.nsPerOp << "," << 1e9 / result.nsPerOp << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--sizes=", 0) == 0)
+        {
+            options.sizes.clear();
+            stringstream list(arg.substr(8));
+            string size;
+            while (getline(list, size, ','))
+            {
+                options.sizes.push_back(strtoull(size.c_str(), nullptr, 10));
+            }
+        }
+        else if (arg.rfind("--min-time=", 0) == 0)
+        {
+            options.minSeconds = atof(arg.c_str() + 11);
+        }
+        else if (arg.rfind("--filter=", 0) == 0)
+        {
+            options.filter = arg.substr(9);
+        }
+        else if (arg == "--format=csv" || arg == "--format=json")
+        {
+            options.format = arg.substr(9);
+        }
+        else if (arg.rfind("--baseline=", 0) == 0)
+        {
+            options.baseline = arg.substr(11);
+        }
+        else if (arg.rfind("--tolerance=", 0) == 0)
+        {
+            options.tolerance = atof(arg.c_str() + 12);
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--sizes=N,N,...] [--min-time=SECONDS] [--filter=NAME] [--format=csv|json]"
+                 << " [--baseline=FILE.csv] [--tolerance=FRACTION]" << endl;
+            return 1;
+        }
+    }
+    BenchmarkRunner runner(options);
+    for (size_t size : options.sizes)
+    {
+        if (size >= 2)
+        {
+            runSuite(runner, size);
+        }
+    }
+    printResults(runner.getResults(), options.format);
+    if (options.baseline.empty())
+    {
+        return 0;
+    }
+    map<pair<string, size_t>, double> baseline = readBaseline(options.baseline);
+    int regressions = 0;
+    for (const BenchmarkResult &result : runner.getResults())
+    {
+        auto it = baseline.find({result.name, result.size});
+        if (it != baseline.end() && result.nsPerOp > it->second * (1 + options.tolerance))
+        {
+            cerr << "REGRESSION " << result.name << " size " << result.size << ": " << it->second << " -> " << result.nsPerOp << " ns/op" << endl;
+            regressions++;
+        }
+    }
+    return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,170 @@
+#ifndef COLD_STORAGE_H
+#define COLD_STORAGE_H
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class User; // Forward declaration
+
+// How much chat history each log keeps in memory.
+// Older messages are sealed into compressed segment files and read back on demand.
+struct RetentionPolicy
+{
+    size_t maxHotMessages = 0;      // Messages kept in memory per log; 0 = no count limit
+    int64_t maxAgeMillis = 0;       // Messages older than this are sealed; 0 = no age limit
+    size_t segmentSize = 256;       // Messages per sealed segment when sealing by count
+    string directory = "segments";  // Where segment files are written
+    function<User *(uint32_t)> resolveUser; // Maps stored user ids back to users when reading segments
+    static const uint32_t NO_USER = UINT32_MAX; // Stored for a missing receiver (group messages)
+
+    bool enabled() const
+    {
+        return maxHotMessages > 0 || maxAgeMillis > 0;
+    }
+};
+
+// Byte-level helpers for segment files
+namespace ColdStorage
+{
+    inline void putVarint(string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    // Returns false on truncated input
+    inline bool getVarint(const string &in, size_t &offset, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && offset < in.size(); shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(in[offset++]);
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Small LZ77 compressor: a sequence of (literal run, back-reference) pairs, found with
+    // a hash of the next 4 bytes. Chat text repeats names and phrases, which this catches.
+    inline string compress(const string &in)
+    {
+        const size_t MIN_MATCH = 4;
+        const size_t HASH_BITS = 14;
+        vector<uint32_t> lastSeen(size_t(1) << HASH_BITS, UINT32_MAX);
+        string out;
+        size_t literalStart = 0;
+        size_t i = 0;
+        while (i + MIN_MATCH <= in.size())
+        {
+            uint32_t word;
+            memcpy(&word, in.data() + i, sizeof(word));
+            uint32_t hash = (word * 2654435761u) >> (32 - HASH_BITS);
+            uint32_t candidate = lastSeen[hash];
+            lastSeen[hash] = static_cast<uint32_t>(i);
+            if (candidate == UINT32_MAX || memcmp(in.data() + candidate, in.data() + i, MIN_MATCH) != 0)
+            {
+                i++;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (i + length < in.size() && in[candidate + length] == in[i + length])
+            {
+                length++;
+            }
+            putVarint(out, i - literalStart);
+            out.append(in, literalStart, i - literalStart);
+            putVarint(out, i - candidate);
+            putVarint(out, length - MIN_MATCH);
+            i += length;
+            literalStart = i;
+        }
+        putVarint(out, in.size() - literalStart);
+        out.append(in, literalStart, string::npos);
+        return out;
+    }
+
+    // Returns false if the input is corrupt or does not expand to exactly `rawSize` bytes.
+    // Every literal run and match is checked against `rawSize` before it is copied.
+    inline bool decompress(const string &in, uint64_t rawSize, string &out)
+    {
+        const size_t MIN_MATCH = 4;
+        out.clear();
+        size_t offset = 0;
+        while (offset < in.size())
+        {
+            uint64_t literals;
+            if (!getVarint(in, offset, literals) || literals > in.size() - offset || literals > rawSize - out.size())
+            {
+                return false;
+            }
+            out.append(in, offset, literals);
+            offset += literals;
+            if (offset == in.size())
+            {
+                break;
+            }
+            uint64_t distance, extra;
+            if (!getVarint(in, offset, distance) || !getVarint(in, offset, extra) || distance == 0 || distance > out.size() ||
+                rawSize - out.size() < MIN_MATCH || extra > rawSize - out.size() - MIN_MATCH)
+            {
+                return false;
+            }
+            size_t from = out.size() - distance;
+            for (size_t k = 0; k < extra + MIN_MATCH; k++)
+            {
+                out += out[from + k]; // Byte by byte: a match may overlap what it is copying
+            }
+        }
+        return out.size() == rawSize;
+    }
+
+    const char SEGMENT_MAGIC[4] = {'C', 'C', 'S', 'G'};
+
+    // Segment file: magic, varint raw size, compressed payload
+    inline bool writeSegment(const string &path, const string &raw)
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+        string header(SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+        putVarint(header, raw.size());
+        string body = compress(raw);
+        file.write(header.data(), header.size());
+        file.write(body.data(), body.size());
+        return static_cast<bool>(file);
+    }
+
+    inline bool readSegment(const string &path, string &raw)
+    {
+        ifstream file(path, ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (contents.size() < sizeof(SEGMENT_MAGIC) || memcmp(contents.data(), SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0)
+        {
+            return false;
+        }
+        size_t offset = sizeof(SEGMENT_MAGIC);
+        uint64_t rawSize;
+        return getVarint(contents, offset, rawSize) && decompress(contents.substr(offset), rawSize, raw);
+    }
+}
+
+#endif // COLD_STORAGE_H
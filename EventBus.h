@@ -0,0 +1,300 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Kinds of change the managers publish
+enum class MutationType : uint8_t
+{
+    SignUp,
+    CreatePost,
+    AddComment,
+    AddReply,
+    AddFriend,
+    RemoveFriend,
+    DirectMessage,
+    CreateGroup,
+    JoinGroup,
+    LeaveGroup,
+    GroupMessage
+};
+
+// One change, by user id, with the text that features derived from it need
+struct MutationEvent
+{
+    MutationType type = MutationType::SignUp;
+    uint32_t actor = 0;    // User who made the change
+    uint32_t subject = 0;  // Other user involved: the friend added or removed, the receiver of a message
+    uint64_t position = 0; // Position of a message in its conversation or group log
+    uint64_t sequence = 0; // Order on the bus
+    string key;            // Group id for group changes, the post's content for comments and replies
+    string text;           // Username, post, comment, message or group name
+};
+
+inline uint32_t mutationBit(MutationType type)
+{
+    return uint32_t(1) << static_cast<uint32_t>(type);
+}
+
+const uint32_t ALL_MUTATIONS = UINT32_MAX;
+
+// Carries mutations from the request path to subscribers that maintain derived data (search postings,
+// notifications, counters) on threads of their own. Publishers claim consecutive slots of one ring with a
+// single atomic increment and fill them in place; each subscriber follows the ring with its own cursor and
+// takes everything published since its last turn as one batch. A publisher that gets a full ring ahead of
+// the slowest subscriber waits for it, so a subscriber that falls behind slows writers instead of growing
+// a queue. Events of types no subscriber asked for are dropped at publish, before anything is copied.
+class EventBus
+{
+public:
+    typedef function<void(const vector<const MutationEvent *> &)> BatchHandler;
+
+private:
+    struct Slot
+    {
+        atomic<uint64_t> published{0}; // sequence + 1 once the event in this slot is readable
+        MutationEvent event;           // Assigned in place, so its strings keep their buffers from lap to lap
+    };
+
+    struct alignas(64) Subscriber
+    {
+        string name;
+        uint32_t types = 0;
+        size_t maxBatch = 0;
+        BatchHandler handler;
+        atomic<uint64_t> consumed{0}; // Next sequence to look at; slots before it can be reused
+        atomic<uint64_t> delivered{0};
+        atomic<uint64_t> batches{0};
+        thread worker;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t capacity;
+    size_t mask;
+    vector<unique_ptr<Subscriber>> subscribers; // Fixed once publishing starts
+    atomic<uint32_t> wanted{0};                 // Union of the subscribers' types
+    alignas(64) atomic<uint64_t> nextSequence{0};
+    alignas(64) atomic<uint64_t> gate{0}; // Cached cursor of the slowest subscriber; never ahead of it
+    atomic<uint64_t> stalls{0};          // Publishes that had to wait for room
+    mutex wakeMutex;
+    condition_variable wakeUp; // Subscribers waiting for events
+    atomic<size_t> sleepingSubscribers{0};
+    bool stopping = false; // Guarded by wakeMutex
+    mutex roomMutex;
+    condition_variable roomReady; // Publishers waiting for room, and waitUntilDelivered
+    atomic<size_t> waitingForRoom{0};
+
+    bool ready(uint64_t sequence) const
+    {
+        return slots[sequence & mask].published.load() == sequence + 1;
+    }
+
+    uint64_t slowestConsumed() const
+    {
+        uint64_t slowest = UINT64_MAX;
+        for (const unique_ptr<Subscriber> &subscriber : subscribers)
+        {
+            slowest = min(slowest, subscriber->consumed.load());
+        }
+        return slowest;
+    }
+
+    void waitForRoom(uint64_t sequence)
+    {
+        uint64_t slowest = slowestConsumed();
+        if (sequence >= slowest + capacity)
+        {
+            stalls++;
+            unique_lock<mutex> lock(roomMutex);
+            waitingForRoom++;
+            roomReady.wait(lock, [&]()
+                           { return sequence < (slowest = slowestConsumed()) + capacity; });
+            waitingForRoom--;
+        }
+        uint64_t cached = gate.load();
+        while (cached < slowest && !gate.compare_exchange_weak(cached, slowest))
+        {
+        }
+    }
+
+    void deliverLoop(Subscriber &subscriber)
+    {
+        vector<const MutationEvent *> batch;
+        batch.reserve(subscriber.maxBatch);
+        uint64_t next = subscriber.consumed.load();
+        while (true)
+        {
+            size_t count = 0;
+            while (count < subscriber.maxBatch && ready(next + count))
+            {
+                count++;
+            }
+            if (count == 0)
+            {
+                unique_lock<mutex> lock(wakeMutex);
+                sleepingSubscribers++;
+                wakeUp.wait(lock, [&]()
+                            { return stopping || ready(next); });
+                sleepingSubscribers--;
+                if (!ready(next))
+                {
+                    return; // Stopping, and everything published has been delivered
+                }
+                continue;
+            }
+            batch.clear();
+            for (size_t i = 0; i < count; i++)
+            {
+                const MutationEvent &event = slots[(next + i) & mask].event;
+                if (subscriber.types & mutationBit(event.type))
+                {
+                    batch.push_back(&event);
+                }
+            }
+            if (!batch.empty())
+            {
+                subscriber.handler(batch);
+                subscriber.delivered += batch.size();
+                subscriber.batches++;
+            }
+            next += count;
+            subscriber.consumed.store(next);
+            if (waitingForRoom.load() > 0)
+            {
+                {
+                    lock_guard<mutex> lock(roomMutex); // Orders the wake-up after the waiter's last look at the cursors
+                }
+                roomReady.notify_all();
+            }
+        }
+    }
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit EventBus(size_t requestedCapacity = 8192)
+    {
+        capacity = 1;
+        while (capacity < requestedCapacity)
+        {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        slots.reset(new Slot[capacity]);
+    }
+
+    EventBus(const EventBus &) = delete;
+    EventBus &operator=(const EventBus &) = delete;
+
+    // Delivers what was published, then stops the subscribers. Publishers must have stopped.
+    ~EventBus()
+    {
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (unique_ptr<Subscriber> &subscriber : subscribers)
+        {
+            subscriber->worker.join();
+        }
+    }
+
+    // Calls `handler` on a thread of its own with batches of at most `maxBatch` events whose type is in
+    // `types` (a mask of mutationBit values), in publish order. Subscribe before anything is published.
+    void subscribe(const string &name, uint32_t types, BatchHandler handler, size_t maxBatch = 256)
+    {
+        unique_ptr<Subscriber> subscriber = make_unique<Subscriber>();
+        subscriber->name = name;
+        subscriber->types = types;
+        subscriber->maxBatch = max<size_t>(1, min(maxBatch, capacity));
+        subscriber->handler = move(handler);
+        subscriber->consumed = nextSequence.load();
+        wanted |= types;
+        Subscriber &added = *subscriber;
+        subscribers.push_back(move(subscriber));
+        added.worker = thread(&EventBus::deliverLoop, this, ref(added));
+    }
+
+    bool wants(MutationType type) const
+    {
+        return wanted.load(memory_order_relaxed) & mutationBit(type);
+    }
+
+    // Queues one event for the subscribers of its type; waits while the ring is full.
+    // Must not be called while holding a lock a subscriber may take.
+    void publish(MutationType type, uint32_t actor, uint32_t subject = 0, const string &text = string(), const string &key = string(),
+                 uint64_t position = 0)
+    {
+        if (!wants(type))
+        {
+            return;
+        }
+        uint64_t sequence = nextSequence.fetch_add(1);
+        if (sequence >= gate.load() + capacity)
+        {
+            waitForRoom(sequence);
+        }
+        Slot &slot = slots[sequence & mask];
+        slot.event.type = type;
+        slot.event.actor = actor;
+        slot.event.subject = subject;
+        slot.event.position = position;
+        slot.event.sequence = sequence;
+        slot.event.key = key;
+        slot.event.text = text;
+        slot.published.store(sequence + 1);
+        if (sleepingSubscribers.load() > 0)
+        {
+            {
+                lock_guard<mutex> lock(wakeMutex); // Orders the wake-up after a sleeper's last look at the ring
+            }
+            wakeUp.notify_all();
+        }
+    }
+
+    // Returns once every subscriber has handled everything published before the call
+    void waitUntilDelivered()
+    {
+        uint64_t target = nextSequence.load();
+        unique_lock<mutex> lock(roomMutex);
+        waitingForRoom++;
+        roomReady.wait(lock, [&]()
+                       { return slowestConsumed() >= target; });
+        waitingForRoom--;
+    }
+
+    uint64_t published() const
+    {
+        return nextSequence.load();
+    }
+
+    uint64_t publishStalls() const
+    {
+        return stalls.load();
+    }
+
+    // Events and batches delivered to each subscriber so far
+    void report(ostream &out)
+    {
+        out << "Event bus: " << published() << " events published, " << publishStalls() << " publishes waited for room" << endl;
+        for (const unique_ptr<Subscriber> &subscriber : subscribers)
+        {
+            out << "  " << left << setw(16) << subscriber->name << right << subscriber->delivered << " events in " << subscriber->batches
+                << " batches" << endl;
+        }
+    }
+};
+
+#endif // EVENT_BUS_H
@@ -0,0 +1,115 @@
+// Throughput of the mutation event bus (EventBus.h): publisher threads against 1, 2, 4, ... subscribers that
+// only count what they are handed, then the cost of sendMessage with search indexing done inline against
+// indexing done by the bus subscriber.
+//
+// Build: make event_benchmark
+// Usage: ./event_benchmark [events per publisher] [publisher threads] [max subscribers] [messages]
+#include "SocialMediaPlatform.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+struct BusResult
+{
+    double eventsPerSecond;
+    double meanBatch;
+    uint64_t stalls;
+};
+
+// Publishes `eventsPerPublisher` direct-message events from each publisher; timed until every subscriber has them
+static BusResult runBus(size_t publishers, size_t subscriberCount, size_t eventsPerPublisher)
+{
+    EventBus bus;
+    vector<uint64_t> batches(subscriberCount, 0);
+    for (size_t s = 0; s < subscriberCount; s++)
+    {
+        bus.subscribe("counter " + to_string(s), mutationBit(MutationType::DirectMessage), [&batches, s](const vector<const MutationEvent *> &)
+                      { batches[s]++; });
+    }
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (size_t p = 0; p < publishers; p++)
+    {
+        threads.emplace_back([&bus, p, eventsPerPublisher]()
+                             {
+            for (size_t i = 0; i < eventsPerPublisher; i++)
+            {
+                bus.publish(MutationType::DirectMessage, p, p + 1, "hello from the benchmark", string(), i);
+            } });
+    }
+    for (thread &publisher : threads)
+    {
+        publisher.join();
+    }
+    bus.waitUntilDelivered();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    size_t total = publishers * eventsPerPublisher;
+    uint64_t allBatches = 0;
+    for (uint64_t count : batches)
+    {
+        allBatches += count; // Written by the subscriber threads; waitUntilDelivered ordered those writes before this read
+    }
+    return {total / elapsed.count(), allBatches ? double(total) * subscriberCount / allBatches : 0.0, bus.publishStalls()};
+}
+
+// Sends `messages` between neighbouring friends; returns sends per second on the request path and the seconds
+// the indexer still needed afterwards (0 when indexing is inline)
+static pair<double, double> runSends(bool withBus, size_t messages)
+{
+    const size_t USERS = 64;
+    QuietConsole quiet; // The managers narrate every change
+    UserManagement userManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    vector<User *> users;
+    for (size_t i = 0; i < USERS; i++)
+    {
+        string name = "user" + to_string(i);
+        users.push_back(userManagement.registerUser(name, "secret", name + "@bench.test", "", true));
+    }
+    for (size_t i = 0; i < USERS; i++)
+    {
+        friendSystem.addFriend(users[i], users[(i + 1) % USERS]);
+    }
+    EventBus events; // Declared after the managers so it is destroyed first
+    if (withBus)
+    {
+        messagingSystem.attachEventBus(&events, userManagement);
+    }
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; i++)
+    {
+        messagingSystem.sendMessage(users[i % USERS], users[(i + 1) % USERS], "meet at the library at " + to_string(i % 24) + " for the exam review");
+    }
+    auto sent = chrono::steady_clock::now();
+    events.waitUntilDelivered();
+    chrono::duration<double> sending = sent - start;
+    chrono::duration<double> catchingUp = chrono::steady_clock::now() - sent;
+    return {messages / sending.count(), catchingUp.count()};
+}
+
+int main(int argc, char **argv)
+{
+    size_t eventsPerPublisher = argc > 1 ? strtoull(argv[1], nullptr, 10) : 500000;
+    size_t publishers = argc > 2 ? strtoull(argv[2], nullptr, 10) : max(2u, thread::hardware_concurrency());
+    size_t maxSubscribers = argc > 3 ? strtoull(argv[3], nullptr, 10) : 4;
+    size_t messages = argc > 4 ? strtoull(argv[4], nullptr, 10) : 200000;
+    cout << fixed << setprecision(1) << "publishers,subscribers,events_per_sec,mean_batch,publish_stalls" << endl;
+    for (size_t subscribers = 1; subscribers <= maxSubscribers; subscribers *= 2)
+    {
+        BusResult result = runBus(publishers, subscribers, eventsPerPublisher);
+        cout << publishers << "," << subscribers << "," << static_cast<long long>(result.eventsPerSecond) << "," << result.meanBatch << ","
+             << result.stalls << endl;
+    }
+    cout << endl
+         << setprecision(3) << "indexing,sends_per_sec,catch_up_sec" << endl;
+    pair<double, double> inlineIndex = runSends(false, messages);
+    cout << "inline," << static_cast<long long>(inlineIndex.first) << "," << inlineIndex.second << endl;
+    pair<double, double> busIndex = runSends(true, messages);
+    cout << "event_bus," << static_cast<long long>(busIndex.first) << "," << busIndex.second << endl;
+    return 0;
+}
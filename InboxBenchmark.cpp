@@ -0,0 +1,156 @@
+// Stress benchmark: many sender threads writing into one hot recipient's inbox.
+// Compares the lock-free MpscInbox against a mutex-guarded std::queue, then the engine's two send paths:
+// sendMessage, which takes the recipient's lock, against postMessage, which queues into their inbox.
+//
+// Build: make inbox_benchmark
+// Usage: ./inbox_benchmark [messages per sender] [max sender threads]
+#include "SocialMediaPlatform.h"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+
+const size_t DRAIN_BATCH = 256;
+
+// Baseline: what a std::queue inbox needs once senders run concurrently
+class LockedInbox
+{
+private:
+    mutex queueMutex;
+    queue<PendingMessage> messages;
+
+public:
+    bool tryPush(PendingMessage value)
+    {
+        lock_guard<mutex> lock(queueMutex);
+        messages.push(move(value));
+        return true;
+    }
+
+    template <typename Consumer>
+    size_t drain(Consumer &&consume, size_t maxItems)
+    {
+        lock_guard<mutex> lock(queueMutex);
+        size_t count = 0;
+        while (count < maxItems && !messages.empty())
+        {
+            consume(move(messages.front()));
+            messages.pop();
+            count++;
+        }
+        return count;
+    }
+};
+
+// Runs `senders` producer threads against one consumer; returns messages per second
+template <typename Inbox>
+double runBenchmark(Inbox &inbox, int senders, size_t messagesPerSender)
+{
+    size_t total = senders * messagesPerSender;
+    size_t received = 0;
+    auto start = chrono::steady_clock::now();
+    thread consumer([&]()
+                    {
+        while (received < total)
+        {
+            size_t batch = inbox.drain([&](PendingMessage &&pending)
+                                       { (void)pending; },
+                                       DRAIN_BATCH);
+            received += batch;
+            if (batch == 0)
+            {
+                this_thread::yield();
+            }
+        } });
+    vector<thread> producers;
+    for (int t = 0; t < senders; t++)
+    {
+        producers.emplace_back([&, t]()
+                               {
+            User *sender = reinterpret_cast<User *>(static_cast<uintptr_t>(t + 1));
+            for (size_t i = 0; i < messagesPerSender; i++)
+            {
+                PendingMessage message{sender, nullptr, "hello from the benchmark"};
+                while (!inbox.tryPush(message))
+                {
+                    this_thread::yield(); // Inbox full: back off until the consumer catches up
+                }
+            } });
+    }
+    for (thread &producer : producers)
+    {
+        producer.join();
+    }
+    consumer.join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return total / elapsed.count();
+}
+
+// `senders` threads, each its own user, all messaging one recipient through the engine; returns messages per
+// second, timed until every message is in the recipient's conversations
+double runEngine(bool posted, int senders, size_t messagesPerSender)
+{
+    QuietConsole quiet; // The managers narrate every change
+    UserManagement userManagement;
+    MessagingSystem messagingSystem;
+    User *recipient = userManagement.registerUser("recipient", "secret", "recipient@bench.test", "", true);
+    vector<User *> users;
+    for (int t = 0; t < senders; t++)
+    {
+        string name = "sender" + to_string(t);
+        users.push_back(userManagement.registerUser(name, "secret", name + "@bench.test", "", true));
+    }
+    auto start = chrono::steady_clock::now();
+    vector<thread> producers;
+    for (int t = 0; t < senders; t++)
+    {
+        producers.emplace_back([&, t]()
+                               {
+            for (size_t i = 0; i < messagesPerSender; i++)
+            {
+                if (posted)
+                {
+                    messagingSystem.postMessage(users[t], recipient, "hello from the benchmark");
+                }
+                else
+                {
+                    messagingSystem.sendMessage(users[t], recipient, "hello from the benchmark");
+                }
+            } });
+    }
+    for (thread &producer : producers)
+    {
+        producer.join();
+    }
+    messagingSystem.deliverPending(recipient);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return senders * messagesPerSender / elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t messagesPerSender = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    int maxSenders = argc > 2 ? atoi(argv[2]) : max(2u, thread::hardware_concurrency()) * 2;
+    cout << "senders,mpsc_msgs_per_sec,locked_queue_msgs_per_sec" << endl;
+    for (int senders = 1; senders <= maxSenders; senders *= 2)
+    {
+        MpscInbox<PendingMessage> lockFree(4096);
+        LockedInbox locked;
+        double lockFreeRate = runBenchmark(lockFree, senders, messagesPerSender);
+        double lockedRate = runBenchmark(locked, senders, messagesPerSender);
+        cout << senders << "," << static_cast<long long>(lockFreeRate) << "," << static_cast<long long>(lockedRate) << endl;
+    }
+    cout << endl
+         << "senders,send_message_msgs_per_sec,post_message_msgs_per_sec" << endl;
+    for (int senders = 1; senders <= maxSenders; senders *= 2)
+    {
+        double sendRate = runEngine(false, senders, messagesPerSender);
+        double postRate = runEngine(true, senders, messagesPerSender);
+        cout << senders << "," << static_cast<long long>(sendRate) << "," << static_cast<long long>(postRate) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "Metrics.h"
+#include "SocketProtocol.h"
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <random>
+#include <thread>
+using namespace std;
+
+// Drives a running college_server over many connections, keeping a fixed number of requests in flight on
+// each (pipelining), and reports throughput and the latency distribution seen by the clients.
+// Run with --help for the options.
+
+struct LoadOptions
+{
+    Endpoint endpoint;
+    size_t connections = 16;
+    size_t pipeline = 8;     // Requests outstanding per connection
+    double seconds = 10;
+    size_t threads = 1;      // Client threads; connections are spread over them
+    double readRatio = 0.8;  // Fraction of requests that only read
+    string prefix;           // Usernames are <prefix><connection>
+};
+
+// One client connection and the send times of its unanswered requests, oldest first
+struct LoadConnection
+{
+    int fd = -1;
+    size_t index = 0;
+    LineReader input;
+    string output;
+    size_t outputSent = 0;
+    deque<chrono::steady_clock::time_point> outstanding;
+};
+
+struct ThreadResult
+{
+    unique_ptr<LatencyHistogram> latency = make_unique<LatencyHistogram>();
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    bool failed = false;
+};
+
+// Blocking round trip used during setup; the reply line without its newline, or "" if the connection failed
+static string roundTrip(int fd, LineReader &input, const string &request)
+{
+    string line = request + "\n";
+    if (send(fd, line.data(), line.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(line.size()))
+    {
+        return "";
+    }
+    char buffer[4096];
+    while (!input.next(line))
+    {
+        ssize_t received = read(fd, buffer, sizeof(buffer));
+        if (received <= 0)
+        {
+            return "";
+        }
+        input.append(buffer, static_cast<size_t>(received));
+    }
+    return line;
+}
+
+static string userName(const LoadOptions &options, size_t index)
+{
+    return options.prefix + to_string(index);
+}
+
+static string nextRequest(const LoadOptions &options, LoadConnection &connection, mt19937_64 &random, uint64_t &counter)
+{
+    string partner = userName(options, (connection.index + 1) % options.connections);
+    string group = options.prefix + "group";
+    counter++;
+    if (uniform_real_distribution<double>(0, 1)(random) < options.readRatio)
+    {
+        switch (random() % 5)
+        {
+        case 0:
+            return "UNREAD";
+        case 1:
+            return "INBOX\t10";
+        case 2:
+            return "HISTORY\t" + partner;
+        case 3:
+            return "GROUP_HISTORY\t" + group;
+        default:
+            return "SUGGEST";
+        }
+    }
+    switch (random() % 3)
+    {
+    case 0:
+        return "SEND\t" + partner + "\tload message " + to_string(counter);
+    case 1:
+        return "GROUP_SEND\t" + group + "\tload group message " + to_string(counter);
+    default:
+        return "POST\tload post " + to_string(connection.index) + "-" + to_string(counter);
+    }
+}
+
+static bool flushOutput(LoadConnection &connection)
+{
+    while (connection.outputSent < connection.output.size())
+    {
+        ssize_t sent = send(connection.fd, connection.output.data() + connection.outputSent,
+                            connection.output.size() - connection.outputSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        connection.outputSent += static_cast<size_t>(sent);
+    }
+    connection.output.clear();
+    connection.outputSent = 0;
+    return true;
+}
+
+// Keeps `pipeline` requests outstanding on each connection until the deadline, then waits for the stragglers
+static void runClient(const LoadOptions &options, vector<LoadConnection> &connections, chrono::steady_clock::time_point deadline,
+                      uint64_t seed, ThreadResult &result)
+{
+    mt19937_64 random(seed);
+    uint64_t counter = 0;
+    vector<pollfd> polls(connections.size());
+    char buffer[64 * 1024];
+    chrono::steady_clock::time_point giveUp = deadline + chrono::seconds(10);
+    while (true)
+    {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        bool sending = now < deadline;
+        bool waiting = false;
+        for (size_t i = 0; i < connections.size(); i++)
+        {
+            LoadConnection &connection = connections[i];
+            while (sending && connection.outstanding.size() < options.pipeline)
+            {
+                connection.output += nextRequest(options, connection, random, counter);
+                connection.output += '\n';
+                connection.outstanding.push_back(now);
+            }
+            if (!flushOutput(connection))
+            {
+                result.failed = true;
+                return;
+            }
+            waiting = waiting || !connection.outstanding.empty();
+            polls[i].fd = connection.fd;
+            polls[i].events = POLLIN | (connection.outputSent < connection.output.size() ? POLLOUT : 0);
+            polls[i].revents = 0;
+        }
+        if (!waiting || now >= giveUp)
+        {
+            return;
+        }
+        if (poll(polls.data(), polls.size(), 100) < 0 && errno != EINTR)
+        {
+            result.failed = true;
+            return;
+        }
+        for (size_t i = 0; i < connections.size(); i++)
+        {
+            if (!(polls[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            LoadConnection &connection = connections[i];
+            ssize_t received = read(connection.fd, buffer, sizeof(buffer));
+            if (received <= 0)
+            {
+                if (received < 0 && (errno == EAGAIN || errno == EINTR))
+                {
+                    continue;
+                }
+                result.failed = true; // The server went away mid-run
+                return;
+            }
+            chrono::steady_clock::time_point arrived = chrono::steady_clock::now();
+            connection.input.append(buffer, static_cast<size_t>(received));
+            string line;
+            while (connection.input.next(line) && !connection.outstanding.empty())
+            {
+                result.latency->record(chrono::duration_cast<chrono::nanoseconds>(arrived - connection.outstanding.front()).count());
+                connection.outstanding.pop_front();
+                result.requests++;
+                if (line.rfind("OK", 0) != 0)
+                {
+                    result.errors++;
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    LoadOptions options;
+    options.prefix = "load" + to_string(getpid()) + "_";
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--socket=", 0) == 0)
+        {
+            options.endpoint.socketPath = arg.substr(9);
+            options.endpoint.port = 0;
+        }
+        else if (arg.rfind("--port=", 0) == 0)
+        {
+            options.endpoint.port = atoi(arg.c_str() + 7);
+        }
+        else if (arg.rfind("--connections=", 0) == 0)
+        {
+            options.connections = max<size_t>(2, strtoull(arg.c_str() + 14, nullptr, 10));
+        }
+        else if (arg.rfind("--pipeline=", 0) == 0)
+        {
+            options.pipeline = max<size_t>(1, strtoull(arg.c_str() + 11, nullptr, 10));
+        }
+        else if (arg.rfind("--duration=", 0) == 0)
+        {
+            options.seconds = max(0.1, atof(arg.c_str() + 11));
+        }
+        else if (arg.rfind("--threads=", 0) == 0)
+        {
+            options.threads = max<size_t>(1, strtoull(arg.c_str() + 10, nullptr, 10));
+        }
+        else if (arg.rfind("--reads=", 0) == 0)
+        {
+            options.readRatio = min(1.0, max(0.0, atof(arg.c_str() + 8)));
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--socket=path | --port=N] [--connections=N] [--pipeline=DEPTH] [--duration=SECONDS]"
+                 << " [--threads=N] [--reads=FRACTION]" << endl;
+            return 1;
+        }
+    }
+    options.threads = min(options.threads, options.connections);
+
+    // Setup, one request at a time: an account per connection, each befriending the next in a ring, all in one group
+    vector<LoadConnection> connections(options.connections);
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        LoadConnection &connection = connections[i];
+        connection.index = i;
+        connection.fd = connectTo(options.endpoint);
+        string name = userName(options, i);
+        if (connection.fd < 0 ||
+            roundTrip(connection.fd, connection.input, "SIGNUP\t" + name + "\tsecret\t" + name + "@load.test\tload client\t1").rfind("OK", 0) != 0 ||
+            roundTrip(connection.fd, connection.input, "LOGIN\t" + name + "\tsecret").rfind("OK", 0) != 0)
+        {
+            cerr << "Could not set up connection " << i << " to " << options.endpoint.describe() << endl;
+            return 1;
+        }
+    }
+    string group = options.prefix + "group";
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        roundTrip(connections[i].fd, connections[i].input, "ADDFRIEND\t" + userName(options, (i + 1) % connections.size()));
+        roundTrip(connections[i].fd, connections[i].input, i == 0 ? "GROUP_CREATE\t" + group : "GROUP_JOIN\t" + group);
+    }
+    for (LoadConnection &connection : connections)
+    {
+        setNonBlocking(connection.fd);
+    }
+
+    vector<vector<LoadConnection>> assigned(options.threads);
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        assigned[i % options.threads].push_back(move(connections[i]));
+    }
+    vector<ThreadResult> results(options.threads);
+    vector<thread> clients;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(options.seconds));
+    for (size_t t = 0; t < options.threads; t++)
+    {
+        clients.emplace_back(runClient, cref(options), ref(assigned[t]), deadline, 0x5eed + t, ref(results[t]));
+    }
+    for (thread &client : clients)
+    {
+        client.join();
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<uint64_t> counts(LatencyHistogram::BUCKETS, 0);
+    uint64_t sum = 0, maximum = 0, requests = 0, errors = 0;
+    bool failed = false;
+    for (ThreadResult &result : results)
+    {
+        result.latency->addTo(counts, sum, maximum);
+        requests += result.requests;
+        errors += result.errors;
+        failed = failed || result.failed;
+    }
+    for (vector<LoadConnection> &group : assigned)
+    {
+        for (LoadConnection &connection : group)
+        {
+            close(connection.fd);
+        }
+    }
+    auto micros = [&](double fraction)
+    { return LatencyHistogram::percentile(counts, requests, fraction, maximum) / 1000.0; };
+    cout << fixed << setprecision(1);
+    cout << "Target: " << options.endpoint.describe() << ", " << options.connections << " connections x " << options.pipeline
+         << " pipelined, " << options.threads << " client threads, " << setprecision(0) << options.readRatio * 100 << "% reads" << endl;
+    cout << setprecision(1) << "Requests: " << requests << " in " << elapsed << " s, " << errors << " errors" << endl;
+    cout << "Throughput: " << (elapsed > 0 ? requests / elapsed : 0.0) << " req/s" << endl;
+    cout << "Latency (us): mean " << (requests ? sum / 1000.0 / requests : 0.0) << ", p50 " << micros(0.5) << ", p99 " << micros(0.99)
+         << ", p99.9 " << micros(0.999) << ", max " << maximum / 1000.0 << endl;
+    if (failed)
+    {
+        cerr << "A connection failed during the run" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#ifndef LOCK_STRIPES_H
+#define LOCK_STRIPES_H
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A fixed array of reader-writer locks; a key (user id, hash of a name) always maps to the same stripe.
+// Unrelated keys almost always land on different stripes, so their writers do not wait for each other.
+class LockStripes
+{
+public:
+    static const size_t STRIPES = 64; // One bit each in a Guard's mask
+
+private:
+    struct alignas(64) Stripe
+    {
+        shared_mutex mutex;
+    };
+    Stripe stripes[STRIPES];
+
+public:
+    static size_t stripeOf(uint64_t key)
+    {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 58); // Top 6 bits of a Fibonacci hash
+    }
+
+    static uint64_t keyOf(const string &name)
+    {
+        return hash<string>()(name);
+    }
+
+    shared_mutex &at(size_t stripe)
+    {
+        return stripes[stripe].mutex;
+    }
+
+    // Locks the stripes of a set of keys, each stripe once and in ascending order, so any two guards
+    // on the same LockStripes can never deadlock. Exclusive for writers, shared for readers.
+    class Guard
+    {
+    private:
+        LockStripes *owner;
+        uint64_t held = 0; // Bit i set: stripe i is locked
+        bool exclusive;
+
+        void lockAll()
+        {
+            for (uint64_t rest = held; rest != 0; rest &= rest - 1)
+            {
+                shared_mutex &mutex = owner->at(__builtin_ctzll(rest));
+                exclusive ? mutex.lock() : mutex.lock_shared();
+            }
+        }
+
+    public:
+        Guard(LockStripes &stripes, initializer_list<uint64_t> keys, bool exclusive) : owner(&stripes), exclusive(exclusive)
+        {
+            for (uint64_t key : keys)
+            {
+                held |= uint64_t(1) << stripeOf(key);
+            }
+            lockAll();
+        }
+
+        Guard(LockStripes &stripes, const vector<uint64_t> &keys, bool exclusive) : owner(&stripes), exclusive(exclusive)
+        {
+            for (uint64_t key : keys)
+            {
+                held |= uint64_t(1) << stripeOf(key);
+            }
+            lockAll();
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+        ~Guard()
+        {
+            for (uint64_t rest = held; rest != 0; rest &= rest - 1)
+            {
+                shared_mutex &mutex = owner->at(__builtin_ctzll(rest));
+                exclusive ? mutex.unlock() : mutex.unlock_shared();
+            }
+        }
+    };
+};
+
+// Writer and reader guards over one or more keys
+class StripeWriteGuard : public LockStripes::Guard
+{
+public:
+    StripeWriteGuard(LockStripes &stripes, initializer_list<uint64_t> keys) : Guard(stripes, keys, true) {}
+    StripeWriteGuard(LockStripes &stripes, const vector<uint64_t> &keys) : Guard(stripes, keys, true) {}
+};
+
+class StripeReadGuard : public LockStripes::Guard
+{
+public:
+    StripeReadGuard(LockStripes &stripes, initializer_list<uint64_t> keys) : Guard(stripes, keys, false) {}
+    StripeReadGuard(LockStripes &stripes, const vector<uint64_t> &keys) : Guard(stripes, keys, false) {}
+};
+
+#endif // LOCK_STRIPES_H
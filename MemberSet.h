@@ -0,0 +1,336 @@
+#ifndef MEMBER_SET_H
+#define MEMBER_SET_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Set of user ids whose layout adapts to its size.
+// Small sets are one sorted vector. Large sets switch to a roaring-style bitmap:
+// ids are split into chunks by their high 16 bits, and each chunk holds its low
+// 16 bits either as a sorted array (sparse) or as a 65536-bit bitmap (dense).
+class MemberSet
+{
+private:
+    static const size_t SMALL_LIMIT = 256;  // Sorted vector up to this many members
+    static const size_t ARRAY_LIMIT = 4096; // Chunk switches to a bitmap above this (4096 * 2 bytes = bitmap size)
+    static const size_t BITMAP_WORDS = 1024;
+
+    struct Chunk
+    {
+        uint16_t key = 0;         // High 16 bits shared by the chunk's ids
+        uint32_t cardinality = 0; // Members in this chunk
+        vector<uint16_t> array;   // Sorted low bits while sparse
+        vector<uint64_t> bits;    // Non-empty once dense
+
+        bool isBitmap() const
+        {
+            return !bits.empty();
+        }
+
+        bool contains(uint16_t low) const
+        {
+            if (isBitmap())
+            {
+                return (bits[low >> 6] >> (low & 63)) & 1;
+            }
+            return binary_search(array.begin(), array.end(), low);
+        }
+
+        bool insert(uint16_t low)
+        {
+            if (isBitmap())
+            {
+                uint64_t mask = uint64_t(1) << (low & 63);
+                if (bits[low >> 6] & mask)
+                {
+                    return false;
+                }
+                bits[low >> 6] |= mask;
+                cardinality++;
+                return true;
+            }
+            auto it = lower_bound(array.begin(), array.end(), low);
+            if (it != array.end() && *it == low)
+            {
+                return false;
+            }
+            array.insert(it, low);
+            cardinality++;
+            if (array.size() > ARRAY_LIMIT)
+            {
+                bits.assign(BITMAP_WORDS, 0);
+                for (uint16_t value : array)
+                {
+                    bits[value >> 6] |= uint64_t(1) << (value & 63);
+                }
+                vector<uint16_t>().swap(array);
+            }
+            return true;
+        }
+
+        bool erase(uint16_t low)
+        {
+            if (isBitmap())
+            {
+                uint64_t mask = uint64_t(1) << (low & 63);
+                if (!(bits[low >> 6] & mask))
+                {
+                    return false;
+                }
+                bits[low >> 6] &= ~mask;
+                cardinality--;
+                if (cardinality <= ARRAY_LIMIT / 2) // Hysteresis so one id cannot flip the layout back and forth
+                {
+                    forEach([&](uint16_t value)
+                            { array.push_back(value); });
+                    vector<uint64_t>().swap(bits);
+                }
+                return true;
+            }
+            auto it = lower_bound(array.begin(), array.end(), low);
+            if (it == array.end() || *it != low)
+            {
+                return false;
+            }
+            array.erase(it);
+            cardinality--;
+            return true;
+        }
+
+        template <typename Visitor>
+        void forEach(Visitor &&visit) const
+        {
+            if (!isBitmap())
+            {
+                for (uint16_t value : array)
+                {
+                    visit(value);
+                }
+                return;
+            }
+            for (size_t word = 0; word < BITMAP_WORDS; word++)
+            {
+                uint64_t remaining = bits[word];
+                while (remaining)
+                {
+                    visit(static_cast<uint16_t>(word * 64 + __builtin_ctzll(remaining)));
+                    remaining &= remaining - 1;
+                }
+            }
+        }
+    };
+
+    vector<uint32_t> small; // Sorted ids while the set is small
+    vector<Chunk> chunks;   // Sorted by key once the set is large
+    bool large = false;
+    size_t count = 0;
+
+    vector<Chunk>::iterator findChunk(uint16_t key)
+    {
+        return lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk &chunk, uint16_t value)
+                           { return chunk.key < value; });
+    }
+
+    const Chunk *findChunk(uint16_t key) const
+    {
+        auto it = lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk &chunk, uint16_t value)
+                              { return chunk.key < value; });
+        return it != chunks.end() && it->key == key ? &*it : nullptr;
+    }
+
+    bool insertLarge(uint32_t id)
+    {
+        uint16_t key = id >> 16;
+        auto it = findChunk(key);
+        if (it == chunks.end() || it->key != key)
+        {
+            it = chunks.insert(it, Chunk());
+            it->key = key;
+        }
+        return it->insert(static_cast<uint16_t>(id));
+    }
+
+    void becomeLarge()
+    {
+        large = true;
+        for (uint32_t id : small)
+        {
+            insertLarge(id);
+        }
+        vector<uint32_t>().swap(small);
+    }
+
+    void becomeSmall()
+    {
+        small.reserve(count);
+        forEach([&](uint32_t id)
+                { small.push_back(id); });
+        vector<Chunk>().swap(chunks);
+        large = false;
+    }
+
+public:
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    bool contains(uint32_t id) const
+    {
+        if (!large)
+        {
+            return binary_search(small.begin(), small.end(), id);
+        }
+        const Chunk *chunk = findChunk(id >> 16);
+        return chunk && chunk->contains(static_cast<uint16_t>(id));
+    }
+
+    // Returns false if the id was already a member
+    bool insert(uint32_t id)
+    {
+        if (!large)
+        {
+            auto it = lower_bound(small.begin(), small.end(), id);
+            if (it != small.end() && *it == id)
+            {
+                return false;
+            }
+            small.insert(it, id);
+            count++;
+            if (count > SMALL_LIMIT)
+            {
+                becomeLarge();
+            }
+            return true;
+        }
+        if (!insertLarge(id))
+        {
+            return false;
+        }
+        count++;
+        return true;
+    }
+
+    // Returns false if the id was not a member
+    bool erase(uint32_t id)
+    {
+        if (!large)
+        {
+            auto it = lower_bound(small.begin(), small.end(), id);
+            if (it == small.end() || *it != id)
+            {
+                return false;
+            }
+            small.erase(it);
+            count--;
+            return true;
+        }
+        auto it = findChunk(id >> 16);
+        if (it == chunks.end() || it->key != (id >> 16) || !it->erase(static_cast<uint16_t>(id)))
+        {
+            return false;
+        }
+        if (it->cardinality == 0)
+        {
+            chunks.erase(it);
+        }
+        count--;
+        if (count < SMALL_LIMIT / 2)
+        {
+            becomeSmall();
+        }
+        return true;
+    }
+
+    // Visits every member in ascending id order
+    template <typename Visitor>
+    void forEach(Visitor &&visit) const
+    {
+        if (!large)
+        {
+            for (uint32_t id : small)
+            {
+                visit(id);
+            }
+            return;
+        }
+        for (const Chunk &chunk : chunks)
+        {
+            uint32_t high = uint32_t(chunk.key) << 16;
+            chunk.forEach([&](uint16_t low)
+                          { visit(high | low); });
+        }
+    }
+
+    // Members of both sets, in ascending order
+    vector<uint32_t> intersect(const MemberSet &other) const
+    {
+        vector<uint32_t> result;
+        if (large && other.large)
+        {
+            // Only chunks present on both sides can overlap
+            auto a = chunks.begin();
+            auto b = other.chunks.begin();
+            while (a != chunks.end() && b != other.chunks.end())
+            {
+                if (a->key < b->key)
+                {
+                    ++a;
+                    continue;
+                }
+                if (b->key < a->key)
+                {
+                    ++b;
+                    continue;
+                }
+                uint32_t high = uint32_t(a->key) << 16;
+                if (a->isBitmap() && b->isBitmap())
+                {
+                    for (size_t word = 0; word < BITMAP_WORDS; word++)
+                    {
+                        uint64_t both = a->bits[word] & b->bits[word];
+                        while (both)
+                        {
+                            result.push_back(high | static_cast<uint32_t>(word * 64 + __builtin_ctzll(both)));
+                            both &= both - 1;
+                        }
+                    }
+                }
+                else
+                {
+                    const Chunk &probe = a->cardinality <= b->cardinality ? *a : *b;
+                    const Chunk &target = a->cardinality <= b->cardinality ? *b : *a;
+                    probe.forEach([&](uint16_t low)
+                                  {
+                        if (target.contains(low))
+                        {
+                            result.push_back(high | low);
+                        } });
+                }
+                ++a;
+                ++b;
+            }
+            return result;
+        }
+        // At least one side is small: probe the other side with each of its members
+        const MemberSet &probe = count <= other.count ? *this : other;
+        const MemberSet &target = count <= other.count ? other : *this;
+        probe.forEach([&](uint32_t id)
+                      {
+            if (target.contains(id))
+            {
+                result.push_back(id);
+            } });
+        return result;
+    }
+};
+
+#endif // MEMBER_SET_H
@@ -0,0 +1,251 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <malloc.h>
+#include <ostream>
+
+using namespace std;
+
+// Parts of the engine that heap memory is charged to
+enum class Subsystem : uint32_t
+{
+    Other, // Anything allocated outside a MemoryScope
+    Users,
+    Posts,
+    Comments,
+    Friends,
+    Messages,
+    Groups,
+    Count // Number of subsystems, not a subsystem
+};
+
+const size_t SUBSYSTEM_COUNT = static_cast<size_t>(Subsystem::Count);
+
+inline const char *subsystemName(Subsystem subsystem)
+{
+    static const char *names[SUBSYSTEM_COUNT] = {"other", "users", "posts", "comments", "friends", "messages", "groups"};
+    return names[static_cast<size_t>(subsystem)];
+}
+
+// Heap counters of one subsystem
+struct SubsystemUsage
+{
+    atomic<int64_t> liveBytes;    // Requested bytes not yet freed
+    atomic<int64_t> liveBlocks;   // Allocations not yet freed
+    atomic<int64_t> slackBytes;   // Usable bytes malloc handed out beyond the request (internal fragmentation)
+    atomic<int64_t> allocations;  // Every allocation ever made
+};
+
+// Counters are kept per thread so the allocation path never takes a locked instruction: each thread owns a slot
+// while it runs and hands it on when it exits. Threads beyond the slot count share the last one atomically.
+// A block freed by another thread is credited to that thread's slot; only the sum over all slots is meaningful.
+struct alignas(64) UsageSlot
+{
+    SubsystemUsage subsystems[SUBSYSTEM_COUNT];
+    atomic<bool> claimed;
+};
+
+const size_t USAGE_SLOTS = 128;
+
+// Zero-initialized before any constructor runs, so allocations made during static initialization are counted too
+inline UsageSlot usageSlots[USAGE_SLOTS + 1];
+inline thread_local Subsystem currentSubsystem = Subsystem::Other;
+
+class ThreadUsageSlot
+{
+public:
+    size_t index = USAGE_SLOTS;
+    bool exclusive = false;
+
+    ThreadUsageSlot()
+    {
+        for (size_t i = 0; i < USAGE_SLOTS; i++)
+        {
+            bool expected = false;
+            if (!usageSlots[i].claimed.load(memory_order_relaxed) &&
+                usageSlots[i].claimed.compare_exchange_strong(expected, true, memory_order_acquire))
+            {
+                index = i;
+                exclusive = true;
+                return;
+            }
+        }
+    }
+
+    // Frees made later in thread teardown fall back to the shared slot
+    ~ThreadUsageSlot()
+    {
+        if (exclusive)
+        {
+            exclusive = false;
+            usageSlots[index].claimed.store(false, memory_order_release);
+            index = USAGE_SLOTS;
+        }
+    }
+
+    void add(atomic<int64_t> &counter, int64_t amount) const
+    {
+        if (exclusive)
+        {
+            counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+        }
+        else
+        {
+            counter.fetch_add(amount, memory_order_relaxed);
+        }
+    }
+};
+
+inline thread_local ThreadUsageSlot threadUsageSlot;
+
+// Charges heap allocations made by this thread to `subsystem` until the scope ends. Scopes nest.
+class MemoryScope
+{
+private:
+    Subsystem previous;
+
+public:
+    explicit MemoryScope(Subsystem subsystem) : previous(currentSubsystem)
+    {
+        currentSubsystem = subsystem;
+    }
+
+    MemoryScope(const MemoryScope &) = delete;
+    MemoryScope &operator=(const MemoryScope &) = delete;
+
+    ~MemoryScope()
+    {
+        currentSubsystem = previous;
+    }
+};
+
+// Heap accounting behind the engine's global operator new/delete. Each block carries a 16-byte header
+// recording its size and subsystem, so a block is credited back to the right subsystem whichever thread frees it.
+class MemoryAccounting
+{
+private:
+    struct BlockHeader
+    {
+        uint64_t size;
+        uint32_t slack;
+        uint32_t subsystem;
+    };
+    static_assert(sizeof(BlockHeader) == 16, "header must keep the default new alignment");
+
+    static void charge(BlockHeader *header, size_t size, size_t usable)
+    {
+        header->size = size;
+        header->slack = static_cast<uint32_t>(usable - size);
+        header->subsystem = static_cast<uint32_t>(currentSubsystem);
+        const ThreadUsageSlot &slot = threadUsageSlot;
+        SubsystemUsage &usage = usageSlots[slot.index].subsystems[header->subsystem];
+        slot.add(usage.liveBytes, static_cast<int64_t>(size));
+        slot.add(usage.liveBlocks, 1);
+        slot.add(usage.slackBytes, header->slack);
+        slot.add(usage.allocations, 1);
+    }
+
+    static void credit(const BlockHeader *header)
+    {
+        const ThreadUsageSlot &slot = threadUsageSlot;
+        SubsystemUsage &usage = usageSlots[slot.index].subsystems[header->subsystem];
+        slot.add(usage.liveBytes, -static_cast<int64_t>(header->size));
+        slot.add(usage.liveBlocks, -1);
+        slot.add(usage.slackBytes, -static_cast<int64_t>(header->slack));
+    }
+
+    // The address `offset` bytes below `block`, computed as an integer: after inlining, GCC would otherwise see
+    // the header as an out-of-bounds index of the object the caller allocated, and free() as mismatching its new
+    static void *below(void *block, size_t offset)
+    {
+        return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(block) - offset);
+    }
+
+public:
+    // nullptr when out of memory
+    static void *allocate(size_t size)
+    {
+        void *raw = malloc(size + sizeof(BlockHeader));
+        if (!raw)
+        {
+            return nullptr;
+        }
+        BlockHeader *header = static_cast<BlockHeader *>(raw);
+        charge(header, size, malloc_usable_size(raw) - sizeof(BlockHeader));
+        return header + 1;
+    }
+
+    static void release(void *block)
+    {
+        if (block)
+        {
+            void *raw = below(block, sizeof(BlockHeader));
+            credit(static_cast<BlockHeader *>(raw));
+            free(raw);
+        }
+    }
+
+    // Over-aligned blocks: the header sits just below the block, in a padding of `alignment` bytes
+    static void *allocateAligned(size_t size, size_t alignment)
+    {
+        alignment = max(alignment, sizeof(BlockHeader));
+        size_t total = (size + alignment + alignment - 1) / alignment * alignment;
+        void *raw = aligned_alloc(alignment, total);
+        if (!raw)
+        {
+            return nullptr;
+        }
+        char *block = static_cast<char *>(raw) + alignment;
+        charge(reinterpret_cast<BlockHeader *>(block) - 1, size, malloc_usable_size(raw) - alignment);
+        return block;
+    }
+
+    static void releaseAligned(void *block, size_t alignment)
+    {
+        if (block)
+        {
+            alignment = max(alignment, sizeof(BlockHeader));
+            credit(static_cast<BlockHeader *>(below(block, sizeof(BlockHeader))));
+            free(below(block, alignment));
+        }
+    }
+
+    // Live bytes, blocks and slack per subsystem, then the allocator's own view of the heap:
+    // free space inside the heap that cannot be returned to the system is external fragmentation
+    static void report(ostream &out)
+    {
+        out << left << setw(10) << "subsystem" << right << setw(14) << "live_bytes" << setw(12) << "live_blocks"
+            << setw(12) << "avg_block" << setw(12) << "slack_pct" << setw(14) << "allocations" << endl;
+        int64_t totalBytes = 0;
+        for (size_t i = 0; i < SUBSYSTEM_COUNT; i++)
+        {
+            int64_t bytes = 0, blocks = 0, slack = 0, allocations = 0;
+            for (const UsageSlot &slot : usageSlots)
+            {
+                const SubsystemUsage &usage = slot.subsystems[i];
+                bytes += usage.liveBytes.load(memory_order_relaxed);
+                blocks += usage.liveBlocks.load(memory_order_relaxed);
+                slack += usage.slackBytes.load(memory_order_relaxed);
+                allocations += usage.allocations.load(memory_order_relaxed);
+            }
+            totalBytes += bytes;
+            out << left << setw(10) << subsystemName(static_cast<Subsystem>(i)) << right << setw(14) << bytes << setw(12) << blocks
+                << fixed << setprecision(1) << setw(12) << (blocks > 0 ? double(bytes) / blocks : 0.0)
+                << setw(12) << (bytes + slack > 0 ? 100.0 * slack / (bytes + slack) : 0.0) << defaultfloat
+                << setw(14) << allocations << endl;
+        }
+        struct mallinfo2 heap = mallinfo2();
+        size_t inUse = heap.uordblks + heap.hblkhd;
+        size_t reserved = heap.arena + heap.hblkhd;
+        out << "Tracked live bytes: " << totalBytes << endl;
+        out << "Heap in use: " << inUse << " of " << reserved << " bytes reserved; " << heap.fordblks << " free in "
+            << heap.ordblks << " chunks (" << fixed << setprecision(1) << (heap.arena > 0 ? 100.0 * heap.fordblks / heap.arena : 0.0)
+            << "% fragmentation), " << heap.keepcost << " releasable" << defaultfloat << endl;
+    }
+};
+
+#endif // MEMORY_ACCOUNTING_H
@@ -0,0 +1,128 @@
+#ifndef MESSAGE_INBOX_H
+#define MESSAGE_INBOX_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+class User; // Forward declaration
+
+// A direct message waiting in the receiver's inbox to be delivered; stamped and logged when it was posted
+struct PendingMessage
+{
+    User *sender = nullptr;
+    User *receiver = nullptr;
+    string message;
+    uint64_t seq = 0;
+    int64_t timestamp = 0;
+};
+
+// Bounded lock-free multi-producer / single-consumer inbox.
+// Any number of threads may call tryPush concurrently; only one thread may drain.
+// Every slot carries a sequence number telling producers and the consumer whose
+// turn it is, so producers only contend on one atomic increment of `tail`.
+template <typename T>
+class MpscInbox
+{
+private:
+    struct Slot
+    {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t capacity;
+    size_t mask;
+    alignas(64) atomic<size_t> tail; // Next position a producer claims
+    alignas(64) size_t head;         // Next position the consumer reads (consumer thread only)
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpscInbox(size_t requestedCapacity = 1024) : tail(0), head(0)
+    {
+        capacity = 1;
+        while (capacity < requestedCapacity)
+        {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        slots.reset(new Slot[capacity]);
+        for (size_t i = 0; i < capacity; i++)
+        {
+            slots[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    MpscInbox(const MpscInbox &) = delete;
+    MpscInbox &operator=(const MpscInbox &) = delete;
+
+    // Returns false when the inbox is full; the caller decides whether to retry or drop
+    bool tryPush(T value)
+    {
+        return tryPushFrom(value);
+    }
+
+    // Like tryPush, but moves out of `value` only when it was queued, so a full inbox leaves it to retry
+    bool tryPushFrom(T &value)
+    {
+        size_t position = tail.load(memory_order_relaxed);
+        Slot *slot;
+        while (true)
+        {
+            slot = &slots[position & mask];
+            size_t sequence = slot->sequence.load(memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = tail.load(memory_order_relaxed);
+            }
+        }
+        slot->value = move(value);
+        slot->sequence.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    // Hands up to `maxItems` queued values to `consume` in arrival order; returns how many.
+    // Consumer thread only.
+    template <typename Consumer>
+    size_t drain(Consumer &&consume, size_t maxItems = SIZE_MAX)
+    {
+        size_t count = 0;
+        while (count < maxItems)
+        {
+            Slot &slot = slots[head & mask];
+            if (slot.sequence.load(memory_order_acquire) != head + 1)
+            {
+                break;
+            }
+            consume(move(slot.value));
+            slot.sequence.store(head + capacity, memory_order_release);
+            head++;
+            count++;
+        }
+        return count;
+    }
+
+    // Queued count as seen by the consumer thread; producers may add more meanwhile
+    size_t sizeApprox() const
+    {
+        return tail.load(memory_order_relaxed) - head;
+    }
+};
+
+#endif // MESSAGE_INBOX_H
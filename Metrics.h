@@ -0,0 +1,327 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+using namespace std;
+
+// Engine operations with their own latency histogram
+enum class Operation
+{
+    SignUp,
+    LogIn,
+    CreatePost,
+    AddComment,
+    AddFriend,
+    RemoveFriend,
+    SuggestFriends,
+    SendMessage,
+    SendGroupMessage,
+    ReadHistory,
+    Count // Number of operations, not an operation
+};
+
+const size_t OPERATION_COUNT = static_cast<size_t>(Operation::Count);
+
+inline const char *operationName(Operation operation)
+{
+    static const char *names[OPERATION_COUNT] = {"signup", "login", "post", "comment", "friend_add", "friend_remove",
+                                                 "suggestions", "dm_send", "group_send", "history_read"};
+    return names[static_cast<size_t>(operation)];
+}
+
+// HDR-style latency histogram in nanoseconds: each power of two is split into 32 linear
+// sub-buckets, so any recorded value is known to within about 3% over the whole range.
+// One thread records; any thread may read while it does.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 5;
+    static const uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BITS;
+    static const int MAX_MAGNITUDE = 40; // 2^40 ns is about 18 minutes; longer values are clamped
+    static const size_t BUCKETS = (MAX_MAGNITUDE - SUB_BITS + 2) * SUB_BUCKETS;
+
+    static size_t bucketOf(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<size_t>(value);
+        }
+        int magnitude = 63 - __builtin_clzll(value);
+        if (magnitude > MAX_MAGNITUDE)
+        {
+            return BUCKETS - 1;
+        }
+        int shift = magnitude - SUB_BITS;
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1)));
+    }
+
+    // Lowest value that falls in `bucket`
+    static uint64_t bucketValue(size_t bucket)
+    {
+        uint64_t tier = bucket >> SUB_BITS;
+        uint64_t sub = bucket & (SUB_BUCKETS - 1);
+        return tier == 0 ? sub : (SUB_BUCKETS + sub) << (tier - 1);
+    }
+
+    // Single writer: plain load + store keeps the hot path free of locked instructions
+    void record(uint64_t nanoseconds)
+    {
+        bump(buckets[bucketOf(nanoseconds)], 1);
+        bump(total, nanoseconds);
+        if (nanoseconds > largest.load(memory_order_relaxed))
+        {
+            largest.store(nanoseconds, memory_order_relaxed);
+        }
+    }
+
+    // Value at `fraction` (0.5 = median) of `count` values merged into `counts`, by nearest rank
+    static uint64_t percentile(const vector<uint64_t> &counts, uint64_t count, double fraction, uint64_t maximum)
+    {
+        uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(fraction * count)));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts.size(); bucket++)
+        {
+            seen += counts[bucket];
+            if (seen >= rank)
+            {
+                return min(bucketValue(bucket), maximum);
+            }
+        }
+        return maximum;
+    }
+
+    void addTo(vector<uint64_t> &counts, uint64_t &sum, uint64_t &maximum) const
+    {
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            counts[i] += buckets[i].load(memory_order_relaxed);
+        }
+        sum += total.load(memory_order_relaxed);
+        maximum = max(maximum, largest.load(memory_order_relaxed));
+    }
+
+    void reset()
+    {
+        for (atomic<uint64_t> &bucket : buckets)
+        {
+            bucket.store(0, memory_order_relaxed);
+        }
+        total.store(0, memory_order_relaxed);
+        largest.store(0, memory_order_relaxed);
+    }
+
+    static void bump(atomic<uint64_t> &counter, uint64_t amount)
+    {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+private:
+    atomic<uint64_t> buckets[BUCKETS] = {};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> largest{0};
+};
+
+// Process-wide metrics. Every thread records into its own block, so recording never contends;
+// a report sums the blocks of live threads plus what exited threads left behind.
+// While disabled, recording costs one relaxed load and a branch.
+class Metrics
+{
+private:
+    struct ThreadBlock
+    {
+        LatencyHistogram latency[OPERATION_COUNT];
+        atomic<uint64_t> failures[OPERATION_COUNT] = {};
+
+        ~ThreadBlock();
+    };
+
+    struct Registry
+    {
+        mutex registryMutex;
+        list<ThreadBlock *> live;
+        vector<uint64_t> retiredCounts[OPERATION_COUNT]; // Buckets of exited threads
+        uint64_t retiredSums[OPERATION_COUNT] = {};
+        uint64_t retiredMax[OPERATION_COUNT] = {};
+        uint64_t retiredFailures[OPERATION_COUNT] = {};
+        chrono::steady_clock::time_point since = chrono::steady_clock::now();
+
+        Registry()
+        {
+            for (vector<uint64_t> &counts : retiredCounts)
+            {
+                counts.assign(LatencyHistogram::BUCKETS, 0);
+            }
+        }
+    };
+
+    static atomic<bool> &enabledFlag()
+    {
+        static atomic<bool> enabled{false};
+        return enabled;
+    }
+
+    static Registry &registry()
+    {
+        static Registry *instance = new Registry(); // Never destroyed: threads may exit after main returns
+        return *instance;
+    }
+
+    static ThreadBlock &local()
+    {
+        thread_local unique_ptr<ThreadBlock> block;
+        if (!block)
+        {
+            block.reset(new ThreadBlock());
+            Registry &shared = registry();
+            lock_guard<mutex> lock(shared.registryMutex);
+            shared.live.push_back(block.get());
+        }
+        return *block;
+    }
+
+public:
+    static bool enabled()
+    {
+        return enabledFlag().load(memory_order_relaxed);
+    }
+
+    static void enable(bool on = true)
+    {
+        if (on && !enabled())
+        {
+            reset();
+        }
+        enabledFlag().store(on, memory_order_relaxed);
+    }
+
+    static void record(Operation operation, uint64_t nanoseconds, bool failed)
+    {
+        ThreadBlock &block = local();
+        size_t index = static_cast<size_t>(operation);
+        block.latency[index].record(nanoseconds);
+        if (failed)
+        {
+            LatencyHistogram::bump(block.failures[index], 1);
+        }
+    }
+
+    // Clears every histogram and restarts the throughput clock
+    static void reset()
+    {
+        Registry &shared = registry();
+        lock_guard<mutex> lock(shared.registryMutex);
+        for (ThreadBlock *block : shared.live)
+        {
+            for (size_t i = 0; i < OPERATION_COUNT; i++)
+            {
+                block->latency[i].reset();
+                block->failures[i].store(0, memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < OPERATION_COUNT; i++)
+        {
+            shared.retiredCounts[i].assign(LatencyHistogram::BUCKETS, 0);
+            shared.retiredSums[i] = shared.retiredMax[i] = shared.retiredFailures[i] = 0;
+        }
+        shared.since = chrono::steady_clock::now();
+    }
+
+    // One row per operation that ran: count, failures, throughput, mean, p50, p99, p999 and max latency
+    static void report(ostream &out)
+    {
+        Registry &shared = registry();
+        lock_guard<mutex> lock(shared.registryMutex);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - shared.since).count();
+        out << left << setw(14) << "operation" << right << setw(10) << "count" << setw(9) << "failed" << setw(12) << "ops/s"
+            << setw(11) << "mean_us" << setw(11) << "p50_us" << setw(11) << "p99_us" << setw(11) << "p999_us" << setw(11) << "max_us" << endl;
+        for (size_t i = 0; i < OPERATION_COUNT; i++)
+        {
+            vector<uint64_t> counts = shared.retiredCounts[i];
+            uint64_t sum = shared.retiredSums[i];
+            uint64_t maximum = shared.retiredMax[i];
+            uint64_t failures = shared.retiredFailures[i];
+            for (ThreadBlock *block : shared.live)
+            {
+                block->latency[i].addTo(counts, sum, maximum);
+                failures += block->failures[i].load(memory_order_relaxed);
+            }
+            uint64_t count = 0;
+            for (uint64_t bucket : counts)
+            {
+                count += bucket;
+            }
+            if (count == 0)
+            {
+                continue;
+            }
+            auto percentile = [&](double fraction)
+            {
+                return LatencyHistogram::percentile(counts, count, fraction, maximum) / 1000.0;
+            };
+            out << left << setw(14) << operationName(static_cast<Operation>(i)) << right << setw(10) << count << setw(9) << failures
+                << fixed << setprecision(1) << setw(12) << count / max(seconds, 1e-9) << setprecision(2)
+                << setw(11) << sum / 1000.0 / count << setw(11) << percentile(0.5) << setw(11) << percentile(0.99)
+                << setw(11) << percentile(0.999) << setw(11) << maximum / 1000.0 << defaultfloat << endl;
+        }
+    }
+};
+
+// Folds an exiting thread's numbers into the retired totals
+inline Metrics::ThreadBlock::~ThreadBlock()
+{
+    Registry &shared = registry();
+    lock_guard<mutex> lock(shared.registryMutex);
+    shared.live.remove(this);
+    for (size_t i = 0; i < OPERATION_COUNT; i++)
+    {
+        latency[i].addTo(shared.retiredCounts[i], shared.retiredSums[i], shared.retiredMax[i]);
+        shared.retiredFailures[i] += failures[i].load(memory_order_relaxed);
+    }
+}
+
+// Times the enclosing scope as one `operation`; call fail() on paths that did not succeed
+class OperationTimer
+{
+private:
+    Operation operation;
+    bool active;
+    bool failed = false;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit OperationTimer(Operation operation) : operation(operation), active(Metrics::enabled())
+    {
+        if (active)
+        {
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    OperationTimer(const OperationTimer &) = delete;
+    OperationTimer &operator=(const OperationTimer &) = delete;
+
+    void fail()
+    {
+        failed = true;
+    }
+
+    ~OperationTimer()
+    {
+        if (active)
+        {
+            uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            Metrics::record(operation, elapsed, failed);
+        }
+    }
+};
+
+#endif // METRICS_H
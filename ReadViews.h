@@ -0,0 +1,348 @@
+#ifndef READ_VIEWS_H
+#define READ_VIEWS_H
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Read-copy-update for data that is read far more often than written. Writers build a new immutable version
+// and publish it with one atomic pointer store; readers load the pointer and never take a lock. What a new
+// version replaces is retired and freed by epoch-based reclamation once no reader can still be looking at it.
+
+const size_t EPOCH_SLOTS = 128;
+const uint64_t EPOCH_IDLE = UINT64_MAX;
+
+// Epoch announced by one reading thread, EPOCH_IDLE outside a read section
+struct alignas(64) EpochSlot
+{
+    atomic<uint64_t> epoch{EPOCH_IDLE};
+    atomic<bool> claimed{false};
+};
+
+// Constant-initialized with no destructor, so threads exiting during shutdown can still hand their slot back
+inline EpochSlot epochSlots[EPOCH_SLOTS];
+inline atomic<size_t> epochSlotsUsed{0}; // Slots ever claimed are all below this; reclamation scans only those
+
+// Each thread claims a slot on its first read section and gives it back when it exits.
+// Threads beyond the slot count are counted in overflowReaders instead; nothing is freed while one is reading.
+class ThreadEpochSlot
+{
+public:
+    size_t index = EPOCH_SLOTS;
+    size_t depth = 0; // Nested read sections; only the outermost announces an epoch
+
+    ThreadEpochSlot()
+    {
+        for (size_t i = 0; i < EPOCH_SLOTS; i++)
+        {
+            bool expected = false;
+            if (!epochSlots[i].claimed.load(memory_order_relaxed) && epochSlots[i].claimed.compare_exchange_strong(expected, true))
+            {
+                index = i;
+                size_t used = epochSlotsUsed.load();
+                while (used <= i && !epochSlotsUsed.compare_exchange_weak(used, i + 1))
+                {
+                }
+                return;
+            }
+        }
+    }
+
+    ~ThreadEpochSlot()
+    {
+        if (index < EPOCH_SLOTS)
+        {
+            epochSlots[index].epoch.store(EPOCH_IDLE);
+            epochSlots[index].claimed.store(false);
+        }
+    }
+};
+
+inline thread_local ThreadEpochSlot threadEpochSlot;
+
+// Frees retired objects once every reader that could have seen them has left its read section.
+// An object retired at epoch e may be held by readers that announced e or earlier; readers arriving later
+// load the pointer after it was replaced, so they cannot reach it.
+class EpochReclaimer
+{
+private:
+    struct Retired
+    {
+        uint64_t epoch;
+        void *object;
+        void (*destroy)(void *);
+    };
+
+    atomic<uint64_t> globalEpoch{1};
+    atomic<size_t> overflowReaders{0};
+    mutex retiredMutex;
+    vector<Retired> retired; // Guarded by retiredMutex
+    static const size_t COLLECT_BATCH = 16; // Retired objects to gather before scanning the slots; freeing soon keeps memory warm
+
+public:
+    // Never destroyed: worker threads may still leave read sections during static destruction
+    static EpochReclaimer &instance()
+    {
+        static EpochReclaimer *reclaimer = new EpochReclaimer();
+        return *reclaimer;
+    }
+
+    void enter()
+    {
+        ThreadEpochSlot &self = threadEpochSlot;
+        if (self.depth++ > 0)
+        {
+            return;
+        }
+        if (self.index < EPOCH_SLOTS)
+        {
+            epochSlots[self.index].epoch.store(globalEpoch.load());
+        }
+        else
+        {
+            overflowReaders++;
+        }
+    }
+
+    void leave()
+    {
+        ThreadEpochSlot &self = threadEpochSlot;
+        if (--self.depth > 0)
+        {
+            return;
+        }
+        if (self.index < EPOCH_SLOTS)
+        {
+            epochSlots[self.index].epoch.store(EPOCH_IDLE);
+        }
+        else
+        {
+            overflowReaders--;
+        }
+    }
+
+    // Frees `object` with `destroy` once no reader can reach it. Call only after it was unpublished.
+    void retire(void *object, void (*destroy)(void *))
+    {
+        lock_guard<mutex> lock(retiredMutex);
+        retired.push_back({globalEpoch.load(), object, destroy});
+    }
+
+    template <typename T>
+    void retire(const T *object)
+    {
+        retire(const_cast<T *>(object), [](void *pointer)
+               { delete static_cast<T *>(pointer); });
+    }
+
+    // Starts a new epoch and frees what every current reader started after; cheap unless enough has piled up
+    void collect()
+    {
+        vector<Retired> ready;
+        {
+            lock_guard<mutex> lock(retiredMutex);
+            if (retired.size() < COLLECT_BATCH)
+            {
+                return;
+            }
+            uint64_t oldest = globalEpoch.fetch_add(1) + 1;
+            if (overflowReaders.load() > 0)
+            {
+                return;
+            }
+            for (size_t i = 0, used = epochSlotsUsed.load(); i < used; i++)
+            {
+                oldest = min(oldest, epochSlots[i].epoch.load());
+            }
+            auto kept = partition(retired.begin(), retired.end(), [&](const Retired &entry)
+                                  { return entry.epoch >= oldest; });
+            ready.assign(kept, retired.end());
+            retired.erase(kept, retired.end());
+        }
+        for (Retired &entry : ready)
+        {
+            entry.destroy(entry.object);
+        }
+    }
+};
+
+// Read section: pointers loaded from a VersionedTable stay valid until it ends. Sections nest.
+// Like a lock, it must not be held across a co_await, since the task may resume on another thread.
+class EpochGuard
+{
+public:
+    EpochGuard()
+    {
+        EpochReclaimer::instance().enter();
+    }
+
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard &operator=(const EpochGuard &) = delete;
+
+    ~EpochGuard()
+    {
+        EpochReclaimer::instance().leave();
+    }
+};
+
+// Immutable values indexed by a dense id (a user's posts, a user's friends), readable without a lock.
+// Writers stage a new value per id while holding whatever lock guards its source, then publish. Publishing
+// works like the log's group commit: one writer builds the next version holding everything staged so far,
+// copying only the chunks of ids that changed, and the writers behind it find their values already out.
+template <typename T>
+class VersionedTable
+{
+private:
+    static const size_t CHUNK_BITS = 8;
+    static const size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+
+    struct Chunk
+    {
+        const T *values[CHUNK_SIZE] = {};
+    };
+
+    struct Version
+    {
+        vector<const Chunk *> chunks; // nullptr for a range of ids with no values yet
+        uint64_t number = 0;
+    };
+
+    atomic<const Version *> current;
+    mutex stageMutex; // Also held while a version is built, so stage() always starts from the newest value
+    vector<pair<uint32_t, unique_ptr<const T>>> staged; // Guarded by stageMutex; usually a handful of ids
+    uint64_t stagedTicket = 0;    // Guarded by stageMutex: values staged so far
+    uint64_t publishedTicket = 0; // Guarded by stageMutex: staged values that are visible
+
+public:
+    VersionedTable() : current(new Version()) {}
+
+    VersionedTable(const VersionedTable &) = delete;
+    VersionedTable &operator=(const VersionedTable &) = delete;
+
+    // Assumes no reader is left: frees the current version outright
+    ~VersionedTable()
+    {
+        const Version *version = current.load();
+        for (const Chunk *chunk : version->chunks)
+        {
+            if (chunk)
+            {
+                for (const T *value : chunk->values)
+                {
+                    delete value;
+                }
+                delete chunk;
+            }
+        }
+        delete version;
+    }
+
+    // The published value for `id`, nullptr if none. Valid until the caller's EpochGuard ends.
+    const T *find(uint32_t id) const
+    {
+        const Version *version = current.load();
+        size_t chunk = id >> CHUNK_BITS;
+        if (chunk >= version->chunks.size() || !version->chunks[chunk])
+        {
+            return nullptr;
+        }
+        return version->chunks[chunk]->values[id & (CHUNK_SIZE - 1)];
+    }
+
+    // Number of versions published so far
+    uint64_t version() const
+    {
+        return current.load()->number;
+    }
+
+    // Queues `value` to replace the value of `id` at the next publish; returns the ticket to publish through.
+    // For bulk loads: `id` must not be staged already.
+    uint64_t stage(uint32_t id, T value)
+    {
+        unique_ptr<const T> next = make_unique<const T>(move(value));
+        lock_guard<mutex> lock(stageMutex);
+        staged.emplace_back(id, move(next));
+        return ++stagedTicket;
+    }
+
+    // Stages update(newest) for `id`, where `newest` is its latest staged or published value (nullptr if none).
+    // Keep `update` short: staging for every id waits on it.
+    template <typename Update>
+    uint64_t stage(uint32_t id, Update update)
+    {
+        lock_guard<mutex> lock(stageMutex);
+        auto it = find_if(staged.begin(), staged.end(), [&](const pair<uint32_t, unique_ptr<const T>> &entry)
+                          { return entry.first == id; });
+        if (it != staged.end())
+        {
+            it->second = make_unique<const T>(update(it->second.get())); // The value it replaces was never visible
+        }
+        else
+        {
+            staged.emplace_back(id, make_unique<const T>(update(find(id)))); // Not retired while stageMutex is held
+        }
+        return ++stagedTicket;
+    }
+
+    // Returns once every value staged up to `ticket` is visible to readers
+    void publish(uint64_t ticket)
+    {
+        const Version *previous;
+        vector<const Chunk *> copiedFrom; // Chunks of `previous` replaced by copies
+        vector<const T *> replaced;
+        {
+            lock_guard<mutex> lock(stageMutex);
+            if (publishedTicket >= ticket)
+            {
+                return; // Published along with an earlier writer's batch
+            }
+            previous = current.load();
+            Version *next = new Version{previous->chunks, previous->number + 1};
+            for (auto &entry : staged)
+            {
+                size_t index = entry.first >> CHUNK_BITS;
+                if (index >= next->chunks.size())
+                {
+                    next->chunks.resize(index + 1, nullptr);
+                }
+                const Chunk *old = index < previous->chunks.size() ? previous->chunks[index] : nullptr;
+                if (next->chunks[index] == old)
+                {
+                    next->chunks[index] = old ? new Chunk(*old) : new Chunk();
+                    if (old)
+                    {
+                        copiedFrom.push_back(old);
+                    }
+                }
+                Chunk *chunk = const_cast<Chunk *>(next->chunks[index]); // Built by this call, not yet visible
+                const T *&slot = chunk->values[entry.first & (CHUNK_SIZE - 1)];
+                if (slot)
+                {
+                    replaced.push_back(slot);
+                }
+                slot = entry.second.release();
+            }
+            staged.clear();
+            publishedTicket = stagedTicket;
+            current.store(next);
+        }
+        EpochReclaimer &reclaimer = EpochReclaimer::instance();
+        for (const T *value : replaced)
+        {
+            reclaimer.retire(value);
+        }
+        for (const Chunk *chunk : copiedFrom)
+        {
+            reclaimer.retire(chunk);
+        }
+        reclaimer.retire(previous);
+        reclaimer.collect();
+    }
+};
+
+#endif // READ_VIEWS_H
@@ -0,0 +1,1201 @@
+#include "SocialMediaPlatform.h"
+#include "SocketProtocol.h"
+#include <csignal>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+using namespace std;
+
+// Socket front-end of the engine: one epoll loop owns every connection and hands request lines to a
+// work-stealing executor; see SocketProtocol.h for the wire format. Run with --help for the options.
+
+// Log records between background snapshots
+const uint64_t SNAPSHOT_INTERVAL = 10000;
+// Requests handed to a worker at once; a connection has at most one batch running, so its replies stay in order
+const size_t MAX_BATCH = 64;
+// Backpressure: stop reading from a connection while this much is waiting on it
+const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+const size_t MAX_QUEUED_REQUESTS = 1024;
+// Largest page a client may ask for
+const size_t MAX_PAGE = 100;
+
+// Per-connection login state
+struct Session
+{
+    User *user = nullptr;
+};
+
+static bool parseCount(const string &text, size_t &value)
+{
+    if (text.empty() || text.find_first_not_of("0123456789") != string::npos)
+    {
+        return false;
+    }
+    value = static_cast<size_t>(strtoull(text.c_str(), nullptr, 10));
+    return true;
+}
+
+static string messageLine(const MessageNode *node)
+{
+    return node->sender->getUsername() + ": " + node->message;
+}
+
+static vector<string> usernames(const vector<User *> &users)
+{
+    vector<string> names;
+    names.reserve(users.size());
+    for (User *user : users)
+    {
+        names.push_back(user->getUsername());
+    }
+    return names;
+}
+
+// File name made of `text` with anything but letters, digits, '-' and '_' replaced
+static string safeFileName(const string &text)
+{
+    string name = text;
+    for (char &c : name)
+    {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+        {
+            c = '_';
+        }
+    }
+    return name;
+}
+
+// Runs one request line against the engine and appends its reply line. Called on executor workers;
+// each Session is only ever used by one worker at a time.
+class RequestHandler
+{
+private:
+    UserManagement &userManagement;
+    PostManagement &postManagement;
+    FriendSystem &friendSystem;
+    MessagingSystem &messagingSystem;
+
+    bool isFriend(User *user, User *other) const
+    {
+        vector<User *> friends = friendSystem.getFriends(user);
+        return find(friends.begin(), friends.end(), other) != friends.end();
+    }
+
+    // Oldest first, preceded by the cursor of the page before it ("" when there is none)
+    static vector<string> historyFields(const HistoryPage &page)
+    {
+        vector<string> fields;
+        fields.push_back(page.hasMore ? to_string(page.cursor) : "");
+        for (const MessageNode *node : page.messages)
+        {
+            fields.push_back(messageLine(node));
+        }
+        return fields;
+    }
+
+    void run(Session &session, const vector<string> &request, string &out)
+    {
+        auto ok = [&](const vector<string> &fields)
+        { appendReply(out, true, fields); };
+        auto fail = [&](const string &reason)
+        { appendReply(out, false, {reason}); };
+        auto usage = [&](size_t arguments, const char *text)
+        {
+            if (request.size() < arguments + 1)
+            {
+                fail(string("usage: ") + text);
+                return false;
+            }
+            return true;
+        };
+        const string &command = request[0];
+        User *user = session.user;
+
+        if (command == "PING")
+        {
+            return ok({"PONG"});
+        }
+        if (command == "SIGNUP")
+        {
+            if (!usage(5, "SIGNUP username password email bio public(1|0)"))
+            {
+                return;
+            }
+            if (request[1].empty() || request[1].find(' ') != string::npos)
+            {
+                return fail("invalid username");
+            }
+            if (!userManagement.isValidEmail(request[3]))
+            {
+                return fail("invalid email");
+            }
+            if (!userManagement.registerUser(request[1], request[2], request[3], request[4], request[5] == "1"))
+            {
+                return fail("username taken");
+            }
+            return ok({});
+        }
+        if (command == "LOGIN")
+        {
+            if (!usage(2, "LOGIN username password"))
+            {
+                return;
+            }
+            session.user = userManagement.logIn(request[1], request[2]);
+            if (!session.user)
+            {
+                return fail("invalid username or password");
+            }
+            UnreadSummary unread = messagingSystem.getUnreadSummary(session.user);
+            return ok({to_string(unread.messages), to_string(unread.chats)});
+        }
+        if (command == "USERS")
+        {
+            return ok(usernames(userManagement.getAllUsers()));
+        }
+        if (!user)
+        {
+            return fail("not logged in");
+        }
+
+        // Account
+        if (command == "LOGOUT")
+        {
+            session.user = nullptr;
+            return ok({});
+        }
+        if (command == "PROFILE")
+        {
+            User *target = request.size() > 1 ? userManagement.findUserByUsername(request[1]) : user;
+            if (!target)
+            {
+                return fail("user not found");
+            }
+            if (target != user && !target->isProfilePublic())
+            {
+                return fail("profile is private");
+            }
+            return ok({target->getUsername(), target->getEmail(), target->getBio(), target->isProfilePublic() ? "1" : "0"});
+        }
+        if (command == "EDIT")
+        {
+            if (!usage(2, "EDIT username|bio|email|password|privacy value"))
+            {
+                return;
+            }
+            static const map<string, ProfileField> fields = {{"username", ProfileField::Username}, {"bio", ProfileField::Bio},
+                                                             {"email", ProfileField::Email}, {"password", ProfileField::Password},
+                                                             {"privacy", ProfileField::Privacy}};
+            auto field = fields.find(request[1]);
+            if (field == fields.end())
+            {
+                return fail("unknown field");
+            }
+            if (field->second == ProfileField::Email && !userManagement.isValidEmail(request[2]))
+            {
+                return fail("invalid email");
+            }
+            if (!userManagement.updateProfileField(user, field->second, request[2]))
+            {
+                return fail("username taken");
+            }
+            return ok({});
+        }
+
+        // Posts and comments
+        if (command == "POST")
+        {
+            if (!usage(1, "POST text"))
+            {
+                return;
+            }
+            postManagement.createPost(user, request[1]);
+            return ok({});
+        }
+        if (command == "MYPOSTS")
+        {
+            return ok(postManagement.getUserPosts(user));
+        }
+        if (command == "FRIENDPOSTS" || command == "PUBLICPOSTS")
+        {
+            vector<User *> authors = command == "FRIENDPOSTS" ? friendSystem.getFriends(user) : postManagement.getAuthors();
+            vector<string> fields;
+            for (User *author : authors)
+            {
+                if (command == "PUBLICPOSTS" && (author == user || !author->isProfilePublic()))
+                {
+                    continue;
+                }
+                string name = author->getUsername();
+                for (const string &post : postManagement.getUserPosts(author))
+                {
+                    fields.push_back(name + ": " + post);
+                }
+            }
+            return ok(fields);
+        }
+        if (command == "COMMENT")
+        {
+            if (!usage(2, "COMMENT post text"))
+            {
+                return;
+            }
+            postManagement.addComment(user, request[1], request[2]);
+            return ok({});
+        }
+        if (command == "COMMENTS")
+        {
+            if (!usage(1, "COMMENTS post"))
+            {
+                return;
+            }
+            return ok(postManagement.getCommentThread(request[1]));
+        }
+        if (command == "REPLY")
+        {
+            size_t index;
+            if (!usage(3, "REPLY post comment-index text"))
+            {
+                return;
+            }
+            vector<Comment *> comments = postManagement.getComments(request[1]);
+            if (!parseCount(request[2], index) || index >= comments.size())
+            {
+                return fail("comment not found");
+            }
+            postManagement.addReplyToComment(user, request[1], comments[index], request[3]);
+            return ok({});
+        }
+
+        // Friends
+        if (command == "ADDFRIEND" || command == "REMOVEFRIEND" || command == "MUTUAL")
+        {
+            if (!usage(1, "ADDFRIEND|REMOVEFRIEND|MUTUAL username"))
+            {
+                return;
+            }
+            User *other = userManagement.findUserByUsername(request[1]);
+            if (!other || other == user)
+            {
+                return fail("user not found");
+            }
+            if (command == "MUTUAL")
+            {
+                return ok({to_string(friendSystem.countMutualFriends(user, other))});
+            }
+            bool friends = isFriend(user, other);
+            if (command == "ADDFRIEND")
+            {
+                if (friends)
+                {
+                    return fail("already friends");
+                }
+                friendSystem.addFriend(user, other);
+            }
+            else
+            {
+                if (!friends)
+                {
+                    return fail("not a friend");
+                }
+                friendSystem.removeFriend(user, other);
+            }
+            return ok({});
+        }
+        if (command == "FRIENDS")
+        {
+            return ok(usernames(friendSystem.getFriends(user)));
+        }
+
+        // Direct messages
+        if (command == "SEND")
+        {
+            if (!usage(2, "SEND username message"))
+            {
+                return;
+            }
+            User *recipient = userManagement.findUserByUsername(request[1]);
+            if (!recipient || !isFriend(user, recipient))
+            {
+                return fail("you can only message your friends");
+            }
+            // Queued in the recipient's inbox once logged, so senders to a busy recipient never wait on its locks
+            messagingSystem.postMessage(user, recipient, request[2]);
+            return ok({});
+        }
+        if (command == "INBOX")
+        {
+            size_t limit = HISTORY_PAGE_SIZE;
+            if (request.size() > 1 && !parseCount(request[1], limit))
+            {
+                return fail("usage: INBOX [limit]");
+            }
+            vector<string> fields;
+            for (const InboxMessage &entry : messagingSystem.fetchNewMessages(user, min(max<size_t>(limit, 1), MAX_PAGE)))
+            {
+                fields.push_back(entry.group ? "[" + messagingSystem.getGroupName(entry.group) + "] " + messageLine(entry.node)
+                                             : messageLine(entry.node));
+            }
+            return ok(fields);
+        }
+        if (command == "UNREAD")
+        {
+            UnreadSummary unread = messagingSystem.getUnreadSummary(user);
+            return ok({to_string(unread.messages), to_string(unread.chats)});
+        }
+        if (command == "HISTORY")
+        {
+            size_t cursor = HISTORY_LATEST;
+            if (!usage(1, "HISTORY username [cursor]"))
+            {
+                return;
+            }
+            User *other = userManagement.findUserByUsername(request[1]);
+            if (!other)
+            {
+                return fail("user not found");
+            }
+            if (request.size() > 2 && !parseCount(request[2], cursor))
+            {
+                return fail("invalid cursor");
+            }
+            // Sent messages another thread is still delivering show up in the page
+            messagingSystem.deliverPending(user);
+            messagingSystem.deliverPending(other);
+            return ok(historyFields(messagingSystem.getChatHistoryPage(user, other, cursor)));
+        }
+        if (command == "SEARCH")
+        {
+            size_t cursor = SEARCH_LATEST;
+            if (!usage(1, "SEARCH query [cursor]"))
+            {
+                return;
+            }
+            if (request.size() > 2 && !parseCount(request[2], cursor))
+            {
+                return fail("invalid cursor");
+            }
+            SearchPage page = messagingSystem.searchMessages(user, request[1], cursor);
+            vector<string> fields;
+            fields.push_back(page.hasMore ? to_string(page.cursor) : "");
+            for (const SearchHit &hit : page.hits)
+            {
+                string where = hit.group ? messagingSystem.getGroupName(hit.group) : hit.partner->getUsername();
+                fields.push_back("[" + where + "] " + messageLine(hit.node));
+            }
+            return ok(fields);
+        }
+
+        // Groups
+        if (command == "GROUPS")
+        {
+            vector<string> fields;
+            for (const Group *group : messagingSystem.getUserGroups(user))
+            {
+                fields.push_back(messagingSystem.getGroupName(group) + " (" + to_string(messagingSystem.getUnreadCount(group, user)) + " unread)");
+            }
+            return ok(fields);
+        }
+        if (command == "GROUP_LIST")
+        {
+            size_t offset = 0;
+            if (request.size() > 1 && !parseCount(request[1], offset))
+            {
+                return fail("usage: GROUP_LIST [offset]");
+            }
+            vector<const Group *> groups = messagingSystem.getJoinableGroups(user, offset, MAX_PAGE);
+            vector<string> fields;
+            fields.push_back(groups.size() == MAX_PAGE ? to_string(offset + MAX_PAGE) : "");
+            for (const Group *group : groups)
+            {
+                fields.push_back(messagingSystem.getGroupName(group));
+            }
+            return ok(fields);
+        }
+        if (command.rfind("GROUP_", 0) == 0)
+        {
+            if (!usage(1, "GROUP_SEND|GROUP_HISTORY|GROUP_JOIN|GROUP_LEAVE|GROUP_RENAME|GROUP_FRIENDS name ..."))
+            {
+                return;
+            }
+            const string &groupName = request[1];
+            if (command == "GROUP_SEND")
+            {
+                if (!usage(2, "GROUP_SEND name message"))
+                {
+                    return;
+                }
+                if (!messagingSystem.sendMessageToGroup(user, groupName, request[2]))
+                {
+                    return fail("not a member of the group");
+                }
+                return ok({});
+            }
+            if (command == "GROUP_HISTORY")
+            {
+                size_t cursor = HISTORY_LATEST;
+                if (request.size() > 2 && !parseCount(request[2], cursor))
+                {
+                    return fail("invalid cursor");
+                }
+                if (!messagingSystem.isUserInGroup(groupName, user))
+                {
+                    return fail("not a member of the group");
+                }
+                return ok(historyFields(messagingSystem.getGroupChatHistoryPage(groupName, cursor)));
+            }
+            if (command == "GROUP_JOIN")
+            {
+                if (!messagingSystem.addUserToGroup(groupName, user))
+                {
+                    return fail("group not found or already a member");
+                }
+                return ok({});
+            }
+            if (command == "GROUP_LEAVE")
+            {
+                const Group *group = messagingSystem.findGroupByName(groupName);
+                if (!group || !messagingSystem.removeUserFromGroup(group->groupId, user))
+                {
+                    return fail("not a member of the group");
+                }
+                return ok({});
+            }
+            if (command == "GROUP_RENAME")
+            {
+                if (!usage(2, "GROUP_RENAME name new-name"))
+                {
+                    return;
+                }
+                if (!messagingSystem.renameGroup(groupName, request[2], user))
+                {
+                    return fail("cannot rename the group");
+                }
+                return ok({});
+            }
+            if (command == "GROUP_FRIENDS")
+            {
+                return ok(usernames(messagingSystem.friendsInGroup(groupName, user, friendSystem)));
+            }
+        }
+        fail("unknown command");
+    }
+
+    static bool isLongRunning(const string &command)
+    {
+        return command == "SUGGEST" || command == "EXPORT" || command == "GROUP_EXPORT" || command == "GROUP_CREATE";
+    }
+
+    // Requests whose work grows with the social graph or a history; they yield every quantum
+    Task<void> runLong(Session &session, const vector<string> &request, string &out, QueryContext &context)
+    {
+        auto ok = [&](const vector<string> &fields)
+        { appendReply(out, true, fields); };
+        auto fail = [&](const string &reason)
+        { appendReply(out, false, {reason}); };
+        const string &command = request[0];
+        User *user = session.user;
+
+        if (command == "SUGGEST")
+        {
+            co_return ok(usernames(co_await friendSystem.suggestFriendsAsync(user, context)));
+        }
+        if (request.size() < 2)
+        {
+            co_return fail("usage: " + command + (command == "EXPORT" ? " username" : command == "GROUP_EXPORT" ? " name" : " name [member...]"));
+        }
+        if (command == "EXPORT" || command == "GROUP_EXPORT")
+        {
+            string path;
+            if (command == "EXPORT")
+            {
+                User *other = userManagement.findUserByUsername(request[1]);
+                if (!other)
+                {
+                    co_return fail("user not found");
+                }
+                path = exportDirectory + "/" + safeFileName(user->getUsername() + "-" + other->getUsername()) + ".txt";
+                ofstream file(path, ios::trunc);
+                size_t written = co_await messagingSystem.exportChatHistory(user, other, file, context);
+                co_return file.flush() ? ok({path, to_string(written)}) : fail("could not write " + path);
+            }
+            const Group *group = messagingSystem.findGroupByName(request[1]);
+            if (!group || !messagingSystem.isUserInGroup(request[1], user))
+            {
+                co_return fail("not a member of the group");
+            }
+            path = exportDirectory + "/" + safeFileName(group->groupId) + ".txt";
+            ofstream file(path, ios::trunc);
+            size_t written = co_await messagingSystem.exportGroupHistory(request[1], file, context);
+            co_return file.flush() ? ok({path, to_string(written)}) : fail("could not write " + path);
+        }
+        // GROUP_CREATE: adding a long member list is a fan-out of membership writes
+        if (friendSystem.getFriends(user).empty())
+        {
+            co_return fail("you need at least one friend to create a group");
+        }
+        Group *group = messagingSystem.createGroup(request[1]);
+        if (!group)
+        {
+            co_return fail("group already exists");
+        }
+        messagingSystem.addUserToGroup(request[1], user);
+        vector<User *> members;
+        for (size_t i = 2; i < request.size(); i++)
+        {
+            User *member = userManagement.findUserByUsername(request[i]);
+            if (member && member != user)
+            {
+                members.push_back(member);
+            }
+        }
+        vector<string> fields = {group->groupId};
+        for (const string &name : usernames(co_await messagingSystem.addUsersToGroup(request[1], members, context)))
+        {
+            fields.push_back(name);
+        }
+        if (wal && !wal->healthy())
+        {
+            co_return fail("change not saved to the log"); // The membership writes ran on whichever workers resumed the task
+        }
+        ok(fields); // Group id, then the members that were added
+    }
+
+public:
+    WorkStealingExecutor *executor = nullptr;      // Long requests yield to it between quanta
+    chrono::milliseconds queryTimeout{2000};       // Deadline of each long request
+    string exportDirectory = "exports";
+    WriteAheadLog *wal = nullptr;                  // Checked after long writes, whose appends span threads
+
+    RequestHandler(UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem, MessagingSystem &messagingSystem)
+        : userManagement(userManagement), postManagement(postManagement), friendSystem(friendSystem), messagingSystem(messagingSystem) {}
+
+    // `cancelled` stops a long request at its next yield (the client went away)
+    Task<void> handle(Session &session, const string &line, string &out, const atomic<bool> &cancelled)
+    {
+        vector<string> request = splitFields(line);
+        try
+        {
+            if (session.user && isLongRunning(request[0]))
+            {
+                QueryContext context;
+                context.executor = executor;
+                context.cancelled = &cancelled;
+                context.deadline = chrono::steady_clock::now() + queryTimeout;
+                co_await runLong(session, request, out, context);
+            }
+            else
+            {
+                // A change that did not reach the log is answered ERR even though memory already has it
+                size_t replyStart = out.size();
+                uint64_t failuresBefore = walAppendFailures;
+                run(session, request, out);
+                if (walAppendFailures != failuresBefore)
+                {
+                    out.resize(replyStart);
+                    appendReply(out, false, {"change not saved to the log"});
+                }
+            }
+        }
+        catch (const TaskStopped &stopped)
+        {
+            appendReply(out, false, {stopped.what()});
+        }
+        catch (const exception &error)
+        {
+            appendReply(out, false, {string("internal error: ") + error.what()});
+        }
+    }
+};
+
+// Everything the event loop knows about one client
+struct Connection
+{
+    int fd;
+    LineReader input;
+    string output;         // Replies not yet sent, from `outputSent` on
+    size_t outputSent = 0;
+    deque<string> requests; // Complete request lines not yet handed to a worker
+    bool busy = false;      // One of this connection's batches is on a worker
+    atomic<bool> closed{false}; // Cancels the long request its batch may be running
+    bool peerClosed = false; // The client shut down its side; finish its requests, then close
+    uint32_t interest = 0;  // Events registered with epoll
+    Session session;        // Used only by the worker running this connection's batch
+
+    explicit Connection(int fd) : fd(fd) {}
+
+    size_t pendingOutput() const
+    {
+        return output.size() - outputSent;
+    }
+};
+
+// Replies of one batch, handed back to the event loop
+struct Completion
+{
+    shared_ptr<Connection> connection;
+    string replies;
+};
+
+// Level-triggered epoll loop. Only the loop thread touches sockets and connection buffers; workers get
+// a batch of lines and return a block of replies through the completion queue, then wake the loop.
+class SocketServer
+{
+private:
+    RequestHandler &handler;
+    WorkStealingExecutor &executor;
+    int listenFd;
+    int signalFd;
+    int epollFd = -1;
+    int wakeFd = -1;
+    bool tcp;
+    unordered_map<int, shared_ptr<Connection>> connections;
+    mutex completionMutex;
+    vector<Completion> completions; // Guarded by completionMutex
+    size_t inFlight = 0;  // Batches on workers
+    bool holding = false; // Dispatch paused until the workers drain, for a checkpoint
+    bool stopping = false;
+
+    void watch(int fd, uint32_t events, int op)
+    {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, op, fd, &event);
+    }
+
+    void updateInterest(Connection &connection)
+    {
+        uint32_t wanted = 0;
+        if (!stopping && !connection.peerClosed && connection.pendingOutput() < MAX_PENDING_OUTPUT &&
+            connection.requests.size() < MAX_QUEUED_REQUESTS)
+        {
+            wanted |= EPOLLIN;
+        }
+        if (connection.pendingOutput() > 0)
+        {
+            wanted |= EPOLLOUT;
+        }
+        if (wanted != connection.interest)
+        {
+            watch(connection.fd, wanted, EPOLL_CTL_MOD);
+            connection.interest = wanted;
+        }
+    }
+
+    void closeConnection(const shared_ptr<Connection> &connection)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        close(connection->fd);
+        connections.erase(connection->fd);
+        connection->closed = true;
+        connection->fd = -1; // A batch still running for it is dropped when it completes
+    }
+
+    void acceptAll()
+    {
+        while (true)
+        {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    cerr << "accept: " << strerror(errno) << endl;
+                }
+                return;
+            }
+            if (tcp)
+            {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            shared_ptr<Connection> connection = make_shared<Connection>(fd);
+            connection->interest = EPOLLIN;
+            connections[fd] = connection;
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    // False if the connection failed and was closed
+    bool readRequests(const shared_ptr<Connection> &connection)
+    {
+        char buffer[64 * 1024];
+        for (int reads = 0; reads < 4; reads++) // Bounded, so one busy client cannot starve the others
+        {
+            ssize_t received = read(connection->fd, buffer, sizeof(buffer));
+            if (received == 0)
+            {
+                connection->peerClosed = true;
+                break;
+            }
+            if (received < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    break;
+                }
+                closeConnection(connection);
+                return false;
+            }
+            connection->input.append(buffer, static_cast<size_t>(received));
+            string line;
+            while (connection->input.next(line))
+            {
+                connection->requests.push_back(move(line));
+            }
+            if (connection->input.partial() > MAX_REQUEST_LINE)
+            {
+                closeConnection(connection);
+                return false;
+            }
+            if (static_cast<size_t>(received) < sizeof(buffer))
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool flush(const shared_ptr<Connection> &connection)
+    {
+        while (connection->pendingOutput() > 0)
+        {
+            ssize_t sent = send(connection->fd, connection->output.data() + connection->outputSent, connection->pendingOutput(),
+                                MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                {
+                    break;
+                }
+                closeConnection(connection);
+                return false;
+            }
+            connection->outputSent += static_cast<size_t>(sent);
+        }
+        if (connection->pendingOutput() == 0)
+        {
+            connection->output.clear();
+            connection->outputSent = 0;
+        }
+        else if (connection->outputSent > connection->output.size() / 2)
+        {
+            connection->output.erase(0, connection->outputSent);
+            connection->outputSent = 0;
+        }
+        return true;
+    }
+
+    void dispatch(const shared_ptr<Connection> &connection)
+    {
+        if (holding || connection->busy || connection->requests.empty())
+        {
+            return;
+        }
+        size_t count = min(MAX_BATCH, connection->requests.size());
+        vector<string> batch(make_move_iterator(connection->requests.begin()), make_move_iterator(connection->requests.begin() + count));
+        connection->requests.erase(connection->requests.begin(), connection->requests.begin() + count);
+        connection->busy = true;
+        inFlight++;
+        spawnTask(executor, runBatch(connection, move(batch)));
+    }
+
+    Task<void> runBatch(shared_ptr<Connection> connection, vector<string> batch)
+    {
+        Completion done{connection, string()};
+        for (const string &line : batch)
+        {
+            co_await handler.handle(connection->session, line, done.replies, connection->closed);
+        }
+        lock_guard<mutex> lock(completionMutex); // Held through the wake-up, so the loop cannot finish and close wakeFd first
+        completions.push_back(move(done));
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    // Sends what it can, queues the next batch, and closes the connection once a departed client is fully answered
+    void progress(const shared_ptr<Connection> &connection)
+    {
+        if (!flush(connection))
+        {
+            return;
+        }
+        dispatch(connection);
+        if (connection->peerClosed && !connection->busy && connection->requests.empty() && connection->pendingOutput() == 0)
+        {
+            closeConnection(connection);
+            return;
+        }
+        updateInterest(*connection);
+    }
+
+    void collectCompletions()
+    {
+        uint64_t count;
+        ssize_t ignored = read(wakeFd, &count, sizeof(count));
+        (void)ignored;
+        vector<Completion> done;
+        {
+            lock_guard<mutex> lock(completionMutex);
+            done.swap(completions);
+        }
+        for (Completion &completion : done)
+        {
+            inFlight--;
+            shared_ptr<Connection> &connection = completion.connection;
+            connection->busy = false;
+            if (connection->fd < 0)
+            {
+                continue; // Closed while its batch ran
+            }
+            connection->output += completion.replies;
+            progress(connection);
+        }
+    }
+
+    void beginShutdown()
+    {
+        stopping = true;
+        holding = false;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+        vector<shared_ptr<Connection>> open;
+        for (auto &entry : connections)
+        {
+            open.push_back(entry.second);
+        }
+        for (shared_ptr<Connection> &connection : open)
+        {
+            progress(connection); // Requests already read are still answered
+        }
+    }
+
+public:
+    // Checkpoint hooks: while needsQuiescence() is true no new batch starts; once none is running,
+    // quiesced() is called with the engine idle, then dispatch resumes
+    function<bool()> needsQuiescence = []()
+    { return false; };
+    function<void()> quiesced = []() {};
+
+    SocketServer(RequestHandler &handler, WorkStealingExecutor &executor, int listenFd, int signalFd, bool tcp)
+        : handler(handler), executor(executor), listenFd(listenFd), signalFd(signalFd), tcp(tcp) {}
+
+    ~SocketServer()
+    {
+        for (auto &entry : connections)
+        {
+            close(entry.first);
+        }
+        if (wakeFd >= 0)
+        {
+            close(wakeFd);
+        }
+        if (epollFd >= 0)
+        {
+            close(epollFd);
+        }
+    }
+
+    // Serves until a signal arrives on signalFd, then answers what was already received and returns
+    bool run()
+    {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0)
+        {
+            cerr << "epoll: " << strerror(errno) << endl;
+            return false;
+        }
+        watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(signalFd, EPOLLIN, EPOLL_CTL_ADD);
+        epoll_event events[256];
+        while (!stopping || inFlight > 0)
+        {
+            int ready = epoll_wait(epollFd, events, 256, -1);
+            if (ready < 0 && errno != EINTR)
+            {
+                cerr << "epoll_wait: " << strerror(errno) << endl;
+                return false;
+            }
+            for (int i = 0; i < ready; i++)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listenFd)
+                {
+                    acceptAll();
+                }
+                else if (fd == wakeFd)
+                {
+                    collectCompletions();
+                }
+                else if (fd == signalFd)
+                {
+                    signalfd_siginfo info;
+                    ssize_t ignored = read(signalFd, &info, sizeof(info));
+                    (void)ignored;
+                    if (!stopping)
+                    {
+                        beginShutdown();
+                    }
+                }
+                else
+                {
+                    auto found = connections.find(fd);
+                    if (found == connections.end())
+                    {
+                        continue; // Closed earlier in this round
+                    }
+                    shared_ptr<Connection> connection = found->second;
+                    if (events[i].events & (EPOLLHUP | EPOLLERR))
+                    {
+                        closeConnection(connection); // Nobody left to read the replies
+                        continue;
+                    }
+                    if ((events[i].events & EPOLLIN) && !readRequests(connection))
+                    {
+                        continue;
+                    }
+                    progress(connection);
+                }
+            }
+            if (!stopping && !holding && needsQuiescence())
+            {
+                holding = true;
+            }
+            if (holding && inFlight == 0)
+            {
+                quiesced();
+                holding = false;
+                vector<shared_ptr<Connection>> waiting;
+                for (auto &entry : connections)
+                {
+                    waiting.push_back(entry.second);
+                }
+                for (shared_ptr<Connection> &connection : waiting)
+                {
+                    progress(connection);
+                }
+            }
+        }
+        for (auto &entry : connections)
+        {
+            flush(entry.second); // Best effort: replies a client is not reading are dropped
+        }
+        return true;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    Endpoint endpoint;
+    ExecutorOptions executorOptions;
+    long queryTimeoutMillis = 2000;
+    string exportDirectory = "exports";
+    string walPath = "college_connect.wal";
+    string snapshotPath = "college_connect.snap";
+    DurabilityMode durability = DurabilityMode::Batched;
+    bool metrics = false;
+    string tracePath;
+    uint64_t traceSampleEvery = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--socket=", 0) == 0)
+        {
+            endpoint.socketPath = arg.substr(9);
+            endpoint.port = 0;
+        }
+        else if (arg.rfind("--port=", 0) == 0)
+        {
+            endpoint.port = atoi(arg.c_str() + 7);
+        }
+        else if (arg.rfind("--threads=", 0) == 0)
+        {
+            executorOptions.threads = strtoull(arg.c_str() + 10, nullptr, 10);
+        }
+        else if (arg.rfind("--batch-workers=", 0) == 0)
+        {
+            executorOptions.batchWorkers = strtoull(arg.c_str() + 16, nullptr, 10);
+        }
+        else if (arg == "--pin-workers")
+        {
+            executorOptions.pinWorkers = true;
+        }
+        else if (arg.rfind("--query-timeout=", 0) == 0)
+        {
+            queryTimeoutMillis = max(1L, atol(arg.c_str() + 16));
+        }
+        else if (arg.rfind("--export-dir=", 0) == 0)
+        {
+            exportDirectory = arg.substr(13);
+        }
+        else if (arg.rfind("--wal=", 0) == 0)
+        {
+            walPath = arg.substr(6);
+        }
+        else if (arg.rfind("--snapshot=", 0) == 0)
+        {
+            snapshotPath = arg.substr(11);
+        }
+        else if (arg == "--durability=none")
+        {
+            durability = DurabilityMode::None;
+        }
+        else if (arg == "--durability=sync")
+        {
+            durability = DurabilityMode::Sync;
+        }
+        else if (arg == "--durability=batched")
+        {
+            durability = DurabilityMode::Batched;
+        }
+        else if (arg == "--metrics")
+        {
+            metrics = true;
+        }
+        else if (arg.rfind("--trace=", 0) == 0)
+        {
+            tracePath = arg.substr(8);
+        }
+        else if (arg.rfind("--trace-sample=", 0) == 0)
+        {
+            traceSampleEvery = max<uint64_t>(1, strtoull(arg.c_str() + 15, nullptr, 10));
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--socket=path | --port=N] [--threads=N] [--batch-workers=N] [--pin-workers] [--query-timeout=MS] [--export-dir=path] [--wal=path] [--snapshot=path]"
+                 << " [--durability=none|batched|sync] [--metrics] [--trace=path] [--trace-sample=N]" << endl;
+            return 1;
+        }
+    }
+    // Blocked before any thread starts so every thread inherits the mask; shutdown arrives through signalFd
+    sigset_t shutdownSignals;
+    sigemptyset(&shutdownSignals);
+    sigaddset(&shutdownSignals, SIGINT);
+    sigaddset(&shutdownSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdownSignals, nullptr);
+    int signalFd = signalfd(-1, &shutdownSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    QuietConsole quiet; // The engine narrates to cout for the interactive app; the server reports on cerr
+    WorkStealingExecutor::configureShared(executorOptions); // Requests, snapshot loading and snapshot writing share its workers
+    WorkStealingExecutor &executor = WorkStealingExecutor::shared();
+
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    RetentionPolicy retention;
+    retention.maxHotMessages = 1000;
+    messagingSystem.setRetentionPolicy(retention, userManagement);
+    uint64_t snapshotLsn = 0;
+    if (loadSnapshot(snapshotPath, userManagement, postManagement, friendSystem, messagingSystem, snapshotLsn))
+    {
+        cerr << "Loaded snapshot " << snapshotPath << endl;
+    }
+    else if (ifstream(snapshotPath))
+    {
+        cerr << "Snapshot " << snapshotPath << " is damaged; rebuilding from the log" << endl;
+    }
+    WalReplayResult recovered = replayWriteAheadLog(walPath, snapshotLsn, userManagement, postManagement, friendSystem, messagingSystem);
+    recovered.lastLsn = max(recovered.lastLsn, snapshotLsn);
+    WriteAheadLog wal;
+    BackgroundSnapshotWriter snapshotWriter;
+    if (wal.open(walPath, durability, recovered))
+    {
+        userManagement.attachWriteAheadLog(&wal);
+        postManagement.attachWriteAheadLog(&wal);
+        friendSystem.attachWriteAheadLog(&wal);
+        messagingSystem.attachWriteAheadLog(&wal);
+        if (recovered.records > 0)
+        {
+            cerr << "Restored " << recovered.records << " changes from " << walPath << endl;
+        }
+    }
+    else
+    {
+        cerr << "Could not open " << walPath << "; changes will not be saved." << endl;
+    }
+    // Derived data such as the search postings is maintained by subscribers, off the request path
+    EventBus events;
+    userManagement.attachEventBus(&events);
+    postManagement.attachEventBus(&events);
+    friendSystem.attachEventBus(&events);
+    messagingSystem.attachEventBus(&events, userManagement);
+    Metrics::enable(metrics);
+    if (!tracePath.empty())
+    {
+        Tracer::setSampling(traceSampleEvery);
+    }
+
+    string error;
+    int listenFd = listenOn(endpoint, error);
+    if (listenFd < 0 || signalFd < 0)
+    {
+        cerr << "Could not listen on " << endpoint.describe() << ": " << (listenFd < 0 ? error : strerror(errno)) << endl;
+        return 1;
+    }
+    error_code ignored;
+    filesystem::create_directories(exportDirectory, ignored);
+    RequestHandler handler(userManagement, postManagement, friendSystem, messagingSystem);
+    handler.queryTimeout = chrono::milliseconds(queryTimeoutMillis);
+    handler.exportDirectory = exportDirectory;
+    handler.wal = wal.isOpen() ? &wal : nullptr;
+    bool served;
+    {
+        handler.executor = &executor;
+        SocketServer server(handler, executor, listenFd, signalFd, endpoint.port != 0);
+        // Snapshots are captured between batches, when no worker is inside the engine
+        server.needsQuiescence = [&]()
+        { return wal.isOpen() && wal.lastLsn() - snapshotLsn >= SNAPSHOT_INTERVAL && !snapshotWriter.writing(); };
+        server.quiesced = [&]()
+        {
+            // The log rolls over with the snapshot; the rolled-over file is deleted once the snapshot is on disk
+            uint64_t lsn = wal.lastLsn();
+            string image = captureSnapshot(userManagement, postManagement, friendSystem, messagingSystem, lsn);
+            wal.rollOver();
+            if (snapshotWriter.start(snapshotPath, move(image), [&wal]()
+                                     { wal.dropRolledOver(); }))
+            {
+                snapshotLsn = lsn;
+            }
+        };
+        cerr << "Listening on " << endpoint.describe() << " with " << executor.size() << " worker threads" << endl;
+        served = server.run();
+    }
+    close(listenFd);
+    close(signalFd);
+    if (!endpoint.port)
+    {
+        unlink(endpoint.socketPath.c_str());
+    }
+
+    snapshotWriter.wait();
+    if (wal.isOpen() && wal.lastLsn() != snapshotLsn)
+    {
+        string image = captureSnapshot(userManagement, postManagement, friendSystem, messagingSystem, wal.lastLsn());
+        wal.rollOver();
+        if (writeSnapshotFile(snapshotPath, image))
+        {
+            wal.dropRolledOver();
+        }
+        else
+        {
+            cerr << "Could not write snapshot " << snapshotPath << endl;
+        }
+    }
+    if (!tracePath.empty() && !Tracer::writeChromeTrace(tracePath))
+    {
+        cerr << "Could not write trace " << tracePath << endl;
+    }
+    if (Metrics::enabled())
+    {
+        Metrics::report(cerr);
+        events.report(cerr);
+    }
+    return served ? 0 : 1;
+}
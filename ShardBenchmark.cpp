@@ -0,0 +1,170 @@
+// Write throughput of the sharded engine (ShardedPlatform.h) for 1, 2, 4, ... shards, against the managers
+// shared by all client threads. Clients issue a mix of posts, direct messages and friend requests between
+// random users, naming users as a request would.
+//
+// Build: make shard_benchmark
+// Usage: ./shard_benchmark [operations per client] [client threads] [max shards] [users]
+#include "ShardedPlatform.h"
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace std;
+
+const size_t WINDOW = 256; // Operations a client keeps in flight on the sharded engine
+
+enum class WriteKind
+{
+    Post,
+    Message,
+    Friend
+};
+
+struct WriteOp
+{
+    WriteKind kind;
+    size_t user;
+    size_t other;
+};
+
+// Half posts, 30% direct messages, 20% friend requests; the same sequence for every engine
+static vector<WriteOp> makeOps(size_t count, size_t users, uint64_t seed)
+{
+    mt19937_64 random(seed);
+    vector<WriteOp> ops(count);
+    for (WriteOp &op : ops)
+    {
+        size_t roll = random() % 10;
+        op.kind = roll < 5 ? WriteKind::Post : roll < 8 ? WriteKind::Message : WriteKind::Friend;
+        op.user = random() % users;
+        op.other = (op.user + 1 + random() % (users - 1)) % users;
+    }
+    return ops;
+}
+
+static string userName(size_t index)
+{
+    return "user" + to_string(index);
+}
+
+// Runs every client's ops through `runClient` on its own thread; returns operations per second
+template <typename Client>
+double timeClients(const vector<vector<WriteOp>> &ops, Client runClient)
+{
+    size_t total = 0;
+    auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (const vector<WriteOp> &mine : ops)
+    {
+        total += mine.size();
+        clients.emplace_back(runClient, cref(mine));
+    }
+    for (thread &client : clients)
+    {
+        client.join();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return total / elapsed.count();
+}
+
+static double runShared(const vector<vector<WriteOp>> &ops, size_t users)
+{
+    QuietConsole quiet; // The managers narrate every change
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    for (size_t i = 0; i < users; i++)
+    {
+        userManagement.registerUser(userName(i), "secret", userName(i) + "@bench.test", "", true);
+    }
+    return timeClients(ops, [&](const vector<WriteOp> &mine)
+                       {
+        for (const WriteOp &op : mine)
+        {
+            User *user = userManagement.findUserByUsername(userName(op.user));
+            User *other = userManagement.findUserByUsername(userName(op.other));
+            switch (op.kind)
+            {
+            case WriteKind::Post:
+                postManagement.createPost(user, "post from " + userName(op.user));
+                break;
+            case WriteKind::Message:
+                messagingSystem.sendMessage(user, other, "hello");
+                break;
+            case WriteKind::Friend:
+                friendSystem.addFriend(user, other);
+                break;
+            }
+        } });
+}
+
+static double runSharded(const vector<vector<WriteOp>> &ops, size_t users, size_t shardCount)
+{
+    QuietConsole quiet;
+    ShardOptions options;
+    options.shards = shardCount;
+    ShardedPlatform platform(options);
+    vector<future<bool>> signedUp;
+    for (size_t i = 0; i < users; i++)
+    {
+        signedUp.push_back(platform.registerUser(userName(i), "secret", userName(i) + "@bench.test", "", true));
+    }
+    for (future<bool> &done : signedUp)
+    {
+        done.get();
+    }
+    return timeClients(ops, [&](const vector<WriteOp> &mine)
+                       {
+        deque<future<bool>> pending;
+        for (const WriteOp &op : mine)
+        {
+            if (pending.size() >= WINDOW)
+            {
+                pending.front().get();
+                pending.pop_front();
+            }
+            switch (op.kind)
+            {
+            case WriteKind::Post:
+                pending.push_back(platform.createPost(userName(op.user), "post from " + userName(op.user)));
+                break;
+            case WriteKind::Message:
+                pending.push_back(platform.sendMessage(userName(op.user), userName(op.other), "hello"));
+                break;
+            case WriteKind::Friend:
+                pending.push_back(platform.addFriend(userName(op.user), userName(op.other)));
+                break;
+            }
+        }
+        for (future<bool> &done : pending)
+        {
+            done.get();
+        } });
+}
+
+int main(int argc, char **argv)
+{
+    size_t opsPerClient = argc > 1 ? strtoull(argv[1], nullptr, 10) : 50000;
+    size_t clients = argc > 2 ? strtoull(argv[2], nullptr, 10) : max(2u, thread::hardware_concurrency());
+    size_t maxShards = argc > 3 ? strtoull(argv[3], nullptr, 10) : max(4u, thread::hardware_concurrency());
+    size_t users = argc > 4 ? max<size_t>(2, strtoull(argv[4], nullptr, 10)) : 10000;
+    vector<vector<WriteOp>> ops;
+    for (size_t c = 0; c < clients; c++)
+    {
+        ops.push_back(makeOps(opsPerClient, users, 0x5eed + c));
+    }
+    cout << fixed << setprecision(2) << "engine,shards,ops_per_sec,speedup" << endl;
+    double shared = runShared(ops, users);
+    cout << "shared,1," << static_cast<long long>(shared) << "," << 1.0 << endl;
+    for (size_t shards = 1; shards <= maxShards; shards *= 2)
+    {
+        double rate = runSharded(ops, users, shards);
+        cout << "sharded," << shards << "," << static_cast<long long>(rate) << "," << rate / shared << endl;
+    }
+    return 0;
+}
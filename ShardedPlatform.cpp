@@ -0,0 +1,620 @@
+#include "ShardedPlatform.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+Shard::Shard(ShardedPlatform &platform, size_t index, size_t shardCount, size_t mailboxCapacity)
+    : platform(platform), mailbox(mailboxCapacity), outboxes(shardCount), index(index)
+{
+}
+
+Shard *&Shard::running()
+{
+    static thread_local Shard *shard = nullptr;
+    return shard;
+}
+
+bool Shard::isHome(const string &username) const
+{
+    return platform.shardOf(username) == index;
+}
+
+User *Shard::find(const string &username)
+{
+    return userManagement.findUserByUsername(username);
+}
+
+User *Shard::local(const string &username)
+{
+    User *user = find(username);
+    if (user || isHome(username))
+    {
+        return user;
+    }
+    // Stand-in: no password or profile, and never logged in, since log in goes to the home shard
+    return userManagement.registerUser(username, "", "", "", false);
+}
+
+void Shard::send(size_t shard, ShardCommand command)
+{
+    if (shard == index)
+    {
+        command(*this);
+        return;
+    }
+    platform.inFlight++;
+    outboxes[shard].push_back(move(command));
+}
+
+bool Shard::push(vector<ShardCommand> &batch)
+{
+    if (!mailbox.tryPushFrom(batch))
+    {
+        return false;
+    }
+    queued++;
+    if (sleeping.load())
+    {
+        {
+            lock_guard<mutex> lock(wakeMutex); // Orders the wake-up after the shard's last look at `queued`
+        }
+        wakeUp.notify_one();
+    }
+    return true;
+}
+
+bool Shard::flushOutboxes()
+{
+    bool flushed = true;
+    for (size_t i = 0; i < outboxes.size(); i++)
+    {
+        if (outboxes[i].empty())
+        {
+            continue;
+        }
+        if (platform.shards[i]->push(outboxes[i]))
+        {
+            outboxes[i].clear();
+        }
+        else
+        {
+            flushed = false; // Kept for the next round; this shard goes on draining its own mailbox meanwhile
+        }
+    }
+    return flushed;
+}
+
+void Shard::recover(const ShardOptions &options)
+{
+    if (options.walPrefix.empty())
+    {
+        return;
+    }
+    string path = options.walPrefix + "." + to_string(index);
+    WalReplayResult recovered = replayWriteAheadLog(path, 0, userManagement, postManagement, friendSystem, messagingSystem);
+    recoveredRecords = recovered.records;
+    if (wal.open(path, options.durability, recovered))
+    {
+        userManagement.attachWriteAheadLog(&wal);
+        postManagement.attachWriteAheadLog(&wal);
+        friendSystem.attachWriteAheadLog(&wal);
+        messagingSystem.attachWriteAheadLog(&wal);
+    }
+    else
+    {
+        cerr << "Could not open " << path << "; changes to shard " << index << " will not be saved." << endl;
+    }
+}
+
+void Shard::run(const ShardOptions &options, promise<void> &recovered, int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    running() = this;
+    recover(options); // Shards replay their logs in parallel
+    recovered.set_value();
+    while (true)
+    {
+        size_t drained = mailbox.drain([&](vector<ShardCommand> &&batch)
+                                       {
+            for (ShardCommand &command : batch)
+            {
+                command(*this);
+                platform.inFlight--;
+            } },
+                                       DRAIN_BATCHES);
+        queued -= static_cast<int64_t>(drained);
+        bool flushed = flushOutboxes();
+        if (drained > 0)
+        {
+            continue;
+        }
+        if (!flushed)
+        {
+            this_thread::yield(); // A destination is full and this mailbox is empty: let the other shards catch up
+            continue;
+        }
+        unique_lock<mutex> lock(wakeMutex);
+        sleeping = true;
+        wakeUp.wait(lock, [&]()
+                    { return stopping || queued.load() > 0; });
+        sleeping = false;
+        if (stopping && queued.load() <= 0)
+        {
+            return;
+        }
+    }
+}
+
+ShardedPlatform::ShardedPlatform(const ShardOptions &options)
+{
+    size_t cores = max(1u, thread::hardware_concurrency());
+    size_t count = options.shards ? options.shards : cores;
+    for (size_t i = 0; i < count; i++)
+    {
+        shards.push_back(make_unique<Shard>(*this, i, count, options.mailboxCapacity));
+    }
+    vector<promise<void>> recovered(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        shards[i]->worker = thread(&Shard::run, shards[i].get(), cref(options), ref(recovered[i]), options.pinShards ? static_cast<int>(i % cores) : -1);
+    }
+    for (promise<void> &shard : recovered)
+    {
+        shard.get_future().wait();
+    }
+}
+
+ShardedPlatform::~ShardedPlatform()
+{
+    while (inFlight.load() > 0)
+    {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    for (unique_ptr<Shard> &shard : shards)
+    {
+        {
+            lock_guard<mutex> lock(shard->wakeMutex);
+            shard->stopping = true;
+        }
+        shard->wakeUp.notify_one();
+    }
+    for (unique_ptr<Shard> &shard : shards)
+    {
+        shard->worker.join();
+    }
+}
+
+uint64_t ShardedPlatform::restoredRecords() const
+{
+    uint64_t records = 0;
+    for (const unique_ptr<Shard> &shard : shards)
+    {
+        records += shard->recoveredRecords;
+    }
+    return records;
+}
+
+void ShardedPlatform::post(size_t shard, ShardCommand command)
+{
+    Shard *self = Shard::running();
+    if (self && &self->platform == this)
+    {
+        self->send(shard, move(command));
+        return;
+    }
+    inFlight++;
+    vector<ShardCommand> batch;
+    batch.push_back(move(command));
+    while (!shards[shard]->push(batch))
+    {
+        this_thread::yield(); // Mailbox full: back off until the shard catches up
+    }
+}
+
+static vector<string> usernames(const vector<User *> &users)
+{
+    vector<string> names;
+    names.reserve(users.size());
+    for (User *user : users)
+    {
+        names.push_back(user->getUsername());
+    }
+    return names;
+}
+
+static vector<string> messageLines(const HistoryPage &page)
+{
+    vector<string> lines;
+    lines.reserve(page.messages.size());
+    for (const MessageNode *node : page.messages)
+    {
+        lines.push_back(node->sender->getUsername() + ": " + node->message);
+    }
+    return lines;
+}
+
+static bool hasFriendNamed(FriendSystem &friendSystem, User *user, const string &friendName)
+{
+    for (User *friendUser : friendSystem.getFriends(user))
+    {
+        if (friendUser->getUsername() == friendName)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+future<bool> ShardedPlatform::registerUser(const string &username, const string &password, const string &email, const string &bio, bool isPublic)
+{
+    // Only the real account can exist on the home shard: stand-ins are created elsewhere
+    return call(shardOf(username), [=](Shard &shard)
+                { return shard.userManagement.registerUser(username, password, email, bio, isPublic) != nullptr; });
+}
+
+future<bool> ShardedPlatform::logIn(const string &username, const string &password)
+{
+    return call(shardOf(username), [=](Shard &shard)
+                { return shard.userManagement.logIn(username, password) != nullptr; });
+}
+
+future<bool> ShardedPlatform::createPost(const string &username, const string &content)
+{
+    return call(shardOf(username), [=](Shard &shard)
+                {
+        User *user = shard.find(username);
+        if (user)
+        {
+            shard.postManagement.createPost(user, content);
+        }
+        return user != nullptr; });
+}
+
+future<vector<string>> ShardedPlatform::getUserPosts(const string &username)
+{
+    return call(shardOf(username), [=](Shard &shard)
+                {
+        User *user = shard.find(username);
+        return user ? shard.postManagement.getUserPosts(user) : vector<string>(); });
+}
+
+future<vector<pair<string, string>>> ShardedPlatform::getFriendsPosts(const string &username)
+{
+    // Each friend's home shard answers for all the friends it holds; the last answer fulfils the promise
+    struct Gather
+    {
+        promise<vector<pair<string, string>>> done;
+        vector<string> friends;
+        vector<vector<string>> posts; // Per friend, filled in by their home shard
+        atomic<size_t> remaining{0};
+
+        void finish()
+        {
+            vector<pair<string, string>> feed;
+            for (size_t i = 0; i < friends.size(); i++)
+            {
+                for (string &post : posts[i])
+                {
+                    feed.emplace_back(friends[i], move(post));
+                }
+            }
+            done.set_value(move(feed));
+        }
+    };
+    auto gather = make_shared<Gather>();
+    future<vector<pair<string, string>>> result = gather->done.get_future();
+    post(shardOf(username), [this, username, gather](Shard &shard)
+         {
+        User *user = shard.find(username);
+        if (user)
+        {
+            gather->friends = usernames(shard.friendSystem.getFriends(user));
+        }
+        gather->posts.resize(gather->friends.size());
+        vector<vector<size_t>> byShard(size());
+        for (size_t i = 0; i < gather->friends.size(); i++)
+        {
+            byShard[shardOf(gather->friends[i])].push_back(i);
+        }
+        size_t asked = count_if(byShard.begin(), byShard.end(), [](const vector<size_t> &held)
+                                { return !held.empty(); });
+        if (asked == 0)
+        {
+            gather->finish();
+            return;
+        }
+        gather->remaining = asked;
+        for (size_t target = 0; target < byShard.size(); target++)
+        {
+            if (byShard[target].empty())
+            {
+                continue;
+            }
+            shard.send(target, [gather, held = move(byShard[target])](Shard &home)
+                       {
+                for (size_t i : held)
+                {
+                    User *friendUser = home.find(gather->friends[i]);
+                    if (friendUser)
+                    {
+                        gather->posts[i] = home.postManagement.getUserPosts(friendUser);
+                    }
+                }
+                if (--gather->remaining == 0)
+                {
+                    gather->finish();
+                } });
+        } });
+    return result;
+}
+
+future<bool> ShardedPlatform::addFriend(const string &username, const string &friendName)
+{
+    auto done = make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    size_t home = shardOf(username);
+    size_t friendHome = shardOf(friendName);
+    post(home, [=](Shard &shard)
+         {
+        if (username == friendName || !shard.find(username))
+        {
+            done->set_value(false);
+            return;
+        }
+        // The friend's shard decides: it checks and adds its half in one step, so of two racing requests only one wins
+        shard.send(friendHome, [=](Shard &other)
+                   {
+            User *friendUser = other.find(friendName);
+            if (!friendUser || hasFriendNamed(other.friendSystem, friendUser, username))
+            {
+                done->set_value(false);
+                return;
+            }
+            other.friendSystem.addFriend(other.local(username), friendUser);
+            if (friendHome == home)
+            {
+                done->set_value(true);
+                return;
+            }
+            other.send(home, [=](Shard &back)
+                       {
+                back.friendSystem.addFriend(back.find(username), back.local(friendName));
+                done->set_value(true); });
+        }); });
+    return result;
+}
+
+future<bool> ShardedPlatform::removeFriend(const string &username, const string &friendName)
+{
+    auto done = make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    size_t home = shardOf(username);
+    size_t friendHome = shardOf(friendName);
+    post(home, [=](Shard &shard)
+         {
+        if (!shard.find(username))
+        {
+            done->set_value(false);
+            return;
+        }
+        shard.send(friendHome, [=](Shard &other)
+                   {
+            User *friendUser = other.find(friendName);
+            if (!friendUser || !hasFriendNamed(other.friendSystem, friendUser, username))
+            {
+                done->set_value(false);
+                return;
+            }
+            other.friendSystem.removeFriend(friendUser, other.find(username));
+            if (friendHome == home)
+            {
+                done->set_value(true);
+                return;
+            }
+            other.send(home, [=](Shard &back)
+                       {
+                User *stayed = back.find(friendName);
+                if (stayed)
+                {
+                    back.friendSystem.removeFriend(back.find(username), stayed);
+                }
+                done->set_value(true); });
+        }); });
+    return result;
+}
+
+future<vector<string>> ShardedPlatform::getFriends(const string &username)
+{
+    return call(shardOf(username), [=](Shard &shard)
+                {
+        User *user = shard.find(username);
+        return user ? usernames(shard.friendSystem.getFriends(user)) : vector<string>(); });
+}
+
+future<bool> ShardedPlatform::sendMessage(const string &fromName, const string &toName, const string &message)
+{
+    auto done = make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    size_t home = shardOf(fromName);
+    size_t toHome = shardOf(toName);
+    post(home, [=](Shard &shard)
+         {
+        if (!shard.find(fromName))
+        {
+            done->set_value(false);
+            return;
+        }
+        shard.send(toHome, [=](Shard &other)
+                   {
+            User *receiver = other.find(toName);
+            if (!receiver)
+            {
+                done->set_value(false);
+                return;
+            }
+            other.messagingSystem.sendMessage(other.local(fromName), receiver, message);
+            if (toHome == home)
+            {
+                done->set_value(true);
+                return;
+            }
+            other.send(home, [=](Shard &back)
+                       {
+                back.messagingSystem.sendMessage(back.find(fromName), back.local(toName), message);
+                done->set_value(true); });
+        }); });
+    return result;
+}
+
+future<UnreadSummary> ShardedPlatform::getUnreadSummary(const string &username)
+{
+    // Direct chats are all on the home shard; groups on other shards hold the user as a stand-in, whose
+    // direct chats there are only the sender-side copies, so only group counts are taken from those shards
+    struct Gather
+    {
+        promise<UnreadSummary> done;
+        vector<UnreadSummary> counts; // Per shard
+        atomic<size_t> remaining{0};
+    };
+    auto gather = make_shared<Gather>();
+    future<UnreadSummary> result = gather->done.get_future();
+    size_t home = shardOf(username);
+    gather->counts.resize(size());
+    gather->remaining = size();
+    for (size_t i = 0; i < size(); i++)
+    {
+        post(i, [=](Shard &shard)
+             {
+            User *user = shard.find(username);
+            if (user)
+            {
+                gather->counts[i] = i == home ? shard.messagingSystem.getUnreadSummary(user) : shard.messagingSystem.getGroupUnreadSummary(user);
+            }
+            if (--gather->remaining == 0)
+            {
+                UnreadSummary all;
+                for (const UnreadSummary &counts : gather->counts)
+                {
+                    all.messages += counts.messages;
+                    all.chats += counts.chats;
+                }
+                gather->done.set_value(all);
+            } });
+    }
+    return result;
+}
+
+future<vector<string>> ShardedPlatform::getChatHistory(const string &username, const string &partnerName)
+{
+    return call(shardOf(username), [=](Shard &shard)
+                {
+        User *user = shard.find(username);
+        User *partner = shard.find(partnerName);
+        if (!user || !partner)
+        {
+            return vector<string>();
+        }
+        return messageLines(shard.messagingSystem.getChatHistoryPage(user, partner, HISTORY_LATEST)); });
+}
+
+future<bool> ShardedPlatform::createGroup(const string &groupName, const string &creatorName)
+{
+    auto done = make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    size_t groupHome = shardOf(groupName);
+    post(shardOf(creatorName), [=](Shard &shard)
+         {
+        if (!shard.find(creatorName))
+        {
+            done->set_value(false);
+            return;
+        }
+        shard.send(groupHome, [=](Shard &other)
+                   {
+            bool created = other.messagingSystem.createGroup(groupName) != nullptr;
+            if (created)
+            {
+                other.messagingSystem.addUserToGroup(groupName, other.local(creatorName));
+            }
+            done->set_value(created); }); });
+    return result;
+}
+
+future<bool> ShardedPlatform::joinGroup(const string &groupName, const string &username)
+{
+    auto done = make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    size_t groupHome = shardOf(groupName);
+    post(shardOf(username), [=](Shard &shard)
+         {
+        if (!shard.find(username))
+        {
+            done->set_value(false);
+            return;
+        }
+        shard.send(groupHome, [=](Shard &other)
+                   {
+            bool exists = other.messagingSystem.findGroupByName(groupName) != nullptr;
+            done->set_value(exists && other.messagingSystem.addUserToGroup(groupName, other.local(username))); }); });
+    return result;
+}
+
+future<bool> ShardedPlatform::sendMessageToGroup(const string &username, const string &groupName, const string &message)
+{
+    // Members of a group are all known on its shard, so a user missing there cannot be a member
+    return call(shardOf(groupName), [=](Shard &shard)
+                {
+        User *user = shard.find(username);
+        return user && shard.messagingSystem.sendMessageToGroup(user, groupName, message); });
+}
+
+future<vector<string>> ShardedPlatform::getGroupHistory(const string &groupName)
+{
+    return call(shardOf(groupName), [=](Shard &shard)
+                { return messageLines(shard.messagingSystem.getGroupChatHistoryPage(groupName, HISTORY_LATEST)); });
+}
+
+future<vector<string>> ShardedPlatform::getUserGroups(const string &username)
+{
+    struct Gather
+    {
+        promise<vector<string>> done;
+        vector<vector<string>> names; // Per shard
+        atomic<size_t> remaining{0};
+    };
+    auto gather = make_shared<Gather>();
+    future<vector<string>> result = gather->done.get_future();
+    gather->names.resize(size());
+    gather->remaining = size();
+    for (size_t i = 0; i < size(); i++)
+    {
+        post(i, [=](Shard &shard)
+             {
+            User *user = shard.find(username);
+            if (user)
+            {
+                for (const Group *group : shard.messagingSystem.getUserGroups(user))
+                {
+                    gather->names[i].push_back(shard.messagingSystem.getGroupName(group));
+                }
+            }
+            if (--gather->remaining == 0)
+            {
+                vector<string> all;
+                for (vector<string> &names : gather->names)
+                {
+                    all.insert(all.end(), names.begin(), names.end());
+                }
+                gather->done.set_value(move(all));
+            } });
+    }
+    return result;
+}
@@ -0,0 +1,173 @@
+#ifndef SHARDED_PLATFORM_H
+#define SHARDED_PLATFORM_H
+#include "MessageInbox.h"
+#include "SocialMediaPlatform.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Shared-nothing partitioning of the engine. Each of N shards owns the users whose name hashes to it, with its
+// own managers, write-ahead log and thread, and only that thread ever touches them. Work reaches a shard as
+// batches of commands in its mailbox. An operation spanning shards (a friendship, a direct message, a message
+// to a group kept elsewhere) does its part on one shard and travels on to the next as a message; a shard holds
+// back what it sends while it works through a batch and hands each destination all of it at once afterwards.
+// A user is known on other shards by a stand-in account with the same name, created on first use and never
+// logged in, so each shard keeps plain User pointers: b's friend list on b's shard holds a's stand-in.
+// Each shard logs its own half of a cross-shard change; the two halves are not applied atomically.
+
+class Shard;
+class ShardedPlatform;
+
+typedef function<void(Shard &)> ShardCommand;
+
+struct ShardOptions
+{
+    size_t shards = 0;             // 0 means one per hardware thread
+    string walPrefix;              // Shard i logs to <walPrefix>.<i> and recovers from it on start; empty keeps nothing
+    DurabilityMode durability = DurabilityMode::Batched;
+    size_t mailboxCapacity = 1024; // Batches waiting per shard before senders back off
+    bool pinShards = false;        // Pin shard i's thread to CPU i modulo the CPU count
+};
+
+// One partition. Its managers may only be used on its own thread, from inside a ShardCommand.
+class Shard
+{
+private:
+    static const size_t DRAIN_BATCHES = 64; // Mailbox entries run between two hand-overs of the outboxes
+
+    ShardedPlatform &platform;
+    MpscInbox<vector<ShardCommand>> mailbox;
+    vector<vector<ShardCommand>> outboxes; // Per destination shard; shard thread only
+    atomic<int64_t> queued{0};             // Batches in the mailbox; briefly negative while a push is being counted
+    atomic<bool> sleeping{false};
+    mutex wakeMutex;
+    condition_variable wakeUp;
+    bool stopping = false; // Guarded by wakeMutex
+    WriteAheadLog wal;
+    uint64_t recoveredRecords = 0;
+    thread worker;
+
+    static Shard *&running(); // The shard whose thread this is, nullptr elsewhere
+    void run(const ShardOptions &options, promise<void> &recovered, int cpu);
+    void recover(const ShardOptions &options);
+    // From any thread; false if the mailbox is full, leaving `batch` untouched
+    bool push(vector<ShardCommand> &batch);
+    // Hands every outbox to its shard; false if a mailbox was full and something is left for the next round
+    bool flushOutboxes();
+
+    friend class ShardedPlatform;
+
+public:
+    const size_t index;
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+
+    Shard(ShardedPlatform &platform, size_t index, size_t shardCount, size_t mailboxCapacity);
+
+    Shard(const Shard &) = delete;
+    Shard &operator=(const Shard &) = delete;
+
+    bool isHome(const string &username) const;
+    // The account for `username` on this shard, nullptr if there is none
+    User *find(const string &username);
+    // The same, except that elsewhere than on their home shard a missing user gets a stand-in
+    User *local(const string &username);
+    // Runs `command` on `shard`: right away if that is this shard, otherwise once the current batch is done
+    void send(size_t shard, ShardCommand command);
+};
+
+// The engine split across shards. Every operation may be called from any thread and returns a future that is
+// ready once each shard involved has done its part. Nothing running on a shard may wait on one of these
+// futures: the shard it waits for could be itself, or waiting on it in turn.
+class ShardedPlatform
+{
+private:
+    vector<unique_ptr<Shard>> shards;
+    atomic<size_t> inFlight{0}; // Commands queued, held in an outbox or running, on any shard
+
+    friend class Shard;
+
+public:
+    explicit ShardedPlatform(const ShardOptions &options = ShardOptions());
+
+    ShardedPlatform(const ShardedPlatform &) = delete;
+    ShardedPlatform &operator=(const ShardedPlatform &) = delete;
+
+    // Waits for every queued command, including messages still travelling between shards, then stops the shards.
+    // Callers must have stopped issuing operations.
+    ~ShardedPlatform();
+
+    size_t size() const
+    {
+        return shards.size();
+    }
+
+    // Home shard of a user or group name. FNV-1a rather than hash<string>, so every process agrees on it.
+    size_t shardOf(const string &name) const
+    {
+        uint64_t key = 14695981039346656037ULL;
+        for (unsigned char c : name)
+        {
+            key = (key ^ c) * 1099511628211ULL;
+        }
+        return key % shards.size();
+    }
+
+    // Log records replayed across all shards on start
+    uint64_t restoredRecords() const;
+
+    // Queues `command` on `shard`, waiting while its mailbox is full. Called on a shard, this is Shard::send.
+    void post(size_t shard, ShardCommand command);
+
+    // Runs function(shard) on `shard`; the future yields its result or rethrows its exception
+    template <typename Function>
+    future<typename invoke_result<Function, Shard &>::type> call(size_t shard, Function function)
+    {
+        typedef typename invoke_result<Function, Shard &>::type Result;
+        auto task = make_shared<packaged_task<Result(Shard &)>>(move(function));
+        future<Result> result = task->get_future();
+        post(shard, [task](Shard &target)
+             { (*task)(target); });
+        return result;
+    }
+
+    // False if the username is taken
+    future<bool> registerUser(const string &username, const string &password, const string &email, const string &bio, bool isPublic);
+    future<bool> logIn(const string &username, const string &password);
+    future<bool> createPost(const string &username, const string &content);
+    future<vector<string>> getUserPosts(const string &username);
+    // (author, post) for each post of each friend, friends in the order they were added
+    future<vector<pair<string, string>>> getFriendsPosts(const string &username);
+    // False if either user is missing or they are already friends
+    future<bool> addFriend(const string &username, const string &friendName);
+    future<bool> removeFriend(const string &username, const string &friendName);
+    future<vector<string>> getFriends(const string &username);
+    // Stored on both users' shards: the receiver's copy counts as unread, the sender's is their history
+    future<bool> sendMessage(const string &fromName, const string &toName, const string &message);
+    // Direct chats from the user's shard plus their groups on every shard
+    future<UnreadSummary> getUnreadSummary(const string &username);
+    // Latest page of the conversation as "sender: message" lines, oldest first
+    future<vector<string>> getChatHistory(const string &username, const string &partnerName);
+    // Groups live on the shard their name hashes to; members from other shards join as stand-ins
+    future<bool> createGroup(const string &groupName, const string &creatorName);
+    future<bool> joinGroup(const string &groupName, const string &username);
+    future<bool> sendMessageToGroup(const string &username, const string &groupName, const string &message);
+    future<vector<string>> getGroupHistory(const string &groupName);
+    // Names of the user's groups; asks every shard
+    future<vector<string>> getUserGroups(const string &username);
+};
+
+#endif // SHARDED_PLATFORM_H
@@ -0,0 +1,422 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include "WorkStealingExecutor.h"
+#include "WriteAheadLog.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Snapshot file layout (all integers little-endian, every section 8-byte aligned):
+//   SnapshotHeader, SnapshotSection[sectionCount], then the sections.
+// Each section is a flat array of fixed-size records, so a mapped file is used in place:
+// records are read straight out of the mapping and strings point into one shared pool.
+const char SNAPSHOT_MAGIC[4] = {'C', 'C', 'S', 'N'};
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_NONE = UINT32_MAX; // Missing id or parent in a record
+
+enum class SnapshotSectionKind : uint32_t
+{
+    Strings = 1,   // Byte pool referenced by SnapshotString
+    Users,         // SnapshotUser, indexed by user id
+    Posts,         // SnapshotPost, grouped by author in id order
+    Comments,      // SnapshotComment, each thread in pre-order
+    FriendOffsets, // uint64_t[users + 1]: user i's friends are FriendIds[offsets[i] .. offsets[i + 1])
+    FriendIds,     // uint32_t
+    Chats,         // SnapshotChat, one per direct conversation
+    Groups,        // SnapshotGroup, in group id order
+    GroupMembers,  // SnapshotGroupMember, ranges referenced by SnapshotGroup
+    DirectReads,   // SnapshotDirectRead
+    Segments,      // SnapshotSegment, ranges referenced by SnapshotLog
+    Messages,      // SnapshotMessage, ranges referenced by SnapshotLog
+    Postings,      // SnapshotPosting, ranges referenced by SnapshotLog
+    PostingIds     // uint32_t message positions, ranges referenced by SnapshotPosting
+};
+
+struct SnapshotHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t walLsn;       // Last write-ahead log record included; replay resumes after it
+    uint64_t nextSequence; // Message clock
+    int64_t lastTimestamp;
+    uint32_t sectionCount;
+    uint32_t reserved;
+};
+
+struct SnapshotSection
+{
+    uint32_t kind;
+    uint32_t recordSize;
+    uint64_t offset; // From the start of the file
+    uint64_t count;  // Records in the section
+};
+
+struct SnapshotString
+{
+    uint64_t offset; // Into the Strings section
+    uint64_t length;
+};
+
+struct SnapshotUser
+{
+    SnapshotString username, password, email, bio;
+    uint32_t isPublic;
+    uint32_t reserved;
+};
+
+struct SnapshotPost
+{
+    uint32_t authorId;
+    uint32_t reserved;
+    SnapshotString content;
+};
+
+struct SnapshotComment
+{
+    SnapshotString post;  // Content of the post the thread belongs to
+    SnapshotString content;
+    uint32_t authorId;
+    uint32_t parent; // Index of the parent comment in this section, SNAPSHOT_NONE for a top-level comment
+};
+
+// One chat log: sealed segments, in-memory messages and the search index
+struct SnapshotLog
+{
+    uint64_t coldCount;
+    uint64_t firstSegment, segmentCount;
+    uint64_t firstMessage, messageCount;
+    uint64_t firstPosting, postingCount;
+};
+
+struct SnapshotChat
+{
+    uint32_t user1, user2;
+    SnapshotLog history;
+};
+
+struct SnapshotGroup
+{
+    SnapshotString groupId, groupName;
+    uint64_t firstMember, memberCount;
+    SnapshotLog history;
+};
+
+struct SnapshotGroupMember
+{
+    uint32_t userId;
+    uint32_t reserved;
+    uint64_t position; // Read watermark
+    uint64_t ownUnread;
+};
+
+struct SnapshotDirectRead
+{
+    uint32_t readerId, partnerId;
+    uint64_t cursor;
+    uint64_t unread;
+};
+
+struct SnapshotSegment
+{
+    uint64_t firstPosition, count, lastSeq;
+    int64_t lastTimestamp;
+    SnapshotString path;
+    uint64_t fileSize; // Segment files are not copied in; loading checks the file is still there at this size
+};
+
+struct SnapshotMessage
+{
+    uint32_t senderId, receiverId; // receiverId is SNAPSHOT_NONE in groups
+    uint64_t seq;
+    int64_t timestamp;
+    SnapshotString text;
+};
+
+struct SnapshotPosting
+{
+    SnapshotString token;
+    uint64_t firstId, count; // Range in PostingIds
+};
+
+// Assembles a snapshot image in memory, section by section
+class SnapshotBuilder
+{
+private:
+    string pool;
+    map<uint32_t, pair<uint32_t, string>> sections; // Kind -> record size, bytes
+
+public:
+    SnapshotString addString(const string &value)
+    {
+        SnapshotString ref{pool.size(), value.size()};
+        pool += value;
+        return ref;
+    }
+
+    template <typename T>
+    void addSection(SnapshotSectionKind kind, const vector<T> &records)
+    {
+        static_assert(is_trivially_copyable<T>::value && alignof(T) <= 8, "records must be flat");
+        string bytes(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(T));
+        sections[static_cast<uint32_t>(kind)] = {sizeof(T), move(bytes)};
+    }
+
+    // Lays out header, section table and sections; the builder is left empty
+    string finish(uint64_t walLsn, uint64_t nextSequence, int64_t lastTimestamp)
+    {
+        sections[static_cast<uint32_t>(SnapshotSectionKind::Strings)] = {1, move(pool)};
+        pool.clear();
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.walLsn = walLsn;
+        header.nextSequence = nextSequence;
+        header.lastTimestamp = lastTimestamp;
+        header.sectionCount = static_cast<uint32_t>(sections.size());
+        vector<SnapshotSection> table;
+        uint64_t offset = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSection);
+        for (auto &entry : sections)
+        {
+            const string &bytes = entry.second.second;
+            table.push_back({entry.first, entry.second.first, offset, bytes.size() / entry.second.first});
+            offset = (offset + bytes.size() + 7) & ~uint64_t(7);
+        }
+        string image;
+        image.reserve(offset);
+        image.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        image.append(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(SnapshotSection));
+        for (auto &entry : sections)
+        {
+            image += entry.second.second;
+            image.resize((image.size() + 7) & ~size_t(7), '\0');
+        }
+        sections.clear();
+        return image;
+    }
+};
+
+// Read-only view of a snapshot file mapped into memory.
+// Every accessor checks bounds, so a truncated or corrupt file is rejected rather than read past.
+class MappedSnapshot
+{
+private:
+    const char *base = nullptr;
+    size_t length = 0;
+    const SnapshotHeader *header = nullptr;
+    const SnapshotSection *table = nullptr;
+    const char *strings = nullptr;
+    size_t stringsLength = 0;
+
+    const SnapshotSection *findSection(SnapshotSectionKind kind) const
+    {
+        for (uint32_t i = 0; i < header->sectionCount; i++)
+        {
+            if (table[i].kind == static_cast<uint32_t>(kind))
+            {
+                return &table[i];
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    MappedSnapshot() = default;
+    MappedSnapshot(const MappedSnapshot &) = delete;
+    MappedSnapshot &operator=(const MappedSnapshot &) = delete;
+
+    ~MappedSnapshot()
+    {
+        close();
+    }
+
+    // False if the file is missing or is not a snapshot of this version
+    bool open(const string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(SnapshotHeader)))
+        {
+            ::close(fd);
+            return false;
+        }
+        length = info.st_size;
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps the file open
+        if (mapping == MAP_FAILED)
+        {
+            length = 0;
+            return false;
+        }
+        madvise(mapping, length, MADV_WILLNEED); // Start reading ahead while the header is checked
+        base = static_cast<const char *>(mapping);
+        header = reinterpret_cast<const SnapshotHeader *>(base);
+        table = reinterpret_cast<const SnapshotSection *>(base + sizeof(SnapshotHeader));
+        bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 && header->version == SNAPSHOT_VERSION &&
+                     header->sectionCount <= (length - sizeof(SnapshotHeader)) / sizeof(SnapshotSection);
+        for (uint32_t i = 0; valid && i < header->sectionCount; i++)
+        {
+            const SnapshotSection &section = table[i];
+            valid = section.recordSize > 0 && section.offset % 8 == 0 && section.offset <= length &&
+                    section.count <= (length - section.offset) / section.recordSize;
+        }
+        if (!valid)
+        {
+            close();
+            return false;
+        }
+        size_t count;
+        strings = records<char>(SnapshotSectionKind::Strings, count);
+        stringsLength = strings ? count : 0;
+        return true;
+    }
+
+    void close()
+    {
+        if (base)
+        {
+            munmap(const_cast<char *>(base), length);
+        }
+        base = nullptr;
+        header = nullptr;
+        length = 0;
+        strings = nullptr;
+        stringsLength = 0;
+    }
+
+    const SnapshotHeader &info() const
+    {
+        return *header;
+    }
+
+    // The section's records in place, or nullptr (count 0) if it is absent or has another record size
+    template <typename T>
+    const T *records(SnapshotSectionKind kind, size_t &count) const
+    {
+        count = 0;
+        const SnapshotSection *section = findSection(kind);
+        if (!section || section->recordSize != sizeof(T))
+        {
+            return nullptr;
+        }
+        count = section->count;
+        return reinterpret_cast<const T *>(base + section->offset);
+    }
+
+    bool validString(const SnapshotString &ref) const
+    {
+        return ref.offset <= stringsLength && ref.length <= stringsLength - ref.offset;
+    }
+
+    // Copies a pooled string out of the mapping; empty if the reference is out of bounds
+    string text(const SnapshotString &ref) const
+    {
+        return validString(ref) ? string(strings + ref.offset, ref.length) : string();
+    }
+
+    const char *data(const SnapshotString &ref) const
+    {
+        return validString(ref) ? strings + ref.offset : nullptr;
+    }
+};
+
+// Writes `image` to `path` atomically: a temporary file is fsynced, then renamed over the old snapshot, and the
+// rename is made durable before this returns true
+inline bool writeSnapshotFile(const string &path, const string &image)
+{
+    string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    size_t offset = 0;
+    while (offset < image.size())
+    {
+        ssize_t written = ::write(fd, image.data() + offset, image.size() - offset);
+        if (written <= 0)
+        {
+            ::close(fd);
+            unlink(temporary.c_str());
+            return false;
+        }
+        offset += written;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return syncDirectoryOf(path);
+}
+
+// Writes captured snapshot images as batch jobs on the shared executor, one at a time
+class BackgroundSnapshotWriter
+{
+private:
+    future<void> pending;
+    atomic<bool> busy{false};
+    atomic<bool> lastOk{true};
+
+public:
+    ~BackgroundSnapshotWriter()
+    {
+        wait();
+    }
+
+    // False if the previous snapshot is still being written; the image is then dropped.
+    // `written` runs on the writing thread once the snapshot is durable.
+    bool start(const string &path, string image, function<void()> written = nullptr)
+    {
+        if (busy.load())
+        {
+            return false;
+        }
+        wait();
+        busy = true;
+        pending = WorkStealingExecutor::shared().submit([this, path, image = move(image), written = move(written)]()
+                                                        {
+            lastOk = writeSnapshotFile(path, image);
+            if (lastOk && written)
+            {
+                written();
+            }
+            busy = false; },
+                                                        TaskPriority::Batch);
+        return true;
+    }
+
+    bool writing() const
+    {
+        return busy.load();
+    }
+
+    // Blocks until the snapshot being written (if any) is on disk; false if it failed
+    bool wait()
+    {
+        if (pending.valid())
+        {
+            pending.get();
+        }
+        return lastOk;
+    }
+};
+
+#endif // SNAPSHOT_H
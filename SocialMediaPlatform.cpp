@@ -1,53 +1,356 @@
-#include "SocialMediaPlatform.h"
-#include <iostream>
-#include <vector>
-#include <limits>
-using namespace std;
-
-User::User(const string &uname, const string &pwd, const string &email, const string &bio, bool isPublic)
-    : username(uname), password(pwd), email(email), bio(bio), isPublic(isPublic) {}
-string User::getUsername() { return username; }
-string User::getEmail() { return email; }
-string User::getBio() { return bio; }
-bool User::isProfilePublic() { return isPublic; }
-bool User::validatePassword(const string &pwd) { return password == pwd; }
-
-void User::updateBio(const string &newBio) { bio = newBio; }
-void User::updateEmail(const string &newEmail) { email = newEmail; }
-void User::updatePassword(const string &newPassword) { password = newPassword; }
-void User::updatePrivacy(bool newPrivacy) { isPublic = newPrivacy; }
-void User::updateUsername(const string &newUsername) { username = newUsername; }
-
-User *UserManagement::validateUsername(const string &username)
-{
-    auto it = userCredentials.find(username);
-    if (it != userCredentials.end())
-    {
-        return it->second.second;
-    }
-    return nullptr;
-}
-bool UserManagement::isValidEmail(const string &email)
-{
-    int atPos = -1;
-    int dotPos = -1;
-    for (int i = 0; i < email.length(); i++)
-    {
-        if (email[i] == '@')
-        {
-            atPos = i;
-        }
-        else if (email[i] == '.' && atPos != -1)
-        {
-            dotPos = i;
-        }
-    }
-    if (atPos > 0 && dotPos > atPos + 1 && dotPos < email.length() - 1)
-    {
-        return true;
-    }
-    return false;
-}
+#include "SocialMediaPlatform.h"
+#include <iostream>
+#include <vector>
+#include <limits>
+#include <filesystem>
+using namespace std;
+
+// Every heap allocation of a program linked with the engine goes through MemoryAccounting,
+// charged to the subsystem of the MemoryScope active on the allocating thread
+void *operator new(size_t size)
+{
+    void *block;
+    while (!(block = MemoryAccounting::allocate(size)))
+    {
+        new_handler handler = get_new_handler();
+        if (!handler)
+        {
+            throw bad_alloc();
+        }
+        handler();
+    }
+    return block;
+}
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    return MemoryAccounting::allocate(size);
+}
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+    return MemoryAccounting::allocate(size);
+}
+void *operator new(size_t size, align_val_t alignment)
+{
+    void *block = MemoryAccounting::allocateAligned(size, static_cast<size_t>(alignment));
+    if (!block)
+    {
+        throw bad_alloc();
+    }
+    return block;
+}
+void *operator new[](size_t size, align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+void operator delete(void *block) noexcept { MemoryAccounting::release(block); }
+void operator delete[](void *block) noexcept { MemoryAccounting::release(block); }
+void operator delete(void *block, size_t) noexcept { MemoryAccounting::release(block); }
+void operator delete[](void *block, size_t) noexcept { MemoryAccounting::release(block); }
+void operator delete(void *block, const nothrow_t &) noexcept { MemoryAccounting::release(block); }
+void operator delete[](void *block, const nothrow_t &) noexcept { MemoryAccounting::release(block); }
+void operator delete(void *block, align_val_t alignment) noexcept { MemoryAccounting::releaseAligned(block, static_cast<size_t>(alignment)); }
+void operator delete[](void *block, align_val_t alignment) noexcept { MemoryAccounting::releaseAligned(block, static_cast<size_t>(alignment)); }
+void operator delete(void *block, size_t, align_val_t alignment) noexcept { MemoryAccounting::releaseAligned(block, static_cast<size_t>(alignment)); }
+void operator delete[](void *block, size_t, align_val_t alignment) noexcept { MemoryAccounting::releaseAligned(block, static_cast<size_t>(alignment)); }
+
+User::User(const string &uname, const string &pwd, const string &email, const string &bio, bool isPublic, uint32_t id)
+    : username(uname), password(pwd), email(email), bio(bio), isPublic(isPublic), id(id) {}
+
+// Profile fields of every user, striped by id; always the innermost lock
+static LockStripes userFieldLocks;
+
+string User::getUsername()
+{
+    StripeReadGuard lock(userFieldLocks, {id});
+    return username;
+}
+string User::getEmail()
+{
+    StripeReadGuard lock(userFieldLocks, {id});
+    return email;
+}
+string User::getBio()
+{
+    StripeReadGuard lock(userFieldLocks, {id});
+    return bio;
+}
+bool User::isProfilePublic()
+{
+    StripeReadGuard lock(userFieldLocks, {id});
+    return isPublic;
+}
+bool User::validatePassword(const string &pwd)
+{
+    StripeReadGuard lock(userFieldLocks, {id});
+    return password == pwd;
+}
+
+void User::updateBio(const string &newBio)
+{
+    StripeWriteGuard lock(userFieldLocks, {id});
+    bio = newBio;
+}
+void User::updateEmail(const string &newEmail)
+{
+    StripeWriteGuard lock(userFieldLocks, {id});
+    email = newEmail;
+}
+void User::updatePassword(const string &newPassword)
+{
+    StripeWriteGuard lock(userFieldLocks, {id});
+    password = newPassword;
+}
+void User::updatePrivacy(bool newPrivacy)
+{
+    StripeWriteGuard lock(userFieldLocks, {id});
+    isPublic = newPrivacy;
+}
+void User::updateUsername(const string &newUsername)
+{
+    StripeWriteGuard lock(userFieldLocks, {id});
+    username = newUsername;
+}
+
+void DoublyLinkedList::clear()
+{
+    MessageNode *current = head;
+    while (current)
+    {
+        MessageNode *nextNode = current->next;
+        delete current;
+        current = nextNode;
+    }
+    head = tail = nullptr;
+    index.clear();
+    segments.clear();
+    segmentCache.clear();
+    coldCount = 0;
+    postings.clear();
+}
+
+void DoublyLinkedList::setRetention(const RetentionPolicy *policy, const string &prefix)
+{
+    retention = policy;
+    segmentPrefix = prefix;
+    enforceRetention(tail ? tail->timestamp : 0);
+}
+
+void DoublyLinkedList::restore(size_t coldMessages, vector<ColdSegment> &&sealed, const vector<MessageNode *> &hot,
+                               unordered_map<string, vector<uint32_t>> &&searchPostings)
+{
+    coldCount = coldMessages;
+    segments = move(sealed);
+    postings = move(searchPostings);
+    for (MessageNode *node : hot)
+    {
+        node->prev = tail;
+        node->next = nullptr;
+        if (tail)
+        {
+            tail->next = node;
+        }
+        else
+        {
+            head = node;
+        }
+        tail = node;
+        index.push_back(node);
+    }
+    enforceRetention(tail ? tail->timestamp : 0);
+}
+
+void DoublyLinkedList::enforceRetention(int64_t now)
+{
+    if (!retention || !retention->enabled())
+    {
+        return;
+    }
+    size_t segmentSize = max<size_t>(1, retention->segmentSize);
+    while (true)
+    {
+        size_t count = 0;
+        if (retention->maxHotMessages > 0 && index.size() >= retention->maxHotMessages + segmentSize)
+        {
+            count = segmentSize;
+        }
+        else if (retention->maxAgeMillis > 0)
+        {
+            while (count < index.size() && count < segmentSize && index[count]->timestamp < now - retention->maxAgeMillis)
+            {
+                count++;
+            }
+        }
+        if (count == 0 || !sealOldest(count))
+        {
+            return;
+        }
+    }
+}
+
+bool DoublyLinkedList::sealOldest(size_t count)
+{
+    // Record layout: seq, timestamp, sender id, receiver id, message length, message bytes
+    string raw;
+    for (size_t i = 0; i < count; i++)
+    {
+        const MessageNode *node = index[i];
+        ColdStorage::putVarint(raw, node->seq);
+        ColdStorage::putVarint(raw, static_cast<uint64_t>(node->timestamp));
+        ColdStorage::putVarint(raw, node->sender ? node->sender->getId() : RetentionPolicy::NO_USER);
+        ColdStorage::putVarint(raw, node->receiver ? node->receiver->getId() : RetentionPolicy::NO_USER);
+        ColdStorage::putVarint(raw, node->message.size());
+        raw += node->message;
+    }
+    error_code ignored;
+    filesystem::create_directories(retention->directory, ignored);
+    string path = retention->directory + "/" + segmentPrefix + "." + to_string(segments.size()) + ".seg";
+    if (!ColdStorage::writeSegment(path, raw))
+    {
+        return false; // Keep the messages in memory rather than lose them
+    }
+    const MessageNode *last = index[count - 1];
+    segments.push_back({coldCount, count, last->seq, last->timestamp, path});
+    for (size_t i = 0; i < count; i++)
+    {
+        MessageNode *node = index.front();
+        index.pop_front();
+        head = node->next;
+        delete node;
+    }
+    if (head)
+    {
+        head->prev = nullptr;
+    }
+    else
+    {
+        tail = nullptr;
+    }
+    coldCount += count;
+    return true;
+}
+
+SegmentPin DoublyLinkedList::loadSegment(size_t segmentIndex) const
+{
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        for (auto it = segmentCache.begin(); it != segmentCache.end(); ++it)
+        {
+            if (it->first == segmentIndex)
+            {
+                segmentCache.splice(segmentCache.begin(), segmentCache, it);
+                return it->second;
+            }
+        }
+    }
+    auto nodes = make_shared<vector<MessageNode>>();
+    string raw;
+    if (ColdStorage::readSegment(segments[segmentIndex].path, raw))
+    {
+        size_t offset = 0;
+        uint64_t seq, timestamp, senderId, receiverId, length;
+        while (ColdStorage::getVarint(raw, offset, seq) && ColdStorage::getVarint(raw, offset, timestamp) &&
+               ColdStorage::getVarint(raw, offset, senderId) && ColdStorage::getVarint(raw, offset, receiverId) &&
+               ColdStorage::getVarint(raw, offset, length) && length <= raw.size() - offset)
+        {
+            User *sender = senderId == RetentionPolicy::NO_USER ? nullptr : retention->resolveUser(static_cast<uint32_t>(senderId));
+            User *receiver = receiverId == RetentionPolicy::NO_USER ? nullptr : retention->resolveUser(static_cast<uint32_t>(receiverId));
+            nodes->emplace_back(sender, receiver, raw.substr(offset, length), seq, static_cast<int64_t>(timestamp));
+            offset += length;
+        }
+    }
+    lock_guard<mutex> lock(cacheMutex); // Two readers may decode the same segment; both copies are equal
+    segmentCache.emplace_front(segmentIndex, nodes);
+    if (segmentCache.size() > SEGMENT_CACHE_SIZE)
+    {
+        segmentCache.pop_back();
+    }
+    return nodes;
+}
+
+const MessageNode *DoublyLinkedList::at(size_t position, SegmentPin &pin) const
+{
+    if (position >= size())
+    {
+        return nullptr;
+    }
+    if (position >= coldCount)
+    {
+        return index[position - coldCount];
+    }
+    auto segment = upper_bound(segments.begin(), segments.end(), position, [](size_t value, const ColdSegment &candidate)
+                               { return value < candidate.firstPosition; });
+    size_t segmentIndex = (segment - segments.begin()) - 1;
+    SegmentPin nodes = loadSegment(segmentIndex);
+    size_t offset = position - segments[segmentIndex].firstPosition;
+    if (offset >= nodes->size())
+    {
+        return nullptr;
+    }
+    pin = nodes;
+    return &(*nodes)[offset];
+}
+
+size_t DoublyLinkedList::lowerBound(bool bySeq, uint64_t value) const
+{
+    // Sequence numbers and timestamps both never decrease along a log, so one search serves both
+    auto keyOf = [bySeq](const MessageNode &node)
+    {
+        return bySeq ? node.seq : static_cast<uint64_t>(node.timestamp);
+    };
+    if (!index.empty() && keyOf(*index.front()) < value)
+    {
+        auto it = lower_bound(index.begin(), index.end(), value, [&](const MessageNode *node, uint64_t target)
+                              { return keyOf(*node) < target; });
+        return coldCount + (it - index.begin());
+    }
+    // The answer is cold: pick the segment from its metadata, then read only that one
+    auto segment = lower_bound(segments.begin(), segments.end(), value, [bySeq](const ColdSegment &candidate, uint64_t target)
+                               { return (bySeq ? candidate.lastSeq : static_cast<uint64_t>(candidate.lastTimestamp)) < target; });
+    if (segment == segments.end())
+    {
+        return coldCount;
+    }
+    SegmentPin nodes = loadSegment(segment - segments.begin());
+    auto it = lower_bound(nodes->begin(), nodes->end(), value, [&](const MessageNode &node, uint64_t target)
+                          { return keyOf(node) < target; });
+    return segment->firstPosition + (it - nodes->begin());
+}
+
+User *UserManagement::validateUsername(const string &username)
+{
+    shared_lock<shared_mutex> lock(accountsMutex);
+    auto it = userCredentials.find(username);
+    if (it != userCredentials.end())
+    {
+        return it->second.second;
+    }
+    return nullptr;
+}
+bool UserManagement::isValidEmail(const string &email)
+{
+    int atPos = -1;
+    int dotPos = -1;
+    for (int i = 0; i < static_cast<int>(email.length()); i++)
+    {
+        if (email[i] == '@')
+        {
+            atPos = i;
+        }
+        else if (email[i] == '.' && atPos != -1)
+        {
+            dotPos = i;
+        }
+    }
+    if (atPos > 0 && dotPos > atPos + 1 && dotPos < static_cast<int>(email.length()) - 1)
+    {
+        return true;
+    }
+    return false;
+}
 User *UserManagement::signUp()
 {
     string username, password, email, bio;
@@ -117,1153 +420,3034 @@ User *UserManagement::signUp()
         }
     }
 
+    return registerUser(username, password, email, bio, isPublic);
+}
+User *UserManagement::registerUser(const string &username, const string &password, const string &email, const string &bio, bool isPublic)
+{
+    OperationTimer timer(Operation::SignUp);
+    MemoryScope memory(Subsystem::Users);
+    unique_lock<shared_mutex> lock(accountsMutex);
+    if (userCredentials.count(username))
+    {
+        timer.fail();
+        return nullptr;
+    }
+    uint32_t id = static_cast<uint32_t>(usersById.size());
+    if (wal)
+    {
+        wal->append(WalRecordType::SignUp, WalPayload().putU32(id).putString(username).putString(password).putString(email).putString(bio).putU8(isPublic));
+    }
     // Create a new user and store in data structures
-    User *newUser = new User(username, password, email, bio, isPublic);
+    User *newUser = new User(username, password, email, bio, isPublic, id);
     userCredentials[username] = {password, newUser};
     userProfiles.push_back(newUser);
-
+    usersById.push_back(newUser);
+    lock.unlock();
+    if (events)
+    {
+        events->publish(MutationType::SignUp, id, 0, username);
+    }
     return newUser;
-}
-User *UserManagement::logIn(const string &username, const string &password)
-{
-    auto it = userCredentials.find(username);
-    if (it != userCredentials.end() && it->second.first == password)
-    {
-        return it->second.second;
-    }
-    return nullptr;
-}
-void UserManagement::editProfile(User *user)
-{
-    int choice;
-    while (true)
-    {
-        cout << "Edit Profile Menu:" << endl;
-        cout << "1. Change Username" << endl;
-        cout << "2. Change Bio" << endl;
-        cout << "3. Change Email" << endl;
-        cout << "4. Change Password" << endl;
-        cout << "5. Change Privacy Settings (Public/Private)" << endl;
-        cout << "6. Go Back" << endl;
-        cout << "Enter your choice: ";
-        cin >> choice;
-        if (choice == 1)
-        {
-            string newUsername;
-            while (true)
-            {
-                cout << "Enter new username: ";
-                cin >> newUsername;
-                if (validateUsername(newUsername) == nullptr)
-                {
-                    string oldUsername = user->getUsername();
-                    userCredentials[newUsername] = userCredentials[oldUsername];
-                    userCredentials.erase(oldUsername);
-                    user->updateUsername(newUsername);
-                    cout << "Username updated successfully!" << endl;
-                    break;
-                }
-                else
-                {
-                    cout << "Username already taken! Please try again." << endl;
-                }
-            }
-        }
-        else if (choice == 2)
-        {
-            string newBio;
-            cout << "Enter new bio: ";
-            cin.ignore();
-            getline(cin, newBio);
-            user->updateBio(newBio);
-            cout << "Bio updated successfully!" << endl;
-        }
-        else if (choice == 3)
-        {
-            string newEmail;
-            while (true)
-            {
-                cout << "Enter new email: ";
-                cin >> newEmail;
-                if (isValidEmail(newEmail))
-                {
-                    user->updateEmail(newEmail);
-                    cout << "Email updated successfully!" << endl;
-                    break;
-                }
-                cout << "Invalid email format! Please try again." << endl;
-            }
-        }
-        else if (choice == 4)
-        {
-            string newPassword, confirmPassword;
-            cout << "Enter new password: ";
-            cin >> newPassword;
-            cout << "Confirm new password: ";
-            cin >> confirmPassword;
-            if (newPassword == confirmPassword)
-            {
-                user->updatePassword(newPassword);
-                userCredentials[user->getUsername()].first = newPassword;
-                cout << "Password updated successfully!" << endl;
-            }
-            else
-            {
-                cout << "Passwords do not match. Try again." << endl;
-            }
-        }
-        else if (choice == 5)
-        {
-            bool isPublic;
-            while (true)
-            {
-                char choice;
-                cout << "Do you want your profile to be public? (Y for Yes, N for No): ";
-                cin >> choice;
-                if (choice == 'y' || choice == 'Y' || choice == 'n' || choice == 'N')
-                {
-                    isPublic = (choice == 'y' || choice == 'Y');
-                    user->updatePrivacy(isPublic);
-                    cout << "Privacy settings updated successfully!" << endl;
-                    break;
-                }
-                else
-                {
-                    cout << "Invalid input. Please enter 'Y' for Yes or 'N' for No." << endl;
-                }
-            }
-        }
-        else if (choice == 6)
-        {
-            break;
-        }
-        else
-        {
-            cout << "Invalid option. Please try again." << endl;
-        }
-    }
-}
-void UserManagement::displayProfile(User *user)
-{
-    cout << "Username: " << user->getUsername() << endl;
-    cout << "Email: " << user->getEmail() << endl;
-    cout << "Bio: " << user->getBio() << endl;
-    cout << "Profile Status: " << (user->isProfilePublic() ? "Public" : "Private") << endl;
-}
-User *UserManagement::findUserByUsername(const string &username)
-{
-    auto it = userCredentials.find(username);
-    return (it != userCredentials.end()) ? it->second.second : nullptr; // Return user if found
-}
-void UserManagement::displayAllUsers()
-{
-    for (User *user : userProfiles)
-    {
-        cout << user->getUsername() << endl;
-    }
-}
-void PostManagement::createPost(User *user, const string &content)
-{
-    userPosts[user].push_back(content);
-    postComments[content] = {};
-    cout << "post created successfully" << endl;
-}
-void PostManagement::addComment(User *user, const std::string &postContent, const std::string &commentContent)
-{
-    std::cout << "Adding a new comment by user: " << user->getUsername() << std::endl;
-    std::cout << "Post content: " << postContent << std::endl;
-    std::cout << "Comment content: " << commentContent << std::endl;
-    Comment *newComment = new Comment(user, commentContent);
-    postComments[postContent].emplace_back(newComment);
-    std::cout << "Comment added successfully to post: " << postContent << std::endl;
-}
-void PostManagement::viewUserPosts(User *user)
-{
-    auto it = userPosts.find(user);
-    if (it != userPosts.end())
-    {
-        for (const string &post : it->second)
-        {
-            cout << post << endl;
-            interactiveCommentSection(user);
-            while (true)
-            {
-                cout << "Do you want to add a comment to this post? (y/n): ";
-                char choice;
-                cin >> choice;
-                if (choice == 'y' || choice == 'Y')
-                {
-                    cin.ignore();
-                    cout << "Enter your comment: ";
-                    string commentContent;
-                    getline(cin, commentContent);
-                    addComment(user, post, commentContent);
-                }
-                else if (choice == 'n' || choice == 'N')
-                {
-                    cout << "Next post:" << endl
-                         << endl;
-                    break;
-                }
-                else
-                {
-                    cout << "Invalid option. Please enter 'y' or 'n'." << endl;
-                }
-            }
-        }
-    }
-    else
-    {
-        cout << "No posts found!" << endl;
-    }
-}
-void PostManagement::viewPostComments(const std::string &postContent, User *currentUser)
-{
-    auto it = postComments.find(postContent);
-    if (it != postComments.end())
-    {
-        std::cout << "Comments for post: " << postContent << std::endl;
-        for (auto *comment : it->second)
-        {
-            comment->displayComment();
-            while (true)
-            {
-                std::cout << "Do you want to add a reply to this comment? (y/n): ";
-                char choice;
-                std::cin >> choice;
-                if (choice == 'y' || choice == 'Y')
-                {
-                    std::cin.ignore();
-                    std::cout << "Enter your reply: ";
-                    std::string replyContent;
-                    std::getline(std::cin, replyContent);
-                    comment->addReply(currentUser, replyContent);
-                    std::cout << "Reply added successfully!" << std::endl;
-                }
-                else if (choice == 'n' || choice == 'N')
-                {
-                    break;
-                }
-                else
-                {
-                    std::cout << "Invalid input. Please enter 'y' or 'n'." << std::endl;
-                }
-            }
-            std::cin.clear();
-            std::cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        }
-    }
-    else
-    {
-        std::cout << "No comments found for this post." << std::endl;
-    }
-}
-void PostManagement::viewFriendsPosts(User *user, const map<User *, list<User *>> &friends)
-{
-    auto it = friends.find(user);
-    if (it != friends.end())
-    {
-        for (User *friendUser : it->second)
-        {
-            cout << "Posts by " << friendUser->getUsername() << ":" << endl;
-            auto friendPosts = userPosts.find(friendUser);
-            if (friendPosts != userPosts.end())
-            {
-                for (const string &post : friendPosts->second)
-                {
-                    cout << post << endl;
-                    interactiveCommentSection(friendUser);
-                    while (true)
-                    {
-                        cout << "Do you want to add a comment to this post? (y/n): ";
-                        char choice;
-                        cin >> choice;
-                        if (choice == 'y' || choice == 'Y')
-                        {
-                            cin.ignore();
-                            cout << "Enter your comment: ";
-                            string commentContent;
-                            getline(cin, commentContent);
-                            addComment(user, post, commentContent);
-                        }
-                        else if (choice == 'n' || choice == 'N')
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            cout << "Invalid option. Please enter 'y' or 'n'." << endl;
-                        }
-                    }
-                }
-            }
-            else
-            {
-                cout << "No posts found for this friend!" << endl;
-            }
-        }
-    }
-    else
-    {
-        cout << "No friends found!" << endl;
-    }
-}
-void PostManagement::viewPublicPosts(const map<User *, list<string>> &userPosts, User *currentUser)
-{
-    for (const auto &pair : userPosts)
-    {
-        User *user = pair.first;
-        if (user != currentUser && user->isProfilePublic())
-        {
-            cout << "Posts by " << user->getUsername() << " (Public Profile):" << endl;
-            for (const string &post : pair.second)
-            {
-                cout << post << endl;
-                interactiveCommentSection(user);
-                while (true)
-                {
-                    cout << "Do you want to add a comment to this post? (y/n): ";
-                    char choice;
-                    cin >> choice;
-                    if (choice == 'y' || choice == 'Y')
-                    {
-                        cin.ignore();
-                        cout << "Enter your comment: ";
-                        string commentContent;
-                        getline(cin, commentContent);
-                        addComment(currentUser, post, commentContent);
-                    }
-                    else if (choice == 'n' || choice == 'N')
-                    {
-                        break;
-                    }
-                    else
-                    {
-                        cout << "Invalid option. Please enter 'y' or 'n'." << endl;
-                    }
-                }
-            }
-        }
-    }
-}
-void Comment::addReply(User *replier, const string &replyContent)
-{
-    replies.emplace_back(replier, replyContent);
-}
-void Comment::displayComment(int level)
-{
-    for (int i = 0; i < level; i++)
-    {
-        cout << "  ";
-    }
-    cout << getAuthor() << ": " << getContent() << endl;
-    for (auto &reply : replies)
-    {
-        reply.displayComment(level + 1);
-    }
-}
-void PostManagement::addCommentOrReply(Comment &parentComment, User *currentUser)
-{
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    cout << "Enter your comment/reply: ";
-    string content;
-    getline(cin, content);
-    parentComment.addReply(currentUser, content);
-    cout << "Reply added successfully!" << endl;
-}
-void PostManagement::interactiveCommentSection(User *currentUser)
-{
-    string content;
-    cout << "Welcome to the Comment Section!\n";
-    User *rootUser = currentUser;
-    cout << "Enter the main comment: ";
-    cin.ignore();
-    getline(cin, content);
-    Comment rootComment(rootUser, content);
-    while (true)
-    {
-        int choice;
-        cout << "\nOptions:\n";
-        cout << "1. Add a reply to the main comment\n";
-        cout << "2. Add a reply to an existing reply\n";
-        cout << "3. Display all comments\n";
-        cout << "4. Exit\n";
-        cout << "Enter your choice: ";
-        cin >> choice;
-        switch (choice)
-        {
-        case 1:
-            addCommentOrReply(rootComment, currentUser);
-            break;
-        case 2:
-        {
-            int replyIndex;
-            cout << "Enter the index of the reply you'd like to respond to: ";
-            cin >> replyIndex;
-            auto &replies = rootComment.getReplies();
-            if (replyIndex <= 0 || replyIndex > static_cast<int>(replies.size()))
-            {
-                cout << "Invalid reply index. Please try again.\n";
-                break;
-            }
-            auto it = replies.begin();
-            for (int i = 1; i < replyIndex; ++i)
-            {
-                ++it;
-            }
-            addCommentOrReply(*it, currentUser);
-            break;
-        }
-        case 3:
-            cout << "\nDisplaying all comments:\n";
-            rootComment.displayComment();
-            break;
-        case 4:
-            cout << "Exiting the Comment Section. Goodbye!\n";
-            return;
-        default:
-            cout << "Invalid choice. Please try again.\n";
-        }
-    }
-}
-void FriendSystem::addFriend(User *user, User *friendUser)
-{
-    if (find(friends[user].begin(), friends[user].end(), friendUser) != friends[user].end())
-    {
-        cout << friendUser->getUsername() << " is already a friend of " << user->getUsername() << ".\n";
-        return;
-    }
-    friends[user].push_back(friendUser);
-    friends[friendUser].push_back(user);
-    cout << "Friend added: " << user->getUsername() << " and " << friendUser->getUsername() << " are now friends.\n";
-}
-bool FriendSystem::viewFriends(User *user)
-{
-    auto &friendList = friends[user];
-    if (friendList.empty())
-    {
-        cout << user->getUsername() << " has no friends.\n";
-        return false;
-    }
-    cout << "Friends of " << user->getUsername() << ": ";
-    for (User *friendUser : friendList)
-    {
-        cout << friendUser->getUsername() << " ";
-    }
-    cout << "\n";
-    return true;
-}
-void FriendSystem::suggestFriendsBFS(User *user)
-{
-    map<User *, bool> visited;
-    list<User *> queue;
-    visited[user] = true;
-    queue.push_back(user);
-    cout << "Friend suggestions for " << user->getUsername() << " using BFS:\n";
-    while (!queue.empty())
-    {
-        User *current = queue.front();
-        queue.pop_front();
-        for (User *friendUser : friends[current])
-        {
-            if (!visited[friendUser])
-            {
-                visited[friendUser] = true;
-                queue.push_back(friendUser);
-                if (find(friends[user].begin(), friends[user].end(), friendUser) == friends[user].end())
-                {
-                    cout << "Suggested: " << friendUser->getUsername() << endl;
-                }
-            }
-        }
-    }
-    cout << "\n";
-}
-void FriendSystem::suggestFriendsDFS(User *user)
-{
-    map<User *, bool> visited;
-    map<User *, int> mutualCount;
-    dfs(user, visited, mutualCount);
-    cout << "Friend suggestions for " << user->getUsername() << " using DFS:\n";
-    for (const auto &entry : mutualCount)
-    {
-        if (entry.first != user && find(friends[user].begin(), friends[user].end(), entry.first) == friends[user].end())
-        {
-            cout << entry.first->getUsername() << " (Mutual friends: " << entry.second << ")\n";
-        }
-    }
-}
-void FriendSystem::dfs(User *user, map<User *, bool> &visited, map<User *, int> &mutualCount)
-{
-    visited[user] = true;
-    cout << "DFS visiting: " << user->getUsername() << endl;
-    for (User *friendUser : friends[user])
-    {
-        mutualCount[friendUser]++;
-        if (!visited[friendUser])
-        {
-            dfs(friendUser, visited, mutualCount);
-        }
-    }
-}
-void FriendSystem::displayPendingRequests(User *user)
-{
-    auto &requests = pendingRequests[user];
-    if (requests.empty())
-    {
-        cout << "No pending friend requests for " << user->getUsername() << ".\n";
-        return;
-    }
-    cout << "Pending friend requests for " << user->getUsername() << ": ";
-    for (User *requester : requests)
-    {
-        cout << requester->getUsername() << " ";
-    }
-    cout << "\n";
-}
-void FriendSystem::removeFriend(User *user1, User *user2)
-{
-    auto &user1Friends = friends[user1];
-    auto &user2Friends = friends[user2];
-    user1Friends.remove(user2);
-    user2Friends.remove(user1);
-    cout << "Friend removed: " << user1->getUsername() << " and " << user2->getUsername() << " are no longer friends.\n";
-}
-void FriendSystem::mutualFriendsCount(User *user1, User *user2)
-{
-    int count = 0;
-    for (User *friendUser : friends[user1])
-    {
-        if (find(friends[user2].begin(), friends[user2].end(), friendUser) != friends[user2].end())
-        {
-            count++;
-        }
-    }
-    cout << "Mutual friends between " << user1->getUsername() << " and " << user2->getUsername() << ": " << count << "\n";
-}
-
-map<User *, list<User *>> &FriendSystem::getFriendsList()
-{
-    return friends;
-}
-
-void MessagingSystem::sendMessage(User *fromUser, User *toUser, const string &message)
-{
-    userMessages[toUser].emplace(fromUser, message);
-    chatHistory[fromUser].append(fromUser, toUser, message);
-    chatHistory[toUser].append(fromUser, toUser, message);
-}
-void MessagingSystem::viewNewMessages(User *user)
-{
-    auto it = userMessages.find(user);
-    if (it != userMessages.end() && !it->second.empty())
-    {
-        cout << "New messages for " << user->getUsername() << ":\n";
-        while (!it->second.empty())
-        {
-            auto messagePair = it->second.front();
-            User *sender = messagePair.first;
-            string message = messagePair.second;
-            cout << "From " << sender->getUsername() << ": " << message << endl;
-            it->second.pop();
-        }
-    }
-    else
-    {
-        cout << "No new messages found for " << user->getUsername() << "!" << endl;
-    }
-}
-
-void MessagingSystem::viewChatHistory(User *recipient, User *friendUser)
-{
-    cout << "Chat history between " << recipient->getUsername()
-         << " and " << friendUser->getUsername() << ":\n";
-    auto recipientIt = chatHistory.find(recipient);
-    if (recipientIt != chatHistory.end())
-    {
-        recipientIt->second.display(recipient, friendUser);
-    }
-    if (recipientIt == chatHistory.end())
-    {
-        cout << "No chat history found between " << recipient->getUsername()
-             << " and " << friendUser->getUsername() << "!" << endl;
-    }
-}
-
-void MessagingSystem::createGroup(User *currentUser, UserManagement &userManagement, FriendSystem &friendSystem, MessagingSystem &messagingSystem)
-{
-    bool uHaveFriend = friendSystem.viewFriends(currentUser);
-    if (!uHaveFriend)
-    {
-        cout << "You need at least one friend to create a group!" << endl;
-        return;
-    }
-    string groupName;
-    cout << "\nEnter the group name: ";
-    cin.ignore();
-    getline(cin, groupName);
-    string groupId = "G" + to_string(groups.size() + 1);
-    set<User *> participants;
-    participants.insert(currentUser);
-    char addMore;
-    do
-    {
-        string friendUsername;
-        cout << "Enter the username of a friend to add to the group: ";
-        cin >> friendUsername;
-        User *friendUser = userManagement.findUserByUsername(friendUsername);
-        if (friendUser && friendUser != currentUser)
-        {
-            participants.insert(friendUser);
-            cout << friendUsername << " has been added to the group!" << endl;
-        }
-        else
-        {
-            cout << "Invalid username or you cannot add yourself!" << endl;
-        }
-        cout << "Do you want to add another friend? (y/n): ";
-        cin >> addMore;
-    } while (addMore == 'y' || addMore == 'Y');
-    Group newGroup(groupId, groupName);
-    newGroup.participants = participants;
-    groups[groupId] = newGroup;
-    cout << "Group \"" << groupName << "\" created successfully with Group ID: " << groupId << endl;
-}
-
-void sendMessageToGroup(User *currentUser, MessagingSystem &messagingSystem)
-{
-    string groupName;
-    cout << "Enter the Group Name: ";
-    cin.ignore();
-    getline(cin, groupName);
-    string message;
-    cout << "Enter your message: ";
-    getline(cin, message);
-    if (messagingSystem.isUserInGroup(groupName, currentUser))
-    {
-        if (messagingSystem.sendMessageToGroup(currentUser, groupName, message))
-        {
-            cout << "Message sent to group \"" << groupName << "\"!" << endl;
-        }
-        else
-        {
-            cout << "Failed to send message to group \"" << groupName << "\"." << endl;
-        }
-    }
-    else
-    {
-        cout << "You are not a member of the group \"" << groupName << "\"!" << endl;
-    }
-}
-bool MessagingSystem::sendMessageToGroup(User *fromUser, const string &groupName, const string &message)
-{
-    auto it = find_if(groups.begin(), groups.end(), [&](const auto &pair)
-                      { return pair.second.groupName == groupName; });
-    if (it != groups.end())
-    {
-        Group &group = it->second;
-        if (group.isUserInGroup(fromUser))
-        {
-            group.addMessage(fromUser, message);
-            for (User *user : group.participants)
-            {
-                if (user != fromUser)
-                {
-                    userMessages[user].push({fromUser, message});
-                }
-            }
-            return true;
-        }
-        else
-        {
-            cout << "You are not a member of the group \"" << groupName << "\"!" << endl;
-            return false;
-        }
-    }
-    else
-    {
-        cout << "Group not found!" << endl;
-        return false;
-    }
-}
-
-bool MessagingSystem::isUserInGroup(const string &groupName, User *user)
-{
-    auto it = find_if(groups.begin(), groups.end(), [&](const auto &pair)
-                      { return pair.second.groupName == groupName; });
-    if (it != groups.end())
-    {
-        Group &group = it->second;
-        return group.isUserInGroup(user);
-    }
-    return false;
-}
-
-void MessagingSystem::viewGroupChatHistory(const string &groupName, User *currentUser)
-{
-    const auto &groups = getGroups();
-    auto it = find_if(groups.begin(), groups.end(), [&](const auto &pair)
-                      { return pair.second.groupName == groupName; });
-    if (it != groups.end())
-    {
-        const Group &group = it->second;
-        if (!group.isUserInGroup(currentUser))
-        {
-            cout << "You are not a member of the group \"" << group.groupName << "\"!" << endl;
-            return;
-        }
-        cout << "Chat history for group \"" << group.groupName << "\":\n";
-        group.messageHistory.display2();
-    }
-    else
-    {
-        cout << "Group not found!" << endl;
-    }
-}
-
-bool MessagingSystem::addUserToGroup(const string &groupName, User *user)
-{
-    auto it = find_if(groups.begin(), groups.end(), [&](const auto &pair)
-                      { return pair.second.groupName == groupName; });
-    if (it != groups.end())
-    {
-        Group &group = it->second;
-        if (group.isUserInGroup(user))
-        {
-            cout << "User is already a member of the group \"" << group.groupName << "\"!" << endl;
-            return false;
-        }
-        group.addUser(user);
-        cout << "User \"" << user->getUsername() << "\" has been added to the group \"" << group.groupName << "\"!" << endl;
-        return true;
-    }
-    else
-    {
-        cout << "Group \"" << groupName << "\" not found!" << endl;
-        return false;
-    }
-}
-
-void joinGroup(User *currentUser, MessagingSystem &messagingSystem)
-{
-    cout << "Available Groups:\n";
-    const auto &groups = messagingSystem.getGroups();
-    for (const auto &groupPair : groups)
-    {
-        const Group &group = groupPair.second;
-        cout << "Group Name: " << group.groupName << endl;
-    }
-    string groupName;
-    cout << "Enter the Group Name to join: ";
-    cin.ignore();
-    getline(cin, groupName);
-    if (messagingSystem.addUserToGroup(groupName, currentUser))
-    {
-        cout << "You have joined the group \"" << groupName << "\"!" << endl;
-    }
-    else
-    {
-        cout << "Failed to join the group \"" << groupName << "\". It may not exist." << endl;
-    }
-}
-
-void leaveGroup(User *currentUser, MessagingSystem &messagingSystem)
-{
-    string groupName;
-    cout << "Enter the Group Name to leave: ";
-    cin.ignore();
-    getline(cin, groupName);
-    const auto &groups = messagingSystem.getGroups();
-    auto it = find_if(groups.begin(), groups.end(), [&](const auto &pair)
-                      { return pair.second.groupName == groupName; });
-    if (it != groups.end())
-    {
-        const string &groupId = it->first;
-        if (messagingSystem.removeUserFromGroup(groupId, currentUser))
-        {
-            cout << "You have left the group \"" << groupName << "\"!" << endl;
-        }
-        else
-        {
-            cout << "You are not a member of the group \"" << groupName << "\"!" << endl;
-        }
-    }
-    else
-    {
-        cout << "Group not found!" << endl;
-    }
-}
-
-bool MessagingSystem::removeUserFromGroup(const string &groupId, User *user)
-{
-    auto it = groups.find(groupId);
-    if (it != groups.end())
-    {
-        Group &group = it->second;
-        if (group.isUserInGroup(user))
-        {
-            group.removeUser(user);
-            return true;
-        }
-    }
-    return false;
-}
-
-void displayHeader()
-{
-    cout << "************************************************************" << endl;
-    cout << "*                    WELCOME TO OUR                        *" << endl;
-    cout << "*                    College Connect                       *" << endl;
-    cout << "*                                                          *" << endl;
-    cout << "* Submitted to:                             Programmed by: *" << endl;
-    cout << "* Sherry Garg                                        Rishu *" << endl;
-    cout << "* Sangeeta Mittal                             Swayam Gupta *" << endl;
-    cout << "*                                             Maanya Gupta *" << endl;
-    cout << "*                                         Shambhavi Mishra *" << endl;
-    cout << "*                                                          *" << endl;
-    cout << "************************************************************" << "\n"
-         << endl;
-}
-void showMenu()
-{
-    displayHeader();
-    cout << "1. Sign Up" << endl;
-    cout << "2. Log In" << endl;
-    cout << "3. Exit" << endl;
-    cout << endl;
-}
-void showUserMenu()
-{
-    displayHeader();
-    cout << "1. View Profile" << endl;
-    cout << "2. Edit Profile" << endl;
-    cout << "3. Create Post" << endl;
-    cout << "4. View My Posts" << endl;
-    cout << "5. View Friends' Posts" << endl;
-    cout << "6. View Public Posts" << endl;
-    cout << "7. View all users" << endl;
-    cout << "8. Add Friend" << endl;
-    cout << "9. Messages" << endl;
-    cout << "10. Group Messages" << endl;
-    cout << "11. Friends" << endl;
-    cout << "12. Log Out" << endl;
-    cout << endl;
-}
-void showFriendMenu()
-{
-    cout << "1. View Friends" << endl;
-    cout << "2. Suggest Friends using BFS" << endl;
-    cout << "3. Suggest Friends using DFS" << endl;
-    cout << "4. View Pending Friend Requests" << endl;
-    cout << "5. Remove a Friend" << endl;
-    cout << "6. Count Mutual Friends" << endl;
-    cout << endl;
-}
-int main()
-{
-    UserManagement userManagement;
-    PostManagement postManagement;
-    FriendSystem friendSystem;
-    MessagingSystem messagingSystem;
-    User *currentUser = nullptr;
-    while (true)
-    {
-        showMenu();
-        int choice;
-        cout << "Enter your choice: ";
-        cin >> choice;
-        if (choice == 1)
-        {
-            currentUser = userManagement.signUp();
-            if (currentUser)
-            {
-                cout << "Sign Up successful! You can now log in." << endl;
-            }
-        }
-        else if (choice == 2)
-        {
-            string username, password;
-            cout << "Enter username: ";
-            cin >> username;
-            cout << "Enter password: ";
-            cin >> password;
-            currentUser = userManagement.logIn(username, password);
-            if (currentUser)
-            {
-                cout << "Log In successful!" << endl;
-                while (true)
-                {
-                    showUserMenu();
-                    int userChoice;
-                    cout << "Enter your choice: ";
-                    cin >> userChoice;
-                    if (userChoice == 1)
-                    {
-                        userManagement.displayProfile(currentUser);
-                        sleep(1);
-                    }
-                    else if (userChoice == 2)
-                    {
-                        userManagement.editProfile(currentUser);
-                        sleep(1);
-                    }
-                    else if (userChoice == 3)
-                    {
-                        string content;
-                        cout << "Enter your post: ";
-                        cin.ignore();
-                        getline(cin, content);
-                        postManagement.createPost(currentUser, content);
-                        sleep(1);
-                    }
-                    else if (userChoice == 4)
-                    {
-                        postManagement.viewUserPosts(currentUser);
-                        sleep(1);
-                    }
-                    else if (userChoice == 5)
-                    {
-                        postManagement.viewFriendsPosts(currentUser, friendSystem.getFriendsList());
-                        sleep(1);
-                    }
-                    else if (userChoice == 6)
-                    {
-                        postManagement.viewPublicPosts(postManagement.userPosts, currentUser);
-                        sleep(1);
-                    }
-                    else if (userChoice == 7)
-                    {
-                        userManagement.displayAllUsers();
-                        sleep(1);
-                    }
-                    else if (userChoice == 8)
-                    {
-                        userManagement.displayAllUsers();
-                        sleep(1);
-                        string friendUsername;
-                        cout << "Enter friend's username: ";
-                        cin >> friendUsername;
-                        User *friendUser = userManagement.findUserByUsername(friendUsername);
-                        if (friendUser)
-                        {
-                            friendSystem.addFriend(currentUser, friendUser);
-                            cout << "Friend added!" << endl;
-                            sleep(1);
-                        }
-                        else
-                        {
-                            cout << "User not found!" << endl;
-                            sleep(1);
-                        }
-                    }
-                    else if (userChoice == 9)
-                    {
-                        int messageChoice;
-                        string recipientUsername;
-                        string message;
-                        User *recipient = nullptr;
-                        bool uHaveFriend = false;
-                        do
-                        {
-                            cout << "Messaging Menu:\n";
-                            cout << "1. View New Messages\n";
-                            cout << "2. Send Message\n";
-                            cout << "3. View Chat History\n";
-                            cout << "0. Go Back\n";
-                            cout << "Enter your choice: ";
-                            cin >> messageChoice;
-                            switch (messageChoice)
-                            {
-                            case 1:
-                                messagingSystem.viewNewMessages(currentUser);
-                                sleep(1);
-                                break;
-
-                            case 2:
-                                uHaveFriend = friendSystem.viewFriends(currentUser);
-                                if (uHaveFriend)
-                                {
-                                    cout << "Enter recipient's username: ";
-                                    cin >> recipientUsername;
-                                    recipient = userManagement.findUserByUsername(recipientUsername);
-                                    if (recipient)
-                                    {
-                                        cout << "Enter your message: ";
-                                        cin.ignore();
-                                        getline(cin, message);
-                                        messagingSystem.sendMessage(currentUser, recipient, message);
-                                        cout << "Message sent!" << endl;
-                                    }
-                                    else
-                                    {
-                                        cout << "User not found!" << endl;
-                                    }
-                                }
-                                else
-                                {
-                                    cout << "No friends found!" << endl;
-                                    cout << "You can only message your Friends!" << endl;
-                                }
-                                sleep(1);
-                                break;
-                            case 3:
-                                uHaveFriend = friendSystem.viewFriends(currentUser);
-                                if (uHaveFriend)
-                                {
-                                    string friendUsername;
-                                    cout << "Enter Friend's username: ";
-                                    cin >> friendUsername;
-                                    User *friendUser = userManagement.findUserByUsername(friendUsername);
-                                    if (friendUser)
-                                    {
-                                        messagingSystem.viewChatHistory(currentUser, friendUser);
-                                    }
-                                    else
-                                    {
-                                        cout << "Friend not found!" << endl;
-                                    }
-                                }
-                                else
-                                {
-                                    cout << "You have no friends to view chat history with!" << endl;
-                                }
-                                sleep(1);
-                                break;
-                            case 0:
-                                cout << "Exiting messaging menu." << endl;
-                                break;
-                            default:
-                                cout << "Invalid choice! Please try again." << endl;
-                                break;
-                            }
-                        } while (messageChoice != 0);
-                    }
-                    else if (userChoice == 10)
-                    {
-                        int groupChoice;
-                        do
-                        {
-                            cout << "Group Messaging Menu:\n";
-                            cout << "1. Create Group\n";
-                            cout << "2. Send Message to Group\n";
-                            cout << "3. View Group Chat History\n";
-                            cout << "4. Join Group\n";
-                            cout << "5. Leave Group\n";
-                            cout << "0. Go Back\n";
-                            cout << "Enter your choice: ";
-                            cin >> groupChoice;
-                            switch (groupChoice)
-                            {
-                            case 1:
-                                messagingSystem.createGroup(currentUser, userManagement, friendSystem, messagingSystem);
-                                break;
-                            case 2:
-                                sendMessageToGroup(currentUser, messagingSystem);
-                                break;
-                            case 3:
-                            {
-                                string groupName;
-                                cout << "Enter the Group Name to view chat history: ";
-                                cin.ignore();
-                                getline(cin, groupName);
-                                messagingSystem.viewGroupChatHistory(groupName, currentUser);
-                                break;
-                            }
-                            case 4:
-                                joinGroup(currentUser, messagingSystem);
-                                break;
-                            case 5:
-                                leaveGroup(currentUser, messagingSystem);
-                                break;
-                            case 0:
-                                cout << "Exiting group messaging menu." << endl;
-                                break;
-                            default:
-                                cout << "Invalid choice! Please try again." << endl;
-                                break;
-                            }
-                        } while (groupChoice != 0);
-                    }
-                    else if (userChoice == 11)
-                    {
-                        showFriendMenu();
-                        int choice;
-                        cin >> choice;
-                        if (choice == 1)
-                        {
-                            if (friendSystem.viewFriends(currentUser))
-                            {
-                                cout << "Friends displayed successfully!" << endl;
-                                sleep(1);
-                            }
-                        }
-                        else if (choice == 2)
-                        {
-                            friendSystem.suggestFriendsBFS(currentUser);
-                            sleep(1);
-                        }
-                        else if (choice == 3)
-                        {
-                            friendSystem.suggestFriendsDFS(currentUser);
-                            sleep(1);
-                        }
-                        else if (choice == 4)
-                        {
-                            friendSystem.displayPendingRequests(currentUser);
-                            sleep(1);
-                        }
-                        else if (choice == 5)
-                        {
-                            string removeFriendUsername;
-                            cout << "Enter the username of the friend you want to remove: ";
-                            cin >> removeFriendUsername;
-                            User *removeFriend = userManagement.findUserByUsername(removeFriendUsername);
-                            if (removeFriend)
-                            {
-                                friendSystem.removeFriend(currentUser, removeFriend);
-                                cout << "Friend removed!" << endl;
-                                sleep(2);
-                            }
-                            else
-                            {
-                                cout << "User not found!" << endl;
-                                sleep(1);
-                            }
-                        }
-                        else if (choice == 6)
-                        {
-                            string mutualFriendUsername;
-                            cout << "Enter the username to find mutual friends with: ";
-                            cin >> mutualFriendUsername;
-                            User *mutualFriendUser = userManagement.findUserByUsername(mutualFriendUsername);
-                            if (mutualFriendUser)
-                            {
-                                friendSystem.mutualFriendsCount(currentUser, mutualFriendUser);
-                                sleep(1);
-                            }
-                            else
-                            {
-                                cout << "User not found!" << endl;
-                                sleep(1);
-                            }
-                        }
-                    }
-                    else if (userChoice == 12)
-                    {
-                        currentUser = nullptr;
-                        break;
-                    }
-                }
-            }
-            else
-            {
-                cout << "Invalid username or password!" << endl;
-            }
-        }
-        else if (choice == 3)
-        {
-            break;
-        }
-    }
-    return 0;
-}
\ No newline at end of file
+}
+bool UserManagement::updateProfileField(User *user, ProfileField field, const string &value)
+{
+    MemoryScope memory(Subsystem::Users);
+    StripeWriteGuard profile(profileLocks, {user->getId()});
+    // Only changes that touch userCredentials need the accounts lock
+    unique_lock<shared_mutex> accounts(accountsMutex, defer_lock);
+    if (field == ProfileField::Username || field == ProfileField::Password)
+    {
+        accounts.lock();
+    }
+    if (field == ProfileField::Username && userCredentials.count(value))
+    {
+        return false;
+    }
+    if (wal)
+    {
+        wal->append(WalRecordType::UpdateProfile, WalPayload().putU32(user->getId()).putU8(static_cast<uint8_t>(field)).putString(value));
+    }
+    switch (field)
+    {
+    case ProfileField::Username:
+    {
+        string oldUsername = user->getUsername();
+        userCredentials[value] = userCredentials[oldUsername];
+        userCredentials.erase(oldUsername);
+        user->updateUsername(value);
+        break;
+    }
+    case ProfileField::Bio:
+        user->updateBio(value);
+        break;
+    case ProfileField::Email:
+        user->updateEmail(value);
+        break;
+    case ProfileField::Password:
+        user->updatePassword(value);
+        userCredentials[user->getUsername()].first = value;
+        break;
+    case ProfileField::Privacy:
+        user->updatePrivacy(value == "1");
+        break;
+    }
+    return true;
+}
+User *UserManagement::logIn(const string &username, const string &password)
+{
+    OperationTimer timer(Operation::LogIn);
+    shared_lock<shared_mutex> lock(accountsMutex);
+    auto it = userCredentials.find(username);
+    if (it != userCredentials.end() && it->second.first == password)
+    {
+        return it->second.second;
+    }
+    timer.fail();
+    return nullptr;
+}
+void UserManagement::editProfile(User *user)
+{
+    int choice;
+    while (true)
+    {
+        cout << "Edit Profile Menu:" << endl;
+        cout << "1. Change Username" << endl;
+        cout << "2. Change Bio" << endl;
+        cout << "3. Change Email" << endl;
+        cout << "4. Change Password" << endl;
+        cout << "5. Change Privacy Settings (Public/Private)" << endl;
+        cout << "6. Go Back" << endl;
+        cout << "Enter your choice: ";
+        cin >> choice;
+        if (choice == 1)
+        {
+            string newUsername;
+            while (true)
+            {
+                cout << "Enter new username: ";
+                cin >> newUsername;
+                if (updateProfileField(user, ProfileField::Username, newUsername))
+                {
+                    cout << "Username updated successfully!" << endl;
+                    break;
+                }
+                else
+                {
+                    cout << "Username already taken! Please try again." << endl;
+                }
+            }
+        }
+        else if (choice == 2)
+        {
+            string newBio;
+            cout << "Enter new bio: ";
+            cin.ignore();
+            getline(cin, newBio);
+            updateProfileField(user, ProfileField::Bio, newBio);
+            cout << "Bio updated successfully!" << endl;
+        }
+        else if (choice == 3)
+        {
+            string newEmail;
+            while (true)
+            {
+                cout << "Enter new email: ";
+                cin >> newEmail;
+                if (isValidEmail(newEmail))
+                {
+                    updateProfileField(user, ProfileField::Email, newEmail);
+                    cout << "Email updated successfully!" << endl;
+                    break;
+                }
+                cout << "Invalid email format! Please try again." << endl;
+            }
+        }
+        else if (choice == 4)
+        {
+            string newPassword, confirmPassword;
+            cout << "Enter new password: ";
+            cin >> newPassword;
+            cout << "Confirm new password: ";
+            cin >> confirmPassword;
+            if (newPassword == confirmPassword)
+            {
+                updateProfileField(user, ProfileField::Password, newPassword);
+                cout << "Password updated successfully!" << endl;
+            }
+            else
+            {
+                cout << "Passwords do not match. Try again." << endl;
+            }
+        }
+        else if (choice == 5)
+        {
+            bool isPublic;
+            while (true)
+            {
+                char choice;
+                cout << "Do you want your profile to be public? (Y for Yes, N for No): ";
+                cin >> choice;
+                if (choice == 'y' || choice == 'Y' || choice == 'n' || choice == 'N')
+                {
+                    isPublic = (choice == 'y' || choice == 'Y');
+                    updateProfileField(user, ProfileField::Privacy, isPublic ? "1" : "0");
+                    cout << "Privacy settings updated successfully!" << endl;
+                    break;
+                }
+                else
+                {
+                    cout << "Invalid input. Please enter 'Y' for Yes or 'N' for No." << endl;
+                }
+            }
+        }
+        else if (choice == 6)
+        {
+            break;
+        }
+        else
+        {
+            cout << "Invalid option. Please try again." << endl;
+        }
+    }
+}
+void UserManagement::displayProfile(User *user)
+{
+    cout << "Username: " << user->getUsername() << endl;
+    cout << "Email: " << user->getEmail() << endl;
+    cout << "Bio: " << user->getBio() << endl;
+    cout << "Profile Status: " << (user->isProfilePublic() ? "Public" : "Private") << endl;
+}
+User *UserManagement::findUserByUsername(const string &username)
+{
+    shared_lock<shared_mutex> lock(accountsMutex);
+    auto it = userCredentials.find(username);
+    return (it != userCredentials.end()) ? it->second.second : nullptr; // Return user if found
+}
+User *UserManagement::findUserById(uint32_t id)
+{
+    shared_lock<shared_mutex> lock(accountsMutex);
+    return id < usersById.size() ? usersById[id] : nullptr;
+}
+vector<User *> UserManagement::getAllUsers() const
+{
+    shared_lock<shared_mutex> lock(accountsMutex);
+    return vector<User *>(userProfiles.begin(), userProfiles.end());
+}
+void UserManagement::displayAllUsers()
+{
+    for (User *user : getAllUsers())
+    {
+        cout << user->getUsername() << endl;
+    }
+}
+// Copy of a published view (empty if there is none) with `item` appended
+template <typename T>
+static vector<T> appended(const vector<T> *view, T item)
+{
+    vector<T> result;
+    result.reserve((view ? view->size() : 0) + 1);
+    if (view)
+    {
+        result.insert(result.end(), view->begin(), view->end());
+    }
+    result.push_back(item);
+    return result;
+}
+// Copy of a published view without any occurrence of `item`
+template <typename T>
+static vector<T> without(const vector<T> *view, T item)
+{
+    vector<T> result;
+    if (view)
+    {
+        result.reserve(view->size());
+        for (const T &entry : *view)
+        {
+            if (entry != item)
+            {
+                result.push_back(entry);
+            }
+        }
+    }
+    return result;
+}
+vector<Comment *> &PostManagement::commentsOf(const string &postContent)
+{
+    {
+        shared_lock<shared_mutex> lock(postsMutex);
+        auto it = postComments.find(postContent);
+        if (it != postComments.end())
+        {
+            return it->second;
+        }
+    }
+    unique_lock<shared_mutex> lock(postsMutex);
+    return postComments[postContent];
+}
+void PostManagement::createPost(User *user, const string &content)
+{
+    TraceSpan span("PostManagement::createPost", "posts");
+    OperationTimer timer(Operation::CreatePost);
+    MemoryScope memory(Subsystem::Posts);
+    unique_lock<shared_mutex> index(postsMutex); // A new post is almost always a new key, so insert straight away
+    list<string> &posts = userPosts[user];
+    vector<Comment *> &comments = postComments[content];
+    index.unlock();
+    uint64_t ticket;
+    {
+        StripeWriteGuard author(authorLocks, {user->getId()});
+        StripeWriteGuard thread(threadLocks, {LockStripes::keyOf(content)});
+        if (wal)
+        {
+            wal->append(WalRecordType::CreatePost, WalPayload().putU32(user->getId()).putString(content));
+        }
+        posts.push_back(content);
+        comments = {};
+        const string *post = &posts.back(); // List nodes never move, so views point at them
+        ticket = postViews.stage(user->getId(), [&](const vector<const string *> *newest)
+                                 { return appended(newest, post); });
+    }
+    postViews.publish(ticket);
+    if (events)
+    {
+        events->publish(MutationType::CreatePost, user->getId(), 0, content);
+    }
+    cout << "post created successfully" << endl;
+}
+vector<string> PostManagement::getUserPosts(User *user) const
+{
+    EpochGuard guard; // Reads the published view: no lock, even while the author is posting
+    const vector<const string *> *posts = postViews.find(user->getId());
+    vector<string> result;
+    if (posts)
+    {
+        result.reserve(posts->size());
+        for (const string *post : *posts)
+        {
+            result.push_back(*post);
+        }
+    }
+    return result;
+}
+vector<Comment *> PostManagement::getComments(const string &postContent) const
+{
+    shared_lock<shared_mutex> lock(postsMutex);
+    auto it = postComments.find(postContent);
+    if (it == postComments.end())
+    {
+        return {};
+    }
+    lock.unlock();
+    StripeReadGuard thread(threadLocks, {LockStripes::keyOf(postContent)});
+    return it->second;
+}
+// Appends `comment` and its replies, depth first, in the layout of Comment::displayComment
+static void flattenComment(Comment &comment, int level, vector<string> &lines)
+{
+    lines.push_back(string(level * 2, ' ') + comment.getAuthor() + ": " + comment.getContent());
+    for (Comment &reply : comment.getReplies())
+    {
+        flattenComment(reply, level + 1, lines);
+    }
+}
+vector<string> PostManagement::getCommentThread(const string &postContent) const
+{
+    vector<string> lines;
+    shared_lock<shared_mutex> lock(postsMutex);
+    auto it = postComments.find(postContent);
+    if (it == postComments.end())
+    {
+        return lines;
+    }
+    lock.unlock();
+    StripeReadGuard thread(threadLocks, {LockStripes::keyOf(postContent)});
+    for (Comment *comment : it->second)
+    {
+        flattenComment(*comment, 0, lines);
+    }
+    return lines;
+}
+void PostManagement::publishAllViews()
+{
+    uint64_t ticket = 0;
+    for (const auto &entry : userPosts)
+    {
+        vector<const string *> view;
+        view.reserve(entry.second.size());
+        for (const string &post : entry.second)
+        {
+            view.push_back(&post);
+        }
+        ticket = postViews.stage(entry.first->getId(), move(view));
+    }
+    postViews.publish(ticket);
+}
+vector<User *> PostManagement::getAuthors() const
+{
+    vector<User *> authors;
+    shared_lock<shared_mutex> lock(postsMutex);
+    for (const auto &pair : userPosts)
+    {
+        authors.push_back(pair.first);
+    }
+    return authors;
+}
+void PostManagement::addComment(User *user, const std::string &postContent, const std::string &commentContent)
+{
+    TraceSpan span("PostManagement::addComment", "posts");
+    OperationTimer timer(Operation::AddComment);
+    MemoryScope memory(Subsystem::Comments);
+    std::cout << "Adding a new comment by user: " << user->getUsername() << std::endl;
+    std::cout << "Post content: " << postContent << std::endl;
+    std::cout << "Comment content: " << commentContent << std::endl;
+    vector<Comment *> &comments = commentsOf(postContent);
+    {
+        StripeWriteGuard thread(threadLocks, {LockStripes::keyOf(postContent)});
+        if (wal)
+        {
+            wal->append(WalRecordType::AddComment, WalPayload().putU32(user->getId()).putString(postContent).putString(commentContent));
+        }
+        Comment *newComment = new Comment(user, commentContent);
+        comments.emplace_back(newComment);
+    }
+    if (events)
+    {
+        events->publish(MutationType::AddComment, user->getId(), 0, commentContent, postContent);
+    }
+    std::cout << "Comment added successfully to post: " << postContent << std::endl;
+}
+// Finds the chain of reply indexes leading from `comment` down to `target`
+static bool findReplyPath(Comment &comment, const Comment *target, vector<uint32_t> &path)
+{
+    uint32_t index = 0;
+    for (Comment &reply : comment.getReplies())
+    {
+        path.push_back(index++);
+        if (&reply == target || findReplyPath(reply, target, path))
+        {
+            return true;
+        }
+        path.pop_back();
+    }
+    return false;
+}
+void PostManagement::addReplyToComment(User *user, const string &postContent, Comment *parentComment, const string &replyContent)
+{
+    TraceSpan span("PostManagement::addReplyToComment", "posts");
+    OperationTimer timer(Operation::AddComment);
+    MemoryScope memory(Subsystem::Comments);
+    const vector<Comment *> &comments = commentsOf(postContent);
+    {
+        StripeWriteGuard thread(threadLocks, {LockStripes::keyOf(postContent)});
+        if (wal)
+        {
+            // Comments have no ids, so the reply is logged by its position: top-level comment index, then reply indexes
+            TraceSpan pathSpan("find reply path", "posts");
+            vector<uint32_t> path;
+            for (uint32_t i = 0; i < comments.size(); i++)
+            {
+                path.assign(1, i);
+                if (comments[i] == parentComment || findReplyPath(*comments[i], parentComment, path))
+                {
+                    break;
+                }
+                path.clear();
+            }
+            pathSpan.end();
+            WalPayload payload;
+            payload.putU32(user->getId()).putString(postContent).putU32(static_cast<uint32_t>(path.size()));
+            for (uint32_t step : path)
+            {
+                payload.putU32(step);
+            }
+            wal->append(WalRecordType::AddReply, payload.putString(replyContent));
+        }
+        parentComment->addReply(user, replyContent);
+    }
+    if (events)
+    {
+        events->publish(MutationType::AddReply, user->getId(), 0, replyContent, postContent);
+    }
+}
+void PostManagement::viewUserPosts(User *user)
+{
+    TraceSpan span("PostManagement::viewUserPosts", "posts");
+    vector<string> posts = getUserPosts(user);
+    if (!posts.empty())
+    {
+        for (const string &post : posts)
+        {
+            cout << post << endl;
+            interactiveCommentSection(user);
+            while (true)
+            {
+                cout << "Do you want to add a comment to this post? (y/n): ";
+                char choice;
+                cin >> choice;
+                if (choice == 'y' || choice == 'Y')
+                {
+                    cin.ignore();
+                    cout << "Enter your comment: ";
+                    string commentContent;
+                    getline(cin, commentContent);
+                    addComment(user, post, commentContent);
+                }
+                else if (choice == 'n' || choice == 'N')
+                {
+                    cout << "Next post:" << endl
+                         << endl;
+                    break;
+                }
+                else
+                {
+                    cout << "Invalid option. Please enter 'y' or 'n'." << endl;
+                }
+            }
+        }
+    }
+    else
+    {
+        cout << "No posts found!" << endl;
+    }
+}
+void PostManagement::viewPostComments(const std::string &postContent, User *currentUser)
+{
+    TraceSpan span("PostManagement::viewPostComments", "posts");
+    vector<Comment *> comments = getComments(postContent);
+    if (!comments.empty())
+    {
+        std::cout << "Comments for post: " << postContent << std::endl;
+        for (auto *comment : comments)
+        {
+            {
+                StripeReadGuard thread(threadLocks, {LockStripes::keyOf(postContent)});
+                comment->displayComment();
+            }
+            while (true)
+            {
+                std::cout << "Do you want to add a reply to this comment? (y/n): ";
+                char choice;
+                std::cin >> choice;
+                if (choice == 'y' || choice == 'Y')
+                {
+                    std::cin.ignore();
+                    std::cout << "Enter your reply: ";
+                    std::string replyContent;
+                    std::getline(std::cin, replyContent);
+                    addReplyToComment(currentUser, postContent, comment, replyContent);
+                    std::cout << "Reply added successfully!" << std::endl;
+                }
+                else if (choice == 'n' || choice == 'N')
+                {
+                    break;
+                }
+                else
+                {
+                    std::cout << "Invalid input. Please enter 'y' or 'n'." << std::endl;
+                }
+            }
+            std::cin.clear();
+            std::cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        }
+    }
+    else
+    {
+        std::cout << "No comments found for this post." << std::endl;
+    }
+}
+void PostManagement::viewFriendsPosts(User *user, const vector<User *> &friends)
+{
+    TraceSpan span("PostManagement::viewFriendsPosts", "posts");
+    if (!friends.empty())
+    {
+        span.annotate("friends", friends.size());
+        for (User *friendUser : friends)
+        {
+            TraceSpan friendSpan("friend's posts", "posts");
+            cout << "Posts by " << friendUser->getUsername() << ":" << endl;
+            vector<string> friendPosts = getUserPosts(friendUser);
+            if (!friendPosts.empty())
+            {
+                for (const string &post : friendPosts)
+                {
+                    cout << post << endl;
+                    interactiveCommentSection(friendUser);
+                    while (true)
+                    {
+                        cout << "Do you want to add a comment to this post? (y/n): ";
+                        char choice;
+                        cin >> choice;
+                        if (choice == 'y' || choice == 'Y')
+                        {
+                            cin.ignore();
+                            cout << "Enter your comment: ";
+                            string commentContent;
+                            getline(cin, commentContent);
+                            addComment(user, post, commentContent);
+                        }
+                        else if (choice == 'n' || choice == 'N')
+                        {
+                            break;
+                        }
+                        else
+                        {
+                            cout << "Invalid option. Please enter 'y' or 'n'." << endl;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                cout << "No posts found for this friend!" << endl;
+            }
+        }
+    }
+    else
+    {
+        cout << "No friends found!" << endl;
+    }
+}
+void PostManagement::viewPublicPosts(User *currentUser)
+{
+    TraceSpan span("PostManagement::viewPublicPosts", "posts");
+    for (User *user : getAuthors())
+    {
+        if (user != currentUser && user->isProfilePublic())
+        {
+            cout << "Posts by " << user->getUsername() << " (Public Profile):" << endl;
+            for (const string &post : getUserPosts(user))
+            {
+                cout << post << endl;
+                interactiveCommentSection(user);
+                while (true)
+                {
+                    cout << "Do you want to add a comment to this post? (y/n): ";
+                    char choice;
+                    cin >> choice;
+                    if (choice == 'y' || choice == 'Y')
+                    {
+                        cin.ignore();
+                        cout << "Enter your comment: ";
+                        string commentContent;
+                        getline(cin, commentContent);
+                        addComment(currentUser, post, commentContent);
+                    }
+                    else if (choice == 'n' || choice == 'N')
+                    {
+                        break;
+                    }
+                    else
+                    {
+                        cout << "Invalid option. Please enter 'y' or 'n'." << endl;
+                    }
+                }
+            }
+        }
+    }
+}
+void Comment::addReply(User *replier, const string &replyContent)
+{
+    replies.emplace_back(replier, replyContent);
+}
+void Comment::displayComment(int level)
+{
+    for (int i = 0; i < level; i++)
+    {
+        cout << "  ";
+    }
+    cout << getAuthor() << ": " << getContent() << endl;
+    for (auto &reply : replies)
+    {
+        reply.displayComment(level + 1);
+    }
+}
+void PostManagement::addCommentOrReply(Comment &parentComment, User *currentUser)
+{
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "Enter your comment/reply: ";
+    string content;
+    getline(cin, content);
+    parentComment.addReply(currentUser, content);
+    cout << "Reply added successfully!" << endl;
+}
+void PostManagement::interactiveCommentSection(User *currentUser)
+{
+    string content;
+    cout << "Welcome to the Comment Section!\n";
+    User *rootUser = currentUser;
+    cout << "Enter the main comment: ";
+    cin.ignore();
+    getline(cin, content);
+    Comment rootComment(rootUser, content);
+    while (true)
+    {
+        int choice;
+        cout << "\nOptions:\n";
+        cout << "1. Add a reply to the main comment\n";
+        cout << "2. Add a reply to an existing reply\n";
+        cout << "3. Display all comments\n";
+        cout << "4. Exit\n";
+        cout << "Enter your choice: ";
+        cin >> choice;
+        switch (choice)
+        {
+        case 1:
+            addCommentOrReply(rootComment, currentUser);
+            break;
+        case 2:
+        {
+            int replyIndex;
+            cout << "Enter the index of the reply you'd like to respond to: ";
+            cin >> replyIndex;
+            auto &replies = rootComment.getReplies();
+            if (replyIndex <= 0 || replyIndex > static_cast<int>(replies.size()))
+            {
+                cout << "Invalid reply index. Please try again.\n";
+                break;
+            }
+            auto it = replies.begin();
+            for (int i = 1; i < replyIndex; ++i)
+            {
+                ++it;
+            }
+            addCommentOrReply(*it, currentUser);
+            break;
+        }
+        case 3:
+            cout << "\nDisplaying all comments:\n";
+            rootComment.displayComment();
+            break;
+        case 4:
+            cout << "Exiting the Comment Section. Goodbye!\n";
+            return;
+        default:
+            cout << "Invalid choice. Please try again.\n";
+        }
+    }
+}
+list<User *> &FriendSystem::friendsOf(User *user)
+{
+    {
+        shared_lock<shared_mutex> lock(friendsMutex);
+        auto it = friends.find(user);
+        if (it != friends.end())
+        {
+            return it->second;
+        }
+    }
+    unique_lock<shared_mutex> lock(friendsMutex);
+    return friends[user];
+}
+vector<User *> FriendSystem::getFriends(User *user) const
+{
+    EpochGuard guard; // Reads the published view: no lock, even while the list changes
+    const vector<User *> *userFriends = friendViews.find(user->getId());
+    return userFriends ? *userFriends : vector<User *>();
+}
+void FriendSystem::publishAllViews()
+{
+    uint64_t ticket = 0;
+    for (const auto &entry : friends)
+    {
+        ticket = friendViews.stage(entry.first->getId(), vector<User *>(entry.second.begin(), entry.second.end()));
+    }
+    friendViews.publish(ticket);
+}
+void FriendSystem::addFriend(User *user, User *friendUser)
+{
+    TraceSpan span("FriendSystem::addFriend", "friends");
+    OperationTimer timer(Operation::AddFriend);
+    MemoryScope memory(Subsystem::Friends);
+    list<User *> &userFriends = friendsOf(user);
+    list<User *> &otherFriends = friendsOf(friendUser);
+    uint64_t ticket;
+    {
+        StripeWriteGuard stripes(userLocks, {user->getId(), friendUser->getId()});
+        TraceSpan check("duplicate check", "friends");
+        bool alreadyFriends = find(userFriends.begin(), userFriends.end(), friendUser) != userFriends.end();
+        check.end();
+        if (alreadyFriends)
+        {
+            cout << friendUser->getUsername() << " is already a friend of " << user->getUsername() << ".\n";
+            timer.fail();
+            return;
+        }
+        if (wal)
+        {
+            wal->append(WalRecordType::AddFriend, WalPayload().putU32(user->getId()).putU32(friendUser->getId()));
+        }
+        userFriends.push_back(friendUser);
+        otherFriends.push_back(user);
+        friendViews.stage(user->getId(), [&](const vector<User *> *newest)
+                          { return appended(newest, friendUser); });
+        ticket = friendViews.stage(friendUser->getId(), [&](const vector<User *> *newest)
+                                   { return appended(newest, user); });
+    }
+    friendViews.publish(ticket);
+    if (events)
+    {
+        events->publish(MutationType::AddFriend, user->getId(), friendUser->getId());
+    }
+    cout << "Friend added: " << user->getUsername() << " and " << friendUser->getUsername() << " are now friends.\n";
+}
+bool FriendSystem::viewFriends(User *user)
+{
+    TraceSpan span("FriendSystem::viewFriends", "friends");
+    vector<User *> friendList = getFriends(user);
+    if (friendList.empty())
+    {
+        cout << user->getUsername() << " has no friends.\n";
+        return false;
+    }
+    cout << "Friends of " << user->getUsername() << ": ";
+    for (User *friendUser : friendList)
+    {
+        cout << friendUser->getUsername() << " ";
+    }
+    cout << "\n";
+    return true;
+}
+vector<User *> FriendSystem::suggestFriends(User *user)
+{
+    QueryContext context;
+    return suggestFriendsAsync(user, context).runInline();
+}
+Task<vector<User *>> FriendSystem::suggestFriendsAsync(User *user, QueryContext &context)
+{
+    OperationTimer timer(Operation::SuggestFriends);
+    // A span must begin and end on one thread, so each quantum between yields is its own span
+    optional<TraceSpan> span(in_place, "FriendSystem::suggestFriends", "friends");
+    map<User *, bool> visited;
+    list<User *> queue;
+    vector<User *> suggestions;
+    visited[user] = true;
+    queue.push_back(user);
+    vector<User *> userFriends = getFriends(user);
+    while (!queue.empty())
+    {
+        User *current = queue.front();
+        queue.pop_front();
+        {
+            EpochGuard guard; // Lists are read in place from the published views; released before any yield
+            const vector<User *> *currentFriends = friendViews.find(current->getId());
+            for (size_t i = 0; currentFriends && i < currentFriends->size(); i++)
+            {
+                User *friendUser = (*currentFriends)[i];
+                if (!visited[friendUser])
+                {
+                    visited[friendUser] = true;
+                    queue.push_back(friendUser);
+                    if (find(userFriends.begin(), userFriends.end(), friendUser) == userFriends.end())
+                    {
+                        suggestions.push_back(friendUser);
+                    }
+                }
+            }
+        }
+        if (context.due())
+        {
+            span.reset();
+            co_await context.yield();
+            span.emplace("FriendSystem::suggestFriends", "friends");
+        }
+    }
+    span->annotate("visited", visited.size());
+    co_return suggestions;
+}
+void FriendSystem::suggestFriendsBFS(User *user)
+{
+    vector<User *> suggestions = suggestFriends(user);
+    cout << "Friend suggestions for " << user->getUsername() << " using BFS:\n";
+    for (User *suggested : suggestions)
+    {
+        cout << "Suggested: " << suggested->getUsername() << endl;
+    }
+    cout << "\n";
+}
+void FriendSystem::suggestFriendsDFS(User *user)
+{
+    TraceSpan span("FriendSystem::suggestFriendsDFS", "friends");
+    OperationTimer timer(Operation::SuggestFriends);
+    map<User *, bool> visited;
+    map<User *, int> mutualCount;
+    TraceSpan traversal("traversal", "friends");
+    dfs(user, visited, mutualCount);
+    traversal.annotate("visited", visited.size());
+    traversal.end();
+    TraceSpan output("output", "friends");
+    vector<User *> userFriends = getFriends(user);
+    cout << "Friend suggestions for " << user->getUsername() << " using DFS:\n";
+    for (const auto &entry : mutualCount)
+    {
+        if (entry.first != user && find(userFriends.begin(), userFriends.end(), entry.first) == userFriends.end())
+        {
+            cout << entry.first->getUsername() << " (Mutual friends: " << entry.second << ")\n";
+        }
+    }
+}
+void FriendSystem::dfs(User *user, map<User *, bool> &visited, map<User *, int> &mutualCount)
+{
+    visited[user] = true;
+    cout << "DFS visiting: " << user->getUsername() << endl;
+    for (User *friendUser : getFriends(user))
+    {
+        mutualCount[friendUser]++;
+        if (!visited[friendUser])
+        {
+            dfs(friendUser, visited, mutualCount);
+        }
+    }
+}
+void FriendSystem::displayPendingRequests(User *user)
+{
+    list<User *> requests;
+    {
+        shared_lock<shared_mutex> lock(friendsMutex);
+        auto it = pendingRequests.find(user);
+        if (it != pendingRequests.end())
+        {
+            requests = it->second;
+        }
+    }
+    if (requests.empty())
+    {
+        cout << "No pending friend requests for " << user->getUsername() << ".\n";
+        return;
+    }
+    cout << "Pending friend requests for " << user->getUsername() << ": ";
+    for (User *requester : requests)
+    {
+        cout << requester->getUsername() << " ";
+    }
+    cout << "\n";
+}
+void FriendSystem::removeFriend(User *user1, User *user2)
+{
+    TraceSpan span("FriendSystem::removeFriend", "friends");
+    OperationTimer timer(Operation::RemoveFriend);
+    MemoryScope memory(Subsystem::Friends);
+    auto &user1Friends = friendsOf(user1);
+    auto &user2Friends = friendsOf(user2);
+    uint64_t ticket;
+    {
+        StripeWriteGuard stripes(userLocks, {user1->getId(), user2->getId()});
+        if (wal)
+        {
+            wal->append(WalRecordType::RemoveFriend, WalPayload().putU32(user1->getId()).putU32(user2->getId()));
+        }
+        user1Friends.remove(user2);
+        user2Friends.remove(user1);
+        friendViews.stage(user1->getId(), [&](const vector<User *> *newest)
+                          { return without(newest, user2); });
+        ticket = friendViews.stage(user2->getId(), [&](const vector<User *> *newest)
+                                   { return without(newest, user1); });
+    }
+    friendViews.publish(ticket);
+    if (events)
+    {
+        events->publish(MutationType::RemoveFriend, user1->getId(), user2->getId());
+    }
+    cout << "Friend removed: " << user1->getUsername() << " and " << user2->getUsername() << " are no longer friends.\n";
+}
+int FriendSystem::countMutualFriends(User *user1, User *user2)
+{
+    TraceSpan span("FriendSystem::countMutualFriends", "friends");
+    int count = 0;
+    EpochGuard guard;
+    const vector<User *> *friends1 = friendViews.find(user1->getId());
+    const vector<User *> *friends2 = friendViews.find(user2->getId());
+    if (!friends1 || !friends2)
+    {
+        return 0;
+    }
+    for (User *friendUser : *friends1)
+    {
+        if (find(friends2->begin(), friends2->end(), friendUser) != friends2->end())
+        {
+            count++;
+        }
+    }
+    return count;
+}
+void FriendSystem::mutualFriendsCount(User *user1, User *user2)
+{
+    int count = countMutualFriends(user1, user2);
+    cout << "Mutual friends between " << user1->getUsername() << " and " << user2->getUsername() << ": " << count << "\n";
+}
+
+map<User *, list<User *>> &FriendSystem::getFriendsList()
+{
+    return friends;
+}
+
+pair<User *, User *> MessagingSystem::conversationKey(User *user1, User *user2)
+{
+    return less<User *>()(user1, user2) ? make_pair(user1, user2) : make_pair(user2, user1);
+}
+void MessagingSystem::stampMessage(uint64_t &seq, int64_t &timestamp)
+{
+    lock_guard<mutex> lock(clockMutex);
+    int64_t now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    lastTimestamp = max(lastTimestamp, now); // Never go backwards, even if the wall clock does
+    seq = nextSequence++;
+    timestamp = lastTimestamp;
+}
+const DoublyLinkedList *MessagingSystem::findConversation(User *user1, User *user2) const
+{
+    shared_lock<shared_mutex> lock(indexMutex);
+    auto it = chatHistory.find(conversationKey(user1, user2));
+    return it != chatHistory.end() ? &it->second : nullptr;
+}
+string MessagingSystem::conversationPrefix(const pair<User *, User *> &key)
+{
+    return "dm-" + to_string(key.first->getId()) + "-" + to_string(key.second->getId());
+}
+DoublyLinkedList &MessagingSystem::conversationLog(User *user1, User *user2)
+{
+    pair<User *, User *> key = conversationKey(user1, user2);
+    {
+        shared_lock<shared_mutex> lock(indexMutex);
+        auto it = chatHistory.find(key);
+        if (it != chatHistory.end())
+        {
+            return it->second;
+        }
+    }
+    unique_lock<shared_mutex> lock(indexMutex);
+    auto result = chatHistory.try_emplace(key);
+    if (result.second)
+    {
+        result.first->second.setRetention(&retentionPolicy, conversationPrefix(key));
+    }
+    return result.first->second;
+}
+MessagingSystem::DirectReadState &MessagingSystem::readStateOf(User *user)
+{
+    {
+        shared_lock<shared_mutex> lock(indexMutex);
+        auto it = directReadState.find(user);
+        if (it != directReadState.end())
+        {
+            return it->second;
+        }
+    }
+    unique_lock<shared_mutex> lock(indexMutex);
+    return directReadState[user];
+}
+vector<Group *> &MessagingSystem::groupsOf(User *user)
+{
+    {
+        shared_lock<shared_mutex> lock(indexMutex);
+        auto it = userGroups.find(user);
+        if (it != userGroups.end())
+        {
+            return it->second;
+        }
+    }
+    unique_lock<shared_mutex> lock(indexMutex);
+    return userGroups[user];
+}
+const MessagingSystem::DirectReadState *MessagingSystem::findReadState(User *user) const
+{
+    shared_lock<shared_mutex> lock(indexMutex);
+    auto it = directReadState.find(user);
+    return it != directReadState.end() ? &it->second : nullptr;
+}
+vector<Group *> MessagingSystem::memberGroups(User *user) const
+{
+    shared_lock<shared_mutex> lock(indexMutex);
+    auto it = userGroups.find(user);
+    return it != userGroups.end() ? it->second : vector<Group *>();
+}
+Group *MessagingSystem::findGroupById(const string &groupId)
+{
+    shared_lock<shared_mutex> lock(indexMutex);
+    auto it = groups.find(groupId);
+    return it != groups.end() ? &it->second : nullptr;
+}
+void MessagingSystem::setRetentionPolicy(const RetentionPolicy &policy, UserManagement &userManagement)
+{
+    retentionPolicy = policy;
+    retentionPolicy.resolveUser = [&userManagement](uint32_t id)
+    {
+        return userManagement.findUserById(id);
+    };
+    for (auto &entry : chatHistory)
+    {
+        entry.second.setRetention(&retentionPolicy, conversationPrefix(entry.first));
+    }
+    for (auto &groupPair : groups)
+    {
+        groupPair.second.messageHistory.setRetention(&retentionPolicy, "group-" + groupPair.first);
+    }
+}
+void MessagingSystem::attachEventBus(EventBus *bus, UserManagement &userManagement)
+{
+    events = bus;
+    eventUsers = &userManagement;
+    bus->subscribe("search index", mutationBit(MutationType::DirectMessage) | mutationBit(MutationType::GroupMessage),
+                   [this](const vector<const MutationEvent *> &batch)
+                   { indexMessages(batch); });
+}
+void MessagingSystem::indexMessages(const vector<const MutationEvent *> &batch)
+{
+    TraceSpan span("MessagingSystem::indexMessages", "messages");
+    MemoryScope memory(Subsystem::Messages);
+    span.annotate("events", batch.size());
+    for (const MutationEvent *event : batch)
+    {
+        if (event->type == MutationType::DirectMessage)
+        {
+            User *sender = eventUsers->findUserById(event->actor);
+            User *receiver = eventUsers->findUserById(event->subject);
+            StripeWriteGuard stripes(userLocks, {event->actor, event->subject});
+            conversationLog(sender, receiver).indexMessage(event->position, event->text);
+        }
+        else if (Group *group = findGroupById(event->key))
+        {
+            StripeWriteGuard stripe(groupLocks, {groupKey(*group)});
+            group->messageHistory.indexMessage(event->position, event->text);
+        }
+    }
+}
+void MessagingSystem::sendMessage(User *fromUser, User *toUser, const string &message)
+{
+    TraceSpan span("MessagingSystem::sendMessage", "messages");
+    OperationTimer timer(Operation::SendMessage);
+    size_t position;
+    {
+        StripeWriteGuard stripes(userLocks, {fromUser->getId(), toUser->getId()});
+        uint64_t seq;
+        int64_t timestamp;
+        logDirectMessage(fromUser, toUser, message, seq, timestamp);
+        position = appendDirectMessage(fromUser, toUser, message, seq, timestamp);
+    }
+    if (events)
+    {
+        events->publish(MutationType::DirectMessage, fromUser->getId(), toUser->getId(), message, string(), position);
+    }
+}
+void MessagingSystem::logDirectMessage(User *fromUser, User *toUser, const string &message, uint64_t &seq, int64_t &timestamp)
+{
+    if (!wal)
+    {
+        stampMessage(seq, timestamp);
+        return;
+    }
+    wal->append(WalRecordType::DirectMessage, [&](WalPayload &payload)
+                {
+        stampMessage(seq, timestamp);
+        payload.putU32(fromUser->getId()).putU32(toUser->getId()).putU64(seq).putI64(timestamp).putString(message); });
+}
+size_t MessagingSystem::appendDirectMessage(User *fromUser, User *toUser, const string &message, uint64_t seq, int64_t timestamp)
+{
+    TraceSpan span("MessagingSystem::appendDirectMessage", "messages");
+    MemoryScope memory(Subsystem::Messages);
+    DoublyLinkedList &conversation = conversationLog(fromUser, toUser);
+    size_t &senderCursor = readStateOf(fromUser).cursors[toUser];
+    bool senderCaughtUp = senderCursor == conversation.size();
+    conversation.append(fromUser, toUser, message, seq, timestamp, !events); // With a bus attached, the search indexer adds it
+    if (senderCaughtUp)
+    {
+        senderCursor = conversation.size();
+    }
+    if (fromUser != toUser)
+    {
+        DirectReadState &receiverState = readStateOf(toUser);
+        receiverState.cursors.emplace(fromUser, conversation.size() - 1);
+        receiverState.unreadByPartner[fromUser]++;
+        receiverState.unreadTotal++;
+    }
+    return conversation.size() - 1;
+}
+void MessagingSystem::appendGroupMessage(Group &group, User *fromUser, const string &message, uint64_t seq, int64_t timestamp, bool indexed)
+{
+    group.addMessage(fromUser, message, seq, timestamp, indexed);
+    // Every other member has one more unread message, and a first one makes the group count as a chat
+    shared_lock<shared_mutex> lock(indexMutex);
+    for (const auto &member : group.readCursors)
+    {
+        auto it = directReadState.find(member.first);
+        if (member.first == fromUser || it == directReadState.end())
+        {
+            continue;
+        }
+        it->second.groupUnreadTotal++;
+        if (group.unreadCount(member.first) == 1)
+        {
+            it->second.unreadGroups++;
+        }
+    }
+}
+void MessagingSystem::countGroupUnread(Group &group, User *user, bool add)
+{
+    size_t unread = group.unreadCount(user);
+    if (unread == 0)
+    {
+        return;
+    }
+    DirectReadState &state = readStateOf(user);
+    if (add)
+    {
+        state.groupUnreadTotal += unread;
+        state.unreadGroups++;
+    }
+    else
+    {
+        state.groupUnreadTotal -= unread;
+        state.unreadGroups--;
+    }
+}
+
+const size_t INBOX_CAPACITY = 4096;
+const size_t INBOX_DRAIN_BATCH = 256;
+
+MessagingSystem::UserInbox &MessagingSystem::inboxFor(User *user)
+{
+    MemoryScope memory(Subsystem::Messages);
+    {
+        shared_lock<shared_mutex> lock(inboxesMutex);
+        auto it = inboxes.find(user);
+        if (it != inboxes.end())
+        {
+            return *it->second;
+        }
+    }
+    unique_lock<shared_mutex> lock(inboxesMutex);
+    auto &inbox = inboxes[user];
+    if (!inbox)
+    {
+        inbox.reset(new UserInbox(INBOX_CAPACITY));
+    }
+    return *inbox;
+}
+
+MessagingSystem::UserInbox *MessagingSystem::findInbox(User *user) const
+{
+    shared_lock<shared_mutex> lock(inboxesMutex);
+    auto it = inboxes.find(user);
+    return it != inboxes.end() ? it->second.get() : nullptr;
+}
+
+void MessagingSystem::postMessage(User *fromUser, User *toUser, const string &message)
+{
+    TraceSpan span("MessagingSystem::postMessage", "messages");
+    OperationTimer timer(Operation::SendMessage);
+    MemoryScope memory(Subsystem::Messages);
+    PendingMessage pending{fromUser, toUser, message, 0, 0};
+    logDirectMessage(fromUser, toUser, message, pending.seq, pending.timestamp);
+    UserInbox &inbox = inboxFor(toUser);
+    if (!inbox.queue.tryPushFrom(pending))
+    {
+        deliver(pending); // Logged already, so it must not be dropped
+        return;
+    }
+    inbox.pending++;
+    // A thread holding the drain keeps draining until it finds nothing counted, so leaving works to it is safe
+    while (inbox.pending > 0 && inbox.drainMutex.try_lock())
+    {
+        drainInbox(inbox);
+        inbox.drainMutex.unlock();
+    }
+}
+
+void MessagingSystem::deliver(PendingMessage &pending)
+{
+    size_t position;
+    {
+        StripeWriteGuard stripes(userLocks, {pending.sender->getId(), pending.receiver->getId()});
+        pair<uint64_t, int64_t> newest = conversationLog(pending.sender, pending.receiver).newestStamp();
+        if (newest.first > pending.seq || newest.second > pending.timestamp)
+        {
+            // A later message of this conversation was delivered first, from the other side or by sendMessage.
+            // Stamp again so the log stays in order; a replay of the log keeps the order they were posted in.
+            stampMessage(pending.seq, pending.timestamp);
+        }
+        position = appendDirectMessage(pending.sender, pending.receiver, pending.message, pending.seq, pending.timestamp);
+    }
+    if (events)
+    {
+        events->publish(MutationType::DirectMessage, pending.sender->getId(), pending.receiver->getId(), pending.message, string(), position);
+    }
+}
+
+size_t MessagingSystem::drainInbox(UserInbox &inbox)
+{
+    TraceSpan span("MessagingSystem::drainInbox", "messages");
+    size_t delivered = 0;
+    size_t batch;
+    do
+    {
+        batch = inbox.queue.drain([&](PendingMessage &&pending)
+                                  { deliver(pending); },
+                                  INBOX_DRAIN_BATCH);
+        inbox.pending -= static_cast<int64_t>(batch);
+        delivered += batch;
+    } while (batch == INBOX_DRAIN_BATCH);
+    span.annotate("messages", delivered);
+    return delivered;
+}
+
+size_t MessagingSystem::deliverPending(User *user)
+{
+    UserInbox *inbox = findInbox(user);
+    // A message still counted is queued or being delivered; one not yet counted has not been acknowledged
+    if (!inbox || inbox->pending <= 0)
+    {
+        return 0;
+    }
+    lock_guard<mutex> drain(inbox->drainMutex);
+    return drainInbox(*inbox);
+}
+
+void MessagingSystem::deliverAllPending()
+{
+    for (auto &entry : inboxes)
+    {
+        lock_guard<mutex> drain(entry.second->drainMutex);
+        drainInbox(*entry.second);
+    }
+}
+
+UnreadSummary MessagingSystem::getUnreadSummary(User *user)
+{
+    deliverPending(user); // Posted messages count once they are in their conversations
+    UnreadSummary summary;
+    StripeReadGuard stripe(userLocks, {user->getId()});
+    if (const DirectReadState *state = findReadState(user))
+    {
+        summary.messages = state->unreadTotal + state->groupUnreadTotal;
+        summary.chats = state->unreadByPartner.size() + state->unreadGroups;
+    }
+    return summary;
+}
+
+UnreadSummary MessagingSystem::getGroupUnreadSummary(User *user) const
+{
+    UnreadSummary summary;
+    StripeReadGuard stripe(userLocks, {user->getId()});
+    if (const DirectReadState *state = findReadState(user))
+    {
+        summary.messages = state->groupUnreadTotal;
+        summary.chats = state->unreadGroups;
+    }
+    return summary;
+}
+
+vector<InboxMessage> MessagingSystem::fetchNewMessages(User *user, size_t limit)
+{
+    TraceSpan span("MessagingSystem::fetchNewMessages", "messages");
+    MemoryScope memory(Subsystem::Messages);
+    // Every conversation and group log is already in send order, so a k-way
+    // merge on sequence numbers over the unread tails gives one chronological inbox.
+    struct Source
+    {
+        const DoublyLinkedList *log;
+        Group *group;  // nullptr for a direct conversation
+        User *partner; // Other participant of a direct conversation
+        size_t position;
+        uint64_t seq; // Sequence number at `position`, read once per step so the heap never reads a segment
+    };
+    TraceSpan collect("collect sources", "messages");
+    deliverPending(user);
+    // Marking messages read writes the user's read state and the read cursors of all their groups
+    StripeWriteGuard stripe(userLocks, {user->getId()});
+    DirectReadState &state = readStateOf(user);
+    vector<Group *> memberOf = memberGroups(user);
+    vector<uint64_t> keys;
+    for (const Group *group : memberOf)
+    {
+        keys.push_back(groupKey(*group));
+    }
+    StripeWriteGuard groupStripes(groupLocks, keys);
+    vector<Source> sources;
+    for (const auto &entry : state.unreadByPartner)
+    {
+        const DoublyLinkedList *conversation = findConversation(user, entry.first);
+        size_t position = state.cursors[entry.first];
+        sources.push_back({conversation, nullptr, entry.first, position, conversation->seqAt(position)});
+    }
+    for (Group *group : memberOf)
+    {
+        if (group->unreadCount(user) > 0)
+        {
+            size_t position = group->readCursors[user].position;
+            sources.push_back({&group->messageHistory, group, nullptr, position, group->messageHistory.seqAt(position)});
+        }
+    }
+    collect.annotate("sources", sources.size());
+    collect.end();
+    TraceSpan merge("merge", "messages");
+    auto later = [&](size_t a, size_t b)
+    {
+        return sources[a].seq > sources[b].seq;
+    };
+    priority_queue<size_t, vector<size_t>, decltype(later)> pending(later);
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        pending.push(i);
+    }
+    vector<InboxMessage> batch;
+    while (!pending.empty() && batch.size() < limit)
+    {
+        size_t i = pending.top();
+        pending.pop();
+        Source &source = sources[i];
+        SegmentPin pin;
+        const MessageNode *node = source.log->at(source.position++, pin);
+        if (!node)
+        {
+            // Unreadable cold segment: skip the message
+        }
+        else if (node->sender == user)
+        {
+            if (source.group)
+            {
+                source.group->readCursors[user].ownUnread--;
+            }
+        }
+        else
+        {
+            if (!pin && source.log->sealsMessages())
+            {
+                node = DoublyLinkedList::detach(node, pin);
+            }
+            batch.push_back({node, source.group, pin});
+            if (source.group)
+            {
+                state.groupUnreadTotal--;
+            }
+            else
+            {
+                state.unreadTotal--;
+                if (--state.unreadByPartner[source.partner] == 0)
+                {
+                    state.unreadByPartner.erase(source.partner);
+                }
+            }
+        }
+        if (source.position < source.log->size())
+        {
+            source.seq = source.log->seqAt(source.position);
+            pending.push(i);
+        }
+    }
+    merge.annotate("messages", batch.size());
+    merge.end();
+    // Only what was returned is marked read; the rest stays unread
+    for (const Source &source : sources)
+    {
+        if (source.group)
+        {
+            source.group->readCursors[user].position = source.position;
+            if (source.group->unreadCount(user) == 0)
+            {
+                state.unreadGroups--;
+            }
+        }
+        else
+        {
+            state.cursors[source.partner] = source.position;
+        }
+    }
+    return batch;
+}
+
+void MessagingSystem::viewNewMessages(User *user)
+{
+    deliverPending(user);
+    UnreadSummary unread = getUnreadSummary(user);
+    if (unread.messages == 0)
+    {
+        cout << "No new messages found for " << user->getUsername() << "!" << endl;
+        return;
+    }
+    cout << "You have " << unread.messages << " unread messages from " << unread.chats << " chats.\n";
+    cout << "New messages for " << user->getUsername() << ":\n";
+    while (true)
+    {
+        for (const InboxMessage &entry : fetchNewMessages(user, HISTORY_PAGE_SIZE))
+        {
+            cout << "From " << entry.node->sender->getUsername();
+            if (entry.group)
+            {
+                cout << " in \"" << getGroupName(entry.group) << "\"";
+            }
+            cout << ": " << entry.node->message << endl;
+        }
+        if (getUnreadSummary(user).messages == 0)
+        {
+            break;
+        }
+        char choice;
+        cout << "Show more new messages? (y/n): ";
+        cin >> choice;
+        if (choice != 'y' && choice != 'Y')
+        {
+            break;
+        }
+    }
+}
+
+SearchPage MessagingSystem::searchSources(const vector<SearchSource> &sources, const string &query, uint64_t cursor, size_t limit)
+{
+    TraceSpan span("MessagingSystem::searchSources", "messages");
+    // Each source yields its matches newest first; a max-heap on sequence
+    // numbers merges them, so only matching postings are ever visited.
+    vector<string> tokens = DoublyLinkedList::tokenize(query);
+    vector<size_t> positions(sources.size(), SIZE_MAX);
+    vector<uint64_t> seqs(sources.size(), 0); // Sequence number at each source's position, read once per step
+    auto older = [&](size_t a, size_t b)
+    {
+        return seqs[a] < seqs[b];
+    };
+    priority_queue<size_t, vector<size_t>, decltype(older)> pending(older);
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        positions[i] = sources[i].log->previousMatch(tokens, sources[i].log->positionBefore(cursor));
+        if (positions[i] != SIZE_MAX)
+        {
+            seqs[i] = sources[i].log->seqAt(positions[i]);
+            pending.push(i);
+        }
+    }
+    SearchPage result;
+    while (!pending.empty() && result.hits.size() < limit)
+    {
+        size_t i = pending.top();
+        pending.pop();
+        SegmentPin pin;
+        const MessageNode *node = sources[i].log->at(positions[i], pin);
+        if (node)
+        {
+            if (!pin && sources[i].log->sealsMessages())
+            {
+                node = DoublyLinkedList::detach(node, pin);
+            }
+            result.hits.push_back({node, sources[i].group, sources[i].partner, pin});
+            result.cursor = node->seq;
+        }
+        positions[i] = sources[i].log->previousMatch(tokens, positions[i]);
+        if (positions[i] != SIZE_MAX)
+        {
+            seqs[i] = sources[i].log->seqAt(positions[i]);
+            pending.push(i);
+        }
+    }
+    result.hasMore = !pending.empty();
+    return result;
+}
+
+SearchPage MessagingSystem::searchMessages(User *user, const string &query, uint64_t cursor, size_t limit)
+{
+    deliverPending(user);
+    StripeReadGuard stripe(userLocks, {user->getId()});
+    vector<SearchSource> sources;
+    if (const DirectReadState *state = findReadState(user))
+    {
+        for (const auto &entry : state->cursors)
+        {
+            const DoublyLinkedList *conversation = findConversation(user, entry.first);
+            if (conversation)
+            {
+                sources.push_back({conversation, nullptr, entry.first});
+            }
+        }
+    }
+    vector<Group *> memberOf = memberGroups(user);
+    vector<uint64_t> keys;
+    for (const Group *group : memberOf)
+    {
+        keys.push_back(groupKey(*group));
+        sources.push_back({&group->messageHistory, group, nullptr});
+    }
+    StripeReadGuard groupStripes(groupLocks, keys);
+    return searchSources(sources, query, cursor, limit);
+}
+
+SearchPage MessagingSystem::searchChat(User *user, User *partner, const string &query, uint64_t cursor, size_t limit)
+{
+    deliverPending(user);
+    StripeReadGuard stripe(userLocks, {user->getId()}); // Either participant's stripe keeps senders out
+    const DoublyLinkedList *conversation = findConversation(user, partner);
+    if (!conversation)
+    {
+        return SearchPage();
+    }
+    return searchSources({{conversation, nullptr, partner}}, query, cursor, limit);
+}
+
+SearchPage MessagingSystem::searchGroup(const string &groupName, User *user, const string &query, uint64_t cursor, size_t limit)
+{
+    const Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        return SearchPage();
+    }
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    if (!group->isUserInGroup(user))
+    {
+        return SearchPage();
+    }
+    return searchSources({{&group->messageHistory, group, nullptr}}, query, cursor, limit);
+}
+
+void MessagingSystem::viewSearchResults(User *user)
+{
+    string query;
+    cout << "Enter search words: ";
+    cin.ignore();
+    getline(cin, query);
+    SearchPage page = searchMessages(user, query);
+    if (page.hits.empty())
+    {
+        cout << "No messages match \"" << query << "\"." << endl;
+        return;
+    }
+    while (true)
+    {
+        for (const SearchHit &hit : page.hits)
+        {
+            if (hit.group)
+            {
+                cout << "[" << getGroupName(hit.group) << "] ";
+            }
+            else
+            {
+                cout << "[" << hit.partner->getUsername() << "] ";
+            }
+            cout << hit.node->sender->getUsername() << ": " << hit.node->message << endl;
+        }
+        if (!page.hasMore)
+        {
+            break;
+        }
+        char choice;
+        cout << "Show more results? (y/n): ";
+        cin >> choice;
+        if (choice != 'y' && choice != 'Y')
+        {
+            break;
+        }
+        page = searchMessages(user, query, page.cursor);
+    }
+}
+
+HistoryPage MessagingSystem::getChatHistoryPage(User *user1, User *user2, size_t cursor, size_t limit) const
+{
+    TraceSpan span("MessagingSystem::getChatHistoryPage", "messages");
+    OperationTimer timer(Operation::ReadHistory);
+    StripeReadGuard stripe(userLocks, {user1->getId()});
+    const DoublyLinkedList *conversation = findConversation(user1, user2);
+    return conversation ? conversation->page(cursor, limit) : HistoryPage();
+}
+size_t MessagingSystem::seekChatHistory(User *user1, User *user2, int64_t timestamp) const
+{
+    StripeReadGuard stripe(userLocks, {user1->getId()});
+    const DoublyLinkedList *conversation = findConversation(user1, user2);
+    return conversation ? conversation->seek(timestamp) : 0;
+}
+
+// Asks whether to keep scrolling back; returns false when there is nothing older or the user declines
+static bool askForOlderMessages(const HistoryPage &page)
+{
+    if (!page.hasMore)
+    {
+        return false;
+    }
+    char choice;
+    cout << "Show older messages? (y/n): ";
+    cin >> choice;
+    return choice == 'y' || choice == 'Y';
+}
+
+void MessagingSystem::viewChatHistory(User *recipient, User *friendUser)
+{
+    TraceSpan span("MessagingSystem::viewChatHistory", "messages");
+    deliverPending(recipient);
+    deliverPending(friendUser);
+    HistoryPage page = getChatHistoryPage(recipient, friendUser, HISTORY_LATEST);
+    if (page.messages.empty())
+    {
+        cout << "No chat history found between " << recipient->getUsername()
+             << " and " << friendUser->getUsername() << "!" << endl;
+        return;
+    }
+    cout << "Chat history between " << recipient->getUsername()
+         << " and " << friendUser->getUsername() << ":\n";
+    while (true)
+    {
+        for (const MessageNode *node : page.messages)
+        {
+            if (node->sender == recipient)
+            {
+                cout << "To " << friendUser->getUsername() << ": " << node->message << endl;
+            }
+            else
+            {
+                cout << "From " << friendUser->getUsername() << ": " << node->message << endl;
+            }
+        }
+        if (!askForOlderMessages(page))
+        {
+            break;
+        }
+        page = getChatHistoryPage(recipient, friendUser, page.cursor);
+        cout << "-- older messages --" << endl;
+    }
+}
+
+void MessagingSystem::createGroup(User *currentUser, UserManagement &userManagement, FriendSystem &friendSystem, MessagingSystem &)
+{
+    bool uHaveFriend = friendSystem.viewFriends(currentUser);
+    if (!uHaveFriend)
+    {
+        cout << "You need at least one friend to create a group!" << endl;
+        return;
+    }
+    string groupName;
+    cout << "\nEnter the group name: ";
+    cin.ignore();
+    getline(cin, groupName);
+    Group *created = createGroup(groupName);
+    if (!created)
+    {
+        cout << "A group named \"" << groupName << "\" already exists!" << endl;
+        return;
+    }
+    Group &newGroup = *created;
+    const string &groupId = newGroup.groupId;
+    addMember(newGroup, currentUser);
+    char addMore;
+    do
+    {
+        string friendUsername;
+        cout << "Enter the username of a friend to add to the group: ";
+        cin >> friendUsername;
+        User *friendUser = userManagement.findUserByUsername(friendUsername);
+        if (friendUser && friendUser != currentUser)
+        {
+            addMember(newGroup, friendUser);
+            cout << friendUsername << " has been added to the group!" << endl;
+        }
+        else
+        {
+            cout << "Invalid username or you cannot add yourself!" << endl;
+        }
+        cout << "Do you want to add another friend? (y/n): ";
+        cin >> addMore;
+    } while (addMore == 'y' || addMore == 'Y');
+    cout << "Group \"" << groupName << "\" created successfully with Group ID: " << groupId << endl;
+}
+
+Group *MessagingSystem::createGroup(const string &groupName)
+{
+    TraceSpan span("MessagingSystem::createGroup", "messages");
+    MemoryScope memory(Subsystem::Groups);
+    unique_lock<shared_mutex> lock(indexMutex); // Held through the log append, so ids are logged in creation order
+    if (groupIdsByName.count(groupName))
+    {
+        return nullptr;
+    }
+    string groupId = "G" + to_string(groups.size() + 1);
+    if (wal)
+    {
+        wal->append(WalRecordType::CreateGroup, WalPayload().putString(groupId).putString(groupName));
+    }
+    // Built in place: no temporary Group, no copied participant set
+    Group &newGroup = groups.try_emplace(groupId, groupId, groupName).first->second;
+    newGroup.messageHistory.setRetention(&retentionPolicy, "group-" + groupId);
+    groupIdsByName.emplace(groupName, groupId);
+    lock.unlock();
+    if (events)
+    {
+        events->publish(MutationType::CreateGroup, 0, 0, groupName, groupId);
+    }
+    return &newGroup;
+}
+
+void sendMessageToGroup(User *currentUser, MessagingSystem &messagingSystem)
+{
+    string groupName;
+    cout << "Enter the Group Name: ";
+    cin.ignore();
+    getline(cin, groupName);
+    string message;
+    cout << "Enter your message: ";
+    getline(cin, message);
+    // sendMessageToGroup checks membership itself, so the group is looked up only once
+    if (messagingSystem.sendMessageToGroup(currentUser, groupName, message))
+    {
+        cout << "Message sent to group \"" << groupName << "\"!" << endl;
+    }
+}
+Group *MessagingSystem::findGroupByName(const string &groupName)
+{
+    shared_lock<shared_mutex> lock(indexMutex);
+    auto nameIt = groupIdsByName.find(groupName);
+    if (nameIt == groupIdsByName.end())
+    {
+        return nullptr;
+    }
+    auto it = groups.find(nameIt->second);
+    return it != groups.end() ? &it->second : nullptr;
+}
+
+const Group *MessagingSystem::findGroupByName(const string &groupName) const
+{
+    return const_cast<MessagingSystem *>(this)->findGroupByName(groupName);
+}
+
+bool MessagingSystem::renameGroup(const string &groupName, const string &newName, User *user)
+{
+    MemoryScope memory(Subsystem::Groups);
+    Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        cout << "Group not found!" << endl;
+        return false;
+    }
+    StripeWriteGuard stripe(groupLocks, {groupKey(*group)});
+    if (group->groupName != groupName) // Renamed by another session since the lookup
+    {
+        cout << "Group not found!" << endl;
+        return false;
+    }
+    if (!group->isUserInGroup(user))
+    {
+        cout << "You are not a member of the group \"" << groupName << "\"!" << endl;
+        return false;
+    }
+    unique_lock<shared_mutex> index(indexMutex);
+    if (newName.empty() || groupIdsByName.count(newName))
+    {
+        cout << "A group named \"" << newName << "\" already exists!" << endl;
+        return false;
+    }
+    if (wal)
+    {
+        wal->append(WalRecordType::RenameGroup, WalPayload().putString(group->groupId).putU32(user->getId()).putString(newName));
+    }
+    groupIdsByName.erase(groupName);
+    groupIdsByName[newName] = group->groupId;
+    group->groupName = newName;
+    return true;
+}
+
+bool MessagingSystem::sendMessageToGroup(User *fromUser, const string &groupName, const string &message)
+{
+    TraceSpan span("MessagingSystem::sendMessageToGroup", "messages");
+    OperationTimer timer(Operation::SendGroupMessage);
+    MemoryScope memory(Subsystem::Groups);
+    TraceSpan lookup("lookup group", "messages");
+    Group *found = findGroupByName(groupName);
+    lookup.end();
+    if (found)
+    {
+        Group &group = *found;
+        size_t position;
+        {
+            StripeWriteGuard stripe(groupLocks, {groupKey(group)});
+            span.annotate("members", group.participants.size());
+            if (!group.isUserInGroup(fromUser))
+            {
+                cout << "You are not a member of the group \"" << groupName << "\"!" << endl;
+                timer.fail();
+                return false;
+            }
+            uint64_t seq;
+            int64_t timestamp;
+            stampMessage(seq, timestamp);
+            if (wal)
+            {
+                wal->append(WalRecordType::GroupMessage, WalPayload().putString(group.groupId).putU32(fromUser->getId()).putU64(seq).putI64(timestamp).putString(message));
+            }
+            // Stored once; members read the tail past their own cursor (see fetchNewMessages)
+            TraceSpan append("append", "messages");
+            appendGroupMessage(group, fromUser, message, seq, timestamp, !events);
+            position = group.messageHistory.size() - 1;
+        }
+        if (events)
+        {
+            events->publish(MutationType::GroupMessage, fromUser->getId(), 0, message, group.groupId, position);
+        }
+        return true;
+    }
+    else
+    {
+        cout << "Group not found!" << endl;
+        timer.fail();
+        return false;
+    }
+}
+
+bool MessagingSystem::isUserInGroup(const string &groupName, User *user)
+{
+    const Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        return false;
+    }
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    return group->isUserInGroup(user);
+}
+
+HistoryPage MessagingSystem::getGroupChatHistoryPage(const string &groupName, size_t cursor, size_t limit) const
+{
+    TraceSpan span("MessagingSystem::getGroupChatHistoryPage", "messages");
+    OperationTimer timer(Operation::ReadHistory);
+    const Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        return HistoryPage();
+    }
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    return group->messageHistory.page(cursor, limit);
+}
+
+size_t MessagingSystem::seekGroupChatHistory(const string &groupName, int64_t timestamp) const
+{
+    const Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        return 0;
+    }
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    return group->messageHistory.seek(timestamp);
+}
+
+// Messages read per lock hold while exporting
+const size_t EXPORT_CHUNK = 64;
+
+// Writes positions [0, total) of a history oldest first, reading a chunk at a time through `readPage`
+static Task<size_t> writeHistory(size_t total, function<HistoryPage(size_t, size_t)> readPage, ostream &out, QueryContext &context)
+{
+    size_t written = 0;
+    for (size_t start = 0; start < total; start += EXPORT_CHUNK)
+    {
+        size_t end = min(total, start + EXPORT_CHUNK);
+        HistoryPage page = readPage(end, end - start);
+        for (const MessageNode *node : page.messages)
+        {
+            out << "[" << node->timestamp << "] " << node->sender->getUsername() << ": " << node->message << "\n";
+        }
+        written += page.messages.size();
+        if (context.due(end - start))
+        {
+            co_await context.yield();
+        }
+    }
+    co_return written;
+}
+
+Task<size_t> MessagingSystem::exportChatHistory(User *user1, User *user2, ostream &out, QueryContext &context) const
+{
+    size_t total;
+    {
+        StripeReadGuard stripe(userLocks, {user1->getId()});
+        const DoublyLinkedList *conversation = findConversation(user1, user2);
+        total = conversation ? conversation->size() : 0;
+    }
+    co_return co_await writeHistory(total, [this, user1, user2](size_t end, size_t limit)
+                                    {
+        StripeReadGuard stripe(userLocks, {user1->getId()});
+        const DoublyLinkedList *conversation = findConversation(user1, user2);
+        return conversation ? conversation->page(end, limit) : HistoryPage(); }, out, context);
+}
+
+Task<size_t> MessagingSystem::exportGroupHistory(const string &groupName, ostream &out, QueryContext &context) const
+{
+    const Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        co_return 0;
+    }
+    size_t total;
+    {
+        StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+        total = group->messageHistory.size();
+    }
+    co_return co_await writeHistory(total, [this, group](size_t end, size_t limit)
+                                    {
+        StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+        return group->messageHistory.page(end, limit); }, out, context);
+}
+
+void MessagingSystem::viewGroupChatHistory(const string &groupName, User *currentUser)
+{
+    TraceSpan span("MessagingSystem::viewGroupChatHistory", "messages");
+    const Group *found = findGroupByName(groupName);
+    if (found)
+    {
+        const Group &group = *found;
+        // Each page is read under the group's stripe, which is released while the user decides
+        auto readPage = [&](size_t cursor)
+        {
+            StripeReadGuard stripe(groupLocks, {groupKey(group)});
+            return group.messageHistory.page(cursor, HISTORY_PAGE_SIZE);
+        };
+        if (!isUserInGroup(groupName, currentUser))
+        {
+            cout << "You are not a member of the group \"" << getGroupName(&group) << "\"!" << endl;
+            return;
+        }
+        HistoryPage page = readPage(HISTORY_LATEST);
+        if (page.messages.empty())
+        {
+            cout << "No messages in this group." << endl;
+            return;
+        }
+        cout << "Chat history for group \"" << getGroupName(&group) << "\":\n";
+        while (true)
+        {
+            for (const MessageNode *node : page.messages)
+            {
+                cout << "From " << node->sender->getUsername() << ": " << node->message << endl;
+            }
+            if (!askForOlderMessages(page))
+            {
+                break;
+            }
+            page = readPage(page.cursor);
+            cout << "-- older messages --" << endl;
+        }
+    }
+    else
+    {
+        cout << "Group not found!" << endl;
+    }
+}
+
+bool MessagingSystem::addUserToGroup(const string &groupName, User *user)
+{
+    TraceSpan span("MessagingSystem::addUserToGroup", "messages");
+    Group *found = findGroupByName(groupName);
+    if (found)
+    {
+        Group &group = *found;
+        if (!addMember(group, user))
+        {
+            cout << "User is already a member of the group \"" << getGroupName(&group) << "\"!" << endl;
+            return false;
+        }
+        cout << "User \"" << user->getUsername() << "\" has been added to the group \"" << getGroupName(&group) << "\"!" << endl;
+        return true;
+    }
+    else
+    {
+        cout << "Group \"" << groupName << "\" not found!" << endl;
+        return false;
+    }
+}
+
+bool MessagingSystem::addMember(Group &group, User *user)
+{
+    MemoryScope memory(Subsystem::Groups);
+    vector<Group *> &memberOf = groupsOf(user);
+    readStateOf(user); // Group sends count the member's unread messages here
+    {
+        StripeWriteGuard userStripe(userLocks, {user->getId()});
+        StripeWriteGuard groupStripe(groupLocks, {groupKey(group)});
+        if (group.isUserInGroup(user))
+        {
+            return false;
+        }
+        if (wal)
+        {
+            wal->append(WalRecordType::JoinGroup, WalPayload().putString(group.groupId).putU32(user->getId()));
+        }
+        group.addUser(user); // Joins with nothing unread
+        memberOf.push_back(&group);
+    }
+    if (events)
+    {
+        events->publish(MutationType::JoinGroup, user->getId(), 0, string(), group.groupId);
+    }
+    return true;
+}
+
+bool MessagingSystem::removeMember(Group &group, User *user)
+{
+    MemoryScope memory(Subsystem::Groups);
+    vector<Group *> &memberOf = groupsOf(user);
+    {
+        StripeWriteGuard userStripe(userLocks, {user->getId()});
+        StripeWriteGuard groupStripe(groupLocks, {groupKey(group)});
+        if (!group.isUserInGroup(user))
+        {
+            return false;
+        }
+        if (wal)
+        {
+            wal->append(WalRecordType::LeaveGroup, WalPayload().putString(group.groupId).putU32(user->getId()));
+        }
+        countGroupUnread(group, user, false);
+        group.removeUser(user);
+        memberOf.erase(find(memberOf.begin(), memberOf.end(), &group));
+    }
+    if (events)
+    {
+        events->publish(MutationType::LeaveGroup, user->getId(), 0, string(), group.groupId);
+    }
+    return true;
+}
+
+vector<const Group *> MessagingSystem::getUserGroups(User *user) const
+{
+    StripeReadGuard stripe(userLocks, {user->getId()});
+    vector<Group *> memberOf = memberGroups(user);
+    return vector<const Group *>(memberOf.begin(), memberOf.end());
+}
+
+vector<const Group *> MessagingSystem::getJoinableGroups(User *user, size_t offset, size_t limit) const
+{
+    // Groups skipped for membership are at most the user's own k groups,
+    // so a page costs O(offset + limit + k) rather than a scan of every member list
+    // Membership is read from the user's own group list, so no group stripe is needed
+    vector<Group *> memberOf;
+    {
+        StripeReadGuard stripe(userLocks, {user->getId()});
+        memberOf = memberGroups(user);
+    }
+    sort(memberOf.begin(), memberOf.end());
+    vector<const Group *> page;
+    size_t skipped = 0;
+    shared_lock<shared_mutex> lock(indexMutex);
+    for (const auto &groupPair : groups)
+    {
+        const Group &group = groupPair.second;
+        if (binary_search(memberOf.begin(), memberOf.end(), const_cast<Group *>(&group)))
+        {
+            continue;
+        }
+        if (skipped < offset)
+        {
+            skipped++;
+            continue;
+        }
+        if (page.size() == limit)
+        {
+            break;
+        }
+        page.push_back(&group);
+    }
+    return page;
+}
+
+string MessagingSystem::getGroupName(const Group *group) const
+{
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    return group->groupName;
+}
+
+size_t MessagingSystem::getUnreadCount(const Group *group, User *user) const
+{
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    return group->unreadCount(user);
+}
+
+void viewMyGroups(User *currentUser, MessagingSystem &messagingSystem)
+{
+    vector<const Group *> myGroups = messagingSystem.getUserGroups(currentUser);
+    if (myGroups.empty())
+    {
+        cout << "You are not in any groups yet." << endl;
+        return;
+    }
+    cout << "Your Groups:\n";
+    for (const Group *group : myGroups)
+    {
+        cout << "Group Name: " << messagingSystem.getGroupName(group);
+        size_t unread = messagingSystem.getUnreadCount(group, currentUser);
+        if (unread > 0)
+        {
+            cout << " (" << unread << " unread)";
+        }
+        cout << endl;
+    }
+}
+
+void joinGroup(User *currentUser, MessagingSystem &messagingSystem)
+{
+    cout << "Available Groups:\n";
+    size_t offset = 0;
+    while (true)
+    {
+        vector<const Group *> page = messagingSystem.getJoinableGroups(currentUser, offset, HISTORY_PAGE_SIZE);
+        for (const Group *group : page)
+        {
+            cout << "Group Name: " << messagingSystem.getGroupName(group) << endl;
+        }
+        offset += page.size();
+        if (page.size() < HISTORY_PAGE_SIZE || messagingSystem.getJoinableGroups(currentUser, offset, 1).empty())
+        {
+            break;
+        }
+        char choice;
+        cout << "Show more groups? (y/n): ";
+        cin >> choice;
+        if (choice != 'y' && choice != 'Y')
+        {
+            break;
+        }
+    }
+    string groupName;
+    cout << "Enter the Group Name to join: ";
+    cin.ignore();
+    getline(cin, groupName);
+    if (messagingSystem.addUserToGroup(groupName, currentUser))
+    {
+        cout << "You have joined the group \"" << groupName << "\"!" << endl;
+    }
+    else
+    {
+        cout << "Failed to join the group \"" << groupName << "\". It may not exist." << endl;
+    }
+}
+
+void leaveGroup(User *currentUser, MessagingSystem &messagingSystem)
+{
+    string groupName;
+    cout << "Enter the Group Name to leave: ";
+    cin.ignore();
+    getline(cin, groupName);
+    const Group *group = messagingSystem.findGroupByName(groupName);
+    if (group)
+    {
+        const string &groupId = group->groupId;
+        if (messagingSystem.removeUserFromGroup(groupId, currentUser))
+        {
+            cout << "You have left the group \"" << groupName << "\"!" << endl;
+        }
+        else
+        {
+            cout << "You are not a member of the group \"" << groupName << "\"!" << endl;
+        }
+    }
+    else
+    {
+        cout << "Group not found!" << endl;
+    }
+}
+
+vector<User *> MessagingSystem::friendsInGroup(const string &groupName, User *user, FriendSystem &friendSystem)
+{
+    vector<User *> result;
+    const Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        return result;
+    }
+    MemberSet friendIds;
+    unordered_map<uint32_t, User *> friendsById;
+    for (User *friendUser : friendSystem.getFriends(user))
+    {
+        friendIds.insert(friendUser->getId());
+        friendsById[friendUser->getId()] = friendUser;
+    }
+    StripeReadGuard stripe(groupLocks, {groupKey(*group)});
+    for (uint32_t id : friendIds.intersect(group->participants))
+    {
+        result.push_back(friendsById[id]);
+    }
+    return result;
+}
+
+void viewFriendsInGroup(User *currentUser, MessagingSystem &messagingSystem, FriendSystem &friendSystem)
+{
+    string groupName;
+    cout << "Enter the Group Name: ";
+    cin.ignore();
+    getline(cin, groupName);
+    if (!messagingSystem.findGroupByName(groupName))
+    {
+        cout << "Group not found!" << endl;
+        return;
+    }
+    vector<User *> members = messagingSystem.friendsInGroup(groupName, currentUser, friendSystem);
+    if (members.empty())
+    {
+        cout << "None of your friends are in \"" << groupName << "\"." << endl;
+        return;
+    }
+    cout << "Friends in \"" << groupName << "\": ";
+    for (User *member : members)
+    {
+        cout << member->getUsername() << " ";
+    }
+    cout << "\n";
+}
+
+void renameGroup(User *currentUser, MessagingSystem &messagingSystem)
+{
+    string groupName, newName;
+    cout << "Enter the Group Name to rename: ";
+    cin.ignore();
+    getline(cin, groupName);
+    cout << "Enter the new Group Name: ";
+    getline(cin, newName);
+    if (messagingSystem.renameGroup(groupName, newName, currentUser))
+    {
+        cout << "Group \"" << groupName << "\" renamed to \"" << newName << "\"!" << endl;
+    }
+}
+
+Task<vector<User *>> MessagingSystem::addUsersToGroup(const string &groupName, vector<User *> users, QueryContext &context)
+{
+    vector<User *> added;
+    Group *group = findGroupByName(groupName);
+    if (!group)
+    {
+        co_return added;
+    }
+    for (User *user : users)
+    {
+        if (addMember(*group, user))
+        {
+            added.push_back(user);
+        }
+        if (context.due())
+        {
+            co_await context.yield();
+        }
+    }
+    co_return added;
+}
+
+bool MessagingSystem::removeUserFromGroup(const string &groupId, User *user)
+{
+    TraceSpan span("MessagingSystem::removeUserFromGroup", "messages");
+    Group *group = findGroupById(groupId);
+    return group && removeMember(*group, user);
+}
+
+void displayHeader()
+{
+    cout << "************************************************************" << endl;
+    cout << "*                    WELCOME TO OUR                        *" << endl;
+    cout << "*                    College Connect                       *" << endl;
+    cout << "*                                                          *" << endl;
+    cout << "* Submitted to:                             Programmed by: *" << endl;
+    cout << "* Sherry Garg                                        Rishu *" << endl;
+    cout << "* Sangeeta Mittal                             Swayam Gupta *" << endl;
+    cout << "*                                             Maanya Gupta *" << endl;
+    cout << "*                                         Shambhavi Mishra *" << endl;
+    cout << "*                                                          *" << endl;
+    cout << "************************************************************" << "\n"
+         << endl;
+}
+WalReplayResult replayWriteAheadLog(const string &path, uint64_t afterLsn, UserManagement &userManagement, PostManagement &postManagement,
+                                    FriendSystem &friendSystem, MessagingSystem &messagingSystem)
+{
+    QuietConsole quiet;
+    auto findGroupById = [&](const string &groupId) -> Group *
+    {
+        auto it = messagingSystem.groups.find(groupId);
+        return it != messagingSystem.groups.end() ? &it->second : nullptr;
+    };
+    auto restoreClock = [&](uint64_t seq, int64_t timestamp)
+    {
+        messagingSystem.nextSequence = max(messagingSystem.nextSequence, seq + 1);
+        messagingSystem.lastTimestamp = max(messagingSystem.lastTimestamp, timestamp);
+    };
+    auto apply = [&](uint64_t, WalRecordType type, WalPayloadReader &in)
+    {
+        switch (type)
+        {
+        case WalRecordType::SignUp:
+        {
+            in.getU32(); // Ids are dense, so replaying sign-ups in order reproduces them
+            string username = in.getString();
+            string password = in.getString();
+            string email = in.getString();
+            string bio = in.getString();
+            bool isPublic = in.getU8() != 0;
+            if (in.good())
+            {
+                userManagement.registerUser(username, password, email, bio, isPublic);
+            }
+            break;
+        }
+        case WalRecordType::UpdateProfile:
+        {
+            User *user = userManagement.findUserById(in.getU32());
+            ProfileField field = static_cast<ProfileField>(in.getU8());
+            string value = in.getString();
+            if (user && in.good())
+            {
+                userManagement.updateProfileField(user, field, value);
+            }
+            break;
+        }
+        case WalRecordType::CreatePost:
+        {
+            User *user = userManagement.findUserById(in.getU32());
+            string content = in.getString();
+            if (user && in.good())
+            {
+                postManagement.createPost(user, content);
+            }
+            break;
+        }
+        case WalRecordType::AddComment:
+        {
+            User *user = userManagement.findUserById(in.getU32());
+            string postContent = in.getString();
+            string comment = in.getString();
+            if (user && in.good())
+            {
+                postManagement.addComment(user, postContent, comment);
+            }
+            break;
+        }
+        case WalRecordType::AddReply:
+        {
+            User *user = userManagement.findUserById(in.getU32());
+            string postContent = in.getString();
+            uint32_t depth = in.getU32();
+            const vector<Comment *> &comments = postManagement.postComments[postContent];
+            Comment *parent = nullptr;
+            for (uint32_t level = 0; level < depth && in.good(); level++)
+            {
+                uint32_t index = in.getU32();
+                if (level == 0)
+                {
+                    parent = index < comments.size() ? comments[index] : nullptr;
+                }
+                else if (parent && index < parent->getReplies().size())
+                {
+                    parent = &*next(parent->getReplies().begin(), index);
+                }
+                else
+                {
+                    parent = nullptr;
+                }
+            }
+            string reply = in.getString();
+            if (user && parent && in.good())
+            {
+                postManagement.addReplyToComment(user, postContent, parent, reply);
+            }
+            break;
+        }
+        case WalRecordType::AddFriend:
+        case WalRecordType::RemoveFriend:
+        {
+            User *user = userManagement.findUserById(in.getU32());
+            User *friendUser = userManagement.findUserById(in.getU32());
+            if (user && friendUser && in.good())
+            {
+                if (type == WalRecordType::AddFriend)
+                {
+                    friendSystem.addFriend(user, friendUser);
+                }
+                else
+                {
+                    friendSystem.removeFriend(user, friendUser);
+                }
+            }
+            break;
+        }
+        case WalRecordType::DirectMessage:
+        {
+            User *fromUser = userManagement.findUserById(in.getU32());
+            User *toUser = userManagement.findUserById(in.getU32());
+            uint64_t seq = in.getU64();
+            int64_t timestamp = in.getI64();
+            string message = in.getString();
+            if (fromUser && toUser && in.good())
+            {
+                messagingSystem.appendDirectMessage(fromUser, toUser, message, seq, timestamp);
+                restoreClock(seq, timestamp);
+            }
+            break;
+        }
+        case WalRecordType::CreateGroup:
+        {
+            in.getString(); // Ids come from the group count, so replaying in order reproduces them
+            string groupName = in.getString();
+            if (in.good())
+            {
+                messagingSystem.createGroup(groupName);
+            }
+            break;
+        }
+        case WalRecordType::JoinGroup:
+        case WalRecordType::LeaveGroup:
+        {
+            Group *group = findGroupById(in.getString());
+            User *user = userManagement.findUserById(in.getU32());
+            if (group && user && in.good())
+            {
+                if (type == WalRecordType::JoinGroup)
+                {
+                    messagingSystem.addMember(*group, user);
+                }
+                else
+                {
+                    messagingSystem.removeMember(*group, user);
+                }
+            }
+            break;
+        }
+        case WalRecordType::RenameGroup:
+        {
+            Group *group = findGroupById(in.getString());
+            User *user = userManagement.findUserById(in.getU32());
+            string newName = in.getString();
+            if (group && user && in.good())
+            {
+                messagingSystem.renameGroup(group->groupName, newName, user);
+            }
+            break;
+        }
+        case WalRecordType::GroupMessage:
+        {
+            Group *group = findGroupById(in.getString());
+            User *fromUser = userManagement.findUserById(in.getU32());
+            uint64_t seq = in.getU64();
+            int64_t timestamp = in.getI64();
+            string message = in.getString();
+            if (group && fromUser && in.good())
+            {
+                messagingSystem.appendGroupMessage(*group, fromUser, message, seq, timestamp, true);
+                restoreClock(seq, timestamp);
+            }
+            break;
+        }
+        }
+    };
+    // Records before the last roll-over first, if no snapshot has made them redundant yet
+    WalReplayResult previous = WriteAheadLog::replay(WriteAheadLog::rolledOverPath(path), afterLsn, apply);
+    WalReplayResult result = WriteAheadLog::replay(path, afterLsn, apply);
+    result.lastLsn = max(result.lastLsn, previous.lastLsn);
+    result.records += previous.records;
+    return result;
+}
+
+// Sections shared by every chat log in a snapshot
+struct SnapshotLogSections
+{
+    vector<SnapshotSegment> segments;
+    vector<SnapshotMessage> messages;
+    vector<SnapshotPosting> postings;
+    vector<uint32_t> postingIds;
+};
+
+static void captureComment(SnapshotBuilder &builder, vector<SnapshotComment> &records, SnapshotString post, Comment &comment, uint32_t parent)
+{
+    uint32_t self = static_cast<uint32_t>(records.size());
+    records.push_back({post, builder.addString(comment.content), comment.author->getId(), parent});
+    for (Comment &reply : comment.getReplies())
+    {
+        captureComment(builder, records, post, reply, self);
+    }
+}
+
+// Size of a sealed segment file, 0 if it is missing (a segment file is never empty)
+static uint64_t segmentFileSize(const string &path)
+{
+    error_code error;
+    uint64_t size = filesystem::file_size(path, error);
+    return error ? 0 : size;
+}
+
+static SnapshotLog captureLog(SnapshotBuilder &builder, SnapshotLogSections &sections, const DoublyLinkedList &log)
+{
+    SnapshotLog record = {};
+    record.coldCount = log.size() - log.hotSize();
+    record.firstSegment = sections.segments.size();
+    for (const ColdSegment &segment : log.coldSegments())
+    {
+        // Sealed files are never rewritten, so the path and size identify the segment
+        sections.segments.push_back({segment.firstPosition, segment.count, segment.lastSeq, segment.lastTimestamp,
+                                     builder.addString(segment.path), segmentFileSize(segment.path)});
+    }
+    record.segmentCount = sections.segments.size() - record.firstSegment;
+    record.firstMessage = sections.messages.size();
+    for (size_t position = record.coldCount; position < log.size(); position++)
+    {
+        SegmentPin pin;
+        const MessageNode *node = log.at(position, pin);
+        sections.messages.push_back({node->sender->getId(), node->receiver ? node->receiver->getId() : SNAPSHOT_NONE,
+                                     node->seq, node->timestamp, builder.addString(node->message)});
+    }
+    record.messageCount = sections.messages.size() - record.firstMessage;
+    record.firstPosting = sections.postings.size();
+    for (const auto &posting : log.searchIndex())
+    {
+        sections.postings.push_back({builder.addString(posting.first), sections.postingIds.size(), posting.second.size()});
+        sections.postingIds.insert(sections.postingIds.end(), posting.second.begin(), posting.second.end());
+    }
+    record.postingCount = sections.postings.size() - record.firstPosting;
+    return record;
+}
+
+string captureSnapshot(UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                       MessagingSystem &messagingSystem, uint64_t walLsn)
+{
+    messagingSystem.deliverAllPending(); // Their log records are older than the snapshot, so it must hold them
+    if (messagingSystem.events)
+    {
+        messagingSystem.events->waitUntilDelivered(); // The search postings are complete once the indexer catches up
+    }
+    SnapshotBuilder builder;
+    const vector<User *> &users = userManagement.usersById;
+    vector<SnapshotUser> userRecords;
+    vector<SnapshotPost> posts;
+    vector<uint64_t> friendOffsets(1, 0);
+    vector<uint32_t> friendIds;
+    userRecords.reserve(users.size());
+    for (User *user : users)
+    {
+        const string &password = userManagement.userCredentials[user->getUsername()].first;
+        userRecords.push_back({builder.addString(user->getUsername()), builder.addString(password), builder.addString(user->getEmail()),
+                               builder.addString(user->getBio()), user->isProfilePublic(), 0});
+        auto postsIt = postManagement.userPosts.find(user);
+        if (postsIt != postManagement.userPosts.end())
+        {
+            for (const string &content : postsIt->second)
+            {
+                posts.push_back({user->getId(), 0, builder.addString(content)});
+            }
+        }
+        auto friendsIt = friendSystem.friends.find(user);
+        if (friendsIt != friendSystem.friends.end())
+        {
+            for (User *friendUser : friendsIt->second)
+            {
+                friendIds.push_back(friendUser->getId());
+            }
+        }
+        friendOffsets.push_back(friendIds.size());
+    }
+    vector<SnapshotComment> comments;
+    for (auto &thread : postManagement.postComments)
+    {
+        SnapshotString post = builder.addString(thread.first);
+        for (Comment *comment : thread.second)
+        {
+            captureComment(builder, comments, post, *comment, SNAPSHOT_NONE);
+        }
+    }
+    SnapshotLogSections logs;
+    vector<SnapshotChat> chats;
+    for (const auto &entry : messagingSystem.chatHistory)
+    {
+        chats.push_back({entry.first.first->getId(), entry.first.second->getId(), captureLog(builder, logs, entry.second)});
+    }
+    vector<SnapshotGroup> groups;
+    vector<SnapshotGroupMember> members;
+    for (const auto &entry : messagingSystem.groups)
+    {
+        const Group &group = entry.second;
+        SnapshotGroup record = {builder.addString(group.groupId), builder.addString(group.groupName), members.size(), 0,
+                                captureLog(builder, logs, group.messageHistory)};
+        group.participants.forEach([&](uint32_t id)
+                                   {
+            auto cursor = group.readCursors.find(users[id]);
+            ReadCursor read = cursor != group.readCursors.end() ? cursor->second : ReadCursor();
+            members.push_back({id, 0, read.position, read.ownUnread}); });
+        record.memberCount = members.size() - record.firstMember;
+        groups.push_back(record);
+    }
+    vector<SnapshotDirectRead> directReads;
+    for (const auto &entry : messagingSystem.directReadState)
+    {
+        for (const auto &cursor : entry.second.cursors)
+        {
+            auto unread = entry.second.unreadByPartner.find(cursor.first);
+            directReads.push_back({entry.first->getId(), cursor.first->getId(), cursor.second,
+                                   unread != entry.second.unreadByPartner.end() ? unread->second : 0});
+        }
+    }
+    builder.addSection(SnapshotSectionKind::Users, userRecords);
+    builder.addSection(SnapshotSectionKind::Posts, posts);
+    builder.addSection(SnapshotSectionKind::Comments, comments);
+    builder.addSection(SnapshotSectionKind::FriendOffsets, friendOffsets);
+    builder.addSection(SnapshotSectionKind::FriendIds, friendIds);
+    builder.addSection(SnapshotSectionKind::Chats, chats);
+    builder.addSection(SnapshotSectionKind::Groups, groups);
+    builder.addSection(SnapshotSectionKind::GroupMembers, members);
+    builder.addSection(SnapshotSectionKind::DirectReads, directReads);
+    builder.addSection(SnapshotSectionKind::Segments, logs.segments);
+    builder.addSection(SnapshotSectionKind::Messages, logs.messages);
+    builder.addSection(SnapshotSectionKind::Postings, logs.postings);
+    builder.addSection(SnapshotSectionKind::PostingIds, logs.postingIds);
+    return builder.finish(walLsn, messagingSystem.nextSequence, messagingSystem.lastTimestamp);
+}
+
+static bool inRange(uint64_t first, uint64_t count, size_t total)
+{
+    return first <= total && count <= total - first;
+}
+
+// Whether a chat log's snapshot record, and every segment, message and posting it refers to, lies within its sections
+static bool validLog(const MappedSnapshot &snapshot, const SnapshotLog &record)
+{
+    size_t segmentCount, messageCount, postingCount, postingIdCount;
+    const SnapshotSegment *segments = snapshot.records<SnapshotSegment>(SnapshotSectionKind::Segments, segmentCount);
+    const SnapshotMessage *messages = snapshot.records<SnapshotMessage>(SnapshotSectionKind::Messages, messageCount);
+    const SnapshotPosting *postings = snapshot.records<SnapshotPosting>(SnapshotSectionKind::Postings, postingCount);
+    snapshot.records<uint32_t>(SnapshotSectionKind::PostingIds, postingIdCount);
+    if (!inRange(record.firstSegment, record.segmentCount, segmentCount) || !inRange(record.firstMessage, record.messageCount, messageCount) ||
+        !inRange(record.firstPosting, record.postingCount, postingCount))
+    {
+        return false;
+    }
+    for (uint64_t i = record.firstSegment; i < record.firstSegment + record.segmentCount; i++)
+    {
+        if (!snapshot.validString(segments[i].path) || segmentFileSize(snapshot.text(segments[i].path)) != segments[i].fileSize)
+        {
+            return false; // A missing or different segment file loses the messages sealed in it
+        }
+    }
+    for (uint64_t i = record.firstMessage; i < record.firstMessage + record.messageCount; i++)
+    {
+        if (!snapshot.validString(messages[i].text))
+        {
+            return false;
+        }
+    }
+    for (uint64_t i = record.firstPosting; i < record.firstPosting + record.postingCount; i++)
+    {
+        if (!snapshot.validString(postings[i].token) || !inRange(postings[i].firstId, postings[i].count, postingIdCount))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rebuilds one chat log from a snapshot record that passed validLog
+static void restoreLog(const MappedSnapshot &snapshot, DoublyLinkedList &log, const SnapshotLog &record, UserManagement &userManagement)
+{
+    size_t segmentCount, messageCount, postingCount, postingIdCount;
+    const SnapshotSegment *segments = snapshot.records<SnapshotSegment>(SnapshotSectionKind::Segments, segmentCount);
+    const SnapshotMessage *messages = snapshot.records<SnapshotMessage>(SnapshotSectionKind::Messages, messageCount);
+    const SnapshotPosting *postings = snapshot.records<SnapshotPosting>(SnapshotSectionKind::Postings, postingCount);
+    const uint32_t *postingIds = snapshot.records<uint32_t>(SnapshotSectionKind::PostingIds, postingIdCount);
+    vector<ColdSegment> sealed;
+    for (uint64_t i = record.firstSegment; i < record.firstSegment + record.segmentCount; i++)
+    {
+        const SnapshotSegment &segment = segments[i];
+        sealed.push_back({segment.firstPosition, segment.count, segment.lastSeq, segment.lastTimestamp, snapshot.text(segment.path)});
+    }
+    vector<MessageNode *> hot;
+    hot.reserve(record.messageCount);
+    for (uint64_t i = record.firstMessage; i < record.firstMessage + record.messageCount; i++)
+    {
+        const SnapshotMessage &message = messages[i];
+        User *sender = userManagement.findUserById(message.senderId);
+        User *receiver = message.receiverId == SNAPSHOT_NONE ? nullptr : userManagement.findUserById(message.receiverId);
+        hot.push_back(new MessageNode(sender, receiver, snapshot.text(message.text), message.seq, message.timestamp));
+    }
+    unordered_map<string, vector<uint32_t>> searchPostings;
+    searchPostings.reserve(record.postingCount);
+    for (uint64_t i = record.firstPosting; i < record.firstPosting + record.postingCount; i++)
+    {
+        const SnapshotPosting &posting = postings[i];
+        searchPostings.emplace(snapshot.text(posting.token),
+                               vector<uint32_t>(postingIds + posting.firstId, postingIds + posting.firstId + posting.count));
+    }
+    log.restore(record.coldCount, move(sealed), hot, move(searchPostings));
+}
+
+bool loadSnapshot(const string &path, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                  MessagingSystem &messagingSystem, uint64_t &walLsn)
+{
+    MappedSnapshot snapshot;
+    if (!snapshot.open(path))
+    {
+        return false;
+    }
+    // Chat history is checked before anything is built: a damaged log fails the whole load, leaving the managers
+    // empty for a full replay, instead of coming back empty and being saved that way by the next snapshot
+    size_t chatCount, groupCount, memberCount, readCount;
+    const SnapshotChat *chats = snapshot.records<SnapshotChat>(SnapshotSectionKind::Chats, chatCount);
+    const SnapshotGroup *groups = snapshot.records<SnapshotGroup>(SnapshotSectionKind::Groups, groupCount);
+    for (size_t i = 0; i < chatCount; i++)
+    {
+        if (!validLog(snapshot, chats[i].history))
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < groupCount; i++)
+    {
+        if (!validLog(snapshot, groups[i].history))
+        {
+            return false;
+        }
+    }
+    WorkStealingExecutor &pool = WorkStealingExecutor::shared();
+    // Users first, split by id range: every other section refers to them by id
+    size_t userCount;
+    const SnapshotUser *users = snapshot.records<SnapshotUser>(SnapshotSectionKind::Users, userCount);
+    vector<User *> &usersById = userManagement.usersById;
+    usersById.assign(userCount, nullptr);
+    for (future<void> &task : pool.submitRanges(userCount, 4096, [&](size_t first, size_t last)
+                                                {
+             MemoryScope memory(Subsystem::Users);
+             for (size_t id = first; id < last; id++)
+             {
+                 const SnapshotUser &record = users[id];
+                 usersById[id] = new User(snapshot.text(record.username), snapshot.text(record.password), snapshot.text(record.email),
+                                          snapshot.text(record.bio), record.isPublic != 0, static_cast<uint32_t>(id));
+             } }))
+    {
+        task.get();
+    }
+
+    // Then every subsystem at once. Each task fills structures nobody else touches and only reads usersById;
+    // logs and friend lists are built standalone and wired into the shared maps afterwards.
+    vector<future<void>> tasks;
+    tasks.push_back(pool.submit([&]()
+                                {
+        MemoryScope memory(Subsystem::Users);
+        userManagement.userCredentials.reserve(userCount);
+        for (uint32_t id = 0; id < userCount; id++)
+        {
+            User *user = usersById[id];
+            userManagement.userCredentials[user->getUsername()] = {snapshot.text(users[id].password), user};
+            userManagement.userProfiles.push_back(user);
+        } }));
+    tasks.push_back(pool.submit([&]()
+                                {
+        MemoryScope memory(Subsystem::Posts);
+        size_t postCount, commentCount;
+        const SnapshotPost *posts = snapshot.records<SnapshotPost>(SnapshotSectionKind::Posts, postCount);
+        for (size_t i = 0; i < postCount; i++)
+        {
+            User *author = userManagement.findUserById(posts[i].authorId);
+            string content = snapshot.text(posts[i].content);
+            if (author)
+            {
+                postManagement.userPosts[author].push_back(content);
+                postManagement.postComments.emplace(content, vector<Comment *>());
+            }
+        }
+        // Pre-order: every parent is built before its replies, and list nodes never move
+        const SnapshotComment *comments = snapshot.records<SnapshotComment>(SnapshotSectionKind::Comments, commentCount);
+        vector<Comment *> built(commentCount, nullptr);
+        MemoryScope commentMemory(Subsystem::Comments);
+        for (size_t i = 0; i < commentCount; i++)
+        {
+            const SnapshotComment &record = comments[i];
+            User *author = userManagement.findUserById(record.authorId);
+            if (!author)
+            {
+                continue;
+            }
+            if (record.parent == SNAPSHOT_NONE)
+            {
+                built[i] = new Comment(author, snapshot.text(record.content));
+                postManagement.postComments[snapshot.text(record.post)].push_back(built[i]);
+            }
+            else if (record.parent < i && built[record.parent])
+            {
+                list<Comment> &replies = built[record.parent]->getReplies();
+                replies.emplace_back(author, snapshot.text(record.content));
+                built[i] = &replies.back();
+            }
+        } }));
+    auto queueAll = [&](vector<future<void>> &&ranges)
+    {
+        move(ranges.begin(), ranges.end(), back_inserter(tasks));
+    };
+    size_t offsetCount, friendIdCount;
+    const uint64_t *friendOffsets = snapshot.records<uint64_t>(SnapshotSectionKind::FriendOffsets, offsetCount);
+    const uint32_t *friendIds = snapshot.records<uint32_t>(SnapshotSectionKind::FriendIds, friendIdCount);
+    vector<list<User *>> friendLists(min(userCount, offsetCount > 0 ? offsetCount - 1 : 0));
+    queueAll(pool.submitRanges(friendLists.size(), 4096, [&](size_t first, size_t last)
+                            {
+        MemoryScope memory(Subsystem::Friends);
+        for (size_t id = first; id < last; id++)
+        {
+            if (friendOffsets[id] >= friendOffsets[id + 1] || !inRange(friendOffsets[id], friendOffsets[id + 1] - friendOffsets[id], friendIdCount))
+            {
+                continue;
+            }
+            for (uint64_t i = friendOffsets[id]; i < friendOffsets[id + 1]; i++)
+            {
+                if (User *friendUser = userManagement.findUserById(friendIds[i]))
+                {
+                    friendLists[id].push_back(friendUser);
+                }
+            }
+        } }));
+    vector<DoublyLinkedList> chatLogs;
+    {
+        MemoryScope memory(Subsystem::Messages); // Each empty log already holds its index blocks
+        chatLogs.resize(chatCount);
+    }
+    queueAll(pool.submitRanges(chatCount, 64, [&](size_t first, size_t last)
+                            {
+        MemoryScope memory(Subsystem::Messages);
+        for (size_t i = first; i < last; i++)
+        {
+            restoreLog(snapshot, chatLogs[i], chats[i].history, userManagement);
+        } }));
+    vector<DoublyLinkedList> groupLogs;
+    {
+        MemoryScope memory(Subsystem::Groups); // Each empty log already holds its index blocks
+        groupLogs.resize(groupCount);
+    }
+    queueAll(pool.submitRanges(groupCount, 16, [&](size_t first, size_t last)
+                            {
+        MemoryScope memory(Subsystem::Groups);
+        for (size_t i = first; i < last; i++)
+        {
+            restoreLog(snapshot, groupLogs[i], groups[i].history, userManagement);
+        } }));
+    for (future<void> &task : tasks)
+    {
+        task.get();
+    }
+
+    // Final pass on this thread: wire the standalone pieces into the managers' shared maps
+    for (size_t id = 0; id < friendLists.size(); id++)
+    {
+        if (!friendLists[id].empty())
+        {
+            MemoryScope memory(Subsystem::Friends);
+            friendSystem.friends[usersById[id]] = move(friendLists[id]);
+        }
+    }
+    postManagement.publishAllViews();
+    friendSystem.publishAllViews();
+    for (size_t i = 0; i < chatCount; i++)
+    {
+        User *user1 = userManagement.findUserById(chats[i].user1);
+        User *user2 = userManagement.findUserById(chats[i].user2);
+        if (user1 && user2)
+        {
+            MemoryScope memory(Subsystem::Messages);
+            pair<User *, User *> key = MessagingSystem::conversationKey(user1, user2);
+            DoublyLinkedList &log = messagingSystem.chatHistory.try_emplace(key, move(chatLogs[i])).first->second;
+            log.setRetention(&messagingSystem.retentionPolicy, MessagingSystem::conversationPrefix(key));
+        }
+    }
+    const SnapshotGroupMember *members = snapshot.records<SnapshotGroupMember>(SnapshotSectionKind::GroupMembers, memberCount);
+    for (size_t i = 0; i < groupCount; i++)
+    {
+        const SnapshotGroup &record = groups[i];
+        MemoryScope memory(Subsystem::Groups);
+        string groupId = snapshot.text(record.groupId);
+        string groupName = snapshot.text(record.groupName);
+        Group &group = messagingSystem.groups.try_emplace(groupId, groupId, groupName).first->second;
+        group.messageHistory = move(groupLogs[i]);
+        group.messageHistory.setRetention(&messagingSystem.retentionPolicy, "group-" + groupId);
+        messagingSystem.groupIdsByName.emplace(groupName, groupId);
+        if (!inRange(record.firstMember, record.memberCount, memberCount))
+        {
+            continue;
+        }
+        for (uint64_t m = record.firstMember; m < record.firstMember + record.memberCount; m++)
+        {
+            if (User *user = userManagement.findUserById(members[m].userId))
+            {
+                messagingSystem.addMember(group, user);
+                group.readCursors[user] = {members[m].position, members[m].ownUnread};
+                messagingSystem.countGroupUnread(group, user, true);
+            }
+        }
+    }
+    const SnapshotDirectRead *reads = snapshot.records<SnapshotDirectRead>(SnapshotSectionKind::DirectReads, readCount);
+    for (size_t i = 0; i < readCount; i++)
+    {
+        User *reader = userManagement.findUserById(reads[i].readerId);
+        User *partner = userManagement.findUserById(reads[i].partnerId);
+        if (!reader || !partner)
+        {
+            continue;
+        }
+        MemoryScope memory(Subsystem::Messages);
+        MessagingSystem::DirectReadState &state = messagingSystem.directReadState[reader];
+        state.cursors[partner] = reads[i].cursor;
+        if (reads[i].unread > 0)
+        {
+            state.unreadByPartner[partner] = reads[i].unread;
+            state.unreadTotal += reads[i].unread;
+        }
+    }
+    const SnapshotHeader &header = snapshot.info();
+    messagingSystem.nextSequence = max(messagingSystem.nextSequence, header.nextSequence);
+    messagingSystem.lastTimestamp = max(messagingSystem.lastTimestamp, header.lastTimestamp);
+    walLsn = header.walLsn;
+    return true;
+}
+// Comments under `comment`, replies at every depth
+static size_t countReplies(Comment &comment)
+{
+    size_t count = 0;
+    for (Comment &reply : comment.getReplies())
+    {
+        count += 1 + countReplies(reply);
+    }
+    return count;
+}
+void reportMemoryUsage(ostream &out, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                       MessagingSystem &messagingSystem)
+{
+    if (messagingSystem.events)
+    {
+        messagingSystem.events->waitUntilDelivered();
+    }
+    MemoryAccounting::report(out);
+
+    size_t posts = 0, comments = 0, replies = 0;
+    for (const auto &entry : postManagement.userPosts)
+    {
+        posts += entry.second.size();
+    }
+    for (auto &entry : postManagement.postComments)
+    {
+        comments += entry.second.size();
+        for (Comment *comment : entry.second)
+        {
+            replies += countReplies(*comment);
+        }
+    }
+    size_t friendLinks = 0, pendingRequests = 0;
+    for (const auto &entry : friendSystem.friends)
+    {
+        friendLinks += entry.second.size();
+    }
+    for (const auto &entry : friendSystem.pendingRequests)
+    {
+        pendingRequests += entry.second.size();
+    }
+    size_t directMessages = 0, coldSegments = 0, searchTokens = 0;
+    for (const auto &entry : messagingSystem.chatHistory)
+    {
+        directMessages += entry.second.size();
+        coldSegments += entry.second.coldSegments().size();
+        searchTokens += entry.second.searchIndex().size();
+    }
+    size_t groupMembers = 0, groupMessages = 0;
+    for (const auto &entry : messagingSystem.groups)
+    {
+        groupMembers += entry.second.participants.size();
+        groupMessages += entry.second.messageHistory.size();
+        coldSegments += entry.second.messageHistory.coldSegments().size();
+        searchTokens += entry.second.messageHistory.searchIndex().size();
+    }
+    size_t inboxes;
+    {
+        shared_lock<shared_mutex> lock(messagingSystem.inboxesMutex);
+        inboxes = messagingSystem.inboxes.size();
+    }
+    out << "Objects:" << endl;
+    out << "  users: " << userManagement.usersById.size() << " (" << userManagement.userCredentials.size() << " credentials, "
+        << userManagement.userProfiles.size() << " profiles)" << endl;
+    out << "  posts: " << posts << " by " << postManagement.userPosts.size() << " authors, " << postManagement.postComments.size()
+        << " comment threads" << endl;
+    out << "  comments: " << comments << " top-level, " << replies << " replies" << endl;
+    out << "  friends: " << friendLinks / 2 << " friendships over " << friendSystem.friends.size() << " users, "
+        << pendingRequests << " pending requests" << endl;
+    out << "  messages: " << directMessages << " in " << messagingSystem.chatHistory.size() << " conversations, "
+        << messagingSystem.directReadState.size() << " readers tracked, " << inboxes << " inboxes" << endl;
+    out << "  groups: " << messagingSystem.groups.size() << " with " << groupMembers << " memberships and " << groupMessages << " messages" << endl;
+    out << "  message logs: " << coldSegments << " sealed segments, " << searchTokens << " search tokens" << endl;
+}
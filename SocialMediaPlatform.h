@@ -1,289 +1,956 @@
-#ifndef SOCIAL_MEDIA_PLATFORM_H
-#define SOCIAL_MEDIA_PLATFORM_H
-#include <unordered_map>
-#include <iostream>
-#include <string>
-#include <vector>
-#include <map>
-#include <queue>
-#include <list>
-#include <set>
-#include <unistd.h>
-#include <windows.h>
-#include <algorithm>
-
-using namespace std;
-
-class User; // Forward declaration
-
-// User Class
-class User
-{
-private:
-    string username;
-    string password;
-    string email;
-    string bio;
-    bool isPublic;
-
-public:
-    User(const string &uname, const string &pwd, const string &email, const string &bio, bool isPublic);
-
-    string getUsername();
-    string getEmail();
-    string getBio();
-    bool isProfilePublic();
-    bool validatePassword(const string &pwd);
-
-    // Methods to update profile details
-    void updateBio(const string &newBio);
-    void updateEmail(const string &newEmail);
-    void updatePassword(const string &newPassword);
-    void updatePrivacy(bool newPrivacy);
-    void updateUsername(const string &newUsername);
-};
-
-class Comment
-{
-public:
-    string content;
-    User *author;
-    list<Comment> replies; // List of replies to this comment
-
-public:
-    Comment(User *author, const string &content) : author(author), content(content) {}
-
-    string getContent() { return content; }
-    string getAuthor() { return author->getUsername(); }
-
-    list<Comment> &getReplies() { return replies; }
-    void addReply(User *replier, const string &replyContent);
-    void displayComment(int level = 0);
-};
-
-// MessageNode Class (For Linked List)
-class MessageNode
-{
-public:
-    User *sender;   // Pointer to the sender User
-    User *receiver; // Pointer to the receiver User
-    string message;
-    MessageNode *prev;
-    MessageNode *next;
-
-    MessageNode(User *sender, User *receiver, const string &message)
-        : sender(sender), receiver(receiver), message(message), prev(nullptr), next(nullptr) {}
-};
-
-// Doubly Linked List Class (Chat History)
-class DoublyLinkedList
-{
-private:
-    MessageNode *head;
-    MessageNode *tail;
-
-public:
-    DoublyLinkedList() : head(nullptr), tail(nullptr) {}
-
-    ~DoublyLinkedList()
-    {
-        MessageNode *current = head;
-        while (current)
-        {
-            MessageNode *nextNode = current->next;
-            delete current;
-            current = nextNode;
-        }
-    }
-
-    void append(User *sender, User *receiver, const string &message)
-    {
-        MessageNode *newNode = new MessageNode(sender, receiver, message);
-        if (!head)
-        {
-            head = tail = newNode;
-        }
-        else
-        {
-            tail->next = newNode;
-            newNode->prev = tail;
-            tail = newNode;
-        }
-    }
-
-    void display(User *user1, User *user2) const
-    {
-        MessageNode *current = head;
-        bool foundMessages = false;
-
-        while (current)
-        {
-            if (current->sender == user1 && current->receiver == user2)
-            {
-                cout << "To " << user2->getUsername() << ": " << current->message << endl;
-                foundMessages = true;
-            }
-            else if (current->sender == user2 && current->receiver == user1)
-            {
-                cout << "From " << user2->getUsername() << ": " << current->message << endl;
-                foundMessages = true;
-            }
-            current = current->next;
-        }
-
-        if (!foundMessages)
-        {
-            cout << "No messages found between " << user1->getUsername() << " and " << user2->getUsername() << "!" << endl;
-        }
-    }
-
-    void display2() const
-    {
-        MessageNode *current = head;
-        if (!current)
-        {
-            cout << "No messages in this group." << endl;
-            return;
-        }
-
-        while (current)
-        {
-            cout << "From " << current->sender->getUsername() << ": " << current->message << endl;
-            current = current->next;
-        }
-    }
-    MessageNode *getHead() const
-    {
-        return head;
-    }
-};
-
-// Group Class for Group Messaging
-class Group
-{
-public:
-    string groupId;             // Unique identifier for the group
-    string groupName;           // Name of the group
-    set<User *> participants;   // Users in the group
-    DoublyLinkedList messageHistory; // Group chat history
-
-    // Default constructor
-    Group() : groupId(""), groupName("") {}
-
-    // Parameterized constructor
-    Group(const string &groupId, const string &groupName)
-        : groupId(groupId), groupName(groupName) {}
-
-    void addUser(User *user)
-    {
-        participants.insert(user);
-    }
-
-    void removeUser(User *user)
-    {
-        participants.erase(user);
-    }
-
-    bool isUserInGroup(User *user) const
-    {
-        return participants.find(user) != participants.end();
-    }
-
-    // Add a message to the group's message history
-    void addMessage(User *sender, const string &message)
-    {
-        messageHistory.append(sender, nullptr, message);
-    }
-};
-
-// User Management Class
-class UserManagement
-{
-private:
-    unordered_map<string, pair<string, User *>> userCredentials; // Hashmap for user credentials and pointers to profiles
-    list<User *> userProfiles;                                                  // Linked list for storing user profile information
-
-public:
-    User *signUp();
-    User *logIn(const string &username, const string &password);
-    void updateUserProfile(User *user, const string &newBio, const string &newEmail);
-    void displayProfile(User *user);
-    User *findUserByUsername(const string &username);
-    void displayAllUsers();
-    void editProfile(User *user);
-    User *validateUsername(const string &username);
-    bool isValidEmail(const string &email);
-
-    friend class FriendSystem;
-    friend class MessagingSystem;
-};
-
-// Post Management Class
-class PostManagement
-{
-public:
-    // Use unordered_map or map as per your requirement, here's using unordered_map
-    map<User *, list<string>> userPosts;
-    map<string, vector<Comment *>> postComments; // Assuming Comment is defined somewhere
-
-    void createPost(User *user, const string &content);
-    void viewUserPosts(User *user);
-    void viewFriendsPosts(User *user, const map<User *, list<User *>> &friends);
-    void viewPublicPosts(const map<User *, list<string>> &userPosts, User *currentUser); // Change parameter to match internal structure
-    void addComment(User *user, const string &postContent, const string &commentContent);
-    void addReplyToComment(User *user, const string &postContent, Comment *parentComment, const string &replyContent);
-    void displayPostWithComments(const string &postContent);
-    vector<string> getAllPosts();
-    void viewPostComments(const string &postContent, User *currentUser);
-    void addCommentOrReply(Comment &parentComment, User *currentUser);
-    void interactiveCommentSection(User *currentUser);
-};
-
-// Friend System Class
-class FriendSystem
-{
-private:
-    map<User *, list<User *>> friends; // Map storing each user and their list of friends
-    map<User *, list<User *>> pendingRequests; // To store pending friend requests
-
-public:
-// Get the entire friends list (for internal use or testing)
-    map<User *, list<User *>> &getFriendsList();
-void addFriend(User *user, User *friendUser);
-bool viewFriends(User *user);
-void suggestFriendsBFS(User *user);
-void suggestFriendsDFS(User *user);
-void dfs(User *user, map<User *, bool> &visited, map<User *, int> &mutualCount);
-void displayPendingRequests(User *user);
-void removeFriend(User *user1, User *user2);
-void mutualFriendsCount(User *user1, User *user2);
-};
-
-// Messaging System Class (One-on-One and Group Messaging)
-class MessagingSystem
-{
-private:
-    map<User *, queue<pair<User *, string>>> userMessages;
-    map<User *, DoublyLinkedList> chatHistory; // One-on-one chat history
-    map<string, Group> groups;            // Group messaging system
-
-public:
-    void sendMessage(User *fromUser, User *toUser, const string &message);
-    void viewNewMessages(User *user);
-    void viewChatHistory(User *recipient, User *friendUser);
-
-    // Group-related functions
-    void createGroup(User *currentUser, UserManagement &userManagement, FriendSystem &friendSystem, MessagingSystem &messagingSystem);
-    // void createGroup(const string &groupId, const string &groupName, const set<User *> &initialParticipants);
-    bool sendMessageToGroup(User *fromUser, const string &groupId, const string &message);
-    void viewGroupChatHistory(const string &groupName, User *currentUser);
-    bool addUserToGroup(const string &groupName, User *user);
-    bool removeUserFromGroup(const string &groupId, User *user);
-    bool isUserInGroup(const string &groupName, User *user);
-    const map<string, Group> &getGroups() const
-    {
-        return groups;
-    }
-};
-
-#endif // SOCIAL_MEDIA_PLATFORM_H
+#ifndef SOCIAL_MEDIA_PLATFORM_H
+#define SOCIAL_MEDIA_PLATFORM_H
+#include <unordered_map>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <list>
+#include <set>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include "MessageInbox.h"
+#include "MemberSet.h"
+#include "ColdStorage.h"
+#include "EventBus.h"
+#include "WriteAheadLog.h"
+#include "Snapshot.h"
+#include "Metrics.h"
+#include "MemoryAccounting.h"
+#include "Tracing.h"
+#include "LockStripes.h"
+#include "ReadViews.h"
+#include "AsyncTask.h"
+#include <deque>
+
+using namespace std;
+
+class User; // Forward declaration
+
+// User Class
+// Profile fields are read and written under a per-user stripe, so another session may change them at any time.
+class User
+{
+private:
+    string username;
+    string password;
+    string email;
+    string bio;
+    bool isPublic;
+    uint32_t id; // Dense id assigned at sign up, used by compact id-based structures
+
+public:
+    User(const string &uname, const string &pwd, const string &email, const string &bio, bool isPublic, uint32_t id = 0);
+
+    uint32_t getId() const { return id; }
+    string getUsername();
+    string getEmail();
+    string getBio();
+    bool isProfilePublic();
+    bool validatePassword(const string &pwd);
+
+    // Methods to update profile details
+    void updateBio(const string &newBio);
+    void updateEmail(const string &newEmail);
+    void updatePassword(const string &newPassword);
+    void updatePrivacy(bool newPrivacy);
+    void updateUsername(const string &newUsername);
+};
+
+class Comment
+{
+public:
+    User *author;
+    string content;
+    list<Comment> replies; // List of replies to this comment
+
+public:
+    Comment(User *author, const string &content) : author(author), content(content) {}
+
+    string getContent() { return content; }
+    string getAuthor() { return author->getUsername(); }
+
+    list<Comment> &getReplies() { return replies; }
+    void addReply(User *replier, const string &replyContent);
+    void displayComment(int level = 0);
+};
+
+// MessageNode Class (For Linked List)
+class MessageNode
+{
+public:
+    User *sender;   // Pointer to the sender User
+    User *receiver; // Pointer to the receiver User
+    string message;
+    uint64_t seq;      // Platform-wide monotonic sequence number
+    int64_t timestamp; // Milliseconds since epoch, non-decreasing within a log
+    MessageNode *prev;
+    MessageNode *next;
+
+    MessageNode(User *sender, User *receiver, const string &message, uint64_t seq = 0, int64_t timestamp = 0)
+        : sender(sender), receiver(receiver), message(message), seq(seq), timestamp(timestamp), prev(nullptr), next(nullptr) {}
+};
+
+// Cursor value meaning "start from the newest message"
+const size_t HISTORY_LATEST = SIZE_MAX;
+const size_t HISTORY_PAGE_SIZE = 10;
+
+// Keeps a decoded cold segment alive while pointers into it are in use
+typedef shared_ptr<const vector<MessageNode>> SegmentPin;
+
+// One page of chat history, oldest message first.
+// Pass `cursor` back to fetch the page just before this one.
+struct HistoryPage
+{
+    vector<const MessageNode *> messages;
+    size_t cursor = 0;    // Position of the oldest message in this page
+    bool hasMore = false; // True if older messages exist before `cursor`
+    vector<SegmentPin> pinned; // Cold segments and message copies that `messages` point into
+};
+
+// A run of old messages sealed into a compressed segment file
+struct ColdSegment
+{
+    size_t firstPosition;
+    size_t count;
+    uint64_t lastSeq;
+    int64_t lastTimestamp;
+    string path;
+};
+
+// Doubly Linked List Class (Chat History)
+// Recent messages are linked nodes in memory. Under a RetentionPolicy the oldest ones
+// are sealed into segment files, and positions below coldCount are read back from there.
+class DoublyLinkedList
+{
+private:
+    MessageNode *head; // Oldest message still in memory
+    MessageNode *tail;
+    deque<MessageNode *> index; // Hot positions: index[i] holds position coldCount + i
+    size_t coldCount = 0;       // Messages sealed into segments, positions 0 .. coldCount - 1
+    vector<ColdSegment> segments;
+    unordered_map<string, vector<uint32_t>> postings; // Search token -> ascending positions of messages containing it
+    const RetentionPolicy *retention = nullptr;
+    string segmentPrefix;                                // File name prefix for this log's segments
+    mutable list<pair<size_t, SegmentPin>> segmentCache; // Recently decoded segments, most recent first
+    mutable mutex cacheMutex;                            // Readers sharing the log's lock still update the cache
+    static const size_t SEGMENT_CACHE_SIZE = 4;
+
+    bool sealOldest(size_t count);
+    void enforceRetention(int64_t now);
+    SegmentPin loadSegment(size_t segmentIndex) const;
+    size_t lowerBound(bool bySeq, uint64_t value) const;
+
+public:
+    DoublyLinkedList() : head(nullptr), tail(nullptr) {}
+
+    // The list owns its nodes: it can be moved, but a copy would delete them twice
+    DoublyLinkedList(const DoublyLinkedList &) = delete;
+    DoublyLinkedList &operator=(const DoublyLinkedList &) = delete;
+
+    DoublyLinkedList(DoublyLinkedList &&other) noexcept : DoublyLinkedList()
+    {
+        swap(other);
+    }
+
+    DoublyLinkedList &operator=(DoublyLinkedList &&other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            swap(other);
+        }
+        return *this;
+    }
+
+    ~DoublyLinkedList()
+    {
+        clear();
+    }
+
+    void swap(DoublyLinkedList &other) noexcept
+    {
+        std::swap(head, other.head);
+        std::swap(tail, other.tail);
+        index.swap(other.index);
+        std::swap(coldCount, other.coldCount);
+        segments.swap(other.segments);
+        postings.swap(other.postings);
+        std::swap(retention, other.retention);
+        segmentPrefix.swap(other.segmentPrefix);
+        segmentCache.swap(other.segmentCache);
+    }
+
+    // Deletes the in-memory nodes. Segment files stay on disk, where the next start (and the snapshot) finds them.
+    void clear();
+
+    // Applies `policy` to this log (nullptr to keep everything in memory) and seals what it already exceeds
+    void setRetention(const RetentionPolicy *policy, const string &prefix);
+
+    // Lower-cased alphanumeric words, each listed once
+    static vector<string> tokenize(const string &text)
+    {
+        vector<string> tokens;
+        string current;
+        for (char c : text)
+        {
+            if (isalnum(static_cast<unsigned char>(c)))
+            {
+                current += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+            else if (!current.empty())
+            {
+                tokens.push_back(current);
+                current.clear();
+            }
+        }
+        if (!current.empty())
+        {
+            tokens.push_back(current);
+        }
+        sort(tokens.begin(), tokens.end());
+        tokens.erase(unique(tokens.begin(), tokens.end()), tokens.end());
+        return tokens;
+    }
+
+    // `indexed` false leaves the message out of search until indexMessage adds it
+    void append(User *sender, User *receiver, const string &message, uint64_t seq = 0, int64_t timestamp = 0, bool indexed = true)
+    {
+        MessageNode *newNode = new MessageNode(sender, receiver, message, seq, timestamp);
+        if (!head)
+        {
+            head = tail = newNode;
+        }
+        else
+        {
+            tail->next = newNode;
+            newNode->prev = tail;
+            tail = newNode;
+        }
+        index.push_back(newNode);
+        if (indexed)
+        {
+            indexMessage(size() - 1, message);
+        }
+        enforceRetention(timestamp);
+    }
+
+    // Adds the message at `position` to the search postings, which stay in ascending order
+    // even when messages are indexed out of order
+    void indexMessage(size_t position, const string &message)
+    {
+        uint32_t value = static_cast<uint32_t>(position);
+        for (const string &token : tokenize(message))
+        {
+            vector<uint32_t> &positions = postings[token];
+            if (positions.empty() || positions.back() < value)
+            {
+                positions.push_back(value);
+            }
+            else
+            {
+                positions.insert(upper_bound(positions.begin(), positions.end(), value), value);
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return coldCount + index.size();
+    }
+
+    // Sequence number and timestamp of the newest message, zeros if there is none; never reads a segment
+    pair<uint64_t, int64_t> newestStamp() const
+    {
+        if (tail)
+        {
+            return {tail->seq, tail->timestamp};
+        }
+        return segments.empty() ? make_pair(uint64_t(0), int64_t(0)) : make_pair(segments.back().lastSeq, segments.back().lastTimestamp);
+    }
+
+    // Messages currently held in memory
+    size_t hotSize() const
+    {
+        return index.size();
+    }
+
+    // Message at `position`, reading its segment back if it is cold. A cold message stays valid while `pin` is held.
+    const MessageNode *at(size_t position, SegmentPin &pin) const;
+
+    // Sequence number at `position`, 0 if it cannot be read
+    uint64_t seqAt(size_t position) const
+    {
+        SegmentPin pin;
+        const MessageNode *node = at(position, pin);
+        return node ? node->seq : 0;
+    }
+
+    // Whether appends may seal in-memory messages into segments, deleting the nodes
+    bool sealsMessages() const
+    {
+        return retention && retention->enabled();
+    }
+
+    // A copy of the in-memory message `node`, kept alive by `pin`. Results handed out of a lock are detached
+    // this way when the log seals messages, because a later append may delete the original.
+    static const MessageNode *detach(const MessageNode *node, SegmentPin &pin)
+    {
+        auto copy = make_shared<vector<MessageNode>>(1, *node);
+        copy->front().prev = copy->front().next = nullptr;
+        pin = copy;
+        return &copy->front();
+    }
+
+    // Returns up to `limit` messages ending just before `cursor` (HISTORY_LATEST for the newest page).
+    // Cost depends only on `limit`, never on the length of the history.
+    // If the log seals messages, in-memory ones are copied into the page so it stays valid once the log is unlocked.
+    HistoryPage page(size_t cursor, size_t limit) const
+    {
+        HistoryPage result;
+        size_t end = min(cursor, size());
+        size_t start = end > limit ? end - limit : 0;
+        shared_ptr<vector<MessageNode>> copies;
+        if (sealsMessages())
+        {
+            copies = make_shared<vector<MessageNode>>();
+            copies->reserve(end - start); // Never reallocates, so pointers into it stay put
+        }
+        for (size_t i = start; i < end; i++)
+        {
+            SegmentPin pin;
+            const MessageNode *node = at(i, pin);
+            if (!node)
+            {
+                continue; // Segment file missing or unreadable
+            }
+            if (pin && (result.pinned.empty() || result.pinned.back() != pin))
+            {
+                result.pinned.push_back(pin);
+            }
+            if (!pin && copies)
+            {
+                copies->push_back(*node);
+                copies->back().prev = copies->back().next = nullptr;
+                node = &copies->back();
+            }
+            result.messages.push_back(node);
+        }
+        if (copies && !copies->empty())
+        {
+            result.pinned.push_back(copies);
+        }
+        result.cursor = start;
+        result.hasMore = start > 0;
+        return result;
+    }
+
+    // Position of the first message sent at or after `timestamp` (size() if none).
+    // Usable as a cursor: page(seek(t) + limit, limit) starts at that message.
+    size_t seek(int64_t timestamp) const
+    {
+        return timestamp <= 0 ? 0 : lowerBound(false, static_cast<uint64_t>(timestamp));
+    }
+
+    // Number of messages with a sequence number below `seq`, i.e. the position where `seq` would be
+    size_t positionBefore(uint64_t seq) const
+    {
+        return lowerBound(true, seq);
+    }
+
+    // Newest position below `before` whose message contains every token, or SIZE_MAX.
+    // Walks only the rarest token's postings and checks the others by binary search.
+    size_t previousMatch(const vector<string> &tokens, size_t before) const
+    {
+        if (tokens.empty())
+        {
+            return SIZE_MAX;
+        }
+        vector<const vector<uint32_t> *> lists;
+        for (const string &token : tokens)
+        {
+            auto it = postings.find(token);
+            if (it == postings.end())
+            {
+                return SIZE_MAX;
+            }
+            lists.push_back(&it->second);
+        }
+        sort(lists.begin(), lists.end(), [](const vector<uint32_t> *a, const vector<uint32_t> *b)
+             { return a->size() < b->size(); });
+        const vector<uint32_t> &rarest = *lists[0];
+        auto it = lower_bound(rarest.begin(), rarest.end(), before);
+        while (it != rarest.begin())
+        {
+            --it;
+            bool inAll = true;
+            for (size_t i = 1; i < lists.size() && inAll; i++)
+            {
+                inAll = binary_search(lists[i]->begin(), lists[i]->end(), *it);
+            }
+            if (inAll)
+            {
+                return *it;
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    void display(User *user1, User *user2) const
+    {
+        MessageNode *current = head;
+        bool foundMessages = false;
+
+        while (current)
+        {
+            if (current->sender == user1 && current->receiver == user2)
+            {
+                cout << "To " << user2->getUsername() << ": " << current->message << endl;
+                foundMessages = true;
+            }
+            else if (current->sender == user2 && current->receiver == user1)
+            {
+                cout << "From " << user2->getUsername() << ": " << current->message << endl;
+                foundMessages = true;
+            }
+            current = current->next;
+        }
+
+        if (!foundMessages)
+        {
+            cout << "No messages found between " << user1->getUsername() << " and " << user2->getUsername() << "!" << endl;
+        }
+    }
+
+    void display2() const
+    {
+        MessageNode *current = head;
+        if (!current)
+        {
+            cout << "No messages in this group." << endl;
+            return;
+        }
+
+        while (current)
+        {
+            cout << "From " << current->sender->getUsername() << ": " << current->message << endl;
+            current = current->next;
+        }
+    }
+    MessageNode *getHead() const
+    {
+        return head;
+    }
+
+    // Snapshot support: what is sealed, the search index, and rebuilding a log from both
+    const vector<ColdSegment> &coldSegments() const
+    {
+        return segments;
+    }
+
+    const unordered_map<string, vector<uint32_t>> &searchIndex() const
+    {
+        return postings;
+    }
+
+    // Refills an empty log. Takes ownership of `hot` (oldest first), which follows the `coldMessages` sealed ones.
+    void restore(size_t coldMessages, vector<ColdSegment> &&sealed, const vector<MessageNode *> &hot,
+                 unordered_map<string, vector<uint32_t>> &&searchPostings);
+};
+
+// Read watermark of one member in a group
+struct ReadCursor
+{
+    size_t position = 0;  // First message not yet read
+    size_t ownUnread = 0; // Member's own messages at or after `position`; never counted as unread
+};
+
+// Group Class for Group Messaging
+// Everything in a group is guarded by its stripe in MessagingSystem::groupLocks.
+class Group
+{
+public:
+    string groupId;             // Unique identifier for the group
+    string groupName;           // Name of the group
+    MemberSet participants;     // Ids of the users in the group
+    DoublyLinkedList messageHistory; // Group chat history
+    map<User *, ReadCursor> readCursors; // Member -> read watermark
+
+    // Groups are constructed in place in MessagingSystem::groups and only ever moved
+    Group(const string &groupId, const string &groupName)
+        : groupId(groupId), groupName(groupName) {}
+
+    Group(const Group &) = delete;
+    Group &operator=(const Group &) = delete;
+    Group(Group &&) = default;
+    Group &operator=(Group &&) = default;
+
+    // New members start with nothing unread
+    void addUser(User *user)
+    {
+        if (participants.insert(user->getId()))
+        {
+            readCursors[user] = {messageHistory.size(), 0};
+        }
+    }
+
+    void removeUser(User *user)
+    {
+        participants.erase(user->getId());
+        readCursors.erase(user);
+    }
+
+    bool isUserInGroup(User *user) const
+    {
+        return participants.contains(user->getId());
+    }
+
+    // Messages from other members past the user's watermark, without touching the history
+    size_t unreadCount(User *user) const
+    {
+        auto it = readCursors.find(user);
+        if (it == readCursors.end())
+        {
+            return 0;
+        }
+        return messageHistory.size() - it->second.position - it->second.ownUnread;
+    }
+
+    // Add a message to the group's message history
+    void addMessage(User *sender, const string &message, uint64_t seq = 0, int64_t timestamp = 0, bool indexed = true)
+    {
+        auto it = readCursors.find(sender);
+        bool senderCaughtUp = it != readCursors.end() && it->second.position == messageHistory.size();
+        messageHistory.append(sender, nullptr, message, seq, timestamp, indexed);
+        if (senderCaughtUp)
+        {
+            it->second.position = messageHistory.size();
+        }
+        else if (it != readCursors.end())
+        {
+            it->second.ownUnread++;
+        }
+    }
+};
+
+// Unread badge: total unread messages and how many chats they are spread over
+struct UnreadSummary
+{
+    size_t messages = 0;
+    size_t chats = 0;
+};
+
+// Cursor value meaning "start from the newest match"
+const uint64_t SEARCH_LATEST = UINT64_MAX;
+
+// One search match and where it was found
+struct SearchHit
+{
+    const MessageNode *node;
+    const Group *group; // nullptr for a direct message
+    User *partner;      // Other participant of a direct conversation
+    SegmentPin pin;     // Set when the message was read back from a cold segment
+};
+
+// One page of search matches, newest first.
+// Pass `cursor` back to fetch the next (older) page.
+struct SearchPage
+{
+    vector<SearchHit> hits;
+    uint64_t cursor = SEARCH_LATEST; // Sequence number of the oldest hit in this page
+    bool hasMore = false;
+};
+
+// A new message as returned by fetchNewMessages
+struct InboxMessage
+{
+    const MessageNode *node;
+    const Group *group; // nullptr for a direct message
+    SegmentPin pin;     // Set when the message was read back from a cold segment
+};
+
+class UserManagement;
+class PostManagement;
+class FriendSystem;
+class MessagingSystem;
+
+// Concurrency: every public manager operation is safe to call from many sessions at once.
+// Each manager guards the key structure of its maps with one reader-writer lock, held only briefly,
+// and the data behind each key with a stripe of reader-writer locks (LockStripes.h) sharded by user id,
+// post content or group id, so writers touching unrelated users do not contend.
+// Lock order, outermost first; a thread only ever acquires locks further down this list:
+//   1. a MessagingSystem inbox's drainMutex (a user's inbox drain, which appends messages)
+//   2. stripes of one manager: UserManagement::profileLocks; PostManagement::authorLocks then threadLocks;
+//      FriendSystem::userLocks; MessagingSystem::userLocks then groupLocks
+//   3. the manager's structural lock: accountsMutex, postsMutex, friendsMutex or indexMutex
+//   4. leaves: the write-ahead log (which takes MessagingSystem::clockMutex to stamp a record), MessagingSystem::clockMutex, a log's segment cache, inboxes, User fields,
+//      a VersionedTable's stage lock
+// Posts and friend lists are also published as immutable read views (ReadViews.h): readers of a user's posts
+// or friends take no lock at all, and a writer publishes its change before returning.
+// Managers publish to the event bus (EventBus.h) only after releasing their locks: a publisher may wait for the
+// subscribers to make room, and the search indexer takes MessagingSystem's stripes.
+// A manager never calls into another while holding its own locks, except for the leaf lookups of
+// UserManagement (findUserById, User getters). Cross-subsystem operations such as createGroup read
+// friends first, release, then take the messaging locks.
+// Log replay, snapshot load and capture, reportMemoryUsage and setRetentionPolicy read internals
+// directly and must run while no session is active.
+
+// Mutes cout while chatty code paths run without a user watching (log replay, benchmarks)
+class QuietConsole
+{
+private:
+    streambuf *saved;
+
+public:
+    QuietConsole() : saved(cout.rdbuf(nullptr)) {}
+    ~QuietConsole()
+    {
+        cout.rdbuf(saved);
+        cout.clear();
+    }
+};
+
+// Rebuilds state from the write-ahead log at `path`, and the file it last rolled over into, skipping records up to `afterLsn`
+WalReplayResult replayWriteAheadLog(const string &path, uint64_t afterLsn, UserManagement &userManagement, PostManagement &postManagement,
+                                    FriendSystem &friendSystem, MessagingSystem &messagingSystem);
+
+// Serializes every manager into a snapshot image of the state at this call; `walLsn` is the last log record it includes
+string captureSnapshot(UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                       MessagingSystem &messagingSystem, uint64_t walLsn);
+
+// Fills empty managers from the snapshot at `path` and reports the last log record it includes.
+// Sections are rebuilt concurrently on the shared executor; call it from outside the executor. False if there is no valid snapshot there
+// or its chat history is damaged; the managers are then left untouched, ready for a full log replay.
+bool loadSnapshot(const string &path, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                  MessagingSystem &messagingSystem, uint64_t &walLsn);
+
+// Prints heap usage per subsystem, then how many objects each manager's containers hold
+void reportMemoryUsage(ostream &out, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                       MessagingSystem &messagingSystem);
+
+// Profile fields that can be changed after sign up
+enum class ProfileField : uint8_t
+{
+    Username,
+    Bio,
+    Email,
+    Password,
+    Privacy // Value "1" for public, "0" for private
+};
+
+// User Management Class
+class UserManagement
+{
+private:
+    unordered_map<string, pair<string, User *>> userCredentials; // Hashmap for user credentials and pointers to profiles
+    list<User *> userProfiles;                                                  // Linked list for storing user profile information
+    vector<User *> usersById;                                                   // Id -> user, ids are dense
+    mutable shared_mutex accountsMutex; // Guards userCredentials, userProfiles and usersById
+    LockStripes profileLocks;           // Per user: a profile change is logged and applied as one step
+    WriteAheadLog *wal = nullptr; // Every mutation is recorded here when attached
+    EventBus *events = nullptr;   // Every mutation is published here when attached
+
+public:
+    void attachWriteAheadLog(WriteAheadLog *log) { wal = log; }
+    void attachEventBus(EventBus *bus) { events = bus; }
+    User *signUp();
+    // Creates the account without prompting; nullptr if the username is taken
+    User *registerUser(const string &username, const string &password, const string &email, const string &bio, bool isPublic);
+    // Applies one profile change; false if a new username is already taken
+    bool updateProfileField(User *user, ProfileField field, const string &value);
+    User *logIn(const string &username, const string &password);
+    void updateUserProfile(User *user, const string &newBio, const string &newEmail);
+    void displayProfile(User *user);
+    User *findUserByUsername(const string &username);
+    User *findUserById(uint32_t id);
+    void displayAllUsers();
+    // Every account, in sign-up order
+    vector<User *> getAllUsers() const;
+    void editProfile(User *user);
+    User *validateUsername(const string &username);
+    bool isValidEmail(const string &email);
+
+    friend class FriendSystem;
+    friend class MessagingSystem;
+    friend string captureSnapshot(UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                                  MessagingSystem &messagingSystem, uint64_t walLsn);
+    friend bool loadSnapshot(const string &path, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                             MessagingSystem &messagingSystem, uint64_t &walLsn);
+    friend void reportMemoryUsage(ostream &out, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                                  MessagingSystem &messagingSystem);
+};
+
+// Post Management Class
+class PostManagement
+{
+private:
+    WriteAheadLog *wal = nullptr; // Every mutation is recorded here when attached
+    EventBus *events = nullptr;   // Every mutation is published here when attached
+    mutable shared_mutex postsMutex;  // Guards the keys of userPosts and postComments
+    mutable LockStripes authorLocks;  // Per author: their list in userPosts
+    mutable LockStripes threadLocks;  // Per post content: its comments and every reply below them
+    VersionedTable<vector<const string *>> postViews; // Author id -> their posts, oldest first; points into userPosts
+
+    vector<Comment *> &commentsOf(const string &postContent);
+    void publishAllViews();
+
+public:
+    void attachWriteAheadLog(WriteAheadLog *log) { wal = log; }
+    void attachEventBus(EventBus *bus) { events = bus; }
+    // Use unordered_map or map as per your requirement, here's using unordered_map
+    // Direct access is unsynchronized; sessions go through the member functions
+    map<User *, list<string>> userPosts;
+    map<string, vector<Comment *>> postComments; // Assuming Comment is defined somewhere
+
+    void createPost(User *user, const string &content);
+    // Copies taken under the locks, safe to use after they are released
+    vector<string> getUserPosts(User *user) const;
+    vector<Comment *> getComments(const string &postContent) const;
+    // Each comment and reply under a post as "author: content", replies indented two spaces per level
+    vector<string> getCommentThread(const string &postContent) const;
+    // Users who have posted
+    vector<User *> getAuthors() const;
+    void viewUserPosts(User *user);
+    void viewFriendsPosts(User *user, const vector<User *> &friends);
+    void viewPublicPosts(User *currentUser);
+    void addComment(User *user, const string &postContent, const string &commentContent);
+    void addReplyToComment(User *user, const string &postContent, Comment *parentComment, const string &replyContent);
+    void displayPostWithComments(const string &postContent);
+    vector<string> getAllPosts();
+    void viewPostComments(const string &postContent, User *currentUser);
+    void addCommentOrReply(Comment &parentComment, User *currentUser);
+    void interactiveCommentSection(User *currentUser);
+
+    friend bool loadSnapshot(const string &path, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                             MessagingSystem &messagingSystem, uint64_t &walLsn);
+};
+
+// Friend System Class
+class FriendSystem
+{
+private:
+    map<User *, list<User *>> friends; // Map storing each user and their list of friends
+    map<User *, list<User *>> pendingRequests; // To store pending friend requests
+    mutable shared_mutex friendsMutex; // Guards the keys of friends and pendingRequests
+    mutable LockStripes userLocks;     // Per user: their friend list
+    VersionedTable<vector<User *>> friendViews; // User id -> friends, published after every change to the lists
+    WriteAheadLog *wal = nullptr; // Every mutation is recorded here when attached
+    EventBus *events = nullptr;   // Every mutation is published here when attached
+
+    list<User *> &friendsOf(User *user);
+    void publishAllViews();
+
+public:
+    void attachWriteAheadLog(WriteAheadLog *log) { wal = log; }
+    void attachEventBus(EventBus *bus) { events = bus; }
+// Get the entire friends list (for internal use or testing); unsynchronized, sessions use getFriends
+    map<User *, list<User *>> &getFriendsList();
+    // Copy of the user's friend list
+    vector<User *> getFriends(User *user) const;
+void addFriend(User *user, User *friendUser);
+bool viewFriends(User *user);
+// Friends of friends (at any distance) who are not yet friends, nearest first
+vector<User *> suggestFriends(User *user);
+// The same walk as a task that yields every `context.quantum` users visited
+Task<vector<User *>> suggestFriendsAsync(User *user, QueryContext &context);
+void suggestFriendsBFS(User *user);
+void suggestFriendsDFS(User *user);
+void dfs(User *user, map<User *, bool> &visited, map<User *, int> &mutualCount);
+void displayPendingRequests(User *user);
+void removeFriend(User *user1, User *user2);
+int countMutualFriends(User *user1, User *user2);
+void mutualFriendsCount(User *user1, User *user2);
+
+    friend string captureSnapshot(UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                                  MessagingSystem &messagingSystem, uint64_t walLsn);
+    friend bool loadSnapshot(const string &path, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                             MessagingSystem &messagingSystem, uint64_t &walLsn);
+    friend void reportMemoryUsage(ostream &out, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                                  MessagingSystem &messagingSystem);
+};
+
+// Messaging System Class (One-on-One and Group Messaging)
+class MessagingSystem
+{
+private:
+    // Per-reader unread bookkeeping; counters are maintained on send, so the badge never visits a log
+    struct DirectReadState
+    {
+        map<User *, size_t> cursors;         // Partner -> position of first unread message in that conversation
+        map<User *, size_t> unreadByPartner; // Only partners with unread messages
+        size_t unreadTotal = 0;
+        // Unread group messages and the groups holding them. A group send updates them under the group's
+        // stripe rather than the reader's, so they are atomic.
+        atomic<size_t> groupUnreadTotal{0};
+        atomic<size_t> unreadGroups{0};
+    };
+
+    // Direct messages posted to one user and not yet appended to their conversations
+    struct UserInbox
+    {
+        MpscInbox<PendingMessage> queue;
+        atomic<int64_t> pending{0}; // Queued and not yet delivered; below 0 while a delivered push is still being counted
+        mutex drainMutex;           // The queue has one consumer at a time
+
+        explicit UserInbox(size_t capacity) : queue(capacity) {}
+    };
+
+    map<User *, DirectReadState> directReadState;
+    unordered_map<User *, unique_ptr<UserInbox>> inboxes; // Concurrent senders write here
+    mutable shared_mutex inboxesMutex; // Guards creation of inboxes only, never a push
+    map<pair<User *, User *>, DoublyLinkedList> chatHistory; // One-on-one chat history, one log per conversation
+    RetentionPolicy retentionPolicy; // Shared by every chat and group log
+    map<string, Group> groups;            // Group messaging system
+    unordered_map<string, string> groupIdsByName; // Group name -> group id, names are unique
+    unordered_map<User *, vector<Group *>> userGroups; // Reverse index: user -> groups they belong to, in join order
+    uint64_t nextSequence = 1;            // Sequence number for the next message
+    int64_t lastTimestamp = 0;            // Keeps message timestamps monotonic
+    WriteAheadLog *wal = nullptr;         // Every mutation is recorded here when attached
+    EventBus *events = nullptr;           // Every mutation is published here when attached
+    UserManagement *eventUsers = nullptr; // Resolves the user ids of events for the search indexer
+    mutable shared_mutex indexMutex; // Guards the keys of chatHistory, directReadState, groups, groupIdsByName and userGroups
+    mutable LockStripes userLocks;   // Per user: their read state, their userGroups entry and, with the partner's, each conversation
+    mutable LockStripes groupLocks;  // Per group id: everything inside the Group
+    mutex clockMutex;                // Guards nextSequence and lastTimestamp
+
+    static pair<User *, User *> conversationKey(User *user1, User *user2);
+    static string conversationPrefix(const pair<User *, User *> &key); // Segment file prefix of a conversation
+    static uint64_t groupKey(const Group &group) { return LockStripes::keyOf(group.groupId); }
+    // Called with the stripes of the log being appended to held, so sequence numbers rise along every log.
+    // Posted direct messages are stamped without them; deliver() stamps one again if it would land behind a newer one.
+    void stampMessage(uint64_t &seq, int64_t &timestamp);
+    // Stamps a direct message and logs it, stamping inside the log's lock so direct messages replay in sequence order
+    void logDirectMessage(User *fromUser, User *toUser, const string &message, uint64_t &seq, int64_t &timestamp);
+    // Caller holds both users' stripes (or runs before sessions start); returns the message's position in the conversation
+    size_t appendDirectMessage(User *fromUser, User *toUser, const string &message, uint64_t seq, int64_t timestamp);
+    // Caller holds the group's stripe (or runs before sessions start); counts the message as unread for the other members
+    void appendGroupMessage(Group &group, User *fromUser, const string &message, uint64_t seq, int64_t timestamp, bool indexed);
+    // Moves the user's unread messages in `group` onto or off their counters, on joining (or loading) and leaving
+    void countGroupUnread(Group &group, User *user, bool add);
+    // Search indexer: adds messages published on the event bus to their log's postings
+    void indexMessages(const vector<const MutationEvent *> &batch);
+    const DoublyLinkedList *findConversation(User *user1, User *user2) const;
+    DoublyLinkedList &conversationLog(User *user1, User *user2);
+    // Entries created on first use; the caller locks the user's stripe before touching them
+    DirectReadState &readStateOf(User *user);
+    vector<Group *> &groupsOf(User *user);
+    // Read-only lookups for a caller holding the user's stripe
+    const DirectReadState *findReadState(User *user) const;
+    vector<Group *> memberGroups(User *user) const;
+    Group *findGroupById(const string &groupId);
+    UserInbox &inboxFor(User *user);
+    UserInbox *findInbox(User *user) const;
+    // Appends a posted message to its conversation and publishes it
+    void deliver(PendingMessage &pending);
+    // Caller holds the inbox's drainMutex; returns the messages delivered
+    size_t drainInbox(UserInbox &inbox);
+    // Every inbox, before a snapshot; run while no session is active
+    void deliverAllPending();
+    struct SearchSource
+    {
+        const DoublyLinkedList *log;
+        const Group *group;
+        User *partner;
+    };
+    static SearchPage searchSources(const vector<SearchSource> &sources, const string &query, uint64_t cursor, size_t limit);
+    // Membership changes go through these so userGroups stays in sync with Group::participants.
+    // Both take the user's stripe, then the group's.
+    bool addMember(Group &group, User *user);
+    bool removeMember(Group &group, User *user);
+
+public:
+    void attachWriteAheadLog(WriteAheadLog *log) { wal = log; }
+    // Publishes every mutation to `bus` and moves search indexing off the send path onto a subscriber of it:
+    // a message becomes searchable once the indexer has caught up. Attach after loading and replay.
+    void attachEventBus(EventBus *bus, UserManagement &userManagement);
+    void sendMessage(User *fromUser, User *toUser, const string &message);
+    // Token search, newest match first; all tokens of the query must appear in a message
+    SearchPage searchMessages(User *user, const string &query, uint64_t cursor = SEARCH_LATEST, size_t limit = HISTORY_PAGE_SIZE);
+    SearchPage searchChat(User *user, User *partner, const string &query, uint64_t cursor = SEARCH_LATEST, size_t limit = HISTORY_PAGE_SIZE);
+    SearchPage searchGroup(const string &groupName, User *user, const string &query, uint64_t cursor = SEARCH_LATEST, size_t limit = HISTORY_PAGE_SIZE);
+    void viewSearchResults(User *user);
+    // Caps in-memory history per log; older messages move to compressed segment files
+    void setRetentionPolicy(const RetentionPolicy &policy, UserManagement &userManagement);
+    // Send for concurrent sessions that never waits on the receiver's locks: the message is stamped and logged
+    // (durably, in Sync mode) on this thread, then queued in the receiver's lock-free inbox. This thread delivers
+    // the inbox unless another one already is, in which case that thread appends the message shortly.
+    // A full inbox makes this thread deliver the message itself.
+    void postMessage(User *fromUser, User *toUser, const string &message);
+    // Appends every message posted to the user so far to its conversation; waits for a delivery in progress
+    size_t deliverPending(User *user);
+    void viewNewMessages(User *user);
+    // Unread counts for the badge; reads maintained counters, after delivering any posted messages still queued
+    UnreadSummary getUnreadSummary(User *user);
+    // The same counts for the user's groups alone, for a shard where the user is only a group member
+    UnreadSummary getGroupUnreadSummary(User *user) const;
+    // Oldest-first batch of at most `limit` unread messages; only the returned ones are marked read
+    vector<InboxMessage> fetchNewMessages(User *user, size_t limit);
+    void viewChatHistory(User *recipient, User *friendUser);
+
+    // Paged history: pass HISTORY_LATEST to open a chat, then the returned cursor to scroll back
+    HistoryPage getChatHistoryPage(User *user1, User *user2, size_t cursor, size_t limit = HISTORY_PAGE_SIZE) const;
+    HistoryPage getGroupChatHistoryPage(const string &groupName, size_t cursor, size_t limit = HISTORY_PAGE_SIZE) const;
+    // Position of the first message at or after `timestamp`, found by binary search
+    size_t seekChatHistory(User *user1, User *user2, int64_t timestamp) const;
+    size_t seekGroupChatHistory(const string &groupName, int64_t timestamp) const;
+    // Writes the whole history, oldest first, one "[timestamp] sender: message" line each, yielding every
+    // `context.quantum` messages; returns the number written. Messages sent meanwhile are not included.
+    Task<size_t> exportChatHistory(User *user1, User *user2, ostream &out, QueryContext &context) const;
+    Task<size_t> exportGroupHistory(const string &groupName, ostream &out, QueryContext &context) const;
+
+    // Group-related functions
+    void createGroup(User *currentUser, UserManagement &userManagement, FriendSystem &friendSystem, MessagingSystem &messagingSystem);
+    // Creates an empty group without prompting; nullptr if the name is taken
+    Group *createGroup(const string &groupName);
+    bool sendMessageToGroup(User *fromUser, const string &groupId, const string &message);
+    void viewGroupChatHistory(const string &groupName, User *currentUser);
+    bool addUserToGroup(const string &groupName, User *user);
+    // Adds many users, yielding every `context.quantum` of them; returns those who were not members yet
+    Task<vector<User *>> addUsersToGroup(const string &groupName, vector<User *> users, QueryContext &context);
+    bool removeUserFromGroup(const string &groupId, User *user);
+    bool isUserInGroup(const string &groupName, User *user);
+    bool renameGroup(const string &groupName, const string &newName, User *user);
+    // Friends of `user` who are members of the group, via membership set intersection
+    vector<User *> friendsInGroup(const string &groupName, User *user, FriendSystem &friendSystem);
+    Group *findGroupByName(const string &groupName);
+    const Group *findGroupByName(const string &groupName) const;
+    // Groups the user belongs to, O(k) in their number of groups
+    vector<const Group *> getUserGroups(User *user) const;
+    // Page of groups the user could join, in group id order
+    vector<const Group *> getJoinableGroups(User *user, size_t offset, size_t limit) const;
+    // Locked reads of a group found through the functions above
+    string getGroupName(const Group *group) const;
+    size_t getUnreadCount(const Group *group, User *user) const;
+    // Unsynchronized; for tools that run with no session active
+    const map<string, Group> &getGroups() const
+    {
+        return groups;
+    }
+
+    friend WalReplayResult replayWriteAheadLog(const string &path, uint64_t afterLsn, UserManagement &userManagement, PostManagement &postManagement,
+                                               FriendSystem &friendSystem, MessagingSystem &messagingSystem);
+    friend string captureSnapshot(UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                                  MessagingSystem &messagingSystem, uint64_t walLsn);
+    friend bool loadSnapshot(const string &path, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                             MessagingSystem &messagingSystem, uint64_t &walLsn);
+    friend void reportMemoryUsage(ostream &out, UserManagement &userManagement, PostManagement &postManagement, FriendSystem &friendSystem,
+                                  MessagingSystem &messagingSystem);
+};
+
+// Console dialogs used by the menus in main.cpp
+void displayHeader();
+void sendMessageToGroup(User *currentUser, MessagingSystem &messagingSystem);
+void joinGroup(User *currentUser, MessagingSystem &messagingSystem);
+void leaveGroup(User *currentUser, MessagingSystem &messagingSystem);
+void renameGroup(User *currentUser, MessagingSystem &messagingSystem);
+void viewFriendsInGroup(User *currentUser, MessagingSystem &messagingSystem, FriendSystem &friendSystem);
+void viewMyGroups(User *currentUser, MessagingSystem &messagingSystem);
+
+#endif // SOCIAL_MEDIA_PLATFORM_H
@@ -0,0 +1,215 @@
+#ifndef SOCKET_PROTOCOL_H
+#define SOCKET_PROTOCOL_H
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// Line protocol of the socket front-end. A request is one line of tab-separated fields, the command first:
+//     POST<TAB>hello world
+// and is answered by one line, "OK" or "ERR" followed by tab-separated fields:
+//     OK<TAB>ann: hello world<TAB>bob: hi
+// Replies come back in request order, so a client may send many requests before reading any reply.
+const size_t MAX_REQUEST_LINE = 64 * 1024; // Longer lines close the connection
+
+// Where the server listens: a Unix-domain socket path, or a TCP port on the loopback interface
+struct Endpoint
+{
+    string socketPath = "college_connect.sock";
+    int port = 0; // Nonzero selects TCP on 127.0.0.1
+
+    string describe() const
+    {
+        return port ? "127.0.0.1:" + to_string(port) : socketPath;
+    }
+};
+
+inline bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Fills `address` for `endpoint`; false if a socket path is too long
+inline bool socketAddress(const Endpoint &endpoint, sockaddr_storage &address, socklen_t &length)
+{
+    memset(&address, 0, sizeof(address));
+    if (endpoint.port)
+    {
+        sockaddr_in &inet = reinterpret_cast<sockaddr_in &>(address);
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons(static_cast<uint16_t>(endpoint.port));
+        inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        length = sizeof(sockaddr_in);
+        return true;
+    }
+    sockaddr_un &local = reinterpret_cast<sockaddr_un &>(address);
+    if (endpoint.socketPath.size() >= sizeof(local.sun_path))
+    {
+        return false;
+    }
+    local.sun_family = AF_UNIX;
+    memcpy(local.sun_path, endpoint.socketPath.c_str(), endpoint.socketPath.size() + 1);
+    length = sizeof(sockaddr_un);
+    return true;
+}
+
+// Non-blocking listening socket, or -1 with `error` set. A stale Unix socket file is replaced.
+inline int listenOn(const Endpoint &endpoint, string &error)
+{
+    sockaddr_storage address;
+    socklen_t length;
+    if (!socketAddress(endpoint, address, length))
+    {
+        error = "socket path too long";
+        return -1;
+    }
+    int fd = socket(endpoint.port ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = strerror(errno);
+        return -1;
+    }
+    int on = 1;
+    if (endpoint.port)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    else
+    {
+        unlink(endpoint.socketPath.c_str());
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), length) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        error = strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Blocking connection to a listening server, or -1
+inline int connectTo(const Endpoint &endpoint)
+{
+    sockaddr_storage address;
+    socklen_t length;
+    if (!socketAddress(endpoint, address, length))
+    {
+        return -1;
+    }
+    int fd = socket(endpoint.port ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), length) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if (endpoint.port)
+    {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Pipelined requests are small
+    }
+    return fd;
+}
+
+inline vector<string> splitFields(const string &line)
+{
+    vector<string> fields;
+    size_t start = 0;
+    while (true)
+    {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == string::npos ? string::npos : tab - start));
+        if (tab == string::npos)
+        {
+            return fields;
+        }
+        start = tab + 1;
+    }
+}
+
+// Text made safe to send as one field: separators become spaces
+inline string cleanField(string text)
+{
+    for (char &c : text)
+    {
+        if (c == '\t' || c == '\n' || c == '\r')
+        {
+            c = ' ';
+        }
+    }
+    return text;
+}
+
+inline void appendReply(string &out, bool ok, const vector<string> &fields)
+{
+    out += ok ? "OK" : "ERR";
+    for (const string &field : fields)
+    {
+        out += '\t';
+        out += cleanField(field);
+    }
+    out += '\n';
+}
+
+// Splits a byte stream into lines. Bytes are appended as they arrive; complete lines come out in order.
+class LineReader
+{
+private:
+    string buffer;
+    size_t consumed = 0; // Bytes of `buffer` already returned as lines
+    size_t scanned = 0;  // Bytes already searched for a newline
+
+public:
+    void append(const char *data, size_t length)
+    {
+        if (consumed > 0 && consumed == buffer.size())
+        {
+            buffer.clear();
+            consumed = scanned = 0;
+        }
+        buffer.append(data, length);
+    }
+
+    // Next complete line without its "\n" (and "\r"), false if none is buffered yet
+    bool next(string &line)
+    {
+        size_t newline = buffer.find('\n', max(scanned, consumed));
+        if (newline == string::npos)
+        {
+            scanned = buffer.size();
+            if (consumed > buffer.size() / 2)
+            {
+                buffer.erase(0, consumed); // Keep the partial line at the front
+                scanned -= consumed;
+                consumed = 0;
+            }
+            return false;
+        }
+        size_t end = newline > consumed && buffer[newline - 1] == '\r' ? newline - 1 : newline;
+        line.assign(buffer, consumed, end - consumed);
+        consumed = scanned = newline + 1;
+        return true;
+    }
+
+    // Bytes of the line still being received
+    size_t partial() const
+    {
+        return buffer.size() - consumed;
+    }
+};
+
+#endif // SOCKET_PROTOCOL_H
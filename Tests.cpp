@@ -0,0 +1,1424 @@
+// Behaviour tests, grouped by the feature they check. Each test starts with an empty scratch directory and
+// prints PASS or FAIL with the checks that failed; the exit code is 1 if any failed.
+//
+// Build: make tests
+// Usage: ./tests [--filter=NAME]     (or `make test`)
+#include "ShardedPlatform.h"
+#include "SocialMediaPlatform.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <sys/resource.h>
+#include <thread>
+using namespace std;
+
+static size_t failedChecks = 0; // In the test now running
+
+static void check(bool condition, const char *expression, int line)
+{
+    if (!condition)
+    {
+        cerr << "    line " << line << ": " << expression << endl;
+        failedChecks++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+// A platform started the way main.cpp starts one: retention, snapshot, log replay, then the log attached
+class Platform
+{
+public:
+    WriteAheadLog wal; // Declared first so it outlives the managers that log to it
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    uint64_t snapshotLsn = 0;
+    bool snapshotLoaded = false;
+    uint64_t replayed = 0;
+
+    Platform(const string &directory, DurabilityMode durability = DurabilityMode::Sync)
+    {
+        RetentionPolicy retention;
+        retention.maxHotMessages = 8; // Small, so the histories below reach sealed segments
+        retention.segmentSize = 4;
+        retention.directory = directory + "/segments";
+        messagingSystem.setRetentionPolicy(retention, userManagement);
+        snapshotLoaded = loadSnapshot(directory + "/state.snap", userManagement, postManagement, friendSystem, messagingSystem, snapshotLsn);
+        string walPath = directory + "/state.wal";
+        WalReplayResult recovered = replayWriteAheadLog(walPath, snapshotLsn, userManagement, postManagement, friendSystem, messagingSystem);
+        recovered.lastLsn = max(recovered.lastLsn, snapshotLsn);
+        replayed = recovered.records;
+        if (wal.open(walPath, durability, recovered))
+        {
+            userManagement.attachWriteAheadLog(&wal);
+            postManagement.attachWriteAheadLog(&wal);
+            friendSystem.attachWriteAheadLog(&wal);
+            messagingSystem.attachWriteAheadLog(&wal);
+        }
+    }
+
+    string snapshot()
+    {
+        return captureSnapshot(userManagement, postManagement, friendSystem, messagingSystem, wal.lastLsn());
+    }
+};
+
+// Four users with profiles, posts, a comment thread, friendships, chats long enough to be partly sealed, and a group
+static void populate(Platform &platform)
+{
+    vector<User *> users;
+    for (string name : {"ada", "grace", "linus", "barbara"})
+    {
+        users.push_back(platform.userManagement.registerUser(name, "secret", name + "@college.edu", "studies " + name, name != "linus"));
+    }
+    platform.userManagement.updateProfileField(users[1], ProfileField::Bio, "compilers");
+    for (size_t i = 0; i < users.size(); i++)
+    {
+        platform.friendSystem.addFriend(users[i], users[(i + 1) % users.size()]);
+        platform.postManagement.createPost(users[i], "first post by " + users[i]->getUsername());
+    }
+    platform.postManagement.addComment(users[1], "first post by ada", "welcome");
+    vector<Comment *> comments = platform.postManagement.getComments("first post by ada");
+    if (!comments.empty())
+    {
+        platform.postManagement.addReplyToComment(users[0], "first post by ada", comments[0], "thanks");
+    }
+    for (size_t i = 0; i < 30; i++)
+    {
+        platform.messagingSystem.sendMessage(users[i % 2], users[1 - i % 2], "study group at " + to_string(i % 12) + " in the library");
+    }
+    platform.messagingSystem.sendMessage(users[2], users[3], "lab report due friday");
+    platform.messagingSystem.createGroup("algorithms");
+    for (User *user : users)
+    {
+        platform.messagingSystem.addUserToGroup("algorithms", user);
+    }
+    for (size_t i = 0; i < 20; i++)
+    {
+        platform.messagingSystem.sendMessageToGroup(users[i % users.size()], "algorithms", "problem set " + to_string(i));
+    }
+}
+
+static void describeHistory(ostringstream &out, const HistoryPage &page)
+{
+    for (const MessageNode *node : page.messages)
+    {
+        out << "  " << node->seq << " " << node->timestamp << " " << node->sender->getUsername() << ": " << node->message << "\n";
+    }
+}
+
+// Everything a user can see, as text, so two platforms can be compared
+static string describe(Platform &platform)
+{
+    const size_t ALL = 1 << 20;
+    ostringstream out;
+    vector<User *> users = platform.userManagement.getAllUsers();
+    sort(users.begin(), users.end(), [](User *a, User *b)
+         { return a->getUsername() < b->getUsername(); });
+    for (User *user : users)
+    {
+        out << "user " << user->getId() << " " << user->getUsername() << " " << user->getEmail() << " " << user->getBio() << " "
+            << user->isProfilePublic() << " " << user->validatePassword("secret") << "\n";
+        for (const string &post : platform.postManagement.getUserPosts(user))
+        {
+            out << " post " << post << "\n";
+            for (const string &line : platform.postManagement.getCommentThread(post))
+            {
+                out << "  " << line << "\n";
+            }
+        }
+        for (User *friendUser : platform.friendSystem.getFriends(user))
+        {
+            out << " friend " << friendUser->getUsername() << "\n";
+        }
+        for (User *partner : users)
+        {
+            if (partner->getUsername() > user->getUsername())
+            {
+                out << " chat with " << partner->getUsername() << "\n";
+                describeHistory(out, platform.messagingSystem.getChatHistoryPage(user, partner, HISTORY_LATEST, ALL));
+            }
+        }
+        for (const Group *group : platform.messagingSystem.getUserGroups(user))
+        {
+            out << " group " << platform.messagingSystem.getGroupName(group) << " unread " << platform.messagingSystem.getUnreadCount(group, user) << "\n";
+        }
+        UnreadSummary unread = platform.messagingSystem.getUnreadSummary(user);
+        out << " unread " << unread.messages << " in " << unread.chats << "\n";
+    }
+    for (const auto &entry : platform.messagingSystem.getGroups())
+    {
+        out << "group " << entry.first << "\n";
+        describeHistory(out, platform.messagingSystem.getGroupChatHistoryPage(entry.first, HISTORY_LATEST, ALL));
+    }
+    return out.str();
+}
+
+static uint64_t fileSize(const string &path)
+{
+    error_code error;
+    uint64_t size = filesystem::file_size(path, error);
+    return error ? 0 : size;
+}
+
+static void appendBytes(const string &path, const string &bytes)
+{
+    ofstream file(path, ios::binary | ios::app);
+    file << bytes;
+}
+
+static WalPayload note(const string &text)
+{
+    WalPayload payload;
+    payload.putU32(0).putString(text);
+    return payload;
+}
+
+static size_t countRecords(const string &path, WalReplayResult &result)
+{
+    size_t records = 0;
+    result = WriteAheadLog::replay(path, 0, [&records](uint64_t, WalRecordType, WalPayloadReader &)
+                                   { records++; });
+    return records;
+}
+
+static void testWalSurvivesRestart(const string &directory)
+{
+    string before;
+    {
+        Platform platform(directory);
+        CHECK(platform.wal.isOpen());
+        populate(platform);
+        CHECK(platform.wal.flush());
+        before = describe(platform);
+    }
+    string after;
+    {
+        Platform restarted(directory);
+        CHECK(restarted.replayed > 0);
+        CHECK(describe(restarted) == before);
+        User *ada = restarted.userManagement.findUserByUsername("ada");
+        restarted.postManagement.createPost(ada, "written after the restart");
+        CHECK(restarted.wal.flush());
+        after = describe(restarted);
+    }
+    Platform again(directory);
+    CHECK(describe(again) == after);
+}
+
+static void testWalCutsTornTail(const string &directory)
+{
+    string path = directory + "/torn.wal";
+    WriteAheadLog wal;
+    CHECK(wal.open(path, DurabilityMode::Sync, WalReplayResult()));
+    for (size_t i = 0; i < 5; i++)
+    {
+        CHECK(wal.append(WalRecordType::CreatePost, note("record " + to_string(i))) == i + 1);
+    }
+    wal.close();
+    uint64_t intact = fileSize(path);
+    // A crash part way through the sixth record: its header and half its body
+    string torn = WalPayload().putU64(6).data();
+    uint32_t header[2] = {64, 0};
+    appendBytes(path, string(reinterpret_cast<const char *>(header), sizeof(header)) + torn);
+    WalReplayResult recovered;
+    CHECK(countRecords(path, recovered) == 5);
+    CHECK(recovered.lastLsn == 5);
+    CHECK(recovered.validBytes == intact);
+    // Reopening cuts the tail, and the next record follows the last intact one
+    CHECK(wal.open(path, DurabilityMode::Sync, recovered));
+    CHECK(fileSize(path) == intact);
+    CHECK(wal.append(WalRecordType::CreatePost, note("after the crash")) == 6);
+    wal.close();
+    CHECK(countRecords(path, recovered) == 6);
+    CHECK(recovered.validBytes == fileSize(path));
+    // A flipped byte inside the last record fails its checksum, so that record is dropped too
+    {
+        fstream file(path, ios::binary | ios::in | ios::out);
+        file.seekp(-1, ios::end);
+        file.put('\x7f');
+    }
+    CHECK(countRecords(path, recovered) == 5);
+    CHECK(recovered.validBytes == intact);
+}
+
+static void testWalRejectsOversizedLength(const string &directory)
+{
+    string path = directory + "/oversized.wal";
+    WriteAheadLog wal;
+    CHECK(wal.open(path, DurabilityMode::Sync, WalReplayResult()));
+    CHECK(wal.append(WalRecordType::CreatePost, note("only record")) == 1);
+    wal.close();
+    uint64_t intact = fileSize(path);
+    // Lengths past the end of the file or past MAX_RECORD_BYTES end the replay instead of being allocated
+    for (uint32_t length : {uint32_t(0xFFFFFFF0u), WriteAheadLog::MAX_RECORD_BYTES + 1, uint32_t(4096)})
+    {
+        filesystem::resize_file(path, intact);
+        uint32_t header[2] = {length, 0};
+        appendBytes(path, string(reinterpret_cast<const char *>(header), sizeof(header)) + string(16, 'x'));
+        WalReplayResult recovered;
+        CHECK(countRecords(path, recovered) == 1);
+        CHECK(recovered.validBytes == intact);
+    }
+}
+
+static void testWalFailedWriteIsNotDurable(const string &directory)
+{
+    string path = directory + "/failing.wal";
+    WriteAheadLog wal;
+    CHECK(wal.open(path, DurabilityMode::Sync, WalReplayResult()));
+    for (size_t i = 0; i < 3; i++)
+    {
+        CHECK(wal.append(WalRecordType::CreatePost, note("fits")) != 0);
+    }
+    uint64_t good = fileSize(path);
+    // Cap the file size just past what is written, so the next record is cut short
+    signal(SIGXFSZ, SIG_IGN);
+    rlimit saved;
+    getrlimit(RLIMIT_FSIZE, &saved);
+    rlimit capped = saved;
+    capped.rlim_cur = good + 16;
+    setrlimit(RLIMIT_FSIZE, &capped);
+    uint64_t failuresBefore = walAppendFailures;
+    CHECK(wal.append(WalRecordType::CreatePost, note(string(256, 'x'))) == 0);
+    CHECK(walAppendFailures == failuresBefore + 1);
+    CHECK(!wal.healthy());
+    CHECK(fileSize(path) == good);
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, SIG_DFL);
+    // The failed record is retried once the disk takes writes again, ahead of the next one
+    uint64_t next = wal.append(WalRecordType::CreatePost, note("after"));
+    CHECK(next == 5);
+    CHECK(wal.flush() && wal.healthy());
+    wal.close();
+    WalReplayResult recovered;
+    CHECK(countRecords(path, recovered) == 5);
+    CHECK(recovered.validBytes == fileSize(path));
+}
+
+static bool roundTrips(const string &raw)
+{
+    string compressed = ColdStorage::compress(raw);
+    string restored = "left over";
+    return ColdStorage::decompress(compressed, raw.size(), restored) && restored == raw;
+}
+
+static void testCompressRoundTrips(const string &)
+{
+    CHECK(roundTrips(""));
+    CHECK(roundTrips("abc"));
+    CHECK(roundTrips("abcd"));
+    // Runs compress into matches that overlap the bytes they copy
+    CHECK(roundTrips(string(1000, 'a')));
+    CHECK(roundTrips("ab" + string(500, 'z') + "abababababababababab"));
+    string chat;
+    for (size_t i = 0; i < 500; i++)
+    {
+        chat += "ada: meet at the library at " + to_string(i % 24) + " for the exam review\n";
+    }
+    CHECK(roundTrips(chat));
+    CHECK(ColdStorage::compress(chat).size() < chat.size() / 4);
+    string noise;
+    uint32_t state = 12345;
+    for (size_t i = 0; i < 20000; i++)
+    {
+        state = state * 1103515245 + 12345;
+        noise += static_cast<char>(state >> 24);
+    }
+    CHECK(roundTrips(noise));
+    CHECK(roundTrips(noise + noise));
+}
+
+static void testDecompressRejectsCorruptInput(const string &)
+{
+    string raw;
+    for (size_t i = 0; i < 50; i++)
+    {
+        raw += "problem set " + to_string(i % 7) + " is due\n";
+    }
+    string compressed = ColdStorage::compress(raw);
+    string out;
+    CHECK(ColdStorage::decompress(compressed, raw.size(), out) && out == raw);
+    // The wrong expected size either way
+    CHECK(!ColdStorage::decompress(compressed, raw.size() - 1, out));
+    CHECK(!ColdStorage::decompress(compressed, raw.size() + 1, out));
+    // Cut anywhere before the last match ends. The stream closes with an empty literal run, a single zero byte
+    // that is the one thing a decoder can do without.
+    CHECK(compressed.back() == 0);
+    for (size_t length = 1; length + 1 < compressed.size(); length++)
+    {
+        CHECK(!ColdStorage::decompress(compressed.substr(0, length), raw.size(), out));
+    }
+    // A literal run longer than the input that follows
+    string literals;
+    ColdStorage::putVarint(literals, 100);
+    literals += "short";
+    CHECK(!ColdStorage::decompress(literals, 100, out));
+    // A match reaching back before the start of the output
+    string before;
+    ColdStorage::putVarint(before, 4);
+    before += "abcd";
+    ColdStorage::putVarint(before, 5);
+    ColdStorage::putVarint(before, 0);
+    CHECK(!ColdStorage::decompress(before, 8, out));
+    // A match of distance 0
+    string zero;
+    ColdStorage::putVarint(zero, 4);
+    zero += "abcd";
+    ColdStorage::putVarint(zero, 0);
+    ColdStorage::putVarint(zero, 0);
+    CHECK(!ColdStorage::decompress(zero, 8, out));
+    // A match that would write far past the expected size
+    string huge;
+    ColdStorage::putVarint(huge, 4);
+    huge += "abcd";
+    ColdStorage::putVarint(huge, 1);
+    ColdStorage::putVarint(huge, uint64_t(1) << 40);
+    CHECK(!ColdStorage::decompress(huge, 64, out));
+    CHECK(out.size() <= 64);
+    // The same match within the expected size is an overlapping copy
+    string overlap;
+    ColdStorage::putVarint(overlap, 4);
+    overlap += "abcd";
+    ColdStorage::putVarint(overlap, 1);
+    ColdStorage::putVarint(overlap, 56);
+    CHECK(ColdStorage::decompress(overlap, 64, out) && out == "abc" + string(61, 'd'));
+}
+
+static void testSnapshotRoundTrip(const string &directory)
+{
+    string before;
+    {
+        Platform platform(directory);
+        populate(platform);
+        before = describe(platform);
+        CHECK(writeSnapshotFile(directory + "/state.snap", platform.snapshot()));
+    }
+    // Nothing left in the log, so everything must come from the snapshot
+    filesystem::remove(directory + "/state.wal");
+    Platform loaded(directory);
+    CHECK(loaded.snapshotLoaded);
+    CHECK(loaded.replayed == 0);
+    CHECK(describe(loaded) == before);
+    // Changes after the snapshot come back from the log on top of it
+    User *grace = loaded.userManagement.findUserByUsername("grace");
+    User *ada = loaded.userManagement.findUserByUsername("ada");
+    loaded.messagingSystem.sendMessage(grace, ada, "sent after the snapshot");
+    loaded.postManagement.createPost(grace, "posted after the snapshot");
+    CHECK(loaded.wal.flush());
+    string after = describe(loaded);
+    CHECK(after != before);
+    loaded.wal.close();
+    Platform restarted(directory);
+    CHECK(restarted.snapshotLoaded);
+    CHECK(restarted.replayed == 2);
+    CHECK(describe(restarted) == after);
+}
+
+static void testDamagedSnapshotIsRejected(const string &directory)
+{
+    string image;
+    {
+        Platform platform(directory);
+        populate(platform);
+        image = platform.snapshot();
+    }
+    string path = directory + "/state.snap";
+    // Point the first chat's history past the messages section
+    SnapshotHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    bool damaged = false;
+    for (uint32_t i = 0; i < header.sectionCount; i++)
+    {
+        SnapshotSection section;
+        memcpy(&section, image.data() + sizeof(header) + i * sizeof(section), sizeof(section));
+        if (section.kind == static_cast<uint32_t>(SnapshotSectionKind::Chats) && section.count > 0)
+        {
+            SnapshotChat chat;
+            memcpy(&chat, image.data() + section.offset, sizeof(chat));
+            chat.history.firstMessage = UINT32_MAX / 2;
+            memcpy(&image[section.offset], &chat, sizeof(chat));
+            damaged = true;
+        }
+    }
+    CHECK(damaged);
+    CHECK(writeSnapshotFile(path, image));
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    uint64_t walLsn = 0;
+    CHECK(!loadSnapshot(path, userManagement, postManagement, friendSystem, messagingSystem, walLsn));
+    CHECK(userManagement.getAllUsers().empty());
+    // A truncated file is rejected as well
+    filesystem::resize_file(path, image.size() / 2);
+    CHECK(!loadSnapshot(path, userManagement, postManagement, friendSystem, messagingSystem, walLsn));
+    CHECK(userManagement.getAllUsers().empty());
+}
+
+static map<string, string> readSegmentFiles(const string &directory)
+{
+    map<string, string> files;
+    error_code error;
+    for (const auto &entry : filesystem::directory_iterator(directory + "/segments", error))
+    {
+        ifstream file(entry.path(), ios::binary);
+        files[entry.path().string()] = string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    }
+    return files;
+}
+
+static void testSegmentFilesOutliveShutdown(const string &directory)
+{
+    string before;
+    map<string, string> sealed;
+    {
+        Platform platform(directory);
+        populate(platform);
+        before = describe(platform);
+        sealed = readSegmentFiles(directory);
+        CHECK(!sealed.empty());
+        string image = platform.snapshot();
+        // The snapshot names the segment files instead of carrying a copy
+        for (const auto &file : sealed)
+        {
+            CHECK(image.find(file.second) == string::npos);
+        }
+        CHECK(writeSnapshotFile(directory + "/state.snap", image));
+    }
+    CHECK(readSegmentFiles(directory) == sealed);
+    filesystem::remove(directory + "/state.wal");
+    {
+        Platform loaded(directory);
+        CHECK(loaded.snapshotLoaded);
+        CHECK(describe(loaded) == before);
+    }
+    // Without one of its segment files the snapshot cannot be used
+    filesystem::remove(sealed.begin()->first);
+    Platform damaged(directory);
+    CHECK(!damaged.snapshotLoaded);
+}
+
+// Sequence numbers rise and timestamps never fall along the page, and every message is there
+static bool inOrder(const HistoryPage &page)
+{
+    for (size_t i = 1; i < page.messages.size(); i++)
+    {
+        if (page.messages[i]->seq <= page.messages[i - 1]->seq || page.messages[i]->timestamp < page.messages[i - 1]->timestamp)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Senders posting to one recipient from several threads while the recipient posts back to one of them
+static void postFromThreads(MessagingSystem &messagingSystem, User *recipient, const vector<User *> &senders, size_t perSender)
+{
+    vector<thread> threads;
+    for (User *sender : senders)
+    {
+        threads.emplace_back([&messagingSystem, recipient, sender, perSender]()
+                             {
+            for (size_t i = 0; i < perSender; i++)
+            {
+                messagingSystem.postMessage(sender, recipient, "post " + to_string(i));
+            } });
+    }
+    threads.emplace_back([&messagingSystem, recipient, &senders, perSender]()
+                         {
+        for (size_t i = 0; i < perSender; i++)
+        {
+            messagingSystem.postMessage(recipient, senders[0], "reply " + to_string(i));
+        } });
+    for (thread &sender : threads)
+    {
+        sender.join();
+    }
+}
+
+static void testPostedMessagesAreDelivered(const string &)
+{
+    const size_t PER_SENDER = 300;
+    UserManagement userManagement;
+    MessagingSystem messagingSystem;
+    User *recipient = userManagement.registerUser("recipient", "secret", "recipient@college.edu", "", true);
+    vector<User *> senders;
+    for (size_t i = 0; i < 6; i++)
+    {
+        senders.push_back(userManagement.registerUser("sender" + to_string(i), "secret", "sender@college.edu", "", true));
+    }
+    postFromThreads(messagingSystem, recipient, senders, PER_SENDER);
+    // The badge counts everything acknowledged, including what another thread had not delivered yet
+    UnreadSummary unread = messagingSystem.getUnreadSummary(recipient);
+    CHECK(unread.messages == senders.size() * PER_SENDER);
+    CHECK(unread.chats == senders.size());
+    CHECK(messagingSystem.getUnreadSummary(senders[0]).messages == PER_SENDER);
+    for (User *sender : senders)
+    {
+        HistoryPage page = messagingSystem.getChatHistoryPage(sender, recipient, HISTORY_LATEST, 1 << 20);
+        CHECK(page.messages.size() == (sender == senders[0] ? 2 : 1) * PER_SENDER);
+        CHECK(inOrder(page));
+        // Each side's messages keep the order they were posted in
+        size_t posts = 0, replies = 0;
+        for (const MessageNode *node : page.messages)
+        {
+            size_t &next = node->sender == recipient ? replies : posts;
+            CHECK(node->message == (node->sender == recipient ? "reply " : "post ") + to_string(next));
+            next++;
+        }
+    }
+    vector<InboxMessage> inbox = messagingSystem.fetchNewMessages(recipient, 1 << 20);
+    CHECK(inbox.size() == senders.size() * PER_SENDER);
+    CHECK(messagingSystem.getUnreadSummary(recipient).messages == 0);
+}
+
+static void testPostedMessagesSurviveRestart(const string &directory)
+{
+    const size_t PER_SENDER = 40;
+    vector<string> names = {"ada", "grace", "linus"};
+    {
+        Platform platform(directory, DurabilityMode::Batched);
+        User *recipient = platform.userManagement.registerUser("recipient", "secret", "recipient@college.edu", "", true);
+        vector<User *> senders;
+        for (const string &name : names)
+        {
+            senders.push_back(platform.userManagement.registerUser(name, "secret", name + "@college.edu", "", true));
+        }
+        postFromThreads(platform.messagingSystem, recipient, senders, PER_SENDER);
+        // Logged before they were queued, so a crash now loses none of them
+        CHECK(platform.wal.flush());
+    }
+    Platform restarted(directory);
+    User *recipient = restarted.userManagement.findUserByUsername("recipient");
+    CHECK(recipient != nullptr);
+    if (!recipient)
+    {
+        return;
+    }
+    CHECK(restarted.messagingSystem.getUnreadSummary(recipient).messages == names.size() * PER_SENDER);
+    for (const string &name : names)
+    {
+        User *sender = restarted.userManagement.findUserByUsername(name);
+        HistoryPage page = restarted.messagingSystem.getChatHistoryPage(sender, recipient, HISTORY_LATEST, 1 << 20);
+        CHECK(page.messages.size() == (name == names[0] ? 2 : 1) * PER_SENDER);
+        CHECK(inOrder(page));
+    }
+}
+
+static void testDirectUnreadCounters(const string &directory)
+{
+    {
+        Platform platform(directory);
+        MessagingSystem &messagingSystem = platform.messagingSystem;
+        User *ada = platform.userManagement.registerUser("ada", "secret", "ada@college.edu", "", true);
+        User *grace = platform.userManagement.registerUser("grace", "secret", "grace@college.edu", "", true);
+        User *linus = platform.userManagement.registerUser("linus", "secret", "linus@college.edu", "", true);
+        UnreadSummary unread = messagingSystem.getUnreadSummary(ada);
+        CHECK(unread.messages == 0 && unread.chats == 0);
+        for (size_t i = 0; i < 3; i++)
+        {
+            messagingSystem.sendMessage(grace, ada, "from grace " + to_string(i));
+        }
+        messagingSystem.sendMessage(linus, ada, "from linus 0");
+        messagingSystem.sendMessage(linus, ada, "from linus 1");
+        unread = messagingSystem.getUnreadSummary(ada);
+        CHECK(unread.messages == 5 && unread.chats == 2);
+        // Replying, reading history and sending to oneself leave the count alone
+        messagingSystem.sendMessage(ada, grace, "hello");
+        messagingSystem.sendMessage(ada, ada, "note to self");
+        messagingSystem.getChatHistoryPage(ada, grace, HISTORY_LATEST);
+        unread = messagingSystem.getUnreadSummary(ada);
+        CHECK(unread.messages == 5 && unread.chats == 2);
+        unread = messagingSystem.getUnreadSummary(grace);
+        CHECK(unread.messages == 1 && unread.chats == 1);
+        // Fetching marks only the returned messages read, oldest first
+        CHECK(messagingSystem.fetchNewMessages(ada, 2).size() == 2);
+        unread = messagingSystem.getUnreadSummary(ada);
+        CHECK(unread.messages == 3 && unread.chats == 2);
+        CHECK(messagingSystem.fetchNewMessages(ada, 1).size() == 1);
+        unread = messagingSystem.getUnreadSummary(ada);
+        CHECK(unread.messages == 2 && unread.chats == 1);
+        CHECK(messagingSystem.fetchNewMessages(ada, 0).empty());
+        CHECK(messagingSystem.getUnreadSummary(ada).messages == 2);
+        CHECK(writeSnapshotFile(directory + "/state.snap", platform.snapshot()));
+        messagingSystem.sendMessage(grace, ada, "after the snapshot");
+    }
+    // Counters are rebuilt from the snapshot's read state, then the log
+    Platform restarted(directory);
+    User *ada = restarted.userManagement.findUserByUsername("ada");
+    UnreadSummary unread = restarted.messagingSystem.getUnreadSummary(ada);
+    CHECK(unread.messages == 3 && unread.chats == 2);
+    vector<InboxMessage> rest = restarted.messagingSystem.fetchNewMessages(ada, 100);
+    CHECK(rest.size() == 3);
+    CHECK(!rest.empty() && rest.back().node->message == "after the snapshot");
+    unread = restarted.messagingSystem.getUnreadSummary(ada);
+    CHECK(unread.messages == 0 && unread.chats == 0);
+}
+
+// The group badge counted the slow way, from each group's read cursor
+static UnreadSummary recountGroupUnread(MessagingSystem &messagingSystem, User *user)
+{
+    UnreadSummary summary;
+    for (const Group *group : messagingSystem.getUserGroups(user))
+    {
+        size_t unread = messagingSystem.getUnreadCount(group, user);
+        summary.messages += unread;
+        summary.chats += unread > 0;
+    }
+    return summary;
+}
+
+static bool countersMatch(MessagingSystem &messagingSystem, User *user)
+{
+    UnreadSummary counted = messagingSystem.getGroupUnreadSummary(user);
+    UnreadSummary recounted = recountGroupUnread(messagingSystem, user);
+    return counted.messages == recounted.messages && counted.chats == recounted.chats;
+}
+
+static void testGroupUnreadCounters(const string &directory)
+{
+    {
+        Platform platform(directory);
+        MessagingSystem &messagingSystem = platform.messagingSystem;
+        vector<User *> users;
+        for (string name : {"ada", "grace", "linus", "barbara"})
+        {
+            users.push_back(platform.userManagement.registerUser(name, "secret", name + "@college.edu", "", true));
+        }
+        User *ada = users[0], *grace = users[1], *linus = users[2], *barbara = users[3];
+        string algorithms = messagingSystem.createGroup("algorithms")->groupId;
+        messagingSystem.createGroup("systems");
+        for (User *user : {ada, grace, linus})
+        {
+            messagingSystem.addUserToGroup("algorithms", user);
+            messagingSystem.addUserToGroup("systems", user);
+        }
+        for (size_t i = 0; i < 3; i++)
+        {
+            messagingSystem.sendMessageToGroup(ada, "algorithms", "problem " + to_string(i));
+        }
+        messagingSystem.sendMessageToGroup(grace, "systems", "lab tonight");
+        messagingSystem.sendMessage(grace, linus, "coming?");
+        UnreadSummary unread = messagingSystem.getUnreadSummary(linus);
+        CHECK(unread.messages == 5 && unread.chats == 3);
+        unread = messagingSystem.getGroupUnreadSummary(linus);
+        CHECK(unread.messages == 4 && unread.chats == 2);
+        CHECK(messagingSystem.getGroupUnreadSummary(ada).messages == 1);
+        // Sending while behind leaves the sender's own unread count alone
+        messagingSystem.sendMessageToGroup(linus, "algorithms", "on it");
+        CHECK(messagingSystem.getGroupUnreadSummary(linus).messages == 4);
+        CHECK(messagingSystem.getGroupUnreadSummary(grace).messages == 4);
+        // A partial fetch marks only what it returned as read
+        CHECK(messagingSystem.fetchNewMessages(linus, 2).size() == 2);
+        unread = messagingSystem.getGroupUnreadSummary(linus);
+        CHECK(unread.messages == 2 && unread.chats == 2);
+        CHECK(messagingSystem.fetchNewMessages(linus, 1).size() == 1);
+        unread = messagingSystem.getUnreadSummary(linus);
+        CHECK(unread.messages == 2 && unread.chats == 2);
+        // Leaving drops the group's unread messages; joining starts with none
+        CHECK(messagingSystem.getGroupUnreadSummary(grace).chats == 1);
+        messagingSystem.removeUserFromGroup(algorithms, grace);
+        unread = messagingSystem.getGroupUnreadSummary(grace);
+        CHECK(unread.messages == 0 && unread.chats == 0);
+        messagingSystem.addUserToGroup("algorithms", barbara);
+        CHECK(messagingSystem.getGroupUnreadSummary(barbara).messages == 0);
+        messagingSystem.sendMessageToGroup(ada, "algorithms", "problem 3");
+        unread = messagingSystem.getGroupUnreadSummary(barbara);
+        CHECK(unread.messages == 1 && unread.chats == 1);
+        for (User *user : users)
+        {
+            CHECK(countersMatch(messagingSystem, user));
+        }
+        // Half the state from a snapshot, half from the log
+        CHECK(writeSnapshotFile(directory + "/state.snap", platform.snapshot()));
+        messagingSystem.sendMessageToGroup(barbara, "systems", "wrong group");
+        messagingSystem.sendMessageToGroup(grace, "systems", "see you there");
+        messagingSystem.sendMessageToGroup(ada, "algorithms", "problem 4");
+    }
+    Platform restarted(directory);
+    CHECK(restarted.snapshotLoaded);
+    for (User *user : restarted.userManagement.getAllUsers())
+    {
+        CHECK(countersMatch(restarted.messagingSystem, user));
+    }
+    User *linus = restarted.userManagement.findUserByUsername("linus");
+    UnreadSummary unread = restarted.messagingSystem.getUnreadSummary(linus);
+    CHECK(unread.messages == 5 && unread.chats == 3);
+    restarted.messagingSystem.fetchNewMessages(linus, 1 << 20);
+    unread = restarted.messagingSystem.getUnreadSummary(linus);
+    CHECK(unread.messages == 0 && unread.chats == 0);
+}
+
+// Everything the sharded platform answers about `names`, as text, so two runs can be compared
+static string describeShards(ShardedPlatform &platform, const vector<string> &names, const string &groupName)
+{
+    ostringstream out;
+    for (const string &name : names)
+    {
+        out << "user " << name << "\n";
+        for (const string &friendName : platform.getFriends(name).get())
+        {
+            out << " friend " << friendName << "\n";
+        }
+        for (const string &partner : names)
+        {
+            for (const string &line : platform.getChatHistory(name, partner).get())
+            {
+                out << " chat with " << partner << " " << line << "\n";
+            }
+        }
+        for (const string &group : platform.getUserGroups(name).get())
+        {
+            out << " group " << group << "\n";
+        }
+        UnreadSummary unread = platform.getUnreadSummary(name).get();
+        out << " unread " << unread.messages << " in " << unread.chats << "\n";
+    }
+    for (const string &line : platform.getGroupHistory(groupName).get())
+    {
+        out << "group " << groupName << " " << line << "\n";
+    }
+    return out.str();
+}
+
+static void testShardsSpanOperations(const string &directory)
+{
+    ShardOptions options;
+    options.shards = 4;
+    options.walPrefix = directory + "/shard";
+    string before, ada, grace, linus, group;
+    {
+        ShardedPlatform platform(options);
+        // Three users and a group, each homed on a different shard
+        auto homedOn = [&platform](size_t shard, const string &base)
+        {
+            for (size_t i = 0;; i++)
+            {
+                if (platform.shardOf(base + to_string(i)) == shard)
+                {
+                    return base + to_string(i);
+                }
+            }
+        };
+        ada = homedOn(0, "ada");
+        grace = homedOn(1, "grace");
+        linus = homedOn(2, "linus");
+        group = homedOn(3, "study");
+        for (const string &name : {ada, grace, linus})
+        {
+            CHECK(platform.registerUser(name, "secret", name + "@college.edu", "", true).get());
+        }
+        CHECK(!platform.registerUser(ada, "other", "ada@college.edu", "", true).get());
+        CHECK(platform.logIn(grace, "secret").get());
+        CHECK(platform.addFriend(ada, grace).get());
+        CHECK(!platform.addFriend(grace, ada).get());
+        CHECK(platform.getFriends(grace).get() == vector<string>{ada});
+        // Grace's shard now knows ada as a stand-in; linus's shard has never heard of her
+        CHECK(platform.call(1, [ada](Shard &shard)
+                            { return shard.find(ada) != nullptr && !shard.isHome(ada); })
+                  .get());
+        CHECK(platform.call(2, [ada](Shard &shard)
+                            { return shard.find(ada) == nullptr; })
+                  .get());
+        CHECK(platform.sendMessage(ada, grace, "lunch?").get());
+        CHECK(platform.sendMessage(ada, grace, "at noon").get());
+        CHECK(platform.sendMessage(grace, ada, "sure").get());
+        CHECK(!platform.sendMessage(ada, "nobody", "hello?").get());
+        CHECK(platform.getChatHistory(ada, grace).get() == platform.getChatHistory(grace, ada).get());
+        CHECK(platform.getChatHistory(grace, ada).get().size() == 3);
+        CHECK(platform.createGroup(group, ada).get());
+        CHECK(platform.joinGroup(group, grace).get());
+        CHECK(platform.joinGroup(group, linus).get());
+        CHECK(!platform.joinGroup("no such group", linus).get());
+        CHECK(platform.sendMessageToGroup(linus, group, "problem set 1").get());
+        CHECK(platform.sendMessageToGroup(linus, group, "problem set 2").get());
+        CHECK(platform.getGroupHistory(group).get().size() == 2);
+        CHECK(platform.getUserGroups(grace).get() == vector<string>{group});
+        // Group unread counts come from the group's shard, direct ones from the user's own
+        UnreadSummary unread = platform.getUnreadSummary(grace).get();
+        CHECK(unread.messages == 4 && unread.chats == 2);
+        unread = platform.getUnreadSummary(ada).get();
+        CHECK(unread.messages == 3 && unread.chats == 2);
+        unread = platform.getUnreadSummary(linus).get();
+        CHECK(unread.messages == 0 && unread.chats == 0);
+        before = describeShards(platform, {ada, grace, linus}, group);
+    }
+    // Each shard replays its own log
+    ShardedPlatform restarted(options);
+    CHECK(restarted.restoredRecords() > 0);
+    CHECK(describeShards(restarted, {ada, grace, linus}, group) == before);
+    CHECK(restarted.call(1, [ada](Shard &shard)
+                         { return shard.find(ada) != nullptr && !shard.isHome(ada); })
+              .get());
+    CHECK(restarted.logIn(grace, "secret").get());
+}
+
+// Pages from the newest back to the first message, checking each page's size, cursor and hasMore flag
+static vector<const MessageNode *> scrollBack(const function<HistoryPage(size_t)> &pageAt, size_t total, size_t limit, vector<HistoryPage> &pages)
+{
+    vector<const MessageNode *> all;
+    size_t cursor = HISTORY_LATEST;
+    size_t end = total;
+    do
+    {
+        pages.push_back(pageAt(cursor));
+        const HistoryPage &page = pages.back();
+        size_t expected = min(limit, end);
+        CHECK(page.messages.size() == expected);
+        CHECK(page.cursor == end - expected);
+        CHECK(page.hasMore == (page.cursor > 0));
+        CHECK(inOrder(page));
+        all.insert(all.begin(), page.messages.begin(), page.messages.end());
+        cursor = end = page.cursor;
+    } while (pages.back().hasMore && pages.size() <= total);
+    return all;
+}
+
+static void testHistoryPagesScrollBack(const string &directory)
+{
+    const size_t MESSAGES = 25, LIMIT = 10;
+    Platform platform(directory);
+    MessagingSystem &messagingSystem = platform.messagingSystem;
+    User *ada = platform.userManagement.registerUser("ada", "secret", "ada@college.edu", "", true);
+    User *grace = platform.userManagement.registerUser("grace", "secret", "grace@college.edu", "", true);
+    messagingSystem.createGroup("algorithms");
+    messagingSystem.addUserToGroup("algorithms", ada);
+    messagingSystem.addUserToGroup("algorithms", grace);
+    for (size_t i = 0; i < MESSAGES; i++)
+    {
+        messagingSystem.sendMessage(i % 2 ? ada : grace, i % 2 ? grace : ada, "message " + to_string(i));
+        messagingSystem.sendMessageToGroup(i % 3 ? ada : grace, "algorithms", "problem " + to_string(i));
+    }
+    // The retention policy has sealed most of both histories, so the older pages come from segment files
+    vector<HistoryPage> chatPages, groupPages;
+    vector<const MessageNode *> chat = scrollBack([&](size_t cursor)
+                                                  { return messagingSystem.getChatHistoryPage(grace, ada, cursor, LIMIT); },
+                                                  MESSAGES, LIMIT, chatPages);
+    vector<const MessageNode *> group = scrollBack([&](size_t cursor)
+                                                   { return messagingSystem.getGroupChatHistoryPage("algorithms", cursor, LIMIT); },
+                                                   MESSAGES, LIMIT, groupPages);
+    CHECK(chatPages.size() == 3 && groupPages.size() == 3);
+    CHECK(chat.size() == MESSAGES && group.size() == MESSAGES);
+    for (size_t i = 0; i < chat.size() && i < group.size(); i++)
+    {
+        CHECK(chat[i]->message == "message " + to_string(i));
+        CHECK(group[i]->message == "problem " + to_string(i));
+    }
+    CHECK(messagingSystem.getChatHistoryPage(ada, grace, 0, LIMIT).messages.empty());
+    CHECK(messagingSystem.getGroupChatHistoryPage("no such group", HISTORY_LATEST, LIMIT).messages.empty());
+}
+
+static void testSeekFindsFirstMessageAtTime(const string &directory)
+{
+    const size_t MESSAGES = 30;
+    Platform platform(directory);
+    MessagingSystem &messagingSystem = platform.messagingSystem;
+    User *ada = platform.userManagement.registerUser("ada", "secret", "ada@college.edu", "", true);
+    User *grace = platform.userManagement.registerUser("grace", "secret", "grace@college.edu", "", true);
+    messagingSystem.createGroup("algorithms");
+    messagingSystem.addUserToGroup("algorithms", ada);
+    for (size_t i = 0; i < MESSAGES; i++)
+    {
+        messagingSystem.sendMessage(ada, grace, "message " + to_string(i));
+        messagingSystem.sendMessageToGroup(ada, "algorithms", "problem " + to_string(i));
+        if (i % 4 == 3)
+        {
+            this_thread::sleep_for(chrono::milliseconds(3)); // Several messages per millisecond, then a gap
+        }
+    }
+    CHECK(messagingSystem.seekChatHistory(ada, grace, 0) == 0);
+    CHECK(messagingSystem.seekChatHistory(ada, ada, 0) == 0);
+    CHECK(messagingSystem.seekGroupChatHistory("no such group", 0) == 0);
+    for (bool inGroup : {false, true})
+    {
+        HistoryPage all = inGroup ? messagingSystem.getGroupChatHistoryPage("algorithms", HISTORY_LATEST, MESSAGES)
+                                  : messagingSystem.getChatHistoryPage(ada, grace, HISTORY_LATEST, MESSAGES);
+        CHECK(all.messages.size() == MESSAGES);
+        if (all.messages.size() != MESSAGES)
+        {
+            continue;
+        }
+        auto seek = [&](int64_t timestamp)
+        {
+            return inGroup ? messagingSystem.seekGroupChatHistory("algorithms", timestamp) : messagingSystem.seekChatHistory(grace, ada, timestamp);
+        };
+        for (size_t i = 0; i < MESSAGES; i++)
+        {
+            for (int64_t timestamp : {all.messages[i]->timestamp, all.messages[i]->timestamp + 1})
+            {
+                size_t expected = 0;
+                while (expected < MESSAGES && all.messages[expected]->timestamp < timestamp)
+                {
+                    expected++;
+                }
+                CHECK(seek(timestamp) == expected);
+            }
+        }
+        CHECK(seek(all.messages.back()->timestamp + 1) == MESSAGES);
+        // A page starting at the seek position opens the history at that time
+        size_t position = seek(all.messages[MESSAGES / 2]->timestamp);
+        HistoryPage page = inGroup ? messagingSystem.getGroupChatHistoryPage("algorithms", position + 5, 5)
+                                   : messagingSystem.getChatHistoryPage(ada, grace, position + 5, 5);
+        CHECK(!page.messages.empty() && page.messages.front()->seq == all.messages[position]->seq);
+    }
+}
+
+static vector<string> fetchTexts(MessagingSystem &messagingSystem, User *user, size_t limit, bool *ordered = nullptr)
+{
+    vector<string> texts;
+    uint64_t last = 0;
+    for (const InboxMessage &entry : messagingSystem.fetchNewMessages(user, limit))
+    {
+        if (ordered && entry.node->seq <= last)
+        {
+            *ordered = false;
+        }
+        last = entry.node->seq;
+        texts.push_back((entry.group ? "group " : "direct ") + entry.node->message);
+    }
+    return texts;
+}
+
+static void testGroupReadCursors(const string &directory)
+{
+    {
+        Platform platform(directory);
+        MessagingSystem &messagingSystem = platform.messagingSystem;
+        vector<User *> users;
+        for (string name : {"ada", "grace", "linus", "barbara"})
+        {
+            users.push_back(platform.userManagement.registerUser(name, "secret", name + "@college.edu", "", true));
+        }
+        User *ada = users[0], *grace = users[1], *linus = users[2], *barbara = users[3];
+        string club = messagingSystem.createGroup("club")->groupId;
+        for (User *user : {ada, grace, linus})
+        {
+            messagingSystem.addUserToGroup("club", user);
+        }
+        messagingSystem.sendMessageToGroup(ada, "club", "g0");
+        messagingSystem.sendMessage(grace, linus, "d0");
+        messagingSystem.sendMessageToGroup(ada, "club", "g1");
+        messagingSystem.sendMessage(barbara, linus, "d1");
+        messagingSystem.sendMessageToGroup(grace, "club", "g2");
+        // Stored once in the group log, whatever the number of members
+        CHECK(messagingSystem.getGroupChatHistoryPage("club", HISTORY_LATEST, 100).messages.size() == 3);
+        CHECK(messagingSystem.getChatHistoryPage(grace, linus, HISTORY_LATEST, 100).messages.size() == 1);
+        // The direct inbox and the group's unread tail merge in send order
+        bool ordered = true;
+        CHECK(fetchTexts(messagingSystem, linus, 100, &ordered) == vector<string>({"group g0", "direct d0", "group g1", "direct d1", "group g2"}));
+        CHECK(ordered);
+        CHECK(fetchTexts(messagingSystem, linus, 100).empty());
+        // Senders never get their own messages back
+        CHECK(fetchTexts(messagingSystem, ada, 100) == vector<string>({"group g2"}));
+        // A member who joins late starts at the end of the log
+        messagingSystem.addUserToGroup("club", barbara);
+        CHECK(fetchTexts(messagingSystem, barbara, 100).empty());
+        messagingSystem.sendMessageToGroup(ada, "club", "g3");
+        CHECK(fetchTexts(messagingSystem, barbara, 100) == vector<string>({"group g3"}));
+        // A partial fetch moves the cursor only past what it returned
+        CHECK(fetchTexts(messagingSystem, grace, 1) == vector<string>({"group g0"}));
+        CHECK(fetchTexts(messagingSystem, grace, 100) == vector<string>({"group g1", "group g3"}));
+        // A member who left no longer receives the group
+        messagingSystem.removeUserFromGroup(club, linus);
+        messagingSystem.sendMessageToGroup(ada, "club", "g4");
+        CHECK(fetchTexts(messagingSystem, linus, 100).empty());
+        messagingSystem.sendMessageToGroup(ada, "club", "g5");
+        CHECK(fetchTexts(messagingSystem, grace, 1) == vector<string>({"group g4"}));
+        CHECK(writeSnapshotFile(directory + "/state.snap", platform.snapshot()));
+        messagingSystem.sendMessageToGroup(barbara, "club", "g6");
+    }
+    // Cursors come back from the snapshot, and the log adds what was sent after it
+    Platform restarted(directory);
+    CHECK(restarted.snapshotLoaded);
+    User *grace = restarted.userManagement.findUserByUsername("grace");
+    User *barbara = restarted.userManagement.findUserByUsername("barbara");
+    CHECK(fetchTexts(restarted.messagingSystem, grace, 100) == vector<string>({"group g5", "group g6"}));
+    CHECK(fetchTexts(restarted.messagingSystem, barbara, 100) == vector<string>({"group g4", "group g5"}));
+}
+
+static bool sameMembers(const MemberSet &members, const set<uint32_t> &expected)
+{
+    vector<uint32_t> visited;
+    members.forEach([&visited](uint32_t id)
+                    { visited.push_back(id); });
+    return members.size() == expected.size() && visited == vector<uint32_t>(expected.begin(), expected.end());
+}
+
+static bool sameIntersection(const MemberSet &a, const set<uint32_t> &expectedA, const MemberSet &b, const set<uint32_t> &expectedB)
+{
+    vector<uint32_t> expected;
+    set_intersection(expectedA.begin(), expectedA.end(), expectedB.begin(), expectedB.end(), back_inserter(expected));
+    return a.intersect(b) == expected && b.intersect(a) == expected;
+}
+
+static void testMemberSetConversions(const string &)
+{
+    MemberSet members;
+    set<uint32_t> expected;
+    auto insert = [&](uint32_t id)
+    {
+        CHECK(members.insert(id) == expected.insert(id).second);
+    };
+    auto erase = [&](uint32_t id)
+    {
+        CHECK(members.erase(id) == (expected.erase(id) == 1));
+    };
+    // Small: one sorted vector
+    for (uint32_t id = 0; id < 600; id += 3)
+    {
+        insert(id);
+    }
+    insert(3);
+    CHECK(sameMembers(members, expected));
+    // Past the small limit into chunks: one dense enough to become a bitmap, one sparse far above it
+    for (uint32_t id = 0; id < 10000; id++)
+    {
+        insert(id);
+    }
+    for (uint32_t id = 0; id < 100; id++)
+    {
+        insert((5u << 16) + id * 7);
+    }
+    CHECK(sameMembers(members, expected));
+    for (uint32_t id : {9999u, 10000u, (5u << 16) + 7, (5u << 16) + 8, 70000u, UINT32_MAX})
+    {
+        CHECK(members.contains(id) == (expected.count(id) == 1));
+    }
+    // Thin the bitmap chunk out until it turns back into an array, then the whole set back into a vector
+    for (uint32_t id = 0; id < 10000; id++)
+    {
+        if (id % 5)
+        {
+            erase(id);
+        }
+    }
+    erase(123456);
+    CHECK(sameMembers(members, expected));
+    while (expected.size() > 50)
+    {
+        erase(*expected.rbegin());
+    }
+    CHECK(sameMembers(members, expected));
+    insert(1u << 20);
+    CHECK(sameMembers(members, expected) && members.contains(1u << 20));
+    // Intersections across every pairing of layouts
+    MemberSet dense, thirds, sparse, small;
+    set<uint32_t> denseIds, thirdIds, sparseIds, smallIds;
+    for (uint32_t id = 0; id < 10000; id++)
+    {
+        dense.insert(id);
+        denseIds.insert(id);
+    }
+    for (uint32_t id = 0; id < 30000; id += 3)
+    {
+        thirds.insert(id);
+        thirdIds.insert(id);
+    }
+    for (uint32_t id = 0; id < 400; id++)
+    {
+        uint32_t spread = id * 977 + (id % 3) * 65536;
+        sparse.insert(spread);
+        sparseIds.insert(spread);
+    }
+    for (uint32_t id = 0; id < 40; id++)
+    {
+        small.insert(id * 250);
+        smallIds.insert(id * 250);
+    }
+    CHECK(sameIntersection(dense, denseIds, thirds, thirdIds));
+    CHECK(sameIntersection(dense, denseIds, sparse, sparseIds));
+    CHECK(sameIntersection(thirds, thirdIds, sparse, sparseIds));
+    CHECK(sameIntersection(dense, denseIds, small, smallIds));
+    CHECK(sameIntersection(sparse, sparseIds, small, smallIds));
+    CHECK(sameIntersection(small, smallIds, MemberSet(), set<uint32_t>()));
+}
+
+// Every hit for the query, page by page; checks that hits run newest first without repeats
+static vector<string> searchAll(const function<SearchPage(uint64_t)> &search)
+{
+    vector<string> texts;
+    uint64_t cursor = SEARCH_LATEST, previous = UINT64_MAX;
+    for (size_t pages = 0; pages < 100; pages++)
+    {
+        SearchPage page = search(cursor);
+        for (const SearchHit &hit : page.hits)
+        {
+            CHECK(hit.node->seq < previous);
+            previous = hit.node->seq;
+            texts.push_back(hit.node->message);
+        }
+        if (!page.hasMore)
+        {
+            break;
+        }
+        CHECK(!page.hits.empty() && page.cursor == page.hits.back().node->seq);
+        cursor = page.cursor;
+    }
+    return texts;
+}
+
+static void testSearchFindsMatchesNewestFirst(const string &directory)
+{
+    const size_t LIMIT = 4;
+    {
+        Platform platform(directory);
+        MessagingSystem &messagingSystem = platform.messagingSystem;
+        User *ada = platform.userManagement.registerUser("ada", "secret", "ada@college.edu", "", true);
+        User *grace = platform.userManagement.registerUser("grace", "secret", "grace@college.edu", "", true);
+        User *linus = platform.userManagement.registerUser("linus", "secret", "linus@college.edu", "", true);
+        messagingSystem.createGroup("club");
+        messagingSystem.addUserToGroup("club", ada);
+        messagingSystem.addUserToGroup("club", grace);
+        for (size_t i = 0; i < 20; i++)
+        {
+            messagingSystem.sendMessage(i % 3 ? ada : grace, i % 3 ? grace : ada, i % 2 ? "lunch at " + to_string(i) : "study group " + to_string(i) + " in the Library");
+        }
+        for (size_t i = 0; i < 3; i++)
+        {
+            messagingSystem.sendMessage(linus, ada, "LIBRARY hours, day " + to_string(i));
+            messagingSystem.sendMessageToGroup(grace, "club", "library meetup " + to_string(i));
+            messagingSystem.sendMessageToGroup(ada, "club", "something else");
+        }
+        // Most of these are sealed into segments by now; search reads its postings, not the messages
+        vector<string> hits = searchAll([&](uint64_t cursor)
+                                        { return messagingSystem.searchMessages(ada, "library", cursor, LIMIT); });
+        CHECK(hits.size() == 16);
+        CHECK(!hits.empty() && hits.front() == "library meetup 2");
+        CHECK(searchAll([&](uint64_t cursor)
+                        { return messagingSystem.searchMessages(ada, "Library!", cursor, LIMIT); }) == hits);
+        // Every word of the query must appear
+        CHECK(searchAll([&](uint64_t cursor)
+                        { return messagingSystem.searchMessages(ada, "library study", cursor, LIMIT); })
+                  .size() == 10);
+        CHECK(messagingSystem.searchMessages(ada, "library zebra").hits.empty());
+        // Narrower scopes, and only what the user can see
+        SearchPage chat = messagingSystem.searchChat(ada, linus, "library", SEARCH_LATEST, 10);
+        CHECK(chat.hits.size() == 3 && !chat.hasMore);
+        CHECK(!chat.hits.empty() && chat.hits[0].partner == linus && chat.hits[0].group == nullptr);
+        SearchPage group = messagingSystem.searchGroup("club", ada, "library", SEARCH_LATEST, 10);
+        CHECK(group.hits.size() == 3);
+        CHECK(!group.hits.empty() && group.hits[0].group != nullptr);
+        CHECK(messagingSystem.searchGroup("club", linus, "library").hits.empty());
+        CHECK(messagingSystem.searchMessages(grace, "hours").hits.empty());
+        CHECK(writeSnapshotFile(directory + "/state.snap", platform.snapshot()));
+        messagingSystem.sendMessage(grace, ada, "library closes early");
+    }
+    // Postings come back from the snapshot, and replayed messages are indexed again
+    Platform restarted(directory);
+    User *ada = restarted.userManagement.findUserByUsername("ada");
+    vector<string> hits = searchAll([&](uint64_t cursor)
+                                    { return restarted.messagingSystem.searchMessages(ada, "library", cursor, LIMIT); });
+    CHECK(hits.size() == 17);
+    CHECK(!hits.empty() && hits.front() == "library closes early");
+}
+
+static void testEventBusDeliversInOrder(const string &)
+{
+    const size_t PUBLISHERS = 4, PER_PUBLISHER = 500, MAX_BATCH = 3;
+    vector<MutationEvent> everything, groupOnly;
+    size_t largestBatch = 0;
+    {
+        EventBus bus(8); // Far smaller than what is published, so publishers wait for the subscribers
+        bus.subscribe("everything", ALL_MUTATIONS, [&](const vector<const MutationEvent *> &batch)
+                      {
+            largestBatch = max(largestBatch, batch.size());
+            for (const MutationEvent *event : batch)
+            {
+                everything.push_back(*event);
+            } }, MAX_BATCH);
+        bus.subscribe("groups", mutationBit(MutationType::GroupMessage), [&](const vector<const MutationEvent *> &batch)
+                      {
+            for (const MutationEvent *event : batch)
+            {
+                groupOnly.push_back(*event);
+            } });
+        vector<thread> publishers;
+        for (uint32_t p = 0; p < PUBLISHERS; p++)
+        {
+            publishers.emplace_back([&bus, p]()
+                                    {
+                for (uint32_t i = 0; i < PER_PUBLISHER; i++)
+                {
+                    bus.publish(i % 2 ? MutationType::GroupMessage : MutationType::DirectMessage, p, i, "event " + to_string(i));
+                } });
+        }
+        for (thread &publisher : publishers)
+        {
+            publisher.join();
+        }
+        bus.waitUntilDelivered();
+        CHECK(bus.published() == PUBLISHERS * PER_PUBLISHER);
+    }
+    CHECK(largestBatch <= MAX_BATCH);
+    CHECK(everything.size() == PUBLISHERS * PER_PUBLISHER);
+    CHECK(groupOnly.size() == PUBLISHERS * PER_PUBLISHER / 2);
+    // Delivered in bus order, and each publisher's events in the order it published them
+    vector<uint32_t> next(PUBLISHERS, 0);
+    for (size_t i = 0; i < everything.size(); i++)
+    {
+        const MutationEvent &event = everything[i];
+        CHECK(event.sequence == i);
+        CHECK(event.actor < PUBLISHERS && event.subject == next[event.actor]);
+        CHECK(event.text == "event " + to_string(event.subject));
+        if (event.actor < PUBLISHERS)
+        {
+            next[event.actor]++;
+        }
+    }
+    for (size_t i = 0; i < groupOnly.size(); i++)
+    {
+        CHECK(groupOnly[i].type == MutationType::GroupMessage);
+        CHECK(i == 0 || groupOnly[i].sequence > groupOnly[i - 1].sequence);
+    }
+}
+
+static void testEventBusDropsUnwantedTypes(const string &)
+{
+    size_t delivered = 0;
+    EventBus bus;
+    bus.subscribe("sign-ups", mutationBit(MutationType::SignUp), [&delivered](const vector<const MutationEvent *> &batch)
+                  { delivered += batch.size(); });
+    bus.publish(MutationType::CreatePost, 1, 0, "nobody asked for this");
+    bus.publish(MutationType::SignUp, 1, 0, "ada");
+    bus.waitUntilDelivered();
+    CHECK(bus.published() == 1);
+    CHECK(delivered == 1);
+}
+
+static void testManagersPublishMutations(const string &)
+{
+    vector<MutationEvent> seen;
+    EventBus bus;
+    bus.subscribe("recorder", ALL_MUTATIONS, [&seen](const vector<const MutationEvent *> &batch)
+                  {
+        for (const MutationEvent *event : batch)
+        {
+            seen.push_back(*event);
+        } });
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    userManagement.attachEventBus(&bus);
+    postManagement.attachEventBus(&bus);
+    friendSystem.attachEventBus(&bus);
+    messagingSystem.attachEventBus(&bus, userManagement);
+    User *ada = userManagement.registerUser("ada", "secret", "ada@college.edu", "", true);
+    User *grace = userManagement.registerUser("grace", "secret", "grace@college.edu", "", true);
+    postManagement.createPost(ada, "hello campus");
+    postManagement.addComment(grace, "hello campus", "welcome");
+    friendSystem.addFriend(ada, grace);
+    messagingSystem.sendMessage(ada, grace, "library at noon");
+    messagingSystem.postMessage(grace, ada, "see you in the library");
+    messagingSystem.deliverPending(ada);
+    string groupId = messagingSystem.createGroup("club")->groupId;
+    messagingSystem.addUserToGroup("club", grace);
+    messagingSystem.sendMessageToGroup(grace, "club", "library meetup");
+    messagingSystem.removeUserFromGroup(groupId, grace);
+    friendSystem.removeFriend(ada, grace);
+    bus.waitUntilDelivered();
+    vector<MutationType> expected = {MutationType::SignUp, MutationType::SignUp, MutationType::CreatePost, MutationType::AddComment,
+                                     MutationType::AddFriend, MutationType::DirectMessage, MutationType::DirectMessage,
+                                     MutationType::CreateGroup, MutationType::JoinGroup, MutationType::GroupMessage,
+                                     MutationType::LeaveGroup, MutationType::RemoveFriend};
+    CHECK(seen.size() == expected.size());
+    for (size_t i = 0; i < seen.size() && i < expected.size(); i++)
+    {
+        CHECK(seen[i].type == expected[i]);
+    }
+    if (seen.size() == expected.size())
+    {
+        CHECK(seen[1].actor == grace->getId() && seen[1].text == "grace");
+        CHECK(seen[3].actor == grace->getId() && seen[3].key == "hello campus" && seen[3].text == "welcome");
+        CHECK(seen[4].actor == ada->getId() && seen[4].subject == grace->getId());
+        CHECK(seen[5].actor == ada->getId() && seen[5].subject == grace->getId() && seen[5].position == 0);
+        CHECK(seen[6].actor == grace->getId() && seen[6].position == 1);
+        CHECK(seen[9].key == groupId && seen[9].text == "library meetup" && seen[9].position == 0);
+    }
+    // The search index is one of the subscribers: once it has caught up, every message is searchable
+    CHECK(messagingSystem.searchMessages(ada, "library").hits.size() == 2);
+    CHECK(messagingSystem.searchGroup("club", ada, "library").hits.empty());
+    messagingSystem.addUserToGroup("club", ada);
+    bus.waitUntilDelivered();
+    CHECK(messagingSystem.searchGroup("club", ada, "library").hits.size() == 1);
+}
+
+int main(int argc, char **argv)
+{
+    string filter;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0)
+        {
+            filter = arg.substr(9);
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--filter=NAME]" << endl;
+            return 1;
+        }
+    }
+    const vector<pair<string, function<void(const string &)>>> tests = {
+        {"wal_survives_restart", testWalSurvivesRestart},
+        {"wal_cuts_torn_tail", testWalCutsTornTail},
+        {"wal_rejects_oversized_length", testWalRejectsOversizedLength},
+        {"wal_failed_write_is_not_durable", testWalFailedWriteIsNotDurable},
+        {"compress_round_trips", testCompressRoundTrips},
+        {"decompress_rejects_corrupt_input", testDecompressRejectsCorruptInput},
+        {"snapshot_round_trip", testSnapshotRoundTrip},
+        {"damaged_snapshot_is_rejected", testDamagedSnapshotIsRejected},
+        {"segment_files_outlive_shutdown", testSegmentFilesOutliveShutdown},
+        {"posted_messages_are_delivered", testPostedMessagesAreDelivered},
+        {"posted_messages_survive_restart", testPostedMessagesSurviveRestart},
+        {"direct_unread_counters", testDirectUnreadCounters},
+        {"group_unread_counters", testGroupUnreadCounters},
+        {"shards_span_operations", testShardsSpanOperations},
+        {"history_pages_scroll_back", testHistoryPagesScrollBack},
+        {"seek_finds_first_message_at_time", testSeekFindsFirstMessageAtTime},
+        {"group_read_cursors", testGroupReadCursors},
+        {"member_set_conversions", testMemberSetConversions},
+        {"search_finds_matches_newest_first", testSearchFindsMatchesNewestFirst},
+        {"event_bus_delivers_in_order", testEventBusDeliversInOrder},
+        {"event_bus_drops_unwanted_types", testEventBusDropsUnwantedTypes},
+        {"managers_publish_mutations", testManagersPublishMutations},
+    };
+    string scratch = (filesystem::temp_directory_path() / "college_tests.XXXXXX").string();
+    if (!mkdtemp(&scratch[0]))
+    {
+        cerr << "Could not create a scratch directory" << endl;
+        return 1;
+    }
+    size_t failedTests = 0;
+    for (const auto &test : tests)
+    {
+        if (test.first.find(filter) == string::npos)
+        {
+            continue;
+        }
+        string directory = scratch + "/" + test.first; // Each test starts with nothing on disk
+        filesystem::create_directories(directory);
+        failedChecks = 0;
+        {
+            QuietConsole quiet; // The managers narrate every change
+            test.second(directory);
+        }
+        cout << (failedChecks == 0 ? "PASS " : "FAIL ") << test.first << endl;
+        failedTests += failedChecks > 0;
+    }
+    filesystem::remove_all(scratch);
+    cout << (failedTests == 0 ? "All tests passed" : to_string(failedTests) + " failed") << endl;
+    return failedTests == 0 ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+#ifndef TRACING_H
+#define TRACING_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+// One finished span. Fields are atomics because an export may read a slot while its thread overwrites it;
+// `version` is odd while the slot is being written (a seqlock), so the reader can skip torn slots.
+struct TraceSlot
+{
+    atomic<uint64_t> version{0};
+    atomic<const char *> name{nullptr};
+    atomic<const char *> category{nullptr};
+    atomic<const char *> argName{nullptr};
+    atomic<uint64_t> argValue{0};
+    atomic<uint64_t> startNs{0};
+    atomic<uint64_t> durationNs{0};
+};
+
+// Scoped spans recorded into a fixed ring per thread and exported in the Chrome trace event format,
+// which chrome://tracing and ui.perfetto.dev open directly. Sampling picks whole requests: one root span in
+// every `sampleEvery` is recorded along with everything nested inside it. Names must be string literals.
+class Tracer
+{
+private:
+    struct ThreadRing
+    {
+        static const size_t CAPACITY = 16384; // Spans kept per thread; the oldest are overwritten
+        TraceSlot slots[CAPACITY];
+        atomic<uint64_t> written{0};
+        uint32_t threadId;
+        uint64_t rootsSeen = 0; // Root spans started on this thread, for sampling
+        int depth = 0;          // Open spans on this thread
+        bool sampling = false;  // Whether the current root span is recorded
+
+        explicit ThreadRing(uint32_t threadId) : threadId(threadId) {}
+    };
+
+    // Hands the thread's ring over to the exited list when the thread ends, so its spans still export
+    struct RingOwner
+    {
+        ThreadRing *ring = nullptr;
+        ~RingOwner();
+    };
+
+    struct Registry
+    {
+        mutex registryMutex;
+        list<ThreadRing *> live;
+        list<unique_ptr<ThreadRing>> exited; // Rings of finished threads, newest last
+        uint32_t nextThreadId = 1;
+    };
+
+    static Registry &registry()
+    {
+        static Registry *instance = new Registry(); // Never destroyed: threads may exit after main returns
+        return *instance;
+    }
+
+    static atomic<uint64_t> &sampleEveryFlag()
+    {
+        static atomic<uint64_t> sampleEvery{0};
+        return sampleEvery;
+    }
+
+    static chrono::steady_clock::time_point origin()
+    {
+        static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        return start;
+    }
+
+    static void writeEvents(ofstream &out, ThreadRing &ring, bool &first)
+    {
+        uint64_t written = ring.written.load(memory_order_acquire);
+        uint64_t begin = written > ThreadRing::CAPACITY ? written - ThreadRing::CAPACITY : 0;
+        for (uint64_t i = begin; i < written; i++)
+        {
+            TraceSlot &slot = ring.slots[i % ThreadRing::CAPACITY];
+            uint64_t version = slot.version.load(memory_order_acquire);
+            const char *name = slot.name.load(memory_order_relaxed);
+            const char *category = slot.category.load(memory_order_relaxed);
+            const char *argName = slot.argName.load(memory_order_relaxed);
+            uint64_t argValue = slot.argValue.load(memory_order_relaxed);
+            uint64_t start = slot.startNs.load(memory_order_relaxed);
+            uint64_t duration = slot.durationNs.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if ((version & 1) || version != slot.version.load(memory_order_relaxed) || !name)
+            {
+                continue; // Being overwritten right now
+            }
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << ring.threadId << ",\"ts\":" << start / 1000 << "." << start % 1000 / 100 << start % 100 / 10 << start % 10
+                << ",\"dur\":" << duration / 1000 << "." << duration % 1000 / 100 << duration % 100 / 10 << duration % 10;
+            if (argName)
+            {
+                out << ",\"args\":{\"" << argName << "\":" << argValue << "}";
+            }
+            out << "}";
+            first = false;
+        }
+    }
+
+public:
+    static ThreadRing &local()
+    {
+        thread_local RingOwner owner;
+        if (!owner.ring)
+        {
+            Registry &shared = registry();
+            lock_guard<mutex> lock(shared.registryMutex);
+            owner.ring = new ThreadRing(shared.nextThreadId++);
+            shared.live.push_back(owner.ring);
+        }
+        return *owner.ring;
+    }
+
+    // Records one request in every `every` (1 = all of them, 0 = tracing off)
+    static void setSampling(uint64_t every)
+    {
+        origin();
+        sampleEveryFlag().store(every, memory_order_relaxed);
+    }
+
+    static bool enabled()
+    {
+        return sampleEveryFlag().load(memory_order_relaxed) != 0;
+    }
+
+    // Decides at each root span whether this request is sampled; nested spans follow their root
+    static bool beginSpan(ThreadRing &ring)
+    {
+        if (ring.depth++ == 0)
+        {
+            uint64_t every = sampleEveryFlag().load(memory_order_relaxed);
+            ring.sampling = every != 0 && ring.rootsSeen++ % every == 0;
+        }
+        return ring.sampling;
+    }
+
+    static void endSpan(ThreadRing &ring)
+    {
+        ring.depth--;
+    }
+
+    static uint64_t now()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin()).count();
+    }
+
+    static void record(ThreadRing &ring, const char *name, const char *category, const char *argName, uint64_t argValue,
+                       uint64_t startNs, uint64_t durationNs)
+    {
+        uint64_t position = ring.written.load(memory_order_relaxed);
+        TraceSlot &slot = ring.slots[position % ThreadRing::CAPACITY];
+        uint64_t version = slot.version.load(memory_order_relaxed);
+        slot.version.store(version + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        slot.name.store(name, memory_order_relaxed);
+        slot.category.store(category, memory_order_relaxed);
+        slot.argName.store(argName, memory_order_relaxed);
+        slot.argValue.store(argValue, memory_order_relaxed);
+        slot.startNs.store(startNs, memory_order_relaxed);
+        slot.durationNs.store(durationNs, memory_order_relaxed);
+        slot.version.store(version + 2, memory_order_release);
+        ring.written.store(position + 1, memory_order_release);
+    }
+
+    // Writes every span still held in the rings as a Chrome trace JSON file; false if it cannot be written
+    static bool writeChromeTrace(const string &path)
+    {
+        ofstream out(path, ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+        Registry &shared = registry();
+        lock_guard<mutex> lock(shared.registryMutex);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        for (ThreadRing *ring : shared.live)
+        {
+            writeEvents(out, *ring, first);
+        }
+        for (unique_ptr<ThreadRing> &ring : shared.exited)
+        {
+            writeEvents(out, *ring, first);
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+    friend class TraceSpan;
+};
+
+inline Tracer::RingOwner::~RingOwner()
+{
+    static const size_t MAX_EXITED = 64; // Short-lived threads would otherwise pile up rings without bound
+    if (!ring)
+    {
+        return;
+    }
+    Registry &shared = registry();
+    lock_guard<mutex> lock(shared.registryMutex);
+    shared.live.remove(ring);
+    if (ring->written.load(memory_order_relaxed) == 0)
+    {
+        delete ring;
+        return;
+    }
+    shared.exited.emplace_back(ring);
+    if (shared.exited.size() > MAX_EXITED)
+    {
+        shared.exited.pop_front();
+    }
+}
+
+// Times the enclosing scope as one span. Costs one relaxed load and a branch while tracing is off.
+class TraceSpan
+{
+private:
+    Tracer::ThreadRing *ring = nullptr; // Set only while this span is being recorded or sampled out
+    bool recording = false;
+    const char *name;
+    const char *category;
+    const char *argName = nullptr;
+    uint64_t argValue = 0;
+    uint64_t start = 0;
+
+public:
+    TraceSpan(const char *name, const char *category) : name(name), category(category)
+    {
+        if (Tracer::enabled())
+        {
+            ring = &Tracer::local();
+            recording = Tracer::beginSpan(*ring);
+            if (recording)
+            {
+                start = Tracer::now();
+            }
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    // Attaches one number to the span, e.g. how many items it fanned out to
+    void annotate(const char *label, uint64_t value)
+    {
+        argName = label;
+        argValue = value;
+    }
+
+    // Closes the span before the end of its scope
+    void end()
+    {
+        if (ring)
+        {
+            if (recording)
+            {
+                Tracer::record(*ring, name, category, argName, argValue, start, Tracer::now() - start);
+            }
+            Tracer::endSpan(*ring);
+            ring = nullptr;
+        }
+    }
+
+    ~TraceSpan()
+    {
+        end();
+    }
+};
+
+#endif // TRACING_H
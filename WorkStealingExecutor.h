@@ -0,0 +1,365 @@
+#ifndef WORK_STEALING_EXECUTOR_H
+#define WORK_STEALING_EXECUTOR_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// Interactive work answers a waiting user; batch work (snapshots and other upkeep) only runs when no
+// interactive work is queued, and never on every worker at once
+enum class TaskPriority
+{
+    Interactive,
+    Batch
+};
+
+struct ExecutorOptions
+{
+    size_t threads = 0;      // 0 means one per hardware thread
+    size_t batchWorkers = 0; // Most workers running batch work at once; 0 means all but one (at least one)
+    bool pinWorkers = false; // Pin worker i to CPU i modulo the CPU count
+};
+
+// Runs coroutines and plain jobs on a fixed set of workers. Each worker has its own deques: what a worker
+// schedules itself goes on the back and is taken from the back while still hot in cache, and idle workers steal
+// from the front of the others. Work from outside the pool, and coroutines that yield, go to a shared FIFO
+// queue per priority, so a long query that yields lets everything queued before it run before its next quantum.
+// The engine's background jobs all run on shared(), the process-wide instance.
+class WorkStealingExecutor
+{
+private:
+    struct alignas(64) WorkerQueue
+    {
+        mutex queueMutex;
+        deque<coroutine_handle<>> tasks[2]; // Indexed by TaskPriority
+    };
+
+    struct WorkerIdentity
+    {
+        WorkStealingExecutor *executor = nullptr;
+        size_t index = 0;
+        TaskPriority running = TaskPriority::Interactive; // Priority of the task being resumed
+    };
+
+    // Runs a plain job as a coroutine, so both kinds of work share the queues; frees itself when done
+    struct Job
+    {
+        struct promise_type
+        {
+            Job get_return_object()
+            {
+                return Job{coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception()
+            {
+                terminate(); // Jobs report errors through their future
+            }
+        };
+
+        coroutine_handle<promise_type> handle;
+    };
+
+    static Job runJob(function<void()> job)
+    {
+        job();
+        co_return;
+    }
+
+    vector<unique_ptr<WorkerQueue>> queues;
+    vector<thread> workers;
+    size_t batchLimit;
+    mutex sharedMutex;
+    deque<coroutine_handle<>> sharedQueues[2]; // Guarded by sharedMutex
+    condition_variable workReady;
+    atomic<size_t> queued[2] = {};       // Tasks waiting in any queue, per priority
+    atomic<size_t> runningBatch{0};      // Workers inside a batch task
+    atomic<size_t> sleeping{0};          // Workers blocked on workReady
+    bool stopping = false;               // Guarded by sharedMutex
+
+    static WorkerIdentity &identity()
+    {
+        static thread_local WorkerIdentity self;
+        return self;
+    }
+
+    static size_t slot(TaskPriority priority)
+    {
+        return static_cast<size_t>(priority);
+    }
+
+    bool runnable() const
+    {
+        return queued[0].load() > 0 || (queued[1].load() > 0 && runningBatch.load() < batchLimit);
+    }
+
+    void wakeOne()
+    {
+        if (sleeping.load() > 0)
+        {
+            {
+                lock_guard<mutex> lock(sharedMutex); // Orders the wake-up after a sleeper's last check of the counts
+            }
+            workReady.notify_one();
+        }
+    }
+
+    void push(coroutine_handle<> task, TaskPriority priority, bool local)
+    {
+        WorkerIdentity &self = identity();
+        if (local && self.executor == this)
+        {
+            WorkerQueue &own = *queues[self.index];
+            lock_guard<mutex> lock(own.queueMutex);
+            own.tasks[slot(priority)].push_back(task);
+        }
+        else
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            sharedQueues[slot(priority)].push_back(task);
+        }
+        queued[slot(priority)]++;
+        wakeOne();
+    }
+
+    coroutine_handle<> takeFrom(size_t index, size_t level)
+    {
+        coroutine_handle<> task;
+        {
+            WorkerQueue &own = *queues[index];
+            lock_guard<mutex> lock(own.queueMutex);
+            if (!own.tasks[level].empty())
+            {
+                task = own.tasks[level].back();
+                own.tasks[level].pop_back();
+            }
+        }
+        if (!task)
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            if (!sharedQueues[level].empty())
+            {
+                task = sharedQueues[level].front();
+                sharedQueues[level].pop_front();
+            }
+        }
+        for (size_t i = 1; !task && i < queues.size(); i++)
+        {
+            WorkerQueue &victim = *queues[(index + i) % queues.size()];
+            lock_guard<mutex> lock(victim.queueMutex);
+            if (!victim.tasks[level].empty())
+            {
+                task = victim.tasks[level].front();
+                victim.tasks[level].pop_front();
+            }
+        }
+        if (task)
+        {
+            queued[level]--;
+        }
+        return task;
+    }
+
+    void workerLoop(size_t index, int cpu)
+    {
+        if (cpu >= 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+        WorkerIdentity &self = identity();
+        self.executor = this;
+        self.index = index;
+        while (true)
+        {
+            coroutine_handle<> task = takeFrom(index, 0);
+            if (task)
+            {
+                self.running = TaskPriority::Interactive;
+                task.resume();
+                continue;
+            }
+            if (runningBatch.fetch_add(1) < batchLimit)
+            {
+                task = takeFrom(index, 1);
+                if (task)
+                {
+                    self.running = TaskPriority::Batch;
+                    task.resume();
+                }
+            }
+            runningBatch--;
+            if (task)
+            {
+                if (queued[1].load() > 0)
+                {
+                    wakeOne(); // A batch slot just freed up
+                }
+                continue;
+            }
+            unique_lock<mutex> lock(sharedMutex);
+            sleeping++;
+            workReady.wait(lock, [&]()
+                           { return stopping || runnable(); });
+            sleeping--;
+            if (stopping && queued[0].load() == 0 && queued[1].load() == 0)
+            {
+                return; // Stopping, and everything queued has run
+            }
+        }
+    }
+
+public:
+    explicit WorkStealingExecutor(const ExecutorOptions &options = ExecutorOptions())
+    {
+        size_t cores = max(1u, thread::hardware_concurrency());
+        size_t threads = options.threads ? options.threads : cores;
+        batchLimit = options.batchWorkers ? min(options.batchWorkers, threads) : max<size_t>(1, threads - 1);
+        for (size_t i = 0; i < threads; i++)
+        {
+            queues.push_back(make_unique<WorkerQueue>());
+        }
+        for (size_t i = 0; i < threads; i++)
+        {
+            workers.emplace_back(&WorkStealingExecutor::workerLoop, this, i, options.pinWorkers ? static_cast<int>(i % cores) : -1);
+        }
+    }
+
+    WorkStealingExecutor(const WorkStealingExecutor &) = delete;
+    WorkStealingExecutor &operator=(const WorkStealingExecutor &) = delete;
+
+    // Runs what is already queued (including coroutines that keep yielding, until they finish), then joins the workers
+    ~WorkStealingExecutor()
+    {
+        {
+            lock_guard<mutex> lock(sharedMutex);
+            stopping = true;
+        }
+        workReady.notify_all();
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Sets the options of shared(); false if it has already started
+    static bool configureShared(const ExecutorOptions &options)
+    {
+        if (sharedStarted())
+        {
+            return false;
+        }
+        sharedOptions() = options;
+        return true;
+    }
+
+    // The process-wide executor, started on first use. Destroyed at exit after running what is queued.
+    static WorkStealingExecutor &shared()
+    {
+        static unique_ptr<WorkStealingExecutor> instance = startShared();
+        return *instance;
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    // True on this executor's own worker threads
+    bool onWorker() const
+    {
+        return identity().executor == this;
+    }
+
+    // Queues a coroutine to be resumed: on this worker's deque when called from a worker, otherwise on the shared queue
+    void schedule(coroutine_handle<> task, TaskPriority priority = TaskPriority::Interactive)
+    {
+        push(task, priority, true);
+    }
+
+    // Requeues a coroutine that used up its quantum behind everything already waiting at its priority
+    void yield(coroutine_handle<> task)
+    {
+        WorkerIdentity &self = identity();
+        push(task, self.executor == this ? self.running : TaskPriority::Interactive, false);
+    }
+
+    // Queues `function`; the future yields its result or rethrows its exception.
+    // A worker must not wait on a future of this executor: every worker might end up waiting.
+    template <typename Function>
+    future<typename invoke_result<Function>::type> submit(Function function, TaskPriority priority = TaskPriority::Interactive)
+    {
+        typedef typename invoke_result<Function>::type Result;
+        auto task = make_shared<packaged_task<Result()>>(move(function));
+        future<Result> result = task->get_future();
+        schedule(runJob([task]()
+                        { (*task)(); })
+                     .handle,
+                 priority);
+        return result;
+    }
+
+    // Splits [0, count) into ranges of at least `minChunk` items, a few per worker, and queues
+    // function(first, last) for each. Wait on the returned futures.
+    template <typename Function>
+    vector<future<void>> submitRanges(size_t count, size_t minChunk, Function function, TaskPriority priority = TaskPriority::Interactive)
+    {
+        vector<future<void>> pending;
+        size_t chunk = max(max<size_t>(1, minChunk), (count + size() * 4 - 1) / (size() * 4));
+        for (size_t first = 0; first < count; first += chunk)
+        {
+            size_t last = min(count, first + chunk);
+            pending.push_back(submit([function, first, last]()
+                                     { function(first, last); },
+                                     priority));
+        }
+        return pending;
+    }
+
+private:
+    static ExecutorOptions &sharedOptions()
+    {
+        static ExecutorOptions options;
+        return options;
+    }
+
+    static atomic<bool> &sharedStarted()
+    {
+        static atomic<bool> started{false};
+        return started;
+    }
+
+    static unique_ptr<WorkStealingExecutor> startShared()
+    {
+        sharedStarted() = true;
+        return make_unique<WorkStealingExecutor>(sharedOptions());
+    }
+};
+
+#endif // WORK_STEALING_EXECUTOR_H
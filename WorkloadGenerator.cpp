@@ -0,0 +1,543 @@
+// Deterministic synthetic dataset generator for load and scale testing.
+// Produces users, a power-law friendship graph (preferential attachment), posts with
+// comment trees, direct messages between friends and groups with Zipf-like sizes.
+// The same seed and options always give the same dataset.
+//
+// Build: make workload_generator
+// Usage: ./workload_generator [--users=N] [--seed=S] [--friends=AVG] [--posts=AVG] [--comments=AVG]
+//                             [--messages=AVG] [--groups=N] [--max-group=N] [--format=wal|script] [--out=PATH]
+//   wal:    a write-ahead log the platform replays at start (./college_connect --wal=PATH --snapshot=unused.snap)
+//   script: console input like input.txt (sign-ups, friends, posts, direct messages only)
+#include "WriteAheadLog.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+struct WorkloadConfig
+{
+    uint64_t seed = 42;
+    size_t users = 10000;
+    double friendsPerUser = 20;  // Average degree; each new user links to half of it
+    double postsPerUser = 3;
+    double commentsPerPost = 2;
+    double replyChance = 0.5;    // A comment answers an earlier one rather than the post
+    size_t maxCommentDepth = 6;
+    double messagesPerUser = 20; // Direct messages
+    size_t groups = 0;           // 0 = one per 50 users
+    size_t maxGroupSize = 5000;
+    double groupSizeSkew = 1.1;  // Group of rank k has about maxGroupSize / k^skew members
+    double groupMessagesPerMember = 2;
+    string format = "wal";
+    string output;
+};
+
+// splitmix64: tiny, fast, and identical on every platform and standard library
+class Random
+{
+private:
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound)
+    uint64_t below(uint64_t bound)
+    {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * bound) >> 64);
+    }
+
+    // Uniform in [0, 1)
+    double unit()
+    {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+
+    bool chance(double probability)
+    {
+        return unit() < probability;
+    }
+
+    // Geometric count with the given mean: many small values, a long tail
+    size_t count(double mean)
+    {
+        if (mean <= 0)
+        {
+            return 0;
+        }
+        return static_cast<size_t>(floor(log(1 - unit()) / log(mean / (mean + 1))));
+    }
+};
+
+const char *WORDS[] = {"lecture", "exam", "library", "canteen", "project", "deadline", "hostel", "fest", "club", "lab",
+                       "assignment", "notes", "placement", "semester", "coffee", "tonight", "tomorrow", "weekend", "match", "quiz",
+                       "professor", "campus", "results", "hackathon", "internship", "seminar", "bus", "party", "study", "group"};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+string sentence(Random &random, size_t minWords, size_t maxWords)
+{
+    size_t words = minWords + random.below(maxWords - minWords + 1);
+    string text;
+    for (size_t i = 0; i < words; i++)
+    {
+        text += (i ? " " : "") + string(WORDS[random.below(WORD_COUNT)]);
+    }
+    return text;
+}
+
+string username(uint32_t id)
+{
+    return "user" + to_string(id);
+}
+
+// Where generated operations go
+class WorkloadSink
+{
+public:
+    virtual ~WorkloadSink() {}
+    virtual void signUp(uint32_t id, const string &bio, bool isPublic) = 0;
+    virtual void addFriend(uint32_t user, uint32_t friendUser) = 0;
+    virtual void createPost(uint32_t user, const string &content) = 0;
+    virtual void addComment(uint32_t user, const string &post, const string &comment) = 0;
+    virtual void addReply(uint32_t user, const string &post, const vector<uint32_t> &path, const string &reply) = 0;
+    virtual void createGroup(const string &groupId, const string &groupName) = 0;
+    virtual void joinGroup(const string &groupId, uint32_t user) = 0;
+    virtual void directMessage(uint32_t from, uint32_t to, uint64_t seq, int64_t timestamp, const string &message) = 0;
+    virtual void groupMessage(const string &groupId, uint32_t from, uint64_t seq, int64_t timestamp, const string &message) = 0;
+    virtual bool finish() = 0;
+};
+
+// Writes the records the platform itself logs, so a start-up replay imports the dataset
+class WalSink : public WorkloadSink
+{
+private:
+    WriteAheadLog wal;
+
+public:
+    bool open(const string &path)
+    {
+        return wal.open(path, DurabilityMode::None, WalReplayResult()); // Empty recovery: start a fresh file
+    }
+
+    void signUp(uint32_t id, const string &bio, bool isPublic) override
+    {
+        wal.append(WalRecordType::SignUp, WalPayload().putU32(id).putString(username(id)).putString("pass" + to_string(id)).putString(username(id) + "@campus.edu").putString(bio).putU8(isPublic));
+    }
+    void addFriend(uint32_t user, uint32_t friendUser) override
+    {
+        wal.append(WalRecordType::AddFriend, WalPayload().putU32(user).putU32(friendUser));
+    }
+    void createPost(uint32_t user, const string &content) override
+    {
+        wal.append(WalRecordType::CreatePost, WalPayload().putU32(user).putString(content));
+    }
+    void addComment(uint32_t user, const string &post, const string &comment) override
+    {
+        wal.append(WalRecordType::AddComment, WalPayload().putU32(user).putString(post).putString(comment));
+    }
+    void addReply(uint32_t user, const string &post, const vector<uint32_t> &path, const string &reply) override
+    {
+        WalPayload payload;
+        payload.putU32(user).putString(post).putU32(static_cast<uint32_t>(path.size()));
+        for (uint32_t step : path)
+        {
+            payload.putU32(step);
+        }
+        wal.append(WalRecordType::AddReply, payload.putString(reply));
+    }
+    void createGroup(const string &groupId, const string &groupName) override
+    {
+        wal.append(WalRecordType::CreateGroup, WalPayload().putString(groupId).putString(groupName));
+    }
+    void joinGroup(const string &groupId, uint32_t user) override
+    {
+        wal.append(WalRecordType::JoinGroup, WalPayload().putString(groupId).putU32(user));
+    }
+    void directMessage(uint32_t from, uint32_t to, uint64_t seq, int64_t timestamp, const string &message) override
+    {
+        wal.append(WalRecordType::DirectMessage, WalPayload().putU32(from).putU32(to).putU64(seq).putI64(timestamp).putString(message));
+    }
+    void groupMessage(const string &groupId, uint32_t from, uint64_t seq, int64_t timestamp, const string &message) override
+    {
+        wal.append(WalRecordType::GroupMessage, WalPayload().putString(groupId).putU32(from).putU64(seq).putI64(timestamp).putString(message));
+    }
+    bool finish() override
+    {
+        bool ok = wal.flush() && walAppendFailures == 0;
+        wal.close();
+        return ok;
+    }
+};
+
+// Console input for the interactive menus: sign-ups, then one session per user.
+// Comments and groups need multi-step menu dialogs and are left out; use the WAL format for them.
+class ScriptSink : public WorkloadSink
+{
+private:
+    ofstream out;
+    vector<string> sessions; // Menu input each user replays once logged in
+    size_t skipped = 0;
+
+public:
+    bool open(const string &path)
+    {
+        out.open(path);
+        return static_cast<bool>(out);
+    }
+
+    void signUp(uint32_t id, const string &bio, bool isPublic) override
+    {
+        out << "1\n" << username(id) << "\npass" << id << "\n" << username(id) << "@campus.edu\n" << bio << "\n" << (isPublic ? "Y" : "N") << "\n";
+        sessions.emplace_back();
+    }
+    void addFriend(uint32_t user, uint32_t friendUser) override
+    {
+        sessions[user] += "8\n" + username(friendUser) + "\n";
+    }
+    void createPost(uint32_t user, const string &content) override
+    {
+        sessions[user] += "3\n" + content + "\n";
+    }
+    void addComment(uint32_t, const string &, const string &) override
+    {
+        skipped++;
+    }
+    void addReply(uint32_t, const string &, const vector<uint32_t> &, const string &) override
+    {
+        skipped++;
+    }
+    void createGroup(const string &, const string &) override
+    {
+        skipped++;
+    }
+    void joinGroup(const string &, uint32_t) override
+    {
+        skipped++;
+    }
+    void directMessage(uint32_t from, uint32_t to, uint64_t, int64_t, const string &message) override
+    {
+        sessions[from] += "9\n2\n" + username(to) + "\n" + message + "\n0\n";
+    }
+    void groupMessage(const string &, uint32_t, uint64_t, int64_t, const string &) override
+    {
+        skipped++;
+    }
+    bool finish() override
+    {
+        for (uint32_t id = 0; id < sessions.size(); id++)
+        {
+            if (!sessions[id].empty())
+            {
+                out << "2\n" << username(id) << "\npass" << id << "\n" << sessions[id] << "12\n";
+            }
+        }
+        out << "3\n";
+        if (skipped > 0)
+        {
+            cerr << "script format: left out " << skipped << " comment and group operations" << endl;
+        }
+        return static_cast<bool>(out);
+    }
+};
+
+// One comment in a generated thread: where it sits and how many replies it has
+struct ThreadNode
+{
+    vector<uint32_t> path; // Top-level comment index, then reply indexes
+    uint32_t replies = 0;
+};
+
+class WorkloadGenerator
+{
+private:
+    const WorkloadConfig &config;
+    Random random;
+    WorkloadSink &sink;
+    vector<uint32_t> endpoints; // Both ends of every friendship: sampling it picks users by degree
+    uint64_t nextSequence = 1;
+    int64_t clock = 1700000000000; // Fixed epoch so timestamps are reproducible too
+    size_t operations = 0;
+
+    // A user picked in proportion to their friend count: the popular get most of the activity
+    uint32_t activeUser()
+    {
+        return endpoints.empty() ? static_cast<uint32_t>(random.below(config.users)) : endpoints[random.below(endpoints.size())];
+    }
+
+    void stamp(uint64_t &seq, int64_t &timestamp)
+    {
+        seq = nextSequence++;
+        clock += 1 + random.below(2000);
+        timestamp = clock;
+    }
+
+    void generateUsers()
+    {
+        size_t links = max<size_t>(1, static_cast<size_t>(config.friendsPerUser / 2));
+        endpoints.reserve(config.users * links * 2);
+        vector<uint32_t> chosen;
+        for (uint32_t id = 0; id < config.users; id++)
+        {
+            sink.signUp(id, sentence(random, 2, 6), random.chance(0.7));
+            operations++;
+            // Preferential attachment: link to `links` existing users, picked by degree
+            chosen.clear();
+            size_t wanted = min<size_t>(links, id);
+            while (chosen.size() < wanted)
+            {
+                uint32_t target = endpoints.empty() || random.chance(0.1) ? static_cast<uint32_t>(random.below(id)) : endpoints[random.below(endpoints.size())];
+                if (find(chosen.begin(), chosen.end(), target) == chosen.end())
+                {
+                    chosen.push_back(target);
+                }
+            }
+            for (uint32_t target : chosen)
+            {
+                sink.addFriend(id, target);
+                endpoints.push_back(id);
+                endpoints.push_back(target);
+                operations++;
+            }
+        }
+    }
+
+    void generatePosts()
+    {
+        size_t posts = static_cast<size_t>(config.users * config.postsPerUser);
+        vector<ThreadNode> thread;
+        for (size_t postId = 0; postId < posts; postId++)
+        {
+            uint32_t author = activeUser();
+            // Post text doubles as the post's key, so it carries a unique id
+            string post = "Post " + to_string(postId) + " by " + username(author) + ": " + sentence(random, 3, 12);
+            sink.createPost(author, post);
+            operations++;
+            thread.clear();
+            uint32_t topLevel = 0;
+            size_t comments = random.count(config.commentsPerPost);
+            for (size_t c = 0; c < comments; c++)
+            {
+                uint32_t commenter = activeUser();
+                string text = sentence(random, 2, 10);
+                if (!thread.empty() && random.chance(config.replyChance))
+                {
+                    ThreadNode &parent = thread[random.below(thread.size())];
+                    if (parent.path.size() < config.maxCommentDepth)
+                    {
+                        sink.addReply(commenter, post, parent.path, text);
+                        ThreadNode reply;
+                        reply.path = parent.path;
+                        reply.path.push_back(parent.replies++);
+                        thread.push_back(move(reply));
+                        operations++;
+                        continue;
+                    }
+                }
+                sink.addComment(commenter, post, text);
+                ThreadNode top;
+                top.path.push_back(topLevel++);
+                thread.push_back(move(top));
+                operations++;
+            }
+        }
+    }
+
+    // Creates the groups and returns their members; sizes fall off with rank like a Zipf law
+    vector<vector<uint32_t>> generateGroups()
+    {
+        size_t groupCount = config.groups ? config.groups : max<size_t>(1, config.users / 50);
+        vector<vector<uint32_t>> members(groupCount);
+        for (size_t rank = 0; rank < groupCount; rank++)
+        {
+            string groupId = "G" + to_string(rank + 1); // The platform numbers groups in creation order
+            sink.createGroup(groupId, "Group " + to_string(rank + 1) + " " + WORDS[random.below(WORD_COUNT)]);
+            operations++;
+            double scaled = config.maxGroupSize / pow(rank + 1.0, config.groupSizeSkew);
+            size_t size = min<size_t>(config.users, max<size_t>(3, static_cast<size_t>(scaled)));
+            unordered_set<uint32_t> seen;
+            while (members[rank].size() < size)
+            {
+                uint32_t user = members[rank].empty() ? activeUser() : static_cast<uint32_t>(random.below(config.users));
+                if (seen.insert(user).second)
+                {
+                    sink.joinGroup(groupId, user);
+                    members[rank].push_back(user);
+                    operations++;
+                }
+            }
+        }
+        return members;
+    }
+
+    // Direct and group messages interleaved in one timeline
+    void generateMessages(const vector<vector<uint32_t>> &groupMembers)
+    {
+        size_t direct = endpoints.empty() ? 0 : static_cast<size_t>(config.users * config.messagesPerUser);
+        size_t memberships = 0;
+        for (const vector<uint32_t> &members : groupMembers)
+        {
+            memberships += members.size();
+        }
+        size_t group = static_cast<size_t>(memberships * config.groupMessagesPerMember);
+        // Pick a group for each message by membership, so big groups are the busy ones
+        vector<uint32_t> groupByMembership;
+        groupByMembership.reserve(memberships);
+        for (uint32_t g = 0; g < groupMembers.size(); g++)
+        {
+            groupByMembership.insert(groupByMembership.end(), groupMembers[g].size(), g);
+        }
+        while (direct + group > 0)
+        {
+            uint64_t seq;
+            int64_t timestamp;
+            stamp(seq, timestamp);
+            if (random.below(direct + group) < direct)
+            {
+                // A random friendship, so pairs with a popular user come up most
+                size_t edge = random.below(endpoints.size() / 2);
+                bool flip = random.chance(0.5);
+                sink.directMessage(endpoints[2 * edge + flip], endpoints[2 * edge + !flip], seq, timestamp, sentence(random, 1, 15));
+                direct--;
+            }
+            else
+            {
+                uint32_t g = groupByMembership[random.below(groupByMembership.size())];
+                const vector<uint32_t> &members = groupMembers[g];
+                sink.groupMessage("G" + to_string(g + 1), members[random.below(members.size())], seq, timestamp, sentence(random, 1, 15));
+                group--;
+            }
+            operations++;
+        }
+    }
+
+public:
+    WorkloadGenerator(const WorkloadConfig &config, WorkloadSink &sink) : config(config), random(config.seed), sink(sink) {}
+
+    size_t run()
+    {
+        generateUsers();
+        generatePosts();
+        vector<vector<uint32_t>> groupMembers = generateGroups();
+        generateMessages(groupMembers);
+        return operations;
+    }
+};
+
+bool parseOption(const string &arg, const string &name, string &value)
+{
+    if (arg.rfind("--" + name + "=", 0) != 0)
+    {
+        return false;
+    }
+    value = arg.substr(name.size() + 3);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    WorkloadConfig config;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i], value;
+        if (parseOption(arg, "users", value))
+        {
+            config.users = strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (parseOption(arg, "seed", value))
+        {
+            config.seed = strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (parseOption(arg, "friends", value))
+        {
+            config.friendsPerUser = atof(value.c_str());
+        }
+        else if (parseOption(arg, "posts", value))
+        {
+            config.postsPerUser = atof(value.c_str());
+        }
+        else if (parseOption(arg, "comments", value))
+        {
+            config.commentsPerPost = atof(value.c_str());
+        }
+        else if (parseOption(arg, "messages", value))
+        {
+            config.messagesPerUser = atof(value.c_str());
+        }
+        else if (parseOption(arg, "groups", value))
+        {
+            config.groups = strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (parseOption(arg, "max-group", value))
+        {
+            config.maxGroupSize = strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (parseOption(arg, "format", value) && (value == "wal" || value == "script"))
+        {
+            config.format = value;
+        }
+        else if (parseOption(arg, "out", value))
+        {
+            config.output = value;
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--users=N] [--seed=S] [--friends=AVG] [--posts=AVG] [--comments=AVG]"
+                 << " [--messages=AVG] [--groups=N] [--max-group=N] [--format=wal|script] [--out=PATH]" << endl;
+            return 1;
+        }
+    }
+    if (config.users == 0)
+    {
+        cerr << "--users must be at least 1" << endl;
+        return 1;
+    }
+    if (config.output.empty())
+    {
+        config.output = config.format == "wal" ? "workload.wal" : "workload.txt";
+    }
+    unique_ptr<WorkloadSink> sink;
+    bool opened;
+    if (config.format == "wal")
+    {
+        WalSink *wal = new WalSink();
+        sink.reset(wal);
+        opened = wal->open(config.output);
+    }
+    else
+    {
+        ScriptSink *script = new ScriptSink();
+        sink.reset(script);
+        opened = script->open(config.output);
+    }
+    if (!opened)
+    {
+        cerr << "Could not open " << config.output << endl;
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    WorkloadGenerator generator(config, *sink);
+    size_t operations = generator.run();
+    if (!sink->finish())
+    {
+        cerr << "Writing " << config.output << " failed" << endl;
+        return 1;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cerr << "Wrote " << operations << " operations for " << config.users << " users to " << config.output
+         << " in " << elapsed.count() << " s" << endl;
+    return 0;
+}
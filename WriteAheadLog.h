@@ -0,0 +1,539 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Tracing.h"
+
+using namespace std;
+
+// How hard append() tries to make a record survive a crash
+enum class DurabilityMode
+{
+    None,    // Written by the background flusher, never fsynced: survives a process crash, not a power loss
+    Batched, // Group commit: the flusher fsyncs a whole batch every commit interval; append() does not wait
+    Sync     // append() waits until its record is fsynced; concurrent appenders share one fsync
+};
+
+// Every state mutation the platform can replay
+enum class WalRecordType : uint8_t
+{
+    SignUp = 1,
+    UpdateProfile,
+    CreatePost,
+    AddComment,
+    AddReply,
+    AddFriend,
+    RemoveFriend,
+    DirectMessage,
+    CreateGroup,
+    JoinGroup,
+    LeaveGroup,
+    RenameGroup,
+    GroupMessage
+};
+
+// Builds a record payload: little-endian integers and length-prefixed strings
+class WalPayload
+{
+private:
+    string bytes;
+
+    template <typename T>
+    WalPayload &putRaw(T value)
+    {
+        bytes.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        return *this;
+    }
+
+public:
+    WalPayload &putU8(uint8_t value) { return putRaw(value); }
+    WalPayload &putU32(uint32_t value) { return putRaw(value); }
+    WalPayload &putU64(uint64_t value) { return putRaw(value); }
+    WalPayload &putI64(int64_t value) { return putRaw(value); }
+
+    WalPayload &putString(const string &value)
+    {
+        putU32(static_cast<uint32_t>(value.size()));
+        bytes += value;
+        return *this;
+    }
+
+    const string &data() const
+    {
+        return bytes;
+    }
+};
+
+// Reads a payload back; any read past the end clears good()
+class WalPayloadReader
+{
+private:
+    const string &bytes;
+    size_t offset = 0;
+    bool ok = true;
+
+    template <typename T>
+    T getRaw()
+    {
+        T value = T();
+        if (!ok || bytes.size() - offset < sizeof(T))
+        {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, bytes.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+public:
+    explicit WalPayloadReader(const string &bytes) : bytes(bytes) {}
+
+    uint8_t getU8() { return getRaw<uint8_t>(); }
+    uint32_t getU32() { return getRaw<uint32_t>(); }
+    uint64_t getU64() { return getRaw<uint64_t>(); }
+    int64_t getI64() { return getRaw<int64_t>(); }
+
+    string getString()
+    {
+        uint32_t length = getU32();
+        if (!ok || bytes.size() - offset < length)
+        {
+            ok = false;
+            return string();
+        }
+        string value = bytes.substr(offset, length);
+        offset += length;
+        return value;
+    }
+
+    bool good() const
+    {
+        return ok;
+    }
+};
+
+// Makes a rename or a new file in the directory holding `path` durable
+inline bool syncDirectoryOf(const string &path)
+{
+    size_t slash = path.rfind('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+// Appends on this thread that were refused or could not be made durable. A caller compares it before and
+// after a change to learn whether that change reached the log.
+inline thread_local uint64_t walAppendFailures = 0;
+
+// Where a replay stopped; pass it to WriteAheadLog::open to continue the same file
+struct WalReplayResult
+{
+    uint64_t lastLsn = 0;   // Highest log sequence number seen
+    uint64_t validBytes = 0; // Length of the intact prefix; anything after it is a torn write
+    size_t records = 0;     // Records handed to the callback
+};
+
+// Append-only, checksummed binary log with group commit.
+// Frame: u32 body length, u32 CRC-32 of the body, then the body: u64 LSN, u8 type, payload.
+// Appenders only copy into an in-memory batch; one background thread writes and fsyncs batches.
+// A batch that fails to write or fsync is cut off the file again and retried, so a torn frame never has
+// records behind it and nothing counts as durable until it is.
+// When a snapshot is taken the log rolls over: what it holds moves to <path>.old, which the snapshot makes
+// redundant, and appending continues in an empty <path>. Replay reads <path>.old first if it is still there.
+class WriteAheadLog
+{
+public:
+    static const uint32_t MAX_RECORD_BYTES = 64 << 20; // Larger bodies are refused on append and read as corrupt on replay
+
+private:
+    int fd = -1;
+    string logPath;
+    DurabilityMode mode = DurabilityMode::Batched;
+    chrono::milliseconds commitInterval{5};
+    size_t maxBatchBytes = 1 << 20; // Flush early once a batch gets this big
+
+    mutex walMutex;
+    condition_variable flusherWake;
+    condition_variable durableChanged;
+    string pending;        // Framed records not yet written
+    uint64_t nextLsn = 1;
+    uint64_t appendedLsn = 0; // Last LSN placed in `pending`
+    uint64_t durableLsn = 0;  // Last LSN written (and fsynced unless mode is None)
+    uint64_t durableBytes = 0; // File length up to the end of durableLsn's frame
+    uint64_t writeFailures = 0; // Batches that failed to write or fsync so far
+    size_t syncWaiters = 0;
+    bool stopping = false;
+    bool failed = false; // The last batch failed; the next one retries it
+    bool broken = false; // A failed batch could not be cut off the file, so nothing more is written
+    thread flusher;
+
+    // Wakes the flusher and waits until `lsn` is durable (true) or the next write attempt fails (false)
+    bool waitDurable(unique_lock<mutex> &lock, uint64_t lsn)
+    {
+        uint64_t failuresBefore = writeFailures;
+        syncWaiters++;
+        flusherWake.notify_one();
+        durableChanged.wait(lock, [&]()
+                            { return durableLsn >= lsn || writeFailures != failuresBefore || broken; });
+        syncWaiters--;
+        return durableLsn >= lsn;
+    }
+
+    void flusherLoop()
+    {
+        unique_lock<mutex> lock(walMutex);
+        while (true)
+        {
+            flusherWake.wait_for(lock, commitInterval, [&]()
+                                 { return stopping || (syncWaiters > 0 && !pending.empty()) || pending.size() >= maxBatchBytes; });
+            if (pending.empty())
+            {
+                if (stopping)
+                {
+                    return;
+                }
+                continue;
+            }
+            string batch;
+            batch.swap(pending);
+            uint64_t batchLsn = appendedLsn;
+            lock.unlock();
+            TraceSpan span("wal.commit", "wal");
+            span.annotate("bytes", batch.size());
+            bool written = writeAll(batch) && (mode == DurabilityMode::None || fdatasync(fd) == 0);
+            span.end();
+            lock.lock();
+            if (written)
+            {
+                durableBytes += batch.size();
+                durableLsn = batchLsn;
+                failed = false;
+                durableChanged.notify_all();
+                continue;
+            }
+            // Cut the partial batch off so the retry starts at a frame boundary, ahead of what was queued since
+            failed = true;
+            writeFailures++;
+            if (ftruncate(fd, durableBytes) != 0 || lseek(fd, durableBytes, SEEK_SET) < 0)
+            {
+                broken = true;
+            }
+            pending.insert(0, batch);
+            durableChanged.notify_all();
+            if (broken || stopping)
+            {
+                pending.clear();
+                return;
+            }
+            flusherWake.wait_for(lock, commitInterval, [&]()
+                                 { return stopping; });
+        }
+    }
+
+    // Frames the record into `body` (empty, perhaps with capacity reserved before locking) and queues it
+    uint64_t appendLocked(unique_lock<mutex> &lock, WalRecordType type, const WalPayload &payload, string &body)
+    {
+        if (broken || payload.data().size() > MAX_RECORD_BYTES - sizeof(uint64_t) - 1)
+        {
+            walAppendFailures++;
+            return 0;
+        }
+        uint64_t lsn = nextLsn++;
+        body.append(reinterpret_cast<const char *>(&lsn), sizeof(lsn));
+        body += static_cast<char>(type);
+        body += payload.data();
+        uint32_t length = static_cast<uint32_t>(body.size());
+        uint32_t crc = crc32(body.data(), body.size());
+        pending.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        pending.append(reinterpret_cast<const char *>(&crc), sizeof(crc));
+        pending += body;
+        appendedLsn = lsn;
+        if (mode == DurabilityMode::Sync)
+        {
+            if (!waitDurable(lock, lsn))
+            {
+                walAppendFailures++;
+                return 0;
+            }
+        }
+        else if (failed)
+        {
+            walAppendFailures++;
+            return 0;
+        }
+        else if (pending.size() >= maxBatchBytes)
+        {
+            flusherWake.notify_one();
+        }
+        return lsn;
+    }
+
+    bool writeAll(const string &batch)
+    {
+        size_t offset = 0;
+        while (offset < batch.size())
+        {
+            ssize_t written = ::write(fd, batch.data() + offset, batch.size() - offset);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            offset += written;
+        }
+        return true;
+    }
+
+public:
+    static uint32_t crc32(const char *data, size_t length)
+    {
+        static const vector<uint32_t> table = []()
+        {
+            vector<uint32_t> entries(256);
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+                }
+                entries[i] = value;
+            }
+            return entries;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    WriteAheadLog() = default;
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    ~WriteAheadLog()
+    {
+        close();
+    }
+
+    // Opens `path` for appending after a replay: the torn tail past `recovered.validBytes`
+    // is cut off and numbering continues after `recovered.lastLsn`.
+    bool open(const string &path, DurabilityMode durability, const WalReplayResult &recovered,
+              chrono::milliseconds interval = chrono::milliseconds(5))
+    {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (ftruncate(fd, recovered.validBytes) != 0 || lseek(fd, 0, SEEK_END) < 0)
+        {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        logPath = path;
+        mode = durability;
+        commitInterval = interval;
+        nextLsn = recovered.lastLsn + 1;
+        appendedLsn = durableLsn = recovered.lastLsn;
+        durableBytes = recovered.validBytes;
+        writeFailures = 0;
+        stopping = false;
+        failed = false;
+        broken = false;
+        flusher = thread(&WriteAheadLog::flusherLoop, this);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return fd >= 0;
+    }
+
+    // False while writes are failing: the last batch could not be written or fsynced and awaits a retry,
+    // or it could not be cut off the file and the log has stopped
+    bool healthy()
+    {
+        lock_guard<mutex> lock(walMutex);
+        return !failed && !broken;
+    }
+
+    // Queues one record and returns its LSN. In Sync mode, returns once the record is durable.
+    // Returns 0 and counts a failure in walAppendFailures if the record is too large or the log has stopped,
+    // in Sync mode if the write failed, and otherwise if writes are failing: the record is queued and retried
+    // with its batch, but may not survive.
+    uint64_t append(WalRecordType type, const WalPayload &payload)
+    {
+        TraceSpan span("wal.append", "wal");
+        string body;
+        body.reserve(sizeof(uint64_t) + 1 + payload.data().size());
+        unique_lock<mutex> lock(walMutex);
+        return appendLocked(lock, type, payload, body);
+    }
+
+    // The same, with the payload built by `build` while the log's lock is held: whatever it stamps into the
+    // record, such as a sequence number, rises with the LSN. `build` runs exactly once, even if the record is refused.
+    uint64_t append(WalRecordType type, const function<void(WalPayload &)> &build)
+    {
+        TraceSpan span("wal.append", "wal");
+        WalPayload payload;
+        string body;
+        unique_lock<mutex> lock(walMutex);
+        build(payload);
+        return appendLocked(lock, type, payload, body);
+    }
+
+    // Blocks until everything appended so far is durable; false if a write failed first
+    bool flush()
+    {
+        unique_lock<mutex> lock(walMutex);
+        if (fd < 0)
+        {
+            return true;
+        }
+        return waitDurable(lock, appendedLsn);
+    }
+
+    // Where the records before the last roll-over wait until a snapshot covers them
+    static string rolledOverPath(const string &path)
+    {
+        return path + ".old";
+    }
+
+    // Moves every record appended so far into rolledOverPath() and continues in an empty file, so that a
+    // snapshot taken at lastLsn() covers all of the rolled-over file. Call with no append in progress, right
+    // before capturing the snapshot. False, leaving the log as it was, if an earlier rolled-over file is still
+    // waiting for a snapshot or the records could not be made durable first.
+    bool rollOver()
+    {
+        unique_lock<mutex> lock(walMutex);
+        string previous = rolledOverPath(logPath);
+        if (fd < 0 || access(previous.c_str(), F_OK) == 0 || !waitDurable(lock, appendedLsn) || !pending.empty())
+        {
+            return false;
+        }
+        // Nothing is pending and everything is durable, so the flusher is idle until the lock is released
+        if (rename(logPath.c_str(), previous.c_str()) != 0)
+        {
+            return false;
+        }
+        int next = ::open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (next < 0)
+        {
+            rename(previous.c_str(), logPath.c_str());
+            return false;
+        }
+        ::close(fd);
+        fd = next;
+        durableBytes = 0;
+        syncDirectoryOf(logPath);
+        return true;
+    }
+
+    // Deletes the rolled-over file; call once a snapshot taken after the roll-over is durable
+    void dropRolledOver()
+    {
+        if (!logPath.empty())
+        {
+            unlink(rolledOverPath(logPath).c_str());
+        }
+    }
+
+    uint64_t lastLsn()
+    {
+        lock_guard<mutex> lock(walMutex);
+        return appendedLsn;
+    }
+
+    void close()
+    {
+        if (fd < 0)
+        {
+            return;
+        }
+        {
+            lock_guard<mutex> lock(walMutex);
+            stopping = true;
+        }
+        flusherWake.notify_one();
+        flusher.join();
+        ::close(fd);
+        fd = -1;
+    }
+
+    // Hands every intact record with LSN > afterLsn to `apply`, in log order.
+    // Stops at the first truncated or corrupt frame, which is where a crash interrupted a write. A length
+    // longer than the rest of the file or than MAX_RECORD_BYTES counts as corrupt and is never allocated.
+    static WalReplayResult replay(const string &path, uint64_t afterLsn,
+                                  const function<void(uint64_t, WalRecordType, WalPayloadReader &)> &apply)
+    {
+        WalReplayResult result;
+        ifstream file(path, ios::binary);
+        if (!file)
+        {
+            return result;
+        }
+        file.seekg(0, ios::end);
+        uint64_t fileBytes = static_cast<uint64_t>(file.tellg());
+        file.seekg(0);
+        string body;
+        while (true)
+        {
+            uint32_t header[2];
+            if (!file.read(reinterpret_cast<char *>(header), sizeof(header)))
+            {
+                break;
+            }
+            uint32_t length = header[0];
+            if (length < sizeof(uint64_t) + 1 || length > MAX_RECORD_BYTES || length > fileBytes - result.validBytes - sizeof(header))
+            {
+                break;
+            }
+            body.resize(length);
+            if (!file.read(&body[0], length) || crc32(body.data(), length) != header[1])
+            {
+                break;
+            }
+            uint64_t lsn;
+            memcpy(&lsn, body.data(), sizeof(lsn));
+            WalRecordType type = static_cast<WalRecordType>(body[sizeof(lsn)]);
+            result.validBytes += sizeof(header) + length;
+            result.lastLsn = lsn;
+            if (lsn > afterLsn)
+            {
+                string payload = body.substr(sizeof(lsn) + 1);
+                WalPayloadReader reader(payload);
+                apply(lsn, type, reader);
+                result.records++;
+            }
+        }
+        return result;
+    }
+};
+
+#endif // WRITE_AHEAD_LOG_H
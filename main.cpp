@@ -0,0 +1,522 @@
+#include "SocialMediaPlatform.h"
+#include <iostream>
+using namespace std;
+
+void showMenu()
+{
+    displayHeader();
+    cout << "1. Sign Up" << endl;
+    cout << "2. Log In" << endl;
+    cout << "3. Exit" << endl;
+    cout << "4. Metrics" << endl;
+    cout << "5. Memory Usage" << endl;
+    cout << endl;
+}
+void showUserMenu()
+{
+    displayHeader();
+    cout << "1. View Profile" << endl;
+    cout << "2. Edit Profile" << endl;
+    cout << "3. Create Post" << endl;
+    cout << "4. View My Posts" << endl;
+    cout << "5. View Friends' Posts" << endl;
+    cout << "6. View Public Posts" << endl;
+    cout << "7. View all users" << endl;
+    cout << "8. Add Friend" << endl;
+    cout << "9. Messages" << endl;
+    cout << "10. Group Messages" << endl;
+    cout << "11. Friends" << endl;
+    cout << "12. Log Out" << endl;
+    cout << endl;
+}
+void showFriendMenu()
+{
+    cout << "1. View Friends" << endl;
+    cout << "2. Suggest Friends using BFS" << endl;
+    cout << "3. Suggest Friends using DFS" << endl;
+    cout << "4. View Pending Friend Requests" << endl;
+    cout << "5. Remove a Friend" << endl;
+    cout << "6. Count Mutual Friends" << endl;
+    cout << endl;
+}
+// Log records between background snapshots
+const uint64_t SNAPSHOT_INTERVAL = 10000;
+
+int main(int argc, char **argv)
+{
+    string walPath = "college_connect.wal";
+    string snapshotPath = "college_connect.snap";
+    DurabilityMode durability = DurabilityMode::Batched;
+    bool metrics = false;
+    string tracePath;
+    uint64_t traceSampleEvery = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--wal=", 0) == 0)
+        {
+            walPath = arg.substr(6);
+        }
+        else if (arg.rfind("--snapshot=", 0) == 0)
+        {
+            snapshotPath = arg.substr(11);
+        }
+        else if (arg == "--durability=none")
+        {
+            durability = DurabilityMode::None;
+        }
+        else if (arg == "--durability=sync")
+        {
+            durability = DurabilityMode::Sync;
+        }
+        else if (arg == "--durability=batched")
+        {
+            durability = DurabilityMode::Batched;
+        }
+        else if (arg == "--metrics")
+        {
+            metrics = true;
+        }
+        else if (arg.rfind("--trace=", 0) == 0)
+        {
+            tracePath = arg.substr(8);
+        }
+        else if (arg.rfind("--trace-sample=", 0) == 0)
+        {
+            traceSampleEvery = max<uint64_t>(1, strtoull(arg.c_str() + 15, nullptr, 10));
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--wal=path] [--snapshot=path] [--durability=none|batched|sync] [--metrics]"
+                 << " [--trace=path] [--trace-sample=N]" << endl;
+            return 1;
+        }
+    }
+    UserManagement userManagement;
+    PostManagement postManagement;
+    FriendSystem friendSystem;
+    MessagingSystem messagingSystem;
+    RetentionPolicy retention;
+    retention.maxHotMessages = 1000;
+    messagingSystem.setRetentionPolicy(retention, userManagement);
+    // Rebuild the previous session from the snapshot and the log written after it, then keep appending to the log
+    uint64_t snapshotLsn = 0;
+    if (loadSnapshot(snapshotPath, userManagement, postManagement, friendSystem, messagingSystem, snapshotLsn))
+    {
+        cout << "Loaded snapshot " << snapshotPath << endl;
+    }
+    else if (ifstream(snapshotPath))
+    {
+        cerr << "Snapshot " << snapshotPath << " is damaged; rebuilding from the log" << endl;
+    }
+    WalReplayResult recovered = replayWriteAheadLog(walPath, snapshotLsn, userManagement, postManagement, friendSystem, messagingSystem);
+    recovered.lastLsn = max(recovered.lastLsn, snapshotLsn); // Never reuse numbers the snapshot already covers
+    WriteAheadLog wal;
+    BackgroundSnapshotWriter snapshotWriter;
+    if (wal.open(walPath, durability, recovered))
+    {
+        userManagement.attachWriteAheadLog(&wal);
+        postManagement.attachWriteAheadLog(&wal);
+        friendSystem.attachWriteAheadLog(&wal);
+        messagingSystem.attachWriteAheadLog(&wal);
+        if (recovered.records > 0)
+        {
+            cout << "Restored " << recovered.records << " changes from " << walPath << endl;
+        }
+    }
+    else
+    {
+        cerr << "Could not open " << walPath << "; changes will not be saved." << endl;
+    }
+    // Derived data such as the search postings is maintained by subscribers, off the request path
+    EventBus events;
+    userManagement.attachEventBus(&events);
+    postManagement.attachEventBus(&events);
+    friendSystem.attachEventBus(&events);
+    messagingSystem.attachEventBus(&events, userManagement);
+    Metrics::enable(metrics); // Only after recovery, so replayed changes are not counted
+    if (!tracePath.empty())
+    {
+        Tracer::setSampling(traceSampleEvery);
+    }
+    // Warns once per change that did not reach the log
+    uint64_t reportedFailures = 0;
+    auto warnIfUnsaved = [&]()
+    {
+        if (walAppendFailures != reportedFailures)
+        {
+            cerr << "Warning: changes could not be saved to " << walPath << " and may be lost on restart." << endl;
+            reportedFailures = walAppendFailures;
+        }
+    };
+    User *currentUser = nullptr;
+    while (true)
+    {
+        warnIfUnsaved();
+        showMenu();
+        int choice;
+        cout << "Enter your choice: ";
+        cin >> choice;
+        if (choice == 1)
+        {
+            currentUser = userManagement.signUp();
+            if (currentUser)
+            {
+                cout << "Sign Up successful! You can now log in." << endl;
+            }
+        }
+        else if (choice == 2)
+        {
+            string username, password;
+            cout << "Enter username: ";
+            cin >> username;
+            cout << "Enter password: ";
+            cin >> password;
+            currentUser = userManagement.logIn(username, password);
+            if (currentUser)
+            {
+                cout << "Log In successful!" << endl;
+                UnreadSummary unread = messagingSystem.getUnreadSummary(currentUser);
+                if (unread.messages > 0)
+                {
+                    cout << "You have " << unread.messages << " unread messages from " << unread.chats << " chats." << endl;
+                }
+                while (true)
+                {
+                    warnIfUnsaved();
+                    showUserMenu();
+                    int userChoice;
+                    cout << "Enter your choice: ";
+                    cin >> userChoice;
+                    if (userChoice == 1)
+                    {
+                        userManagement.displayProfile(currentUser);
+                        sleep(1);
+                    }
+                    else if (userChoice == 2)
+                    {
+                        userManagement.editProfile(currentUser);
+                        sleep(1);
+                    }
+                    else if (userChoice == 3)
+                    {
+                        string content;
+                        cout << "Enter your post: ";
+                        cin.ignore();
+                        getline(cin, content);
+                        postManagement.createPost(currentUser, content);
+                        sleep(1);
+                    }
+                    else if (userChoice == 4)
+                    {
+                        postManagement.viewUserPosts(currentUser);
+                        sleep(1);
+                    }
+                    else if (userChoice == 5)
+                    {
+                        postManagement.viewFriendsPosts(currentUser, friendSystem.getFriends(currentUser));
+                        sleep(1);
+                    }
+                    else if (userChoice == 6)
+                    {
+                        postManagement.viewPublicPosts(currentUser);
+                        sleep(1);
+                    }
+                    else if (userChoice == 7)
+                    {
+                        userManagement.displayAllUsers();
+                        sleep(1);
+                    }
+                    else if (userChoice == 8)
+                    {
+                        userManagement.displayAllUsers();
+                        sleep(1);
+                        string friendUsername;
+                        cout << "Enter friend's username: ";
+                        cin >> friendUsername;
+                        User *friendUser = userManagement.findUserByUsername(friendUsername);
+                        if (friendUser)
+                        {
+                            friendSystem.addFriend(currentUser, friendUser);
+                            cout << "Friend added!" << endl;
+                            sleep(1);
+                        }
+                        else
+                        {
+                            cout << "User not found!" << endl;
+                            sleep(1);
+                        }
+                    }
+                    else if (userChoice == 9)
+                    {
+                        int messageChoice;
+                        string recipientUsername;
+                        string message;
+                        User *recipient = nullptr;
+                        bool uHaveFriend = false;
+                        do
+                        {
+                            cout << "Messaging Menu:\n";
+                            cout << "1. View New Messages\n";
+                            cout << "2. Send Message\n";
+                            cout << "3. View Chat History\n";
+                            cout << "4. Search Messages\n";
+                            cout << "0. Go Back\n";
+                            cout << "Enter your choice: ";
+                            cin >> messageChoice;
+                            switch (messageChoice)
+                            {
+                            case 1:
+                                messagingSystem.viewNewMessages(currentUser);
+                                sleep(1);
+                                break;
+
+                            case 2:
+                                uHaveFriend = friendSystem.viewFriends(currentUser);
+                                if (uHaveFriend)
+                                {
+                                    cout << "Enter recipient's username: ";
+                                    cin >> recipientUsername;
+                                    recipient = userManagement.findUserByUsername(recipientUsername);
+                                    if (recipient)
+                                    {
+                                        cout << "Enter your message: ";
+                                        cin.ignore();
+                                        getline(cin, message);
+                                        messagingSystem.sendMessage(currentUser, recipient, message);
+                                        cout << "Message sent!" << endl;
+                                    }
+                                    else
+                                    {
+                                        cout << "User not found!" << endl;
+                                    }
+                                }
+                                else
+                                {
+                                    cout << "No friends found!" << endl;
+                                    cout << "You can only message your Friends!" << endl;
+                                }
+                                sleep(1);
+                                break;
+                            case 3:
+                                uHaveFriend = friendSystem.viewFriends(currentUser);
+                                if (uHaveFriend)
+                                {
+                                    string friendUsername;
+                                    cout << "Enter Friend's username: ";
+                                    cin >> friendUsername;
+                                    User *friendUser = userManagement.findUserByUsername(friendUsername);
+                                    if (friendUser)
+                                    {
+                                        messagingSystem.viewChatHistory(currentUser, friendUser);
+                                    }
+                                    else
+                                    {
+                                        cout << "Friend not found!" << endl;
+                                    }
+                                }
+                                else
+                                {
+                                    cout << "You have no friends to view chat history with!" << endl;
+                                }
+                                sleep(1);
+                                break;
+                            case 4:
+                                messagingSystem.viewSearchResults(currentUser);
+                                sleep(1);
+                                break;
+                            case 0:
+                                cout << "Exiting messaging menu." << endl;
+                                break;
+                            default:
+                                cout << "Invalid choice! Please try again." << endl;
+                                break;
+                            }
+                        } while (messageChoice != 0);
+                    }
+                    else if (userChoice == 10)
+                    {
+                        int groupChoice;
+                        do
+                        {
+                            cout << "Group Messaging Menu:\n";
+                            cout << "1. Create Group\n";
+                            cout << "2. Send Message to Group\n";
+                            cout << "3. View Group Chat History\n";
+                            cout << "4. Join Group\n";
+                            cout << "5. Leave Group\n";
+                            cout << "6. Rename Group\n";
+                            cout << "7. View Friends in Group\n";
+                            cout << "8. My Groups\n";
+                            cout << "0. Go Back\n";
+                            cout << "Enter your choice: ";
+                            cin >> groupChoice;
+                            switch (groupChoice)
+                            {
+                            case 1:
+                                messagingSystem.createGroup(currentUser, userManagement, friendSystem, messagingSystem);
+                                break;
+                            case 2:
+                                sendMessageToGroup(currentUser, messagingSystem);
+                                break;
+                            case 3:
+                            {
+                                string groupName;
+                                cout << "Enter the Group Name to view chat history: ";
+                                cin.ignore();
+                                getline(cin, groupName);
+                                messagingSystem.viewGroupChatHistory(groupName, currentUser);
+                                break;
+                            }
+                            case 4:
+                                joinGroup(currentUser, messagingSystem);
+                                break;
+                            case 5:
+                                leaveGroup(currentUser, messagingSystem);
+                                break;
+                            case 6:
+                                renameGroup(currentUser, messagingSystem);
+                                break;
+                            case 7:
+                                viewFriendsInGroup(currentUser, messagingSystem, friendSystem);
+                                break;
+                            case 8:
+                                viewMyGroups(currentUser, messagingSystem);
+                                break;
+                            case 0:
+                                cout << "Exiting group messaging menu." << endl;
+                                break;
+                            default:
+                                cout << "Invalid choice! Please try again." << endl;
+                                break;
+                            }
+                        } while (groupChoice != 0);
+                    }
+                    else if (userChoice == 11)
+                    {
+                        showFriendMenu();
+                        int choice;
+                        cin >> choice;
+                        if (choice == 1)
+                        {
+                            if (friendSystem.viewFriends(currentUser))
+                            {
+                                cout << "Friends displayed successfully!" << endl;
+                                sleep(1);
+                            }
+                        }
+                        else if (choice == 2)
+                        {
+                            friendSystem.suggestFriendsBFS(currentUser);
+                            sleep(1);
+                        }
+                        else if (choice == 3)
+                        {
+                            friendSystem.suggestFriendsDFS(currentUser);
+                            sleep(1);
+                        }
+                        else if (choice == 4)
+                        {
+                            friendSystem.displayPendingRequests(currentUser);
+                            sleep(1);
+                        }
+                        else if (choice == 5)
+                        {
+                            string removeFriendUsername;
+                            cout << "Enter the username of the friend you want to remove: ";
+                            cin >> removeFriendUsername;
+                            User *removeFriend = userManagement.findUserByUsername(removeFriendUsername);
+                            if (removeFriend)
+                            {
+                                friendSystem.removeFriend(currentUser, removeFriend);
+                                cout << "Friend removed!" << endl;
+                                sleep(2);
+                            }
+                            else
+                            {
+                                cout << "User not found!" << endl;
+                                sleep(1);
+                            }
+                        }
+                        else if (choice == 6)
+                        {
+                            string mutualFriendUsername;
+                            cout << "Enter the username to find mutual friends with: ";
+                            cin >> mutualFriendUsername;
+                            User *mutualFriendUser = userManagement.findUserByUsername(mutualFriendUsername);
+                            if (mutualFriendUser)
+                            {
+                                friendSystem.mutualFriendsCount(currentUser, mutualFriendUser);
+                                sleep(1);
+                            }
+                            else
+                            {
+                                cout << "User not found!" << endl;
+                                sleep(1);
+                            }
+                        }
+                    }
+                    else if (userChoice == 12)
+                    {
+                        currentUser = nullptr;
+                        // Once the log has grown enough, save a snapshot in the background so the next start replays less
+                        // The log rolls over with it, and the rolled-over file is deleted once the snapshot is on disk
+                        uint64_t lsn = wal.isOpen() ? wal.lastLsn() : snapshotLsn;
+                        if (lsn - snapshotLsn >= SNAPSHOT_INTERVAL && !snapshotWriter.writing())
+                        {
+                            string image = captureSnapshot(userManagement, postManagement, friendSystem, messagingSystem, lsn);
+                            wal.rollOver();
+                            snapshotWriter.start(snapshotPath, move(image), [&wal]()
+                                                 { wal.dropRolledOver(); });
+                            snapshotLsn = lsn;
+                        }
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                cout << "Invalid username or password!" << endl;
+            }
+        }
+        else if (choice == 3)
+        {
+            snapshotWriter.wait();
+            if (wal.isOpen() && wal.lastLsn() != snapshotLsn)
+            {
+                string image = captureSnapshot(userManagement, postManagement, friendSystem, messagingSystem, wal.lastLsn());
+                wal.rollOver();
+                if (writeSnapshotFile(snapshotPath, image))
+                {
+                    wal.dropRolledOver();
+                }
+                else
+                {
+                    cerr << "Could not write snapshot " << snapshotPath << endl;
+                }
+            }
+            if (!tracePath.empty() && !Tracer::writeChromeTrace(tracePath))
+            {
+                cerr << "Could not write trace " << tracePath << endl;
+            }
+            break;
+        }
+        else if (choice == 4)
+        {
+            if (Metrics::enabled())
+            {
+                Metrics::report(cout);
+                events.report(cout);
+            }
+            else
+            {
+                cout << "Metrics are off; start with --metrics to record them." << endl;
+            }
+        }
+        else if (choice == 5)
+        {
+            reportMemoryUsage(cout, userManagement, postManagement, friendSystem, messagingSystem);
+        }
+    }
+    return 0;
+}
\ No newline at end of file